@@ -0,0 +1,84 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <CppHistogram.h>
+using namespace std;
+
+TEST(CppHistogram, RecordAndPercentile)
+{
+    CppHistogram histogram(3600ULL * 1000 * 1000, 3);
+    EXPECT_EQ(0U, histogram.GetTotalCount());
+    EXPECT_EQ(0U, histogram.GetValueAtPercentile(50));
+
+    // 1-10000各记录一次
+    for (uint64_t i = 1; i <= 10000; ++i)
+    {
+        histogram.Record(i);
+    }
+
+    EXPECT_EQ(10000U, histogram.GetTotalCount());
+    EXPECT_EQ(1U, histogram.GetMin());
+    EXPECT_EQ(10000U, histogram.GetMax());
+    EXPECT_DOUBLE_EQ(5000.5, histogram.GetMean());
+
+    // 3位有效数字，相对误差不超过0.1%
+    EXPECT_NEAR(5000, histogram.GetValueAtPercentile(50), 5);
+    EXPECT_NEAR(9000, histogram.GetValueAtPercentile(90), 9);
+    EXPECT_NEAR(9900, histogram.GetValueAtPercentile(99), 10);
+    EXPECT_NEAR(9990, histogram.GetValueAtPercentile(99.9), 10);
+    EXPECT_EQ(10000U, histogram.GetValueAtPercentile(100));
+
+    // 2048以内的值精确记录
+    EXPECT_EQ(1000U, histogram.GetValueAtPercentile(10));
+    EXPECT_EQ(1U, histogram.GetValueAtPercentile(0));
+}
+
+TEST(CppHistogram, LargeValue)
+{
+    CppHistogram histogram(60ULL * 1000 * 1000, 3);
+    histogram.Record(0);
+    histogram.Record(1000000, 99);
+
+    // 超过最大值按最大值记录
+    histogram.Record(100ULL * 1000 * 1000);
+
+    EXPECT_EQ(101U, histogram.GetTotalCount());
+    EXPECT_EQ(0U, histogram.GetMin());
+    EXPECT_EQ(60ULL * 1000 * 1000, histogram.GetMax());
+    EXPECT_EQ(0U, histogram.GetValueAtPercentile(0));
+    EXPECT_NEAR(1000000, histogram.GetValueAtPercentile(50), 1000);
+    EXPECT_NEAR(1000000, histogram.GetValueAtPercentile(99), 1000);
+    EXPECT_NEAR(60ULL * 1000 * 1000, histogram.GetValueAtPercentile(99.99), 60000);
+}
+
+TEST(CppHistogram, MergeAndReset)
+{
+    CppHistogram histogram1;
+    CppHistogram histogram2;
+    for (uint64_t i = 1; i <= 100; ++i)
+    {
+        histogram1.Record(i);
+        histogram2.Record(i + 100);
+    }
+
+    EXPECT_TRUE(histogram1.Merge(histogram2));
+    EXPECT_EQ(200U, histogram1.GetTotalCount());
+    EXPECT_EQ(1U, histogram1.GetMin());
+    EXPECT_EQ(200U, histogram1.GetMax());
+    EXPECT_EQ(100U, histogram1.GetValueAtPercentile(50));
+    EXPECT_EQ(198U, histogram1.GetValueAtPercentile(99));
+
+    // 精度不同不能合并
+    CppHistogram histogram3(3600ULL * 1000 * 1000, 2);
+    EXPECT_FALSE(histogram1.Merge(histogram3));
+
+    histogram1.Reset();
+    EXPECT_EQ(0U, histogram1.GetTotalCount());
+    EXPECT_EQ(0U, histogram1.GetMax());
+    EXPECT_EQ(0U, histogram1.GetValueAtPercentile(99));
+
+    histogram1.Record(7);
+    EXPECT_EQ(7U, histogram1.GetMin());
+    EXPECT_EQ(7U, histogram1.GetValueAtPercentile(50));
+}
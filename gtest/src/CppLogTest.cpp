@@ -1,9 +1,21 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include <CppLog.h>
+#include <CppFile.h>
+#include <CppArray.h>
 #include "global.h"
 
 using namespace std;
@@ -50,3 +62,720 @@ TEST(CppLog, MacroTest)
 //         DEBUG_LOG("a");
 //     }
 // }
+
+TEST(CppLog, AsyncLogTest)
+{
+    const string FILE_PATH = "/tmp/CppLogAsyncTest.txt";
+    const uint32_t THREAD_COUNT = 4;
+    const uint32_t LOG_COUNT_PER_THREAD = 10000;
+    unlink(FILE_PATH.c_str());
+
+    CppLog asyncLog(FILE_PATH, CppLog::DEBUG);
+    ASSERT_EQ(0, asyncLog.StartAsync(64 * 1024, 4096, 10));
+    EXPECT_TRUE(asyncLog.IsAsync());
+
+    vector<thread> threads;
+    for (uint32_t i = 0; i < THREAD_COUNT; ++i)
+    {
+        threads.push_back(thread([&asyncLog, i, LOG_COUNT_PER_THREAD]()
+        {
+            for (uint32_t j = 0; j < LOG_COUNT_PER_THREAD; ++j)
+            {
+                DEBUG_ILOG(&asyncLog, "thread[%u],index[%u].", i, j);
+            }
+        }));
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    // 等待全部写入
+    asyncLog.Flush();
+    string content = CppFile::ReadFromFile(FILE_PATH);
+    EXPECT_EQ(THREAD_COUNT * LOG_COUNT_PER_THREAD, count(content.begin(), content.end(), '\n'));
+
+    // ERROR级别立即写入
+    ERROR_ILOG(&asyncLog, "error.");
+    asyncLog.StopAsync();
+    EXPECT_FALSE(asyncLog.IsAsync());
+    content = CppFile::ReadFromFile(FILE_PATH);
+    EXPECT_EQ(THREAD_COUNT * LOG_COUNT_PER_THREAD + 1, count(content.begin(), content.end(), '\n'));
+
+    unlink(FILE_PATH.c_str());
+}
+
+TEST(CppLog, AsyncRingLogTest)
+{
+    const string FILE_PATH = "/tmp/CppLogAsyncRingTest.txt";
+    const uint32_t THREAD_COUNT = 4;
+    const uint32_t LOG_COUNT_PER_THREAD = 10000;
+    unlink(FILE_PATH.c_str());
+
+    CppLog asyncLog(FILE_PATH, CppLog::DEBUG);
+    ASSERT_EQ(0, asyncLog.StartAsync(16 * 1024, 4096, 10, CppLog::ASYNC_THREAD_RING));
+
+    vector<thread> threads;
+    for (uint32_t i = 0; i < THREAD_COUNT; ++i)
+    {
+        threads.push_back(thread([&asyncLog, i, LOG_COUNT_PER_THREAD]()
+        {
+            for (uint32_t j = 0; j < LOG_COUNT_PER_THREAD; ++j)
+            {
+                DEBUG_ILOG(&asyncLog, "thread[%u],index[%u].", i, j);
+            }
+        }));
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    asyncLog.Flush();
+    string content = CppFile::ReadFromFile(FILE_PATH);
+    EXPECT_EQ(THREAD_COUNT * LOG_COUNT_PER_THREAD, count(content.begin(), content.end(), '\n'));
+
+    // 同一线程的日志保持顺序
+    EXPECT_LT(content.find("thread[0],index[0]."), content.find("thread[0],index[9999]."));
+
+    // 停止或者析构时关闭当前线程的缓冲区，之后重新开启时重新创建
+    const string OTHER_FILE_PATH = "/tmp/CppLogAsyncRingTest2.txt";
+    unlink(OTHER_FILE_PATH.c_str());
+    DEBUG_ILOG(&asyncLog, "main.");
+    asyncLog.StopAsync();
+    ASSERT_EQ(0, asyncLog.StartAsync(0, 4096, 10, CppLog::ASYNC_THREAD_RING));
+    DEBUG_ILOG(&asyncLog, "restart.");
+    {
+        CppLog otherLog(OTHER_FILE_PATH, CppLog::DEBUG);
+        ASSERT_EQ(0, otherLog.StartAsync(0, 4096, 10, CppLog::ASYNC_THREAD_RING));
+        DEBUG_ILOG(&otherLog, "other.");
+    }
+
+    DEBUG_ILOG(&asyncLog, "after other.");
+    asyncLog.StopAsync();
+    DEBUG_ILOG(&asyncLog, "sync.");
+    content = CppFile::ReadFromFile(FILE_PATH);
+    EXPECT_EQ(THREAD_COUNT * LOG_COUNT_PER_THREAD + 4, count(content.begin(), content.end(), '\n'));
+    EXPECT_LT(content.find("|main."), content.find("|restart."));
+    EXPECT_LT(content.find("|restart."), content.find("|after other."));
+    EXPECT_LT(content.find("|after other."), content.find("|sync."));
+    EXPECT_NE(string::npos, CppFile::ReadFromFile(OTHER_FILE_PATH).find("|other."));
+
+    unlink(OTHER_FILE_PATH.c_str());
+    unlink(FILE_PATH.c_str());
+}
+
+TEST(CppLog, LogFormatTest)
+{
+    const string FILE_PATH = "/tmp/CppLogFormatTest.txt";
+    unlink(FILE_PATH.c_str());
+
+    CppLog fileLog(FILE_PATH, CppLog::DEBUG);
+    TRACE_ILOG(&fileLog, "trace.");
+    INFOR_ILOG(&fileLog, "value[%d],str[%s].", 10, "abc");
+
+    // 超过线程缓冲区大小的日志
+    string longStr(100 * 1024, 'a');
+    WARNN_ILOG(&fileLog, "%s", longStr.c_str());
+
+    vector<string> lines;
+    CppString::SplitStr(CppFile::ReadFromFile(FILE_PATH), "\n", lines);
+    ASSERT_EQ(2U, lines.size());
+
+    EXPECT_EQ('[', lines[0][0]);
+    EXPECT_NE(string::npos, lines[0].find("][INFOR]CppLogTest.cpp:"));
+    EXPECT_NE(string::npos, lines[1].find("][WARNN]CppLogTest.cpp:"));
+    EXPECT_EQ(longStr, lines[1].substr(lines[1].find('|') + 1));
+
+    unlink(FILE_PATH.c_str());
+}
+
+TEST(CppLog, BinaryLogTest)
+{
+    const string TEXT_FILE = "/tmp/CppLogBinaryTest.txt";
+    const string BIN_FILE = "/tmp/CppLogBinaryTest.bin";
+    unlink(TEXT_FILE.c_str());
+    unlink(BIN_FILE.c_str());
+
+    CppLog textLog(TEXT_FILE, CppLog::DEBUG);
+    CppLog binLog(BIN_FILE, CppLog::DEBUG);
+    binLog.SetBinary(true);
+
+    // 按转换说明编码：%p记录地址，%.*s不超过精度读取，raw不以'\0'结尾
+    char path[] = "abc";
+    const char raw[4] = { 'w', 'x', 'y', 'z' };
+    for (CppLog *pLog : { &textLog, &binLog })
+    {
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            string str = CppString::ToString(i);
+            INFOR_ILOG(pLog, "i[%d],u[%05u],x[%#llx],f[%.3f],s[%-4s],c[%c],w[%*d].", i, i + 1U, 255ULL, i / 3.0, str.c_str(), 'a' + i, 4, i);
+        }
+
+        const char *nullStr = NULL;
+        ERROR_ILOG(pLog, "null[%s][%p],percent[100%%].", nullStr, nullStr);
+        INFOR_ILOG(pLog, "p[%p][%s],raw[%.*s][%-6.2s][%.3s].", path, path, 4, raw, raw, path);
+        pLog->LogMsg("raw message", CppLog::ERROR);
+
+        // 异步模式下的二进制日志
+        pLog->StartAsync();
+        DEBUG_ILOG(pLog, "async[%d].", 1);
+        pLog->StopAsync();
+    }
+
+    ostringstream decoded;
+    EXPECT_EQ(0, CppLog::DecodeBinaryLog(BIN_FILE, decoded));
+
+    // 去掉时间后与文本模式相同
+    vector<string> textLines;
+    vector<string> binLines;
+    CppString::SplitStr(CppFile::ReadFromFile(TEXT_FILE), "\n", textLines);
+    CppString::SplitStr(decoded.str(), "\n", binLines);
+    ASSERT_EQ(7U, textLines.size());
+    ASSERT_EQ(textLines.size(), binLines.size());
+    for (size_t i = 0; i < textLines.size(); ++i)
+    {
+        if (textLines[i] == "raw message")
+        {
+            EXPECT_EQ(textLines[i], binLines[i]);
+            continue;
+        }
+
+        EXPECT_EQ(textLines[i].substr(textLines[i].find("]")), binLines[i].substr(binLines[i].find("]")));
+    }
+
+    unlink(TEXT_FILE.c_str());
+    unlink(BIN_FILE.c_str());
+}
+
+// 两个二进制模式实例共用的调用点
+static CppLogSite gSharedBinarySite("CppLogTest.cpp:1", "shared[%d].", "CppLogTest.cpp");
+
+TEST(CppLog, SharedBinarySiteTest)
+{
+    const string BIN_FILE1 = "/tmp/CppLogSharedBinaryTest1.bin";
+    const string BIN_FILE2 = "/tmp/CppLogSharedBinaryTest2.bin";
+    unlink(BIN_FILE1.c_str());
+    unlink(BIN_FILE2.c_str());
+
+    {
+        CppLog binLog1(BIN_FILE1, CppLog::DEBUG);
+        CppLog binLog2(BIN_FILE2, CppLog::DEBUG);
+        binLog1.SetBinary(true);
+        binLog2.SetBinary(true);
+        binLog1.LogSite(CppLog::INFOR, gSharedBinarySite, -1);
+        binLog2.LogSite(CppLog::INFOR, gSharedBinarySite, -2);
+
+        // 两个实例的注册状态在不同的槽中，交替记录时不再进入加锁的注册流程
+        vector<uint64_t> instanceIds;
+        for (auto &instanceId : gSharedBinarySite.mInstanceIds)
+        {
+            instanceIds.push_back(instanceId.load());
+        }
+
+        EXPECT_EQ(2, CppLogSite::LEVEL_CACHE_SLOTS - count(instanceIds.begin(), instanceIds.end(), 0U));
+        for (int32_t i = 0; i < 100; ++i)
+        {
+            binLog1.LogSite(CppLog::INFOR, gSharedBinarySite, i);
+            binLog2.LogSite(CppLog::INFOR, gSharedBinarySite, i);
+        }
+
+        for (uint32_t i = 0; i < CppLogSite::LEVEL_CACHE_SLOTS; ++i)
+        {
+            EXPECT_EQ(instanceIds[i], gSharedBinarySite.mInstanceIds[i].load());
+        }
+    }
+
+    // 每个文件都注册了调用点，可以完整解码
+    for (const string &binFile : { BIN_FILE1, BIN_FILE2 })
+    {
+        ostringstream decoded;
+        EXPECT_EQ(0, CppLog::DecodeBinaryLog(binFile, decoded));
+        vector<string> lines;
+        CppString::SplitStr(decoded.str(), "\n", lines);
+        ASSERT_EQ(101U, lines.size());
+        EXPECT_NE(string::npos, lines[100].find("|shared[99]."));
+        unlink(binFile.c_str());
+    }
+}
+
+TEST(CppLog, RotateSizeTest)
+{
+    const string FILE_PATH = "/tmp/CppLogRotateTest.txt";
+    const char *ROTATE_FILES[] = { "/tmp/CppLogRotateTest.txt", "/tmp/CppLogRotateTest1.txt", "/tmp/CppLogRotateTest2.txt",
+                                   "/tmp/CppLogRotateTest3.txt", "/tmp/CppLogRotateTest1.txt.gz", "/tmp/CppLogRotateTest2.txt.gz" };
+    for (auto file : ROTATE_FILES)
+    {
+        unlink(file);
+    }
+
+    {
+        CppLog cppLog(FILE_PATH, CppLog::DEBUG, 1000, 3);
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            DEBUG_ILOG(&cppLog, "index[%u].", i);
+        }
+
+        cppLog.Flush();
+        EXPECT_EQ(0, access("/tmp/CppLogRotateTest1.txt", F_OK));
+        EXPECT_EQ(0, access("/tmp/CppLogRotateTest2.txt", F_OK));
+        EXPECT_NE(0, access("/tmp/CppLogRotateTest3.txt", F_OK));
+        EXPECT_GE(1000U, CppFile::ReadFromFile(FILE_PATH).size());
+        EXPECT_NE(string::npos, CppFile::ReadFromFile(FILE_PATH).find("index[99]."));
+
+        // 压缩旧日志
+        cppLog.SetRotate(CppLog::ROTATE_NONE, true);
+        cppLog.StartAsync(64 * 1024, 1024, 10);
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            DEBUG_ILOG(&cppLog, "index[%u].", i);
+        }
+
+        cppLog.StopAsync();
+        cppLog.Flush();
+        EXPECT_EQ(0, access("/tmp/CppLogRotateTest1.txt.gz", F_OK));
+        EXPECT_NE(0, access("/tmp/CppLogRotateTest1.txt", F_OK));
+    }
+
+    for (auto file : ROTATE_FILES)
+    {
+        unlink(file);
+    }
+}
+
+TEST(CppLog, RotatePeriodTest)
+{
+    const string FILE_PATH = "/tmp/CppLogPeriodTest.txt";
+    const string OLDEST_FILE = "/tmp/CppLogPeriodTest.2000010100.txt";
+    CppFile::WriteToFile(OLDEST_FILE, "oldest\n");
+
+    // 两个小时前写的日志
+    time_t oldTime = time(NULL) - 7200;
+    CppFile::WriteToFile(FILE_PATH, "old\n");
+    timeval oldTimes[2] = { { oldTime, 0 }, { oldTime, 0 } };
+    ASSERT_EQ(0, utimes(FILE_PATH.c_str(), oldTimes));
+
+    char periodName[32];
+    tm oldTm;
+    localtime_r(&oldTime, &oldTm);
+    strftime(periodName, sizeof(periodName), "%Y%m%d%H", &oldTm);
+    const string PERIOD_FILE = string("/tmp/CppLogPeriodTest.") + periodName + ".txt";
+
+    {
+        CppLog cppLog(FILE_PATH, CppLog::DEBUG, 0, 2);
+        cppLog.SetRotate(CppLog::ROTATE_HOURLY);
+        DEBUG_ILOG(&cppLog, "new.");
+        cppLog.Flush();
+    }
+
+    EXPECT_EQ("old\n", CppFile::ReadFromFile(PERIOD_FILE));
+    EXPECT_NE(string::npos, CppFile::ReadFromFile(FILE_PATH).find("new."));
+    EXPECT_NE(0, access(OLDEST_FILE.c_str(), F_OK));
+
+    unlink(FILE_PATH.c_str());
+    unlink(PERIOD_FILE.c_str());
+    unlink(OLDEST_FILE.c_str());
+}
+
+static uint32_t CountCall(uint32_t &callCount)
+{
+    return ++callCount;
+}
+
+TEST(CppLog, ModuleLevelTest)
+{
+    const string FILE_PATH = "/tmp/CppLogModuleLevelTest.txt";
+    CppFile::WriteToFile(FILE_PATH, "");
+
+    CppLog cppLog(FILE_PATH, CppLog::INFOR);
+    auto lineCount = [&FILE_PATH]() {
+        string content = CppFile::ReadFromFile(FILE_PATH);
+        return count(content.begin(), content.end(), '\n');
+    };
+
+    // 不记录时不计算参数
+    uint32_t callCount = 0;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        DEBUG_ILOG(&cppLog, "count[%u].", CountCall(callCount));
+    }
+
+    EXPECT_EQ(0U, callCount);
+    EXPECT_EQ(0, lineCount());
+
+    // 模块级别优先
+    cppLog.SetModuleLevel("CppLogTest.cpp", CppLog::DEBUG);
+    DEBUG_ILOG(&cppLog, "count[%u].", CountCall(callCount));
+    EXPECT_EQ(1U, callCount);
+    EXPECT_EQ(1, lineCount());
+
+    cppLog.SetModuleLevel("OtherModule.cpp", CppLog::ERROR);
+    cppLog.mLogLevel = CppLog::ERROR;
+    INFOR_ILOG(&cppLog, "module level.");
+    EXPECT_EQ(2, lineCount());
+
+    // 删除模块级别后直接修改mLogLevel也生效
+    cppLog.ClearModuleLevel();
+    INFOR_ILOG(&cppLog, "not logged.");
+    EXPECT_EQ(2, lineCount());
+    cppLog.mLogLevel = CppLog::INFOR;
+    INFOR_ILOG(&cppLog, "logged.");
+    EXPECT_EQ(3, lineCount());
+
+    // 信号切换TRACE级别
+    CppLog::EnableSignalTrace(&cppLog, SIGUSR2);
+    raise(SIGUSR2);
+    TRACE_ILOG(&cppLog, "signal trace.");
+    EXPECT_EQ(4, lineCount());
+    raise(SIGUSR2);
+    TRACE_ILOG(&cppLog, "not logged.");
+    EXPECT_EQ(4, lineCount());
+    CppLog::EnableSignalTrace(NULL, SIGUSR2);
+
+    unlink(FILE_PATH.c_str());
+}
+
+// 多个实例共用的调用点，和库代码中用传入的CppLog*记录日志的情况相同
+static CppLogSite gSharedSite("CppLogTest.cpp:0", "", "CppLogTest.cpp");
+
+TEST(CppLog, SharedSiteLevelTest)
+{
+    CppLog cppLog1("/tmp/CppLogSharedSiteTest1.txt", CppLog::INFOR);
+    CppLog cppLog2("/tmp/CppLogSharedSiteTest2.txt", CppLog::ERROR);
+    EXPECT_TRUE(cppLog1.IsLevelEnabled(gSharedSite, CppLog::INFOR));
+    EXPECT_FALSE(cppLog2.IsLevelEnabled(gSharedSite, CppLog::INFOR));
+
+    // 两个实例各自占用一个缓存槽，交替调用时缓存不被对方覆盖
+    vector<uint64_t> caches;
+    for (auto &levelCache : gSharedSite.mLevelCaches)
+    {
+        caches.push_back(levelCache.load());
+    }
+
+    EXPECT_EQ(2, CppLogSite::LEVEL_CACHE_SLOTS - count(caches.begin(), caches.end(), 0U));
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        ASSERT_TRUE(cppLog1.IsLevelEnabled(gSharedSite, CppLog::INFOR));
+        ASSERT_FALSE(cppLog2.IsLevelEnabled(gSharedSite, CppLog::WARNN));
+        ASSERT_TRUE(cppLog2.IsLevelEnabled(gSharedSite, CppLog::ERROR));
+    }
+
+    for (uint32_t i = 0; i < CppLogSite::LEVEL_CACHE_SLOTS; ++i)
+    {
+        EXPECT_EQ(caches[i], gSharedSite.mLevelCaches[i].load());
+    }
+
+    // 修改一个实例的模块级别只影响这个实例
+    cppLog2.SetModuleLevel("CppLogTest.cpp", CppLog::DEBUG);
+    EXPECT_TRUE(cppLog2.IsLevelEnabled(gSharedSite, CppLog::DEBUG));
+    EXPECT_FALSE(cppLog1.IsLevelEnabled(gSharedSite, CppLog::DEBUG));
+    cppLog2.ClearModuleLevel("CppLogTest.cpp");
+    EXPECT_FALSE(cppLog2.IsLevelEnabled(gSharedSite, CppLog::DEBUG));
+
+    // 其他线程修改模块级别时无锁读取快照，旧快照在没有读者时释放
+    atomic<bool> stop(false);
+    thread setThread([&]()
+    {
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            cppLog1.SetModuleLevel("OtherModule.cpp", i % 2 == 0 ? CppLog::DEBUG : CppLog::ERROR);
+        }
+
+        stop = true;
+    });
+
+    atomic<uint32_t> readErrors(0);
+    thread readThread([&]()
+    {
+        while (!stop)
+        {
+            if (!cppLog1.IsLevelEnabled(gSharedSite, CppLog::INFOR) || cppLog1.IsLevelEnabled(gSharedSite, CppLog::DEBUG))
+            {
+                ++readErrors;
+            }
+        }
+    });
+
+    while (!stop)
+    {
+        if (!cppLog1.IsLevelEnabled(gSharedSite, CppLog::INFOR) || cppLog1.IsLevelEnabled(gSharedSite, CppLog::DEBUG))
+        {
+            ++readErrors;
+        }
+    }
+
+    setThread.join();
+    readThread.join();
+    EXPECT_EQ(0U, readErrors.load());
+}
+
+static int32_t CheckFailed(CppLog *pCppLog, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        CHECK_CONTINUE_F(pCppLog, i > count, -1, CppLog::ERROR, "index[%u].", i);
+    }
+
+    return 0;
+}
+
+TEST(CppLog, RateLimitTest)
+{
+    const string FILE_PATH = "/tmp/CppLogRateLimitTest.txt";
+    CppFile::WriteToFile(FILE_PATH, "");
+
+    CppLog cppLog(FILE_PATH, CppLog::DEBUG);
+    auto lineCount = [&FILE_PATH]() {
+        string content = CppFile::ReadFromFile(FILE_PATH);
+        return count(content.begin(), content.end(), '\n');
+    };
+
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        LOG_FIRST_N(&cppLog, CppLog::DEBUG, 3, "first[%u].", i);
+    }
+
+    EXPECT_EQ(3, lineCount());
+
+    // 第0、3、6、9次
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        LOG_EVERY_N(&cppLog, CppLog::DEBUG, 3, "every[%u].", i);
+    }
+
+    EXPECT_EQ(7, lineCount());
+
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        LOG_EVERY_MS(&cppLog, CppLog::DEBUG, 10000, "every ms[%u].", i);
+    }
+
+    EXPECT_EQ(8, lineCount());
+
+    // 连续5条之后每100ms一条，再次记录时先记录丢弃的条数
+    CppFile::WriteToFile(FILE_PATH, "");
+    for (uint32_t round = 0; round < 2; ++round)
+    {
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            LOG_RATE_LIMIT(&cppLog, CppLog::DEBUG, 10, 5, "limit[%u].", i);
+        }
+
+        usleep(200 * 1000);
+    }
+
+    string content = CppFile::ReadFromFile(FILE_PATH);
+    EXPECT_EQ(8, count(content.begin(), content.end(), '\n'));
+    EXPECT_NE(string::npos, content.find("|suppressed 95 logs.\n"));
+
+    // CHECK系列宏默认限速
+    CppFile::WriteToFile(FILE_PATH, "");
+    CheckFailed(&cppLog, 10000);
+    EXPECT_GE(CPP_LOG_CHECK_BURST + 10, lineCount());
+
+    unlink(FILE_PATH.c_str());
+}
+
+static string __attribute__((noinline)) DeepStackTrace(uint32_t depth)
+{
+    if (depth == 0)
+    {
+        return CppLog::GetStackTrace();
+    }
+
+    return DeepStackTrace(depth - 1) + "";
+}
+
+TEST(CppLog, StackTraceTest)
+{
+    // 每次调用的深度不同
+    string shallow = DeepStackTrace(0);
+    string deep = DeepStackTrace(5);
+    EXPECT_EQ(count(shallow.begin(), shallow.end(), '\n') + 5, count(deep.begin(), deep.end(), '\n'));
+
+    CppStackTrace stackTrace;
+    stackTrace.Capture();
+    EXPECT_LT(0U, stackTrace.mSize);
+    EXPECT_EQ(stackTrace.ToString(), stackTrace.ToString());
+
+    // 异步模式下由写线程解析
+    const string FILE_PATH = "/tmp/CppLogStackTraceTest.txt";
+    unlink(FILE_PATH.c_str());
+    for (auto asyncMode : { CppLog::ASYNC_SHARED_QUEUE, CppLog::ASYNC_THREAD_RING })
+    {
+        CppLog cppLog(FILE_PATH, CppLog::DEBUG);
+        cppLog.StartAsync(64 * 1024, 4096, 1000, asyncMode);
+        DEBUG_ILOG(&cppLog, "before.");
+        LOG_STACK_TRACE(&cppLog, CppLog::DEBUG);
+        DEBUG_ILOG(&cppLog, "after.");
+        cppLog.Flush();
+
+        string content = CppFile::ReadFromFile(FILE_PATH);
+        EXPECT_NE(string::npos, content.find("|stack trace:\n"));
+        EXPECT_LT(content.find("before."), content.find("|stack trace:\n"));
+        EXPECT_LT(content.find("|stack trace:\n"), content.find("after."));
+        EXPECT_LT(4, count(content.begin(), content.end(), '\n'));
+        unlink(FILE_PATH.c_str());
+    }
+
+    // 共享队列的块很小时，调用栈跨块插入也要保持顺序
+    {
+        const uint32_t LINE_COUNT = 40;
+        CppLog cppLog(FILE_PATH, CppLog::DEBUG);
+        cppLog.StartAsync(256, 1024, 1000, CppLog::ASYNC_SHARED_QUEUE);
+        for (uint32_t i = 0; i < LINE_COUNT; ++i)
+        {
+            DEBUG_ILOG(&cppLog, "line[%u].", i);
+            if (i % 3 == 0)
+            {
+                LOG_STACK_TRACE(&cppLog, CppLog::DEBUG);
+            }
+        }
+
+        LOG_STACK_TRACE(&cppLog, CppLog::DEBUG);
+        cppLog.Flush();
+
+        string content = CppFile::ReadFromFile(FILE_PATH);
+        size_t pos = 0;
+        for (uint32_t i = 0; i < LINE_COUNT; ++i)
+        {
+            pos = content.find("|line[" + CppString::ToString(i) + "].", pos);
+            ASSERT_NE(string::npos, pos);
+            size_t nextPos = content.find("|line[", pos + 1);
+            size_t tracePos = content.find("|stack trace:\n", pos);
+            ASSERT_NE(string::npos, tracePos);
+            if (i % 3 == 0)
+            {
+                EXPECT_LT(tracePos, nextPos);
+            }
+            else
+            {
+                EXPECT_GT(tracePos, nextPos);
+            }
+        }
+
+        unlink(FILE_PATH.c_str());
+    }
+}
+
+/*
+ * 日志压测，统计每秒记录的条数和单次调用的耗时分位数（纳秒，包含一次取时间的开销），运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppLog.DISABLED_LogBenchmark
+ * 同步模式的耗时包括写文件，异步模式的每秒条数包括最后Flush的时间
+ */
+struct LogBenchmarkResult
+{
+    double LinesPerSec;
+    uint64_t P50;
+    uint64_t P99;
+    uint64_t P999;
+    uint64_t Max;
+};
+
+static LogBenchmarkResult RunLogBenchmark(CppLog &benchLog, uint32_t threadCount, uint32_t logCountPerThread)
+{
+    vector<vector<uint32_t>> costs(threadCount, vector<uint32_t>(logCountPerThread));
+    vector<thread> threads;
+    auto begin = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        threads.push_back(thread([&benchLog, &costs, i, logCountPerThread]()
+        {
+            vector<uint32_t> &threadCosts = costs[i];
+            for (uint32_t j = 0; j < logCountPerThread; ++j)
+            {
+                auto logBegin = chrono::steady_clock::now();
+                INFOR_ILOG(&benchLog, "benchmark thread[%u],index[%u],value[%.3f],str[%s].", i, j, j * 0.5, "abcdefghijklmnopqrstuvwxyz");
+                threadCosts[j] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - logBegin).count();
+            }
+        }));
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    benchLog.Flush();
+    double totalSecond = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    vector<uint32_t> allCosts;
+    allCosts.reserve(threadCount * logCountPerThread);
+    for (auto &threadCosts : costs)
+    {
+        allCosts.insert(allCosts.end(), threadCosts.begin(), threadCosts.end());
+    }
+
+    sort(allCosts.begin(), allCosts.end());
+    LogBenchmarkResult result;
+    result.LinesPerSec = allCosts.size() / totalSecond;
+    result.P50 = allCosts[allCosts.size() * 50 / 100];
+    result.P99 = allCosts[allCosts.size() * 99 / 100];
+    result.P999 = allCosts[allCosts.size() * 999 / 1000];
+    result.Max = allCosts.back();
+    return result;
+}
+
+TEST(CppLog, DISABLED_LogBenchmark)
+{
+    const uint32_t LOG_COUNT_PER_THREAD = 100000;
+    const string FILE_PATH = "/tmp/CppLogBenchmark.txt";
+    const char *SINK_NAMES[] = { "stdout", "file", "rotating" };
+    const char *MODE_NAMES[] = { "sync", "queue", "ring" };
+
+    vector<uint32_t> threadCounts = { 1, 2, 4, 8 };
+    uint32_t maxThreadCount = max(thread::hardware_concurrency(), 1U);
+    while (threadCounts.back() < maxThreadCount)
+    {
+        threadCounts.push_back(threadCounts.back() * 2);
+    }
+
+    fprintf(stderr, "%-10s%-8s%-10s%-14s%-10s%-10s%-10s%-10s\n", "sink", "mode", "threads", "lines/s", "p50", "p99", "p999", "max");
+    for (uint32_t sink = 0; sink < ARRAY_SIZE(SINK_NAMES); ++sink)
+    {
+        for (uint32_t mode = 0; mode < ARRAY_SIZE(MODE_NAMES); ++mode)
+        {
+            for (auto threadCount : threadCounts)
+            {
+                // 标准输出重定向到/dev/null，测试结果仍输出到标准错误
+                int stdoutFd = -1;
+                if (sink == 0)
+                {
+                    fflush(stdout);
+                    stdoutFd = dup(STDOUT_FILENO);
+                    int nullFd = open("/dev/null", O_WRONLY);
+                    dup2(nullFd, STDOUT_FILENO);
+                    close(nullFd);
+                }
+
+                LogBenchmarkResult result;
+                {
+                    CppLog benchLog(sink == 0 ? "" : FILE_PATH, CppLog::DEBUG, sink == 2 ? 16 * 1024 * 1024 : 0, 3);
+                    if (mode > 0)
+                    {
+                        benchLog.StartAsync(16 * 1024 * 1024, 64 * 1024, 100, mode == 1 ? CppLog::ASYNC_SHARED_QUEUE : CppLog::ASYNC_THREAD_RING);
+                    }
+
+                    result = RunLogBenchmark(benchLog, threadCount, LOG_COUNT_PER_THREAD);
+                }
+
+                if (sink == 0)
+                {
+                    cout.flush();
+                    dup2(stdoutFd, STDOUT_FILENO);
+                    close(stdoutFd);
+                }
+
+                fprintf(stderr, "%-10s%-8s%-10u%-14.0f%-10llu%-10llu%-10llu%-10llu\n", SINK_NAMES[sink], MODE_NAMES[mode], threadCount,
+                        result.LinesPerSec, static_cast<unsigned long long>(result.P50), static_cast<unsigned long long>(result.P99),
+                        static_cast<unsigned long long>(result.P999), static_cast<unsigned long long>(result.Max));
+
+                unlink(FILE_PATH.c_str());
+                unlink("/tmp/CppLogBenchmark1.txt");
+                unlink("/tmp/CppLogBenchmark2.txt");
+            }
+        }
+    }
+}
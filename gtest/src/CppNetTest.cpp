@@ -1,18 +1,22 @@
 #ifndef __CYGWIN__
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/epoll.h>
 #include <netinet/tcp.h>
 
 #include <map>
 #include <list>
+#include <deque>
 #include <mutex>
 #include <thread>
+#include <atomic>
 
 #include <CppString.h>
 #include <CppArray.h>
 #include <CppTime.h>
 #include <CppNet.h>
+#include <CppFile.h>
 
 #include "global.h"
 
@@ -41,7 +45,8 @@ using namespace std;
 enum ServerType
 {
     SINGLE_THREAD_SERVER,       // 单线程服务端
-    MULTI_THREAD_SERVER         // 多线程服务端
+    MULTI_THREAD_SERVER,        // 多线程服务端
+    REACTOR_SERVER              // 多Reactor服务端，使用CppTcpServer
 };
 
 // 公共配置
@@ -52,6 +57,9 @@ static const uint16_t SERV_PORT = 20001;
 static const uint32_t TOTAL_SECOND = 15;                    // 总共执行的秒数
 static const uint32_t CLIENT_COUNT_PER_THREAD = 30;         // 每个客户端线程包含的客户端数量
 static const uint32_t CLIENT_THREAD_COUNT = 4;              // 客户端线程数
+static const bool CLIENT_EDGE_TRIGGERED = false;            // 客户端Epoll池是否使用边缘触发
+static const uint32_t CLIENT_PIPELINE_DEPTH = 1;            // 客户端每个连接的管道深度
+static const uint64_t CLIENT_TARGET_QPS = 0;                // 客户端开环模式的目标QPS，0表示闭环
 
 // 服务端配置
 static const ServerType SERVER_TYPE = MULTI_THREAD_SERVER;  // 服务端类型
@@ -72,7 +80,7 @@ bool gServerStart = false;                                  // 服务端开始
 class ClientData :public PressCallClientDataBase
 {
 public:
-    uint64_t value = 0;
+    deque<uint64_t> values;     // 已发送未回包的数据，按发送顺序
 };
 
 class MultiThreadClient :public MultiThreadClientBase
@@ -81,29 +89,43 @@ public:
     MultiThreadClient(const std::string &serverAddr, uint16_t serverPort,
                       uint32_t runSecond, uint32_t clientThreadCount,
                       uint32_t clientCountPerThread,
-                      uint32_t epollSize, CppLog *mpCppLog) :MultiThreadClientBase(
+                      uint32_t epollSize, CppLog *mpCppLog, bool edgeTriggered = false) :MultiThreadClientBase(
                           serverAddr, serverPort, runSecond, clientThreadCount, clientCountPerThread,
-                          epollSize, mpCppLog)
+                          epollSize, mpCppLog, edgeTriggered)
     {
     }
 
 protected:
-    virtual bool CheckResponse(uint32_t threadId, int fd, const string &bufStr);
-    virtual const string GetSendData(uint32_t threadId, int fd);
+    virtual int32_t GetResponseSize(uint32_t threadId, int fd, CppNetBuffer &recvBuf)
+    {
+        static_cast<void>(threadId);
+        static_cast<void>(fd);
+        return recvBuf.Size() >= sizeof(uint64_t) ? sizeof(uint64_t) : 0;
+    }
+
+    virtual bool CheckResponse(uint32_t threadId, int fd, CppNetBuffer &recvBuf, size_t size);
+    virtual void GetSendData(uint32_t threadId, int fd, CppNetBuffer &sendBuf);
     virtual shared_ptr<PressCallClientDataBase> MakeNewClientData()
     {
         return make_shared<ClientData>();
     }
 };
 
-bool MultiThreadClient::CheckResponse(uint32_t threadId, int fd, const string &bufStr)
+bool MultiThreadClient::CheckResponse(uint32_t threadId, int fd, CppNetBuffer &recvBuf, size_t size)
 {
-    // 比较回复，看是否与期望值相等，期望值是发送过去的数据+1
-    uint64_t expectValue = static_cast<ClientData *>(GetClientData(threadId, fd).get())->value + 1;
+    // 比较回复，看是否与期望值相等，期望值是最早发送过去的数据+1
+    deque<uint64_t> &values = static_cast<ClientData *>(GetClientData(threadId, fd).get())->values;
+    if (values.empty())
+    {
+        return false;
+    }
 
-    // 先保存成指针，再解引用，避免产生warning: dereferencing type-punned pointer will break strict-aliasing rules [-Wstrict-aliasing]
-    const uint64_t *pAactualValue = reinterpret_cast<const uint64_t *>(bufStr.c_str());
-    uint64_t actualValue = *pAactualValue;
+    uint64_t expectValue = values.front() + 1;
+    values.pop_front();
+
+    // 直接从接收缓冲区中取数据，先拷贝出来，避免产生warning: dereferencing type-punned pointer will break strict-aliasing rules [-Wstrict-aliasing]
+    uint64_t actualValue = 0;
+    recvBuf.Copy(reinterpret_cast<char *>(&actualValue), min(size, sizeof(actualValue)));
     actualValue = CppNet::Ntohll(actualValue);
     if (actualValue == expectValue)
     {
@@ -118,13 +140,15 @@ bool MultiThreadClient::CheckResponse(uint32_t threadId, int fd, const string &b
     }
 }
 
-const string MultiThreadClient::GetSendData(uint32_t threadId, int fd)
+void MultiThreadClient::GetSendData(uint32_t threadId, int fd, CppNetBuffer &sendBuf)
 {
-    uint64_t data = CppTime::GetUTime();
-    static_cast<ClientData *>(GetClientData(threadId, fd).get())->value = data;
+    // 同一微秒内可能发送多个请求，加上序号区分
+    static thread_local uint64_t seq = 0;
+    uint64_t data = CppTime::GetUTime() * 1000 + (++seq % 1000);
+    static_cast<ClientData *>(GetClientData(threadId, fd).get())->values.push_back(data);
 
     data = CppNet::Htonll(data);
-    return string(reinterpret_cast<char *>(&data), sizeof(data));
+    sendBuf.Append(reinterpret_cast<char *>(&data), sizeof(data));
 }
 
 namespace SingleThreadServer
@@ -538,12 +562,12 @@ void ServerWorkThead::ProcDeleteFd(int fd)
 
 void ServerWorkThead::AddClientFd(int clientFd)
 {
-    // 添加进epoll fd里
+    // 添加进epoll fd里，在监听线程中调用，需要投递到工作线程中添加
     epoll_event ev;
     ev.data.fd = clientFd;
     ev.events = EPOLLIN;
 
-    mEpollManager.AddOrModFd(clientFd, ev);
+    mEpollManager.PostAddFd(clientFd, ev);
 }
 
 void ServerWorkThead::Run()
@@ -740,93 +764,2193 @@ int32_t MultiThreadServer::StartServer()
     return 0;
 }
 
-TEST(CppNet, DISABLED_EpollTest)
+/** 按指定指令集批量转换，和逐个转换的结果比较，包括不满一个向量的尾部、非对齐地址和原地转换
+ *
+ * @param   CppNet::SIMD_LEVEL level
+ * @retval  void
+ * @author  moontan
+ */
+template <typename T>
+static void CheckHtonArray(CppNet::SIMD_LEVEL level, T (*swapFunc)(T))
 {
-    gServerStop = false;
-    MultiThreadServer multiServer;
-    shared_ptr<thread> pServer;
+    const size_t MAX_COUNT = 100;
+    mt19937_64 random(level);
+    vector<T> src(MAX_COUNT);
+    for (auto &value : src)
+    {
+        value = (T)random();
+    }
 
-    // 创建一个服务端线程
-    if (SERVER_TYPE == MULTI_THREAD_SERVER)
+    // 多分配一个元素，从第1个字节开始存放，地址不对齐
+    vector<char> destBuffer((MAX_COUNT + 1) * sizeof(T));
+    T *pDest = (T *)(destBuffer.data() + 1);
+    for (size_t count = 0; count <= MAX_COUNT; ++count)
     {
-        pServer = make_shared<thread>(&MultiThreadServer::StartServer, &multiServer);
+        CppNet::HtonArray(src.data(), pDest, count, level);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ASSERT_EQ(swapFunc(src[i]), pDest[i]) << "level=" << level << ",count=" << count << ",i=" << i;
+        }
+
+        // 原地转回主机序
+        CppNet::NtohArray(pDest, pDest, count, level);
+        ASSERT_EQ(0, memcmp(src.data(), pDest, count * sizeof(T))) << "level=" << level << ",count=" << count;
     }
-    else
+}
+
+static uint16_t Htons16(uint16_t data)
+{
+    return htons(data);
+}
+
+static uint32_t Htonl32(uint32_t data)
+{
+    return htonl(data);
+}
+
+TEST(CppNet, ByteOrderTest)
+{
+    // 编译期计算
+    static_assert(CppNet::Ntohll(CppNet::Htonll(0x0102030405060708ULL)) == 0x0102030405060708ULL, "Htonll");
+    EXPECT_EQ(htonl(1) == 1, CppNet::IsBigendian());
+    EXPECT_EQ(((uint64_t)htonl(0x05060708) << 32) + htonl(0x01020304), CppNet::Htonll(0x0102030405060708ULL));
+    if (!CppNet::IsBigendian())
     {
-        pServer = make_shared<thread>(SingleThreadServer::StartServer);
+        EXPECT_EQ(0x0807060504030201ULL, CppNet::Htonll(0x0102030405060708ULL));
     }
 
-    // 忙等待服务端开启，TODO：可使用条件变量代替
-    while (!gServerStart)
+    // 超过CPU支持的指令集时自动降级，所以每种都可以测
+    for (int32_t level = CppNet::SIMD_NONE; level <= CppNet::SIMD_AVX2; ++level)
     {
-        usleep(10);
+        CheckHtonArray<uint64_t>((CppNet::SIMD_LEVEL)level, CppNet::Htonll);
+        CheckHtonArray<uint32_t>((CppNet::SIMD_LEVEL)level, Htonl32);
+        CheckHtonArray<uint16_t>((CppNet::SIMD_LEVEL)level, Htons16);
     }
+}
 
-    // 执行客户端线程，此处阻塞知道客户端全部退出
-    MultiThreadClient client(SERV_NAME, SERV_PORT, TOTAL_SECOND, CLIENT_THREAD_COUNT,
-                             CLIENT_COUNT_PER_THREAD, CLIENT_EPOLL_SIZE, &cppLog);
-    client.Run();
+/*
+ * 批量字节序转换压测，运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppNet.DISABLED_ByteOrderBenchmark
+ * loop为逐个调用Htonll/htonl/htons，其他为HtonArray指定的指令集，数组在L1/L2缓存内，排除内存带宽的影响
+ * 结果（1核虚拟机，-O2，4096个元素，每项转换20万次，跑3次，GB/s）：
+ *  uint64: loop[10.2-12.5]，none[10.9-13.6]，ssse3[14.7-17.9]，avx2[31.9-33.6]
+ *  uint32: loop[7.3-7.9]，none[7.1-7.7]，ssse3[31.7-39.2]，avx2[51.5-62.2]
+ *  uint16: loop[17.2-23.7]，none[3.4-3.8]，ssse3[25.7-30.2]，avx2[46.4-66.6]
+ *  默认的x86-64目标没有pshufb，32/64位逐个转换无法自动向量化，AVX2有3-8倍的提升；
+ *  16位的循环能被编译器用SSE2移位向量化，AVX2仍有约3倍的提升
+ */
+template <typename T>
+static void RunByteOrderBenchmark(const char *typeName, T (*swapFunc)(T))
+{
+    const size_t COUNT = 4096;
+    const uint32_t LOOP_TIMES = 200000;
+    vector<T> src(COUNT, (T)0x0102030405060708ULL);
+    vector<T> dest(COUNT);
+    const char *names[] = {"none", "ssse3", "avx2"};
+
+    uint64_t beginTime = CppTime::GetUTime();
+    for (uint32_t loop = 0; loop < LOOP_TIMES; ++loop)
+    {
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            dest[i] = swapFunc(src[i]);
+        }
 
-    // 通知服务端停止
-    gServerStop = true;
+        // 防止编译器把循环优化掉
+        src[loop % COUNT] = dest[(loop + 1) % COUNT];
+    }
 
-    // 等待线程返回
-    pServer->join();
+    uint64_t useTime = max<uint64_t>(CppTime::GetUTime() - beginTime, 1);
+    printf("%-8s %-6s %8.2f GB/s\n", typeName, "loop", (double)COUNT * sizeof(T) * LOOP_TIMES / useTime / 1000);
 
-    DEBUG_LOG("Finished,totalSuccess[%llu],totalFail[%llu],successPercent[%.3f%].",
-              client.gSuccessCount, client.gFailCount,
-              (double)(client.gSuccessCount) / (client.gSuccessCount + client.gFailCount) * 100);
+    for (int32_t level = CppNet::SIMD_NONE; level <= CppNet::GetSimdLevel(); ++level)
+    {
+        beginTime = CppTime::GetUTime();
+        for (uint32_t loop = 0; loop < LOOP_TIMES; ++loop)
+        {
+            CppNet::HtonArray(src.data(), dest.data(), COUNT, (CppNet::SIMD_LEVEL)level);
+            src[loop % COUNT] = dest[(loop + 1) % COUNT];
+        }
+
+        useTime = max<uint64_t>(CppTime::GetUTime() - beginTime, 1);
+        printf("%-8s %-6s %8.2f GB/s\n", typeName, names[level], (double)COUNT * sizeof(T) * LOOP_TIMES / useTime / 1000);
+    }
+}
+
+TEST(CppNet, DISABLED_ByteOrderBenchmark)
+{
+    RunByteOrderBenchmark<uint64_t>("uint64", CppNet::Htonll);
+    RunByteOrderBenchmark<uint32_t>("uint32", Htonl32);
+    RunByteOrderBenchmark<uint16_t>("uint16", Htons16);
+}
+
+TEST(CppNet, IpParseFormatTest)
+{
+    char buf[INET6_ADDRSTRLEN];
+    char expectBuf[INET6_ADDRSTRLEN];
+    mt19937_64 random(1);
+
+    // IPv4随机地址和inet_ntop/inet_pton结果一致
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+        uint32_t netIp = (uint32_t)random();
+        size_t len = CppNet::FormatIpv4(netIp, buf);
+        ASSERT_STREQ(inet_ntop(AF_INET, &netIp, expectBuf, sizeof(expectBuf)), buf);
+        ASSERT_EQ(strlen(buf), len);
+
+        uint32_t parsedIp = 0;
+        ASSERT_TRUE(CppNet::ParseIpv4(buf, len, parsedIp)) << buf;
+        ASSERT_EQ(netIp, parsedIp);
+    }
+
+    EXPECT_EQ("255.255.255.255", CppNet::NetIpToStr(0xFFFFFFFF));
+    EXPECT_EQ(htonl(0x7F000001), CppNet::StrToNetIp("127.0.0.1"));
+    EXPECT_EQ(htonl(0x7F000001), CppNet::StrToNetIp("127.1"));
+    EXPECT_THROW(CppNet::StrToNetIp("localhost"), CppException);
+
+    // IPv6随机地址，每组有一半的概率为0，覆盖各种::缩写的位置
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+        uint8_t ip[16];
+        for (uint32_t j = 0; j < sizeof(ip); j += 2)
+        {
+            uint64_t value = random();
+            ip[j] = (value & 1) ? 0 : (uint8_t)(value >> 8);
+            ip[j + 1] = (value & 1) ? 0 : (uint8_t)(value >> 16);
+        }
+
+        // 部分改成IPv4映射地址
+        if (i % 10 == 0)
+        {
+            memset(ip, 0, 10);
+            ip[10] = ip[11] = 0xFF;
+        }
+
+        size_t len = CppNet::FormatIpv6(ip, buf);
+        ASSERT_STREQ(inet_ntop(AF_INET6, ip, expectBuf, sizeof(expectBuf)), buf);
+        ASSERT_EQ(strlen(buf), len);
+
+        uint8_t parsedIp[16];
+        ASSERT_TRUE(CppNet::ParseIpv6(buf, len, parsedIp)) << buf;
+        ASSERT_EQ(0, memcmp(ip, parsedIp, sizeof(ip))) << buf;
+    }
+
+    // 合法和非法格式的判断和inet_pton一致
+    const char *ipv4Strs[] = {"0.0.0.0", "1.2.3.4", "255.255.255.255", "256.1.1.1", "1.2.3", "1.2.3.4.5", "01.2.3.4",
+                              "1..2.3", "1.2.3.4 ", "", ".1.2.3", "1.2.3.", "1.2.3.1000", "a.b.c.d", "1.2.3.-4"
+                             };
+    for (auto pStr : ipv4Strs)
+    {
+        uint32_t netIp;
+        uint32_t expectIp;
+        bool expect = inet_pton(AF_INET, pStr, &expectIp) == 1;
+        EXPECT_EQ(expect, CppNet::ParseIpv4(pStr, strlen(pStr), netIp)) << pStr;
+        if (expect)
+        {
+            EXPECT_EQ(expectIp, netIp) << pStr;
+        }
+    }
+
+    const char *ipv6Strs[] = {"::", "::1", "1::", "1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8",
+                              "::ffff:1.2.3.4", "1:2:3:4:5:6:1.2.3.4", "FE80::ABCD", "0001:02:003:0004::",
+                              ":", ":::", "1:", ":1", "1::2::3", "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7:8::",
+                              "::1:2:3:4:5:6:7:8", "12345::", "g::", "1:2:3:4:5:6:7:1.2.3.4", "::1.2.3",
+                              "::1.2.3.4:1", "1.2.3.4::", "fe80::1%eth0", "", "1:2:3:4:5:6:7", "::ffff:01.2.3.4"
+                             };
+    for (auto pStr : ipv6Strs)
+    {
+        uint8_t ip[16];
+        uint8_t expectIp[16];
+        bool expect = inet_pton(AF_INET6, pStr, expectIp) == 1;
+        EXPECT_EQ(expect, CppNet::ParseIpv6(pStr, strlen(pStr), ip)) << pStr;
+        if (expect)
+        {
+            EXPECT_EQ(0, memcmp(expectIp, ip, sizeof(ip))) << pStr;
+        }
+    }
+
+    // 长度参数之外的字符不解析
+    uint32_t netIp;
+    EXPECT_TRUE(CppNet::ParseIpv4("1.2.3.4:80", 7, netIp));
+    EXPECT_EQ(htonl(0x01020304), netIp);
+}
+
+TEST(CppNet, IpPortKeyTest)
+{
+    char buf[IpPortKey::MAX_STR_LEN];
+
+    IpPortKey key4;
+    ASSERT_TRUE(key4.Parse("10.0.0.1", 8080));
+    EXPECT_TRUE(key4.IsIpv4());
+    EXPECT_EQ(htonl(0x0A000001), key4.GetIpv4());
+    EXPECT_EQ(8080, key4.GetPort());
+    EXPECT_EQ(13U, key4.Format(buf));
+    EXPECT_STREQ("10.0.0.1:8080", buf);
+    EXPECT_EQ(IpPortKey(htonl(0x0A000001), 8080), key4);
+
+    // IPv4映射地址和IPv4是同一个键
+    IpPortKey mappedKey;
+    ASSERT_TRUE(mappedKey.Parse("::ffff:10.0.0.1", 8080));
+    EXPECT_EQ(key4, mappedKey);
+    EXPECT_EQ(key4.Hash(), mappedKey.Hash());
+
+    IpPortKey key6;
+    ASSERT_TRUE(key6.Parse("2001:db8::1", 443));
+    EXPECT_FALSE(key6.IsIpv4());
+    EXPECT_EQ("[2001:db8::1]:443", key6.ToString());
+    EXPECT_EQ(11U, key6.FormatIp(buf));
+    EXPECT_STREQ("2001:db8::1", buf);
+
+    // 没有缩写的IPv6和5位端口
+    IpPortKey longKey;
+    ASSERT_TRUE(longKey.Parse("ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255", 65535));
+    EXPECT_EQ(47U, longKey.Format(buf));
+    EXPECT_STREQ("[ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff]:65535", buf);
+
+    // 失败时不修改
+    EXPECT_FALSE(key6.Parse("localhost", 80));
+    EXPECT_FALSE(key6.Parse("1.2.3.4:80", 80));
+    EXPECT_EQ("[2001:db8::1]:443", key6.ToString());
+
+    // sockaddr互相转换
+    sockaddr_storage addr;
+    EXPECT_EQ(sizeof(sockaddr_in), key4.ToSockAddr(addr));
+    EXPECT_EQ(AF_INET, addr.ss_family);
+    EXPECT_EQ(htons(8080), reinterpret_cast<sockaddr_in *>(&addr)->sin_port);
+    IpPortKey fromAddr;
+    ASSERT_TRUE(fromAddr.FromSockAddr(reinterpret_cast<sockaddr *>(&addr)));
+    EXPECT_EQ(key4, fromAddr);
+
+    EXPECT_EQ(sizeof(sockaddr_in6), key6.ToSockAddr(addr));
+    EXPECT_EQ(AF_INET6, addr.ss_family);
+    ASSERT_TRUE(fromAddr.FromSockAddr(reinterpret_cast<sockaddr *>(&addr)));
+    EXPECT_EQ(key6, fromAddr);
+
+    addr.ss_family = AF_UNIX;
+    EXPECT_FALSE(fromAddr.FromSockAddr(reinterpret_cast<sockaddr *>(&addr)));
+
+    // 按IP再按端口排序
+    IpPortKey key4Port;
+    ASSERT_TRUE(key4Port.Parse("10.0.0.1", 80));
+    IpPortKey key4Next;
+    ASSERT_TRUE(key4Next.Parse("10.0.0.2", 1));
+    EXPECT_TRUE(key4Port < key4);
+    EXPECT_TRUE(key4 < key4Next);
+    EXPECT_FALSE(key4 < key4);
+    EXPECT_TRUE(key4 < key6);       // IPv4映射地址::ffff:在2001::之前
+    EXPECT_FALSE(key6 < key4);
+
+    // IpPort同样先按IP再按端口排序
+    EXPECT_TRUE(IpPort("10.0.0.1", 8080) < IpPort("10.0.0.2", 80));
+    EXPECT_TRUE(IpPort("10.0.0.1", 80) < IpPort("10.0.0.1", 8080));
+    EXPECT_FALSE(IpPort("10.0.0.2", 80) < IpPort("10.0.0.1", 8080));
+    EXPECT_FALSE(IpPort("10.0.0.1", 80) < IpPort("10.0.0.1", 80));
+
+    // 作为哈希表的键，IP相同端口不同的哈希值都不冲突
+    unordered_map<IpPortKey, uint32_t> keyMap;
+    set<size_t> hashes;
+    for (uint32_t port = 0; port < 1000; ++port)
+    {
+        keyMap[IpPortKey(htonl(0x0A000001), port)] = port;
+        hashes.insert(IpPortKey(htonl(0x0A000001), port).Hash());
+    }
+
+    EXPECT_EQ(1000U, keyMap.size());
+    EXPECT_EQ(1000U, hashes.size());
+    EXPECT_EQ(80U, keyMap[IpPortKey(htonl(0x0A000001), 80)]);
 }
 
 /*
- * Redis压测工具，性能比redis-benchmark稍高点
- * 性能数据：
- *  本机测试（办公机虚拟机），redis-benchmark为22W，这个压测可达26W（非pipeline，纯PING）
- **/
-class PressCallRedisClient :public MultiThreadClientBase
+ * IP解析和格式化压测，运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppNet.DISABLED_IpParseFormatBenchmark
+ * 每项100万次，对比libc的inet_ntop/inet_pton，IPv6使用带::缩写的地址
+ * 结果（1核虚拟机，-O2，跑3次，ns/次，包括std::function调用的开销）：
+ *  IPv4格式化：inet_ntop[172-232]，FormatIpv4[20-25]；IPv4解析：inet_pton[30-39]，ParseIpv4[22-29]
+ *  IPv6格式化：inet_ntop[380-525]，FormatIpv6[73-84]；IPv6解析：inet_pton[77-82]，ParseIpv6[56-69]
+ *  inet_ntop内部用sprintf，格式化有5-8倍的提升，解析的提升较小
+ */
+TEST(CppNet, DISABLED_IpParseFormatBenchmark)
 {
-public:
-    PressCallRedisClient(const std::string &serverAddr, uint16_t serverPort,
-                         uint32_t runSecond, uint32_t clientThreadCount,
-                         uint32_t clientCountPerThread,
-                         uint32_t epollSize, CppLog *mpCppLog) :MultiThreadClientBase(
-                             serverAddr, serverPort, runSecond, clientThreadCount, clientCountPerThread,
-                             epollSize, mpCppLog)
+    const uint32_t LOOP_TIMES = 1000000;
+    char buf[INET6_ADDRSTRLEN];
+    uint8_t ip6[16];
+    uint32_t ip4 = htonl(0xC0A8010A);
+    inet_pton(AF_INET6, "2001:db8:85a3::8a2e:370:7334", ip6);
+    const char *ip4Str = "192.168.1.10";
+    const char *ip6Str = "2001:db8:85a3::8a2e:370:7334";
+    uint64_t checkSum = 0;
+
+    auto runCase = [&](const char *name, const function<void(uint32_t i)> &func)
+    {
+        uint64_t beginTime = CppTime::GetUTime();
+        for (uint32_t i = 0; i < LOOP_TIMES; ++i)
+        {
+            func(i);
+        }
+
+        uint64_t useTime = max<uint64_t>(CppTime::GetUTime() - beginTime, 1);
+        printf("%-16s %8.1f ns/op\n", name, useTime * 1000.0 / LOOP_TIMES);
+    };
+
+    runCase("inet_ntop4", [&](uint32_t i) { ip4 += i; checkSum += strlen(inet_ntop(AF_INET, &ip4, buf, sizeof(buf))); });
+    runCase("FormatIpv4", [&](uint32_t i) { ip4 += i; checkSum += CppNet::FormatIpv4(ip4, buf); });
+    runCase("inet_pton4", [&](uint32_t) { checkSum += inet_pton(AF_INET, ip4Str, &ip4); });
+    runCase("ParseIpv4", [&](uint32_t) { checkSum += CppNet::ParseIpv4(ip4Str, 12, ip4); });
+    runCase("inet_ntop6", [&](uint32_t i) { ip6[15] = i; checkSum += strlen(inet_ntop(AF_INET6, ip6, buf, sizeof(buf))); });
+    runCase("FormatIpv6", [&](uint32_t i) { ip6[15] = i; checkSum += CppNet::FormatIpv6(ip6, buf); });
+    runCase("inet_pton6", [&](uint32_t) { checkSum += inet_pton(AF_INET6, ip6Str, ip6); });
+    runCase("ParseIpv6", [&](uint32_t) { checkSum += CppNet::ParseIpv6(ip6Str, 28, ip6); });
+    EXPECT_LT(0U, checkSum);
+}
+
+TEST(CppNet, NetBufferTest)
+{
+    // 追加跨多个块的数据
+    string data;
+    for (uint32_t i = 0; i < CppNetBuffer::BLOCK_SIZE * 3 + 100; ++i)
     {
+        data.push_back('a' + i % 26);
     }
 
-protected:
-    virtual bool CheckResponse(uint32_t threadId, int fd, const string &bufStr);
-    virtual const string GetSendData(uint32_t threadId, int fd);
-    virtual shared_ptr<PressCallClientDataBase> MakeNewClientData()
+    CppNetBuffer buffer;
+    EXPECT_TRUE(buffer.Empty());
+    EXPECT_EQ(NULL, buffer.Peek(1));
+    buffer.Append(data.data(), 10);
+    buffer.Append(data.data() + 10, data.size() - 10);
+    ASSERT_EQ(data.size(), buffer.Size());
+    EXPECT_EQ(data, buffer.ToString());
+
+    // 同一个块中的数据直接返回块中的指针，跨块的拷贝出来
+    const char *pFirst = buffer.Peek(10);
+    ASSERT_TRUE(pFirst != NULL);
+    EXPECT_EQ(data.substr(0, 10), string(pFirst, 10));
+    EXPECT_EQ(pFirst, buffer.Peek(CppNetBuffer::BLOCK_SIZE));
+    const char *pCross = buffer.Peek(CppNetBuffer::BLOCK_SIZE + 10);
+    ASSERT_TRUE(pCross != NULL);
+    EXPECT_NE(pFirst, pCross);
+    EXPECT_EQ(data.substr(0, CppNetBuffer::BLOCK_SIZE + 10), string(pCross, CppNetBuffer::BLOCK_SIZE + 10));
+
+    char buf[100];
+    ASSERT_EQ(100U, buffer.Copy(buf, sizeof(buf), CppNetBuffer::BLOCK_SIZE - 50));
+    EXPECT_EQ(data.substr(CppNetBuffer::BLOCK_SIZE - 50, 100), string(buf, sizeof(buf)));
+    EXPECT_EQ(50U, buffer.Copy(buf, sizeof(buf), data.size() - 50));
+
+    // 查找，包括跨块的数据
+    EXPECT_EQ(0U, buffer.Find("abc"));
+    EXPECT_EQ(26U, buffer.Find("abc", 1));
+    EXPECT_EQ(data.find("xyzab", CppNetBuffer::BLOCK_SIZE - 30), buffer.Find("xyzab", CppNetBuffer::BLOCK_SIZE - 30));
+    EXPECT_LT(CppNetBuffer::BLOCK_SIZE - 30, buffer.Find("xyzab", CppNetBuffer::BLOCK_SIZE - 30));
+    EXPECT_EQ(data.rfind("yz"), buffer.Find("yz", data.size() - 30));
+    EXPECT_EQ(string::npos, buffer.Find("aa"));
+    EXPECT_EQ(string::npos, buffer.Find("abc", data.size() - 1));
+
+    buffer.Consume(CppNetBuffer::BLOCK_SIZE + 5);
+    EXPECT_EQ(data.substr(CppNetBuffer::BLOCK_SIZE + 5), buffer.ToString());
+    buffer.Consume(data.size());
+    EXPECT_TRUE(buffer.Empty());
+
+    // 通过socketpair读写1MB数据，写缓冲区满时部分写入
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    UniqueFd fd0(fds[0]);
+    UniqueFd fd1(fds[1]);
+
+    string bigData;
+    while (bigData.size() < 1024 * 1024)
     {
-        return make_shared<PressCallClientDataBase>();
+        bigData.append(data);
     }
-};
 
-bool PressCallRedisClient::CheckResponse(uint32_t threadId, int fd, const string &bufStr)
+    CppNetBuffer sendBuf;
+    CppNetBuffer recvBuf;
+    sendBuf.Append(bigData);
+    uint32_t partialCount = 0;
+    while (!sendBuf.Empty() || recvBuf.Size() < bigData.size())
+    {
+        if (!sendBuf.Empty())
+        {
+            ssize_t ret = sendBuf.WriteFd(fd0);
+            if (ret < 0)
+            {
+                ASSERT_EQ(EAGAIN, errno);
+                ++partialCount;
+            }
+        }
+
+        ssize_t ret = recvBuf.ReadFd(fd1);
+        ASSERT_NE(0, ret);
+        if (ret < 0)
+        {
+            ASSERT_EQ(EAGAIN, errno);
+        }
+    }
+
+    EXPECT_LT(0U, partialCount);
+    EXPECT_EQ(bigData, recvBuf.ToString());
+
+    // 对端关闭返回0
+    fd0.Reset();
+    EXPECT_EQ(0, recvBuf.ReadFd(fd1));
+}
+
+/** 把数据逐字节追加到CppNetBuffer和string中，每次都解码，两种缓冲区的结果必须相同
+ *
+ * @param   CppFrameCodec & codec
+ * @param   const string & data
+ * @retval  vector<int32_t>         依次返回每个完整帧的大小，出错时最后一个为错误码
+ * @author  moontan
+ */
+static vector<int32_t> DecodeFragmented(CppFrameCodec &codec, const string &data)
 {
-    static_cast<void>(threadId);
-    static_cast<void>(fd);
-    if (!bufStr.empty() && *bufStr.begin() == '+')
+    unique_ptr<CppFrameCodec> pStrCodec = codec.Clone();
+    CppNetBuffer buffer;
+    string str;
+    vector<int32_t> sizes;
+    for (char c : data)
     {
-        return true;
+        buffer.Append(&c, 1);
+        str.push_back(c);
+        int32_t size = 0;
+        while ((size = codec.GetFrameSize(buffer)) != 0)
+        {
+            EXPECT_EQ(size, pStrCodec->GetFrameSize(str.data(), str.size()));
+            sizes.push_back(size);
+            if (size < 0)
+            {
+                return sizes;
+            }
+
+            buffer.Consume(size);
+            str.erase(0, size);
+        }
+
+        EXPECT_EQ(0, pStrCodec->GetFrameSize(str.data(), str.size()));
     }
 
-    return false;
+    return sizes;
 }
 
-const string PressCallRedisClient::GetSendData(uint32_t threadId, int fd)
+TEST(CppNet, FrameCodecTest)
 {
-    static_cast<void>(threadId);
-    static_cast<void>(fd);
-    return "PING\r\n";
+    // 长度前缀，u32和u16
+    {
+        CppLengthCodec codec;
+        string data;
+        codec.Encode("hello", 5, data);
+        codec.Encode("", 0, data);
+        codec.Encode("world!!", 7, data);
+        EXPECT_EQ(vector<int32_t>({9, 4, 11}), DecodeFragmented(codec, data));
+
+        CppLengthCodec codec16(2);
+        data.clear();
+        codec16.Encode("hello", 5, data);
+        EXPECT_EQ(string("\x00\x05hello", 7), data);
+        EXPECT_EQ(vector<int32_t>({7}), DecodeFragmented(codec16, data));
+    }
+
+    // 固定帧头，长度字段在中间并且包含帧头
+    {
+        CppLengthCodec codec(4, 12, 4, true);
+        EXPECT_EQ(12U, codec.GetHeaderSize());
+        string data;
+        codec.Encode("abc", 3, data);
+        ASSERT_EQ(15U, data.size());
+        EXPECT_EQ(string("\x00\x00\x00\x0f", 4), data.substr(4, 4));
+        data.append(data);
+        EXPECT_EQ(vector<int32_t>({15, 15}), DecodeFragmented(codec, data));
+
+        // 长度小于帧头
+        data = string(12, '\0');
+        EXPECT_EQ(vector<int32_t>({-1}), DecodeFragmented(codec, data));
+    }
+
+    // 超过最大帧大小和参数错误
+    {
+        CppLengthCodec codec(4, 0, 0, false, 10);
+        string data;
+        EXPECT_THROW(codec.Encode("0123456789", 10, data), CppException);
+        CppLengthCodec(4).Encode("0123456789", 10, data);
+        EXPECT_EQ(vector<int32_t>({-1}), DecodeFragmented(codec, data));
+        EXPECT_THROW(CppLengthCodec(3), CppException);
+        EXPECT_THROW(CppLengthCodec(4, 2), CppException);
+    }
+
+    // 分隔符，分隔符跨两次到达
+    {
+        CppDelimiterCodec codec;
+        EXPECT_EQ(vector<int32_t>({3, 4, 2}), DecodeFragmented(codec, "a\r\nbc\r\n\r\nd"));
+
+        CppDelimiterCodec codec2("||");
+        string data;
+        codec2.Encode("x|y", 3, data);
+        EXPECT_EQ("x|y||", data);
+        EXPECT_EQ(vector<int32_t>({5, 3}), DecodeFragmented(codec2, data + "z||"));
+
+        CppDelimiterCodec codec3("\n", 4);
+        EXPECT_EQ(vector<int32_t>({2, -1}), DecodeFragmented(codec3, "a\nbcdef\n"));
+    }
+
+    // RESP，批量字符串中的\r\n按长度跳过，嵌套数组
+    {
+        vector<string> frames = {"+OK\r\n", "-ERR x\r\n", ":100\r\n", "$5\r\nhe\r\no\r\n", "$-1\r\n", "$0\r\n\r\n",
+                                 "*0\r\n", "*-1\r\n", "*2\r\n*1\r\n:1\r\n+x\r\n", "*2\r\n*2\r\n$1\r\na\r\n*0\r\n$-1\r\n"};
+        string command;
+        CppRespCodec::EncodeCommand({"GET", "a"}, command);
+        EXPECT_EQ("*2\r\n$3\r\nGET\r\n$1\r\na\r\n", command);
+        frames.push_back(command);
+
+        string data;
+        vector<int32_t> sizes;
+        for (const string &frame : frames)
+        {
+            data.append(frame);
+            sizes.push_back(frame.size());
+        }
+
+        CppRespCodec codec;
+        EXPECT_EQ(sizes, DecodeFragmented(codec, data));
+
+        // 长度超过int64_t范围时不能溢出
+        for (const char *error : {"$3\r\nabcd\r\n", "?x\r\n", "$x\r\n", "*-2\r\n", "$\r\n", "$99999999999999999999\r\n",
+                                  "*9223372036854775808\r\n", "*-9999999999999999999\r\n", "$18446744073709551617\r\n"
+                                 })
+        {
+            CppRespCodec errorCodec;
+            vector<int32_t> errorSizes = DecodeFragmented(errorCodec, error);
+            ASSERT_EQ(1U, errorSizes.size()) << error;
+            EXPECT_GT(0, errorSizes[0]) << error;
+        }
+    }
 }
 
-TEST(CppNet, DISABLED_PressCallRedis)
+TEST(CppNet, EpollManagerTest)
 {
-    PressCallRedisClient presscallRedisClient("127.0.0.1", 6379, TOTAL_SECOND, CLIENT_THREAD_COUNT,
-                                              CLIENT_COUNT_PER_THREAD, CLIENT_EPOLL_SIZE, &cppLog);
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    UniqueFd fd0(fds[0]);
+    UniqueFd fd1(fds[1]);
+    epoll_event events[4];
+    epoll_event ev;
+
+    // 水平触发：只监听读，没有数据时不触发
+    {
+        CppEpollManager epollManager(10);
+        ev.events = EPOLLIN;
+        epollManager.AddOrModFd(fd0, ev);
+        EXPECT_EQ(0, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+
+        // 重复添加变成修改
+        ev.events = EPOLLOUT;
+        epollManager.AddOrModFd(fd0, ev);
+        ASSERT_EQ(1, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+        EXPECT_EQ(fd0.Get(), epollManager.GetFdFromEvent(events[0]));
+        EXPECT_EQ(1, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+
+        epollManager.DelFd(fd0);
+        EXPECT_EQ(0, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+        EXPECT_THROW(epollManager.DelFd(fd0), CppException);
+    }
+
+    // 边缘触发：加入时同时注册读写，可写只触发一次
+    {
+        CppEpollManager epollManager(10, true);
+        ev.events = EPOLLIN;
+        epollManager.AddOrModFd(fd0, ev);
+        ASSERT_EQ(1, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+        EXPECT_TRUE(events[0].events & EPOLLOUT);
+        EXPECT_EQ(0, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+
+        // 修改不再调用epoll_ctl，新数据产生新的可读事件
+        ev.events = EPOLLOUT;
+        epollManager.AddOrModFd(fd0, ev);
+        ASSERT_EQ(1, write(fd1, "a", 1));
+        ASSERT_EQ(1, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+        EXPECT_TRUE(events[0].events & EPOLLIN);
+        EXPECT_EQ(0, epollManager.Wait(events, ARRAY_SIZE(events), 0));
+        epollManager.DelFd(fd0);
+    }
+
+    // 其他线程投递任务和fd，按顺序执行并且唤醒Wait
+    {
+        CppEpollManager epollManager(10);
+        vector<int> results;
+        thread postThread([&]()
+        {
+            usleep(10000);
+            for (int i = 0; i < 100; ++i)
+            {
+                epollManager.PostTask([&results, i]()
+                {
+                    results.push_back(i);
+                });
+            }
+
+            ev.events = EPOLLIN;
+            epollManager.PostAddFd(fd0, ev);
+        });
+
+        // 任务执行后Wait返回0个事件，fd加入后返回可读事件（前面写入的数据还没有读取）
+        uint64_t beginTime = CppTime::GetUTime();
+        int32_t fdsCount = 0;
+        while (fdsCount == 0 && CppTime::GetUTime() - beginTime < 5000000)
+        {
+            fdsCount = epollManager.Wait(events, ARRAY_SIZE(events), 5000);
+        }
+
+        postThread.join();
+        EXPECT_LT(CppTime::GetUTime() - beginTime, 1000000);
+        ASSERT_EQ(1, fdsCount);
+        EXPECT_EQ(fd0.Get(), epollManager.GetFdFromEvent(events[0]));
+        ASSERT_EQ(100U, results.size());
+        for (int i = 0; i < 100; ++i)
+        {
+            EXPECT_EQ(i, results[i]);
+        }
+
+        // 任务抛出的异常由Wait抛出，其他任务照常执行
+        results.clear();
+        epollManager.PostTask([]()
+        {
+            THROW("task error");
+        });
+        epollManager.PostTask([&results]()
+        {
+            results.push_back(1);
+        });
+        EXPECT_THROW(epollManager.Wait(events, ARRAY_SIZE(events), 1000), CppException);
+        EXPECT_EQ(1U, results.size());
+    }
+
+    // 回调返回PROC_AGAIN时保留fd，返回其他非0值（包括1）时删除fd
+    {
+        CppEpollManager epollManager(10);
+        ev.events = EPOLLIN;
+        epollManager.AddOrModFd(fd0, ev);
+        int32_t readRet = CppEpollManager::PROC_AGAIN;
+        uint32_t readCount = 0;
+        vector<int> deletedFds;
+        function<int32_t(epoll_event &inevent)> readFunc = [&](epoll_event &) { ++readCount; return readRet; };
+        function<int32_t(epoll_event &inevent)> writeFunc = [](epoll_event &) { return 0; };
+        function<void(int fd)> deleteFdFunc = [&](int fd) { deletedFds.push_back(fd); };
+
+        // 前面写入的数据没有读取，一直可读
+        epollManager.Wait(readFunc, writeFunc, deleteFdFunc, 0);
+        epollManager.Wait(readFunc, writeFunc, deleteFdFunc, 0);
+        EXPECT_EQ(2U, readCount);
+        EXPECT_TRUE(deletedFds.empty());
+
+        readRet = 1;
+        epollManager.Wait(readFunc, writeFunc, deleteFdFunc, 0);
+        ASSERT_EQ(1U, deletedFds.size());
+        EXPECT_EQ(fd0.Get(), deletedFds[0]);
+        epollManager.Wait(readFunc, writeFunc, deleteFdFunc, 0);
+        EXPECT_EQ(3U, readCount);
+    }
+}
+
+/*
+ * Epoll事件分发压测，对比std::function版本的Wait和处理器模板版本的Wait，运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppNet.DISABLED_EpollDispatchBenchmark
+ * socketpair两端都在同一个Epoll池中，每个事件读1个字节或者写1个字节，读写事件互相触发，单线程不断产生事件
+ * 结果（1核虚拟机，256对socketpair，每项3秒，跑3次，事件/秒）：
+ *  水平触发：std::function[68W-74W]，模板[73W-87W]
+ *  边缘触发：std::function[103W-121W]，模板[106W-128W]
+ *  每个事件都有read/write系统调用，分发方式的差别基本在误差范围内；边缘触发省掉epoll_ctl，提升约50%
+ */
+TEST(CppNet, TimerWheelTest)
+{
+    uint64_t nowMs = 1000000;
+    CppTimerWheel wheel(nowMs);
+    EXPECT_EQ(-1, wheel.GetNextTimeoutMs(nowMs));
+
+    // 跨越各层的定时器，逐毫秒推进时准确在到期时间触发
+    const uint32_t delays[] = {0, 1, 63, 64, 65, 100, 4095, 4096, 4097, 5000, 70000};
+    map<uint64_t, uint64_t> firedTimes;
+    for (uint32_t delay : delays)
+    {
+        wheel.AddTimer(delay, [&, delay]() { firedTimes[delay] = nowMs; });
+    }
+
+    EXPECT_EQ(sizeof(delays) / sizeof(delays[0]), wheel.Size());
+    EXPECT_LT(0, wheel.GetNextTimeoutMs(nowMs));
+    EXPECT_GE(1, wheel.GetNextTimeoutMs(nowMs));
+
+    uint64_t startMs = nowMs;
+    for (uint32_t i = 0; i < 70000; ++i)
+    {
+        wheel.Advance(++nowMs);
+    }
+
+    for (uint32_t delay : delays)
+    {
+        EXPECT_EQ(startMs + max(delay, 1U), firedTimes[delay]) << delay;
+    }
+
+    EXPECT_EQ(0U, wheel.Size());
+
+    // 取消
+    bool fired = false;
+    uint64_t timerId = wheel.AddTimer(10, [&]() { fired = true; });
+    EXPECT_TRUE(wheel.CancelTimer(timerId));
+    EXPECT_FALSE(wheel.CancelTimer(timerId));
+    nowMs += 100;
+    EXPECT_EQ(0U, wheel.Advance(nowMs));
+    EXPECT_FALSE(fired);
+
+    // 周期定时器，在回调中取消自己；回调中添加的0毫秒定时器在下一毫秒触发
+    uint32_t periodicCount = 0;
+    uint64_t periodicId = 0;
+    uint64_t nextMs = 0;
+    periodicId = wheel.AddTimer(10, [&]()
+    {
+        if (++periodicCount == 3)
+        {
+            EXPECT_TRUE(wheel.CancelTimer(periodicId));
+            wheel.AddTimer(0, [&]() { nextMs = nowMs; });
+        }
+    }, 10);
+
+    startMs = nowMs;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        wheel.Advance(++nowMs);
+    }
+
+    EXPECT_EQ(3U, periodicCount);
+    EXPECT_EQ(startMs + 31, nextMs);
+    EXPECT_EQ(0U, wheel.Size());
+
+    // 大步推进，每个定时器只触发一次，不会提前触发，延迟不超过步长
+    const uint32_t TIMER_COUNT = 10000;
+    const uint32_t STEP_MS = 50;
+    std::mt19937 rng(12345);
+    vector<uint64_t> expireTimes(TIMER_COUNT);
+    vector<uint64_t> fireTimes(TIMER_COUNT, 0);
+    vector<uint32_t> fireCounts(TIMER_COUNT, 0);
+    for (uint32_t i = 0; i < TIMER_COUNT; ++i)
+    {
+        uint32_t delay = rng() % (1 << 22);
+        expireTimes[i] = nowMs + max(delay, 1U);
+        wheel.AddTimer(delay, [&, i]()
+        {
+            fireTimes[i] = nowMs;
+            ++fireCounts[i];
+        });
+    }
+
+    // 超出时间轮范围的定时器
+    bool farFired = false;
+    uint64_t farExpireMs = nowMs + (1ULL << 31);
+    wheel.AddTimer(1U << 31, [&]() { farFired = true; EXPECT_LE(farExpireMs, nowMs); });
+
+    while (wheel.Size() > 1)
+    {
+        // 空闲时下一个需要处理的时间不会晚于最早的定时器
+        int64_t timeoutMs = wheel.GetNextTimeoutMs(nowMs);
+        ASSERT_LE(0, timeoutMs);
+        nowMs += min<uint64_t>(timeoutMs, STEP_MS);
+        wheel.Advance(nowMs);
+    }
+
+    for (uint32_t i = 0; i < TIMER_COUNT; ++i)
+    {
+        ASSERT_EQ(1U, fireCounts[i]) << i;
+        ASSERT_LE(expireTimes[i], fireTimes[i]) << i;
+        ASSERT_GT(expireTimes[i] + STEP_MS, fireTimes[i]) << i;
+    }
+
+    // 长时间空闲后一次推进
+    nowMs += 1ULL << 32;
+    EXPECT_EQ(1U, wheel.Advance(nowMs));
+    EXPECT_TRUE(farFired);
+}
+
+TEST(CppNet, EpollTimerTest)
+{
+    CppEpollManager epollManager(16);
+    epoll_event events[16];
+
+    // epoll_wait最多等到定时器到期，超时返回前执行到期的定时器
+    uint32_t firedCount = 0;
+    epollManager.AddTimer(50, [&]() { ++firedCount; });
+    uint64_t startUs = CppTime::GetUTime();
+    while (firedCount == 0)
+    {
+        EXPECT_EQ(0, epollManager.Wait(events, 16, 1000));
+    }
+
+    uint64_t usedMs = (CppTime::GetUTime() - startUs) / 1000;
+    EXPECT_LE(45U, usedMs);
+    EXPECT_GT(500U, usedMs);
+
+    // 其他线程通过投递任务添加定时器
+    uint64_t periodicId = 0;
+    epollManager.PostTask([&]()
+    {
+        periodicId = epollManager.AddTimer(10, [&]() { ++firedCount; }, 10);
+    });
+
+    startUs = CppTime::GetUTime();
+    while (firedCount < 6)
+    {
+        epollManager.Wait(events, 16, 1000);
+    }
+
+    EXPECT_TRUE(epollManager.CancelTimer(periodicId));
+    EXPECT_GT(500U, (CppTime::GetUTime() - startUs) / 1000);
+}
+
+class DispatchBenchmarkHandler
+{
+public:
+    DispatchBenchmarkHandler() : EventCount(0)
+    {
+    }
+
+    int32_t OnRead(epoll_event &event)
+    {
+        ++EventCount;
+        char c;
+        return read(event.data.fd, &c, sizeof(c)) == sizeof(c) ? 0 : -1;
+    }
+
+    int32_t OnWrite(epoll_event &event)
+    {
+        ++EventCount;
+        return write(event.data.fd, "a", 1) == 1 ? 0 : -1;
+    }
+
+    void OnDelete(int fd)
+    {
+        static_cast<void>(fd);
+    }
+
+    uint64_t EventCount;
+};
+
+static double RunDispatchBenchmark(bool edgeTriggered, bool useTemplate, uint32_t pairCount, uint32_t runMs)
+{
+    CppEpollManager epollManager(pairCount * 2, edgeTriggered);
+    vector<UniqueFd> fds;
+    epoll_event ev;
+    for (uint32_t i = 0; i < pairCount; ++i)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) != 0)
+        {
+            return 0;
+        }
+
+        fds.push_back(UniqueFd(pair[0]));
+        fds.push_back(UniqueFd(pair[1]));
+
+        // 一端先写，另一端先读
+        ev.events = EPOLLOUT | EPOLLRDHUP;
+        epollManager.AddOrModFd(pair[0], ev);
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        epollManager.AddOrModFd(pair[1], ev);
+    }
+
+    DispatchBenchmarkHandler handler;
+    function<int32_t(epoll_event &inevent)> readFunc = bind(&DispatchBenchmarkHandler::OnRead, &handler, placeholders::_1);
+    function<int32_t(epoll_event &inevent)> writeFunc = bind(&DispatchBenchmarkHandler::OnWrite, &handler, placeholders::_1);
+    function<void(int fd)> deleteFdFunc = bind(&DispatchBenchmarkHandler::OnDelete, &handler, placeholders::_1);
+
+    uint64_t beginTime = CppTime::GetUTime();
+    uint64_t endTime = beginTime;
+    while (endTime - beginTime < runMs * 1000ULL)
+    {
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            if (useTemplate)
+            {
+                epollManager.Wait(handler, 0);
+            }
+            else
+            {
+                epollManager.Wait(readFunc, writeFunc, deleteFdFunc, 0);
+            }
+        }
+
+        endTime = CppTime::GetUTime();
+    }
+
+    return handler.EventCount * 1000000.0 / (endTime - beginTime);
+}
+
+TEST(CppNet, DISABLED_EpollDispatchBenchmark)
+{
+    const uint32_t PAIR_COUNT = 256;
+    const uint32_t RUN_MS = 3000;
+    printf("%-8s %-14s %14s\n", "mode", "dispatch", "events/sec");
+    for (uint32_t edgeTriggered = 0; edgeTriggered < 2; ++edgeTriggered)
+    {
+        for (uint32_t useTemplate = 0; useTemplate < 2; ++useTemplate)
+        {
+            double eventsPerSec = RunDispatchBenchmark(edgeTriggered != 0, useTemplate != 0, PAIR_COUNT, RUN_MS);
+            printf("%-8s %-14s %14.0f\n", edgeTriggered ? "ET" : "LT", useTemplate ? "template" : "std::function",
+                   eventsPerSec);
+            EXPECT_LT(0, eventsPerSec);
+        }
+    }
+}
+
+/*
+ * io_uring和epoll的事件分发压测，运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppNet.DISABLED_UringBenchmark
+ * 回环TCP连接两端都在同一个CppUringManager中，和DISABLED_EpollDispatchBenchmark一样每个事件读1个字节或者写1个字节，
+ * 使用处理器模板版本的Wait，fixed为在事件中用固定缓冲区提交读写，不再单独调用read/write
+ * 结果（1核虚拟机，6.18内核，256对连接，每项3秒，跑3次，事件/秒）：
+ *  epoll[34W-37W]，epoll+fixed[33W-38W]，uring[34W-42W]，uring+fixed[36W-41W]
+ *  单线程回环时耗时主要在TCP协议栈，io_uring省掉的epoll_ctl和事件等待的系统调用最多带来约15%的提升；
+ *  固定缓冲区的读写在事件之后才提交，多了一轮提交，适合大块数据，1字节的小包没有优势
+ */
+class UringFixedHandler
+{
+public:
+    UringFixedHandler(CppUringManager &manager) : EventCount(0), mManager(manager)
+    {
+    }
+
+    int32_t OnRead(epoll_event &event)
+    {
+        mManager.ReadFixed(event.data.fd, 0, 1, [this](int32_t ret) { EventCount += ret == 1 ? 1 : 0; });
+        return 0;
+    }
+
+    int32_t OnWrite(epoll_event &event)
+    {
+        mManager.WriteFixed(event.data.fd, 1, 1, [this](int32_t ret) { EventCount += ret == 1 ? 1 : 0; });
+        return 0;
+    }
+
+    void OnDelete(int fd)
+    {
+        static_cast<void>(fd);
+    }
+
+    uint64_t EventCount;
+
+private:
+    CppUringManager &mManager;
+};
+
+/** 创建回环TCP连接对，两端都是非阻塞并且关闭Nagle
+ *
+ * @param   uint32_t pairCount
+ * @param   vector<UniqueFd> & fds      每对连接的客户端和服务端依次加入
+ * @retval  bool
+ * @author  moontan
+ */
+static bool CreateLoopbackPairs(uint32_t pairCount, vector<UniqueFd> &fds)
+{
+    UniqueFd listenFd(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    socklen_t addrLen = sizeof(addr);
+    if (::bind(listenFd.Get(), (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd.Get(), pairCount) != 0 ||
+        getsockname(listenFd.Get(), (struct sockaddr *)&addr, &addrLen) != 0)
+    {
+        return false;
+    }
+
+    int noDelay = 1;
+    for (uint32_t i = 0; i < pairCount; ++i)
+    {
+        UniqueFd clientFd(socket(AF_INET, SOCK_STREAM, 0));
+        if (connect(clientFd.Get(), (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            return false;
+        }
+
+        UniqueFd serverFd(accept(listenFd.Get(), NULL, NULL));
+        if (serverFd.Get() < 0)
+        {
+            return false;
+        }
+
+        for (int fd : {clientFd.Get(), serverFd.Get()})
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+
+        fds.push_back(std::move(clientFd));
+        fds.push_back(std::move(serverFd));
+    }
+
+    return true;
+}
+
+template <typename Handler>
+static double RunUringLoop(CppUringManager &manager, Handler &handler, uint32_t runMs)
+{
+    uint64_t beginTime = CppTime::GetUTime();
+    uint64_t endTime = beginTime;
+    while (endTime - beginTime < runMs * 1000ULL)
+    {
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            manager.Wait(handler, 0);
+        }
+
+        endTime = CppTime::GetUTime();
+    }
+
+    return handler.EventCount * 1000000.0 / (endTime - beginTime);
+}
+
+static double RunUringBenchmark(bool useUring, bool useFixed, uint32_t pairCount, uint32_t runMs)
+{
+    CppUringManager manager(pairCount * 2, useUring);
+    vector<UniqueFd> fds;
+    if (!CreateLoopbackPairs(pairCount, fds))
+    {
+        return 0;
+    }
+
+    // 客户端先写，服务端先读
+    epoll_event ev;
+    for (uint32_t i = 0; i < fds.size(); ++i)
+    {
+        ev.events = (i % 2 == 0 ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+        manager.AddOrModFd(fds[i].Get(), ev);
+    }
+
+    if (useFixed)
+    {
+        manager.RegisterBuffers(2, 64);
+        manager.GetBuffer(1)[0] = 'a';
+        UringFixedHandler handler(manager);
+        return RunUringLoop(manager, handler, runMs);
+    }
+
+    DispatchBenchmarkHandler handler;
+    return RunUringLoop(manager, handler, runMs);
+}
+
+TEST(CppNet, DISABLED_UringBenchmark)
+{
+    const uint32_t PAIR_COUNT = 256;
+    const uint32_t RUN_MS = 3000;
+    printf("io_uring supported[%d]\n", CppUringManager::IsSupported());
+    printf("%-12s %14s\n", "mode", "events/sec");
+    for (uint32_t useUring = 0; useUring < 2; ++useUring)
+    {
+        for (uint32_t useFixed = 0; useFixed < 2; ++useFixed)
+        {
+            double eventsPerSec = RunUringBenchmark(useUring != 0, useFixed != 0, PAIR_COUNT, RUN_MS);
+            printf("%-12s %14.0f\n", useUring ? (useFixed ? "uring+fixed" : "uring") : (useFixed ? "epoll+fixed" : "epoll"),
+                   eventsPerSec);
+            EXPECT_LT(0, eventsPerSec);
+        }
+    }
+}
+
+TEST(CppNet, UringManagerTest)
+{
+    // 不支持io_uring时两种都是epoll，结果相同
+    for (uint32_t useUring = 0; useUring < 2; ++useUring)
+    {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+        UniqueFd fd0(fds[0]);
+        UniqueFd fd1(fds[1]);
+        epoll_event events[4];
+        epoll_event ev;
+
+        CppUringManager manager(10, useUring != 0);
+        EXPECT_EQ(useUring != 0 && CppUringManager::IsSupported(), manager.IsUringEnabled());
+
+        // 和水平触发的CppEpollManager相同
+        ev.events = EPOLLIN;
+        manager.AddOrModFd(fd0, ev);
+        EXPECT_EQ(0, manager.Wait(events, ARRAY_SIZE(events), 0));
+        ev.events = EPOLLOUT;
+        manager.AddOrModFd(fd0, ev);
+        ASSERT_EQ(1, manager.Wait(events, ARRAY_SIZE(events), 0));
+        EXPECT_TRUE(events[0].events & EPOLLOUT);
+        EXPECT_EQ(fd0.Get(), manager.GetFdFromEvent(events[0]));
+        EXPECT_EQ(1, manager.Wait(events, ARRAY_SIZE(events), 0));
+
+        // 等待可读，数据到达时返回
+        ev.events = EPOLLIN;
+        manager.AddOrModFd(fd0, ev);
+        thread writeThread([&]()
+        {
+            usleep(20000);
+            ASSERT_EQ(1, write(fd1, "a", 1));
+        });
+
+        uint64_t beginTime = CppTime::GetUTime();
+        int32_t fdsCount = 0;
+        while (fdsCount == 0 && CppTime::GetUTime() - beginTime < 1000000)
+        {
+            fdsCount = manager.Wait(events, ARRAY_SIZE(events), 1000);
+        }
+
+        writeThread.join();
+        ASSERT_EQ(1, fdsCount);
+        EXPECT_TRUE(events[0].events & EPOLLIN);
+        EXPECT_GT(500000U, CppTime::GetUTime() - beginTime);
+
+        // 固定缓冲区读写，回调在Wait中执行
+        manager.RegisterBuffers(2, 64);
+        EXPECT_THROW(manager.RegisterBuffers(2, 64), CppException);
+        EXPECT_THROW(manager.ReadFixed(fd0, 2, 64, [](int32_t) {}), CppException);
+        int32_t readResult = 0;
+        int32_t writeResult = 0;
+        manager.ReadFixed(fd0, 0, 64, [&](int32_t ret) { readResult = ret; });
+        memcpy(manager.GetBuffer(1), "hello", 5);
+        manager.WriteFixed(fd0, 1, 5, [&](int32_t ret) { writeResult = ret; });
+        for (uint32_t i = 0; i < 10 && (readResult == 0 || writeResult == 0); ++i)
+        {
+            manager.Wait(events, ARRAY_SIZE(events), 100);
+        }
+
+        EXPECT_EQ(1, readResult);
+        EXPECT_EQ('a', manager.GetBuffer(0)[0]);
+        EXPECT_EQ(5, writeResult);
+        char buf[8];
+        ASSERT_EQ(5, read(fd1, buf, sizeof(buf)));
+        EXPECT_EQ("hello", string(buf, 5));
+
+        // 没有数据时直接read返回-EAGAIN，较新的内核上io_uring会等到有数据后完成
+        readResult = 0;
+        manager.ReadFixed(fd0, 0, 64, [&](int32_t ret) { readResult = ret; });
+        manager.Wait(events, ARRAY_SIZE(events), 10);
+        ASSERT_EQ(1, write(fd1, "c", 1));
+        for (uint32_t i = 0; i < 10 && readResult == 0; ++i)
+        {
+            manager.Wait(events, ARRAY_SIZE(events), 100);
+        }
+
+        EXPECT_TRUE(readResult == -EAGAIN || readResult == 1) << readResult;
+
+        // 删除后不再触发，投递的任务和定时器照常执行
+        manager.DelFd(fd0);
+        EXPECT_THROW(manager.DelFd(fd0), CppException);
+        ASSERT_EQ(1, write(fd1, "b", 1));
+        bool taskDone = false;
+        bool timerDone = false;
+        manager.AddTimer(10, [&]() { timerDone = true; });
+        thread postThread([&]()
+        {
+            manager.PostTask([&]() { taskDone = true; });
+        });
+
+        beginTime = CppTime::GetUTime();
+        while ((!taskDone || !timerDone) && CppTime::GetUTime() - beginTime < 1000000)
+        {
+            EXPECT_EQ(0, manager.Wait(events, ARRAY_SIZE(events), 1000));
+        }
+
+        postThread.join();
+        EXPECT_TRUE(taskDone);
+        EXPECT_TRUE(timerDone);
+
+        // 回环TCP连接上的处理器模板分发
+        EXPECT_LT(0, RunUringBenchmark(useUring != 0, false, 4, 20));
+        EXPECT_LT(0, RunUringBenchmark(useUring != 0, true, 4, 20));
+    }
+}
+
+// 基于CppTcpServer的服务端，收到8字节数据后回复数据+1
+class PlusOneServer :public CppTcpServer
+{
+public:
+    PlusOneServer(uint16_t port, uint32_t reactorCount, bool reusePort) :
+        CppTcpServer("127.0.0.1", port, reactorCount, reusePort, false, &cppLog), ConnectCount(0), CloseCount(0)
+    {
+    }
+
+    ~PlusOneServer()
+    {
+        Stop();
+    }
+
+    atomic<uint32_t> ConnectCount;
+    atomic<uint32_t> CloseCount;
+
+protected:
+    virtual void OnConnect(CppTcpConnection &conn)
+    {
+        static_cast<void>(conn);
+        ++ConnectCount;
+    }
+
+    virtual int32_t OnMessage(CppTcpConnection &conn)
+    {
+        // 处理所有完整的包，不完整的留到下次
+        while (conn.ReadSize() >= sizeof(uint64_t))
+        {
+            uint64_t value;
+            memcpy(&value, conn.ReadData(), sizeof(value));
+            conn.Consume(sizeof(value));
+
+            value = CppNet::Htonll(CppNet::Ntohll(value) + 1);
+            conn.Send(reinterpret_cast<char *>(&value), sizeof(value));
+        }
+
+        return 0;
+    }
+
+    virtual void OnClose(CppTcpConnection &conn)
+    {
+        static_cast<void>(conn);
+        ++CloseCount;
+    }
+};
+
+/** 阻塞方式连接本机端口
+ *
+ * @param   uint16_t port
+ * @retval  int
+ * @author  moontan
+ */
+static int ConnectLocal(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/** 阻塞读取指定长度的数据
+ *
+ * @param   int fd
+ * @param   char * buf
+ * @param   size_t size
+ * @retval  bool
+ * @author  moontan
+ */
+static bool ReadFull(int fd, char *buf, size_t size)
+{
+    size_t readSize = 0;
+    while (readSize < size)
+    {
+        ssize_t ret = read(fd, buf + readSize, size - readSize);
+        if (ret <= 0)
+        {
+            return false;
+        }
+
+        readSize += ret;
+    }
+
+    return true;
+}
+
+static void CheckPlusOneServer(PlusOneServer &server)
+{
+    ASSERT_EQ(0, server.Start());
+    ASSERT_NE(0, server.GetPort());
+
+    // 多个连接，分布到各个reactor
+    const uint32_t CLIENT_COUNT = 8;
+    const uint32_t VALUE_COUNT = 4096;
+    vector<UniqueFd> clientFds;
+    for (uint32_t i = 0; i < CLIENT_COUNT; ++i)
+    {
+        int fd = ConnectLocal(server.GetPort());
+        ASSERT_GE(fd, 0);
+        clientFds.push_back(UniqueFd(fd));
+    }
+
+    for (uint32_t i = 0; i < CLIENT_COUNT; ++i)
+    {
+        // 单个请求
+        uint64_t value = CppNet::Htonll(i * 100);
+        ASSERT_EQ(static_cast<ssize_t>(sizeof(value)), write(clientFds[i], &value, sizeof(value)));
+        ASSERT_TRUE(ReadFull(clientFds[i], reinterpret_cast<char *>(&value), sizeof(value)));
+        EXPECT_EQ(i * 100 + 1, CppNet::Ntohll(value));
+
+        // 一次写入大量请求，服务端需要处理粘包和半包，回包需要多次写出
+        vector<uint64_t> values(VALUE_COUNT);
+        for (uint32_t j = 0; j < VALUE_COUNT; ++j)
+        {
+            values[j] = CppNet::Htonll(j);
+        }
+
+        const char *pData = reinterpret_cast<const char *>(&values[0]);
+        size_t dataSize = values.size() * sizeof(uint64_t);
+        ASSERT_EQ(static_cast<ssize_t>(dataSize - 3), write(clientFds[i], pData, dataSize - 3));
+        usleep(1000);
+        ASSERT_EQ(3, write(clientFds[i], pData + dataSize - 3, 3));
+
+        ASSERT_TRUE(ReadFull(clientFds[i], reinterpret_cast<char *>(&values[0]), dataSize));
+        for (uint32_t j = 0; j < VALUE_COUNT; ++j)
+        {
+            ASSERT_EQ(j + 1, CppNet::Ntohll(values[j]));
+        }
+    }
+
+    EXPECT_EQ(CLIENT_COUNT, server.ConnectCount);
+
+    // 客户端关闭，服务端应该回调OnClose
+    clientFds.clear();
+    for (uint32_t i = 0; i < 1000 && server.CloseCount < CLIENT_COUNT; ++i)
+    {
+        usleep(1000);
+    }
+
+    EXPECT_EQ(CLIENT_COUNT, server.CloseCount);
+
+    // 停止后所有线程退出，连接被关闭
+    int fd = ConnectLocal(server.GetPort());
+    UniqueFd uniqFd(fd);
+    server.Stop();
+    EXPECT_LT(ConnectLocal(server.GetPort()), 0);
+}
+
+// 按2字节长度前缀切帧的回显服务端，帧最大64字节
+class FrameEchoServer :public CppTcpServer
+{
+public:
+    FrameEchoServer() : CppTcpServer("127.0.0.1", 0, 1, false, false, &cppLog)
+    {
+        SetFrameCodec(CppLengthCodec(2, 0, 0, false, 64));
+    }
+
+protected:
+    virtual int32_t OnMessage(CppTcpConnection &conn)
+    {
+        int32_t frameSize = 0;
+        while ((frameSize = conn.NextFrame()) > 0)
+        {
+            conn.Send(conn.ReadData(), frameSize);
+            conn.Consume(frameSize);
+        }
+
+        return frameSize < 0 ? -1 : 0;
+    }
+};
+
+TEST(CppNet, FrameCodecServerTest)
+{
+    FrameEchoServer server;
+    ASSERT_EQ(0, server.Start());
+    UniqueFd fd(ConnectLocal(server.GetPort()));
+    ASSERT_LE(0, fd.Get());
+
+    // 逐字节发送，服务端收到完整的帧才回显
+    CppLengthCodec codec(2);
+    string data;
+    codec.Encode("hello", 5, data);
+    codec.Encode("", 0, data);
+    codec.Encode("world", 5, data);
+    for (char c : data)
+    {
+        ASSERT_EQ(1, write(fd.Get(), &c, 1));
+        usleep(100);
+    }
+
+    char buf[64];
+    ASSERT_TRUE(ReadFull(fd.Get(), buf, data.size()));
+    EXPECT_EQ(data, string(buf, data.size()));
+
+    // 超过最大帧大小时关闭连接
+    ASSERT_EQ(2, write(fd.Get(), "\x01\x00", 2));
+    EXPECT_EQ(0, read(fd.Get(), buf, sizeof(buf)));
+    server.Stop();
+}
+
+TEST(CppNet, TcpServerTest)
+{
+    // accept线程分发
+    PlusOneServer acceptServer(0, 3, false);
+    CheckPlusOneServer(acceptServer);
+
+    // SO_REUSEPORT
+    PlusOneServer reusePortServer(0, 3, true);
+    CheckPlusOneServer(reusePortServer);
+}
+
+TEST(CppNet, PipelineClientTest)
+{
+    PlusOneServer server(0, 2, false);
+    ASSERT_EQ(0, server.Start());
+
+    // 每个连接同时有8个请求在途，回包按8字节切分并且按顺序对应
+    MultiThreadClient client("127.0.0.1", server.GetPort(), 1, 2, 2, CLIENT_EPOLL_SIZE, &cppLog);
+    client.SetPipelineDepth(8);
+    client.Run();
+    EXPECT_LT(0U, client.gSuccessCount);
+    EXPECT_EQ(0U, client.gFailCount);
+
+    // 边缘触发
+    MultiThreadClient etClient("127.0.0.1", server.GetPort(), 1, 1, 2, CLIENT_EPOLL_SIZE, &cppLog, true);
+    etClient.SetPipelineDepth(8);
+    etClient.Run();
+    EXPECT_LT(0U, etClient.gSuccessCount);
+    EXPECT_EQ(0U, etClient.gFailCount);
+}
+
+TEST(CppNet, OpenLoopClientTest)
+{
+    PlusOneServer server(0, 1, false);
+    ASSERT_EQ(0, server.Start());
+
+    // 固定间隔，2个线程共2000QPS，1秒应该发送2000个左右，不受回包速度影响
+    MultiThreadClient client("127.0.0.1", server.GetPort(), 1, 2, 4, CLIENT_EPOLL_SIZE, &cppLog);
+    client.SetOpenLoop(2000);
+    client.Run();
+    EXPECT_LT(1500U, client.gSuccessCount);
+    EXPECT_GT(2500U, client.gSuccessCount);
+    EXPECT_EQ(0U, client.gFailCount);
+
+    // 泊松到达，数量有随机波动
+    MultiThreadClient poissonClient("127.0.0.1", server.GetPort(), 1, 1, 4, CLIENT_EPOLL_SIZE, &cppLog);
+    poissonClient.SetOpenLoop(2000, true);
+    poissonClient.SetPipelineDepth(4);
+    poissonClient.Run();
+    EXPECT_LT(1500U, poissonClient.gSuccessCount);
+    EXPECT_GT(2500U, poissonClient.gSuccessCount);
+    EXPECT_EQ(0U, poissonClient.gFailCount);
+}
+
+TEST(CppNet, ClientStatsTest)
+{
+    PlusOneServer server(0, 1, false);
+    ASSERT_EQ(0, server.Start());
+
+    // 每秒一行CSV，最后一行为总统计
+    const string csvPath = "/tmp/CppNetClientStats.csv";
+    MultiThreadClient client("127.0.0.1", server.GetPort(), 2, 2, 2, CLIENT_EPOLL_SIZE, &cppLog);
+    client.SetStatsExport(csvPath);
+    client.Run();
+    EXPECT_LT(0U, client.gSuccessCount);
+    EXPECT_EQ(0U, client.gFailCount);
+    EXPECT_EQ(client.gSuccessCount, client.gTotalHistogram.GetTotalCount());
+    EXPECT_EQ(client.gMaxTimeUs, client.gTotalHistogram.GetMax());
+    EXPECT_LE(client.gTotalHistogram.GetValueAtPercentile(50), client.gTotalHistogram.GetValueAtPercentile(99.99));
+
+    vector<string> lines;
+    CppString::SplitStr(CppFile::ReadFromFile(csvPath), "\n", lines);
+    ASSERT_EQ(4U, lines.size());
+    EXPECT_EQ(0U, lines[0].find("second,success,fail,"));
+    EXPECT_EQ(0U, lines[1].find("1,"));
+    EXPECT_EQ(0U, lines[2].find("2,"));
+    EXPECT_EQ(0U, lines[3].find("total," + CppString::ToString(client.gSuccessCount) + ",0,"));
+
+    // JSON每行一个对象
+    const string jsonPath = "/tmp/CppNetClientStats.json";
+    MultiThreadClient jsonClient("127.0.0.1", server.GetPort(), 1, 1, 2, CLIENT_EPOLL_SIZE, &cppLog);
+    jsonClient.SetStatsExport(jsonPath, MultiThreadClientBase::STATS_JSON);
+    jsonClient.Run();
+
+    CppString::SplitStr(CppFile::ReadFromFile(jsonPath), "\n", lines);
+    ASSERT_EQ(2U, lines.size());
+    EXPECT_EQ(0U, lines[0].find("{\"second\":1,\"success\":"));
+    EXPECT_EQ(0U, lines[1].find("{\"second\":\"total\",\"success\":" + CppString::ToString(jsonClient.gSuccessCount) + ","));
+
+    unlink(csvPath.c_str());
+    unlink(jsonPath.c_str());
+}
+
+/** 等待条件成立
+ *
+ * @param   const function<bool()> & cond
+ * @param   uint32_t timeoutMs
+ * @retval  bool                    超时返回false
+ * @author  moontan
+ */
+static bool WaitUntil(const function<bool()> &cond, uint32_t timeoutMs)
+{
+    for (uint32_t i = 0; i < timeoutMs / 10; ++i)
+    {
+        if (cond())
+        {
+            return true;
+        }
+
+        usleep(10000);
+    }
+
+    return cond();
+}
+
+/** 通过连接池的非阻塞连接请求PlusOneServer
+ *
+ * @param   int fd
+ * @param   uint64_t value
+ * @retval  bool                    回包为value+1返回true
+ * @author  moontan
+ */
+static bool PoolPlusOne(int fd, uint64_t value)
+{
+    uint64_t netValue = CppNet::Htonll(value);
+    if (write(fd, &netValue, sizeof(netValue)) != static_cast<ssize_t>(sizeof(netValue)))
+    {
+        return false;
+    }
+
+    size_t readSize = 0;
+    while (readSize < sizeof(netValue))
+    {
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0)
+        {
+            return false;
+        }
+
+        ssize_t ret = read(fd, reinterpret_cast<char *>(&netValue) + readSize, sizeof(netValue) - readSize);
+        if (ret <= 0)
+        {
+            return false;
+        }
+
+        readSize += ret;
+    }
+
+    return CppNet::Ntohll(netValue) == value + 1;
+}
+
+TEST(CppNet, DnsCacheTest)
+{
+    CppDnsCache dnsCache(200, 200, &cppLog);
+    vector<sockaddr_storage> addrs;
+
+    // IP直接返回，不进入缓存
+    ASSERT_EQ(0, dnsCache.Resolve("127.0.0.1", 80, addrs));
+    ASSERT_EQ(1U, addrs.size());
+    EXPECT_EQ(AF_INET, addrs[0].ss_family);
+    EXPECT_EQ(htons(80), reinterpret_cast<sockaddr_in *>(&addrs[0])->sin_port);
+
+    ASSERT_EQ(0, dnsCache.Resolve("::1", 443, addrs));
+    ASSERT_EQ(1U, addrs.size());
+    EXPECT_EQ(AF_INET6, addrs[0].ss_family);
+    EXPECT_EQ(htons(443), reinterpret_cast<sockaddr_in6 *>(&addrs[0])->sin6_port);
+    EXPECT_EQ(0U, dnsCache.Size());
+
+    // 域名解析后缓存
+    ASSERT_EQ(0, dnsCache.Resolve("localhost", 8080, addrs));
+    ASSERT_LT(0U, addrs.size());
+    EXPECT_EQ(1U, dnsCache.Size());
+
+    string ip;
+    ASSERT_EQ(0, dnsCache.ResolveIp("localhost", ip, 0));
+    EXPECT_TRUE(ip == "127.0.0.1" || ip == "::1");
+
+    // 过了80%的缓存时间后访问，返回旧结果并在后台刷新
+    usleep(170 * 1000);
+    ASSERT_EQ(0, dnsCache.ResolveIp("localhost", ip, 0));
+    usleep(100 * 1000);
+    ASSERT_EQ(0, dnsCache.ResolveIp("localhost", ip, 0));
+
+    // 解析失败也会缓存
+    EXPECT_NE(0, dnsCache.Resolve("nonexistent.invalid", 80, addrs));
+    EXPECT_TRUE(addrs.empty());
+    EXPECT_EQ(2U, dnsCache.Size());
+    EXPECT_NE(0, dnsCache.Resolve("nonexistent.invalid", 80, addrs, 0));
+
+    // 地址列表
+    string hosts;
+    ASSERT_EQ(0, dnsCache.ResolveHostList("localhost:2181,10.0.0.1:2182,[::1]:2183", hosts));
+    EXPECT_TRUE(hosts == "127.0.0.1:2181,10.0.0.1:2182,[::1]:2183" || hosts == "[::1]:2181,10.0.0.1:2182,[::1]:2183");
+    EXPECT_NE(0, dnsCache.ResolveHostList("localhost", hosts));
+
+    dnsCache.Clear();
+    EXPECT_EQ(0U, dnsCache.Size());
+
+    // 不等待时未命中返回EAI_AGAIN，解析在后台继续
+    EXPECT_EQ(EAI_AGAIN, dnsCache.Resolve("localhost", 80, addrs, 0));
+    EXPECT_EQ(0, dnsCache.Resolve("localhost", 80, addrs));
+}
+
+TEST(CppNet, ConnectionPoolTest)
+{
+    PlusOneServer server1(0, 1, false);
+    PlusOneServer server2(0, 1, false);
+    ASSERT_EQ(0, server1.Start());
+    ASSERT_EQ(0, server2.Start());
+    IpPort endpoint1("127.0.0.1", server1.GetPort());
+    IpPort endpoint2("127.0.0.1", server2.GetPort());
+
+    // 绑定但不监听的端口，connect会被拒绝
+    UniqueFd deadFd(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ASSERT_EQ(0, ::bind(deadFd.Get(), (struct sockaddr *)&addr, sizeof(addr)));
+    socklen_t addrLen = sizeof(addr);
+    getsockname(deadFd.Get(), (struct sockaddr *)&addr, &addrLen);
+    IpPort deadEndpoint("127.0.0.1", ntohs(addr.sin_port));
+
+    CppConnectionPool pool(CppConnectionPool::LEAST_LOADED, &cppLog);
+    pool.SetIdle(2, 4, 60000);
+    pool.SetHealthCheck(50, 2);
+    pool.SetConnectTimeout(200);
+    EXPECT_EQ(0, pool.AddEndpoint(endpoint1));
+    EXPECT_EQ(0, pool.AddEndpoint(endpoint2));
+    EXPECT_EQ(0, pool.AddEndpoint(deadEndpoint));
+    EXPECT_NE(0, pool.AddEndpoint(endpoint1));
+    EXPECT_NE(0, pool.AddEndpoint(IpPort("localhost", 80)));
+    ASSERT_EQ(0, pool.Start());
+
+    // 预先建立空闲连接，不能连接的后端被标记为不健康
+    EXPECT_TRUE(WaitUntil([&]() { return pool.GetIdleCount(endpoint1) == 2 && pool.GetIdleCount(endpoint2) == 2; }, 2000));
+    EXPECT_TRUE(WaitUntil([&]() { return !pool.IsHealthy(deadEndpoint); }, 2000));
+    EXPECT_TRUE(pool.IsHealthy(endpoint1));
+
+    // 最少连接，4个连接平均分布到2个健康的后端
+    map<string, uint32_t> endpointCounts;
+    vector<int> fds;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        IpPort endpoint;
+        int fd = pool.Acquire(endpoint, 0, 1000);
+        ASSERT_GE(fd, 0);
+        EXPECT_TRUE(PoolPlusOne(fd, i));
+        ++endpointCounts[endpoint.ToString()];
+        fds.push_back(fd);
+    }
+
+    EXPECT_EQ(2U, endpointCounts[endpoint1.ToString()]);
+    EXPECT_EQ(2U, endpointCounts[endpoint2.ToString()]);
+
+    // 空闲连接被取完后由后台补充，等待中可以拿到新连接
+    IpPort endpoint;
+    int fd = pool.Acquire(endpoint, 0, 1000);
+    ASSERT_GE(fd, 0);
+    EXPECT_TRUE(PoolPlusOne(fd, 100));
+    fds.push_back(fd);
+
+    for (int usedFd : fds)
+    {
+        EXPECT_EQ(0, pool.Release(usedFd));
+    }
+
+    EXPECT_NE(0, pool.Release(deadFd.Get()));
+    EXPECT_GE(4U, pool.GetIdleCount(endpoint1));
+
+    // 连接复用，不会每次都新建连接
+    uint32_t connectCount = server1.ConnectCount + server2.ConnectCount;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        fd = pool.Acquire(endpoint, 0, 1000);
+        ASSERT_GE(fd, 0);
+        EXPECT_TRUE(PoolPlusOne(fd, i));
+        EXPECT_EQ(0, pool.Release(fd));
+    }
+
+    EXPECT_GE(connectCount + 10, server1.ConnectCount + server2.ConnectCount);
+    pool.Stop();
+    EXPECT_EQ(-1, pool.Acquire(endpoint));
+
+    // 一致性哈希，同一个key总是选择同一个后端
+    CppConnectionPool hashPool(CppConnectionPool::CONSISTENT_HASH, &cppLog);
+    hashPool.SetHealthCheck(50, 2);
+    hashPool.AddEndpoint(endpoint1);
+    hashPool.AddEndpoint(endpoint2);
+    ASSERT_EQ(0, hashPool.Start());
+
+    map<uint64_t, string> keyEndpoints;
+    for (uint64_t key = 0; key < 100; ++key)
+    {
+        fd = hashPool.Acquire(endpoint, key, 1000);
+        ASSERT_GE(fd, 0);
+        keyEndpoints[key] = endpoint.ToString();
+        EXPECT_EQ(0, hashPool.Release(fd));
+
+        fd = hashPool.Acquire(endpoint, key, 1000);
+        ASSERT_GE(fd, 0);
+        EXPECT_EQ(keyEndpoints[key], endpoint.ToString());
+        EXPECT_EQ(0, hashPool.Release(fd));
+    }
+
+    // 两个后端都分到了key
+    uint32_t endpoint1KeyCount = 0;
+    for (auto &item : keyEndpoints)
+    {
+        endpoint1KeyCount += item.second == endpoint1.ToString() ? 1 : 0;
+    }
+
+    EXPECT_LT(10U, endpoint1KeyCount);
+    EXPECT_GT(90U, endpoint1KeyCount);
+
+    // 后端停止后被标记为不健康，它的key转移到另一个后端，其他key不变
+    server2.Stop();
+    EXPECT_TRUE(WaitUntil([&]() { return !hashPool.IsHealthy(endpoint2); }, 2000));
+    for (uint64_t key = 0; key < 100; ++key)
+    {
+        fd = hashPool.Acquire(endpoint, key, 1000);
+        ASSERT_GE(fd, 0);
+        EXPECT_EQ(endpoint1.ToString(), endpoint.ToString());
+        EXPECT_TRUE(PoolPlusOne(fd, key));
+        EXPECT_EQ(0, hashPool.Release(fd));
+    }
+
+    // 删除后端后不再被选中
+    EXPECT_EQ(0, hashPool.RemoveEndpoint(endpoint1));
+    EXPECT_NE(0, hashPool.RemoveEndpoint(endpoint1));
+    EXPECT_EQ(-1, hashPool.Acquire(endpoint, 0, 100));
+}
+
+TEST(CppNet, TcpServerIdleTest)
+{
+    PlusOneServer server(0, 2, false);
+    server.SetIdleTimeout(100);
+    ASSERT_EQ(0, server.Start());
+
+    UniqueFd idleFd(ConnectLocal(server.GetPort()));
+    UniqueFd activeFd(ConnectLocal(server.GetPort()));
+    ASSERT_GE(idleFd.Get(), 0);
+    ASSERT_GE(activeFd.Get(), 0);
+
+    // 一直有请求的连接不会被关闭
+    for (uint64_t i = 0; i < 10; ++i)
+    {
+        uint64_t value = CppNet::Htonll(i);
+        ASSERT_EQ(static_cast<ssize_t>(sizeof(value)), write(activeFd.Get(), &value, sizeof(value)));
+        ASSERT_TRUE(ReadFull(activeFd.Get(), reinterpret_cast<char *>(&value), sizeof(value)));
+        EXPECT_EQ(i + 1, CppNet::Ntohll(value));
+        usleep(30 * 1000);
+    }
+
+    // 空闲连接被服务端关闭
+    char buf[8];
+    EXPECT_EQ(0, read(idleFd.Get(), buf, sizeof(buf)));
+    EXPECT_TRUE(WaitUntil([&]() { return server.CloseCount == 1; }, 1000));
+
+    usleep(200 * 1000);
+    EXPECT_EQ(0, read(activeFd.Get(), buf, sizeof(buf)));
+    EXPECT_TRUE(WaitUntil([&]() { return server.CloseCount == 2; }, 1000));
+}
+
+/** 收取报文直到收到count个或者超时
+ *
+ * @param   CppUdpSocket & sock
+ * @param   uint32_t count
+ * @param   vector<string> & datas      收到的数据
+ * @param   IpPortKey * pPeer           非NULL时返回最后一个报文的来源
+ * @retval  bool
+ * @author  moontan
+ */
+static bool RecvDatagrams(CppUdpSocket &sock, uint32_t count, vector<string> &datas, IpPortKey *pPeer = NULL)
+{
+    vector<CppUdpSocket::Datagram> datagrams;
+    uint64_t beginTime = CppTime::GetUTime();
+    while (datas.size() < count && CppTime::GetUTime() - beginTime < 1000 * 1000)
+    {
+        pollfd pfd = {sock.GetFd(), POLLIN, 0};
+        poll(&pfd, 1, 10);
+        if (sock.Recv(datagrams) < 0)
+        {
+            return false;
+        }
+
+        for (auto &datagram : datagrams)
+        {
+            datas.push_back(string(datagram.pData, datagram.Size));
+            if (pPeer != NULL)
+            {
+                *pPeer = datagram.Peer;
+            }
+        }
+    }
+
+    return datas.size() == count;
+}
+
+TEST(CppNet, UdpSocketTest)
+{
+    CppUdpSocket client(16);
+    CppUdpSocket server(64, 1500);
+    ASSERT_EQ(0, client.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+    ASSERT_EQ(0, server.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+    ASSERT_EQ(0, server.SetBufferSize(4 * 1024 * 1024, 0));
+    IpPortKey serverAddr = server.GetLocalAddr();
+    IpPortKey clientAddr = client.GetLocalAddr();
+    EXPECT_TRUE(serverAddr.IsIpv4());
+    EXPECT_NE(0, serverAddr.GetPort());
+
+    // 100个不同长度的报文，包括空报文，每16个一次sendmmsg
+    vector<string> sendDatas;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        sendDatas.push_back(string(i * 7 % 1400, (char)('a' + i % 26)));
+        ASSERT_EQ(0, client.Send(serverAddr, sendDatas.back().data(), sendDatas.back().size()));
+    }
+
+    EXPECT_EQ(100U % 16, client.GetPendingCount());
+    EXPECT_EQ(4, client.Flush());
+    EXPECT_EQ(0U, client.GetPendingCount());
+    EXPECT_EQ(100U / 16 + 1, client.GetSyscallCount());
+
+    vector<string> recvDatas;
+    IpPortKey peer;
+    ASSERT_TRUE(RecvDatagrams(server, 100, recvDatas, &peer));
+    EXPECT_EQ(sendDatas, recvDatas);
+    EXPECT_EQ(clientAddr, peer);
+    EXPECT_GT(50U, server.GetSyscallCount());
+
+    // 超过最大长度的报文被丢弃
+    string bigData(2000, 'x');
+    ASSERT_EQ(0, client.Send(serverAddr, bigData.data(), bigData.size()));
+    ASSERT_EQ(0, client.Send(serverAddr, "end", 3));
+    EXPECT_EQ(2, client.Flush());
+    recvDatas.clear();
+    ASSERT_TRUE(RecvDatagrams(server, 1, recvDatas));
+    EXPECT_EQ("end", recvDatas[0]);
+
+    // IPv4的socket不能发往IPv6
+    IpPortKey ipv6Addr;
+    ASSERT_TRUE(ipv6Addr.Parse("::1", serverAddr.GetPort()));
+    EXPECT_EQ(-EAFNOSUPPORT, client.Send(ipv6Addr, "a", 1));
+
+    // 双栈socket收到的IPv4来源和IPv4的键相同
+    CppUdpSocket dualServer;
+    if (dualServer.Open(IpPortKey()) == 0)
+    {
+        IpPortKey dualAddr(htonl(INADDR_LOOPBACK), dualServer.GetLocalAddr().GetPort());
+        ASSERT_EQ(0, client.Send(dualAddr, "dual", 4));
+        EXPECT_EQ(1, client.Flush());
+        recvDatas.clear();
+        ASSERT_TRUE(RecvDatagrams(dualServer, 1, recvDatas, &peer));
+        EXPECT_EQ("dual", recvDatas[0]);
+        EXPECT_EQ(clientAddr, peer);
+
+        // 双栈socket发往IPv4
+        ASSERT_EQ(0, dualServer.Send(clientAddr, "back", 4));
+        EXPECT_EQ(1, dualServer.Flush());
+        recvDatas.clear();
+        ASSERT_TRUE(RecvDatagrams(client, 1, recvDatas));
+        EXPECT_EQ("back", recvDatas[0]);
+    }
+
+    client.Close();
+    EXPECT_EQ(-EBADF, client.Send(serverAddr, "a", 1));
+}
+
+TEST(CppNet, UdpGsoGroTest)
+{
+    CppUdpSocket client(64);
+    CppUdpSocket server(64, 1500);
+    ASSERT_EQ(0, client.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+    ASSERT_EQ(0, server.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+    if (!client.EnableGso() || !server.EnableGro())
+    {
+        printf("kernel does not support UDP GSO/GRO, skip.\n");
+        return;
+    }
+
+    // 40个1000字节和一个500字节的报文合并成一个消息发送，之后发往另一个地址的报文单独一个消息
+    IpPortKey serverAddr = server.GetLocalAddr();
+    IpPortKey otherAddr(htonl(INADDR_LOOPBACK), client.GetLocalAddr().GetPort());
+    vector<string> sendDatas;
+    for (uint32_t i = 0; i < 41; ++i)
+    {
+        sendDatas.push_back(string(i == 40 ? 500 : 1000, (char)('a' + i % 26)));
+        ASSERT_EQ(0, client.Send(serverAddr, sendDatas.back().data(), sendDatas.back().size()));
+    }
+
+    ASSERT_EQ(0, client.Send(otherAddr, "self", 4));
+    EXPECT_EQ(42, client.Flush());
+    EXPECT_EQ(1U, client.GetSyscallCount());
+    EXPECT_TRUE(client.IsGsoEnabled());
+
+    // GRO合并的消息拆成原来的报文
+    vector<string> recvDatas;
+    ASSERT_TRUE(RecvDatagrams(server, 41, recvDatas));
+    EXPECT_EQ(sendDatas, recvDatas);
+
+    recvDatas.clear();
+    ASSERT_TRUE(RecvDatagrams(client, 1, recvDatas));
+    EXPECT_EQ("self", recvDatas[0]);
+}
+
+// UDP回显，可读时收取所有报文并原样发回
+class UdpEchoHandler
+{
+public:
+    UdpEchoHandler(CppUdpSocket &sock) : EchoCount(0), mSock(sock)
+    {
+    }
+
+    int32_t OnRead(epoll_event &event)
+    {
+        static_cast<void>(event);
+        int32_t ret;
+        while ((ret = mSock.Recv(mDatagrams)) > 0)
+        {
+            for (auto &datagram : mDatagrams)
+            {
+                mSock.Send(datagram.Peer, datagram.pData, datagram.Size);
+                ++EchoCount;
+            }
+        }
+
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        // 还有没发出的报文时切换到可写
+        return mSock.Flush() >= 0 && mSock.GetPendingCount() > 0 ? 0 : CppEpollManager::PROC_AGAIN;
+    }
+
+    int32_t OnWrite(epoll_event &event)
+    {
+        static_cast<void>(event);
+        mSock.Flush();
+        return mSock.GetPendingCount() > 0 ? CppEpollManager::PROC_AGAIN : 0;
+    }
+
+    void OnDelete(int fd)
+    {
+        static_cast<void>(fd);
+    }
+
+    uint32_t EchoCount;
+
+private:
+    CppUdpSocket &mSock;
+    vector<CppUdpSocket::Datagram> mDatagrams;
+};
+
+TEST(CppNet, UdpEpollTest)
+{
+    CppUdpSocket server;
+    CppUdpSocket client;
+    ASSERT_EQ(0, server.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+    ASSERT_EQ(0, client.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)));
+
+    CppEpollManager epollManager(10);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    epollManager.AddOrModFd(server.GetFd(), ev);
+    UdpEchoHandler handler(server);
+
+    const uint32_t COUNT = 500;
+    IpPortKey serverAddr = server.GetLocalAddr();
+    vector<string> recvDatas;
+    vector<CppUdpSocket::Datagram> datagrams;
+    for (uint32_t i = 0; i < COUNT; ++i)
+    {
+        string data = CppString::ToString(i);
+        ASSERT_EQ(0, client.Send(serverAddr, data.data(), data.size()));
+
+        // 每100个处理一次，期间服务端socket一直可读
+        if (i % 100 == 99)
+        {
+            client.Flush();
+            epollManager.Wait(handler, 10);
+            ASSERT_TRUE(RecvDatagrams(client, i + 1, recvDatas));
+        }
+    }
+
+    EXPECT_EQ(COUNT, handler.EchoCount);
+    ASSERT_EQ(COUNT, recvDatas.size());
+    for (uint32_t i = 0; i < COUNT; ++i)
+    {
+        EXPECT_EQ(CppString::ToString(i), recvDatas[i]);
+    }
+
+    // 回显使用批量发送，系统调用远少于报文数
+    EXPECT_GT(COUNT / 5, server.GetSyscallCount());
+}
+
+/*
+ * UDP批量收发压测，运行方法：
+ * ./MoonLibTest --gtest_also_run_disabled_tests --gtest_filter=CppNet.DISABLED_UdpBatchBenchmark
+ * 回环地址上单线程交替发送和接收一批报文，single为每个报文一次sendto/recvfrom，batch为CppUdpSocket，
+ * gso为发送端开启GSO、接收端开启GRO
+ * 结果（1核虚拟机，6.18内核，-O2，每批64个报文，每项3秒，跑3次，报文/秒）：
+ *  100字节：single[33W-38W]，batch[35W-37W]，gso[666W-774W]
+ *  1000字节：single[31W-35W]，batch[32W-39W]，gso[377W-457W]
+ *  回环上每个报文的耗时主要在协议栈，sendmmsg/recvmmsg只省掉系统调用本身，提升在10%以内；
+ *  GSO+GRO让一批报文只走一次协议栈，有10-20倍的提升，经过网卡时的效果取决于网卡是否支持分段卸载
+ */
+static double RunUdpBenchmark(uint32_t mode, uint32_t datagramSize, uint32_t runMs)
+{
+    const uint32_t BATCH_SIZE = 64;
+    CppUdpSocket client(BATCH_SIZE);
+    CppUdpSocket server(BATCH_SIZE);
+    if (client.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)) != 0 || server.Open(IpPortKey(htonl(INADDR_LOOPBACK), 0)) != 0)
+    {
+        return 0;
+    }
+
+    server.SetBufferSize(8 * 1024 * 1024, 0);
+    if (mode == 2 && (!client.EnableGso() || !server.EnableGro()))
+    {
+        return 0;
+    }
+
+    IpPortKey serverAddr = server.GetLocalAddr();
+    sockaddr_storage addr;
+    socklen_t addrLen = serverAddr.ToSockAddr(addr);
+    string data(datagramSize, 'x');
+    char buf[2048];
+    vector<CppUdpSocket::Datagram> datagrams;
+    uint64_t recvCount = 0;
+    uint64_t beginTime = CppTime::GetUTime();
+    uint64_t endTime = beginTime;
+    while (endTime - beginTime < runMs * 1000ULL)
+    {
+        for (uint32_t i = 0; i < BATCH_SIZE; ++i)
+        {
+            if (mode == 0)
+            {
+                sendto(client.GetFd(), data.data(), data.size(), 0, reinterpret_cast<sockaddr *>(&addr), addrLen);
+            }
+            else
+            {
+                client.Send(serverAddr, data.data(), data.size());
+            }
+        }
+
+        client.Flush();
+        if (mode == 0)
+        {
+            while (recvfrom(server.GetFd(), buf, sizeof(buf), 0, NULL, NULL) >= 0)
+            {
+                ++recvCount;
+            }
+        }
+        else
+        {
+            while (server.Recv(datagrams) > 0)
+            {
+                recvCount += datagrams.size();
+            }
+        }
+
+        endTime = CppTime::GetUTime();
+    }
+
+    return recvCount * 1000000.0 / (endTime - beginTime);
+}
+
+TEST(CppNet, DISABLED_UdpBatchBenchmark)
+{
+    const char *modes[] = {"single", "batch", "gso"};
+    printf("%-8s %-8s %14s\n", "mode", "size", "datagrams/sec");
+    for (uint32_t size : {100, 1000})
+    {
+        for (uint32_t mode = 0; mode < 3; ++mode)
+        {
+            printf("%-8s %-8u %14.0f\n", modes[mode], size, RunUdpBenchmark(mode, size, 3000));
+        }
+    }
+}
+
+TEST(CppNet, DISABLED_EpollTest)
+{
+    gServerStop = false;
+    MultiThreadServer multiServer;
+    PlusOneServer reactorServer(SERV_PORT, SERVER_THREAD_COUNT, false);
+    shared_ptr<thread> pServer;
+
+    // 创建一个服务端线程
+    if (SERVER_TYPE == MULTI_THREAD_SERVER)
+    {
+        pServer = make_shared<thread>(&MultiThreadServer::StartServer, &multiServer);
+    }
+    else if (SERVER_TYPE == REACTOR_SERVER)
+    {
+        gServerStart = reactorServer.Start() == 0;
+    }
+    else
+    {
+        pServer = make_shared<thread>(SingleThreadServer::StartServer);
+    }
+
+    // 忙等待服务端开启，TODO：可使用条件变量代替
+    while (!gServerStart)
+    {
+        usleep(10);
+    }
+
+    // 执行客户端线程，此处阻塞知道客户端全部退出
+    MultiThreadClient client(SERV_NAME, SERV_PORT, TOTAL_SECOND, CLIENT_THREAD_COUNT,
+                             CLIENT_COUNT_PER_THREAD, CLIENT_EPOLL_SIZE, &cppLog, CLIENT_EDGE_TRIGGERED);
+    client.SetPipelineDepth(CLIENT_PIPELINE_DEPTH);
+    client.SetOpenLoop(CLIENT_TARGET_QPS);
+    client.Run();
+
+    // 通知服务端停止
+    gServerStop = true;
+
+    // 等待线程返回
+    if (pServer)
+    {
+        pServer->join();
+    }
+
+    reactorServer.Stop();
+
+    DEBUG_LOG("Finished,totalSuccess[%llu],totalFail[%llu],successPercent[%.3f%].",
+              client.gSuccessCount, client.gFailCount,
+              (double)(client.gSuccessCount) / (client.gSuccessCount + client.gFailCount) * 100);
+}
+
+/*
+ * Redis压测工具，性能比redis-benchmark稍高点
+ * 性能数据：
+ *  本机测试（办公机虚拟机），redis-benchmark为22W，这个压测可达26W（非pipeline，纯PING）
+ **/
+class PressCallRedisClient :public MultiThreadClientBase
+{
+public:
+    PressCallRedisClient(const std::string &serverAddr, uint16_t serverPort,
+                         uint32_t runSecond, uint32_t clientThreadCount,
+                         uint32_t clientCountPerThread,
+                         uint32_t epollSize, CppLog *mpCppLog) :MultiThreadClientBase(
+                             serverAddr, serverPort, runSecond, clientThreadCount, clientCountPerThread,
+                             epollSize, mpCppLog)
+    {
+    }
+
+protected:
+    virtual bool CheckResponse(uint32_t threadId, int fd, const string &bufStr);
+    virtual const string GetSendData(uint32_t threadId, int fd);
+    virtual shared_ptr<PressCallClientDataBase> MakeNewClientData()
+    {
+        return make_shared<PressCallClientDataBase>();
+    }
+};
+
+bool PressCallRedisClient::CheckResponse(uint32_t threadId, int fd, const string &bufStr)
+{
+    static_cast<void>(threadId);
+    static_cast<void>(fd);
+    if (!bufStr.empty() && *bufStr.begin() == '+')
+    {
+        return true;
+    }
+
+    return false;
+}
+
+const string PressCallRedisClient::GetSendData(uint32_t threadId, int fd)
+{
+    static_cast<void>(threadId);
+    static_cast<void>(fd);
+    return "PING\r\n";
+}
+
+TEST(CppNet, DISABLED_PressCallRedis)
+{
+    PressCallRedisClient presscallRedisClient("127.0.0.1", 6379, TOTAL_SECOND, CLIENT_THREAD_COUNT,
+                                              CLIENT_COUNT_PER_THREAD, CLIENT_EPOLL_SIZE, &cppLog);
+    presscallRedisClient.SetPipelineDepth(CLIENT_PIPELINE_DEPTH);
+
+    // 按RESP协议切分回包，管道模式下需要
+    presscallRedisClient.SetFrameCodec(CppRespCodec());
     presscallRedisClient.Run();
 }
 
@@ -1,3 +1,5 @@
+#include <stdlib.h>
+
 #include <iostream>
 
 #include "gtest/gtest.h"
@@ -26,3 +28,39 @@ TEST(CppTime, IsSameDayTest)
     EXPECT_FALSE(CppTime::IsSameDay(CppTime::GetTimeFromStr("2013-07-08 00:01:02"), CppTime::GetTimeFromStr("2013-07-09 23:59:59")));
     EXPECT_TRUE(CppTime::IsSameDay(CppTime::GetTimeFromStr("2013-07-09 00:00:00"), CppTime::GetTimeFromStr("2013-07-09 23:59:59")));
 }
+
+TEST(CppTime, GetUTimeStrTest)
+{
+    char buf[CppTime::UTIME_STR_LEN + 1];
+    timeval timev = { 1373212862, 5 };
+    EXPECT_EQ(CppTime::UTIME_STR_LEN, CppTime::GetUTimeStr(buf, sizeof(buf), &timev));
+    EXPECT_EQ(CppTime::GetTimeStr(timev.tv_sec) + ".000005", buf);
+
+    // 同一秒内使用缓存，只更新微秒
+    timev.tv_usec = 999999;
+    CppTime::GetUTimeStr(buf, sizeof(buf), &timev);
+    EXPECT_EQ(CppTime::GetTimeStr(timev.tv_sec) + ".999999", buf);
+
+    // 秒数变化重新格式化
+    timev.tv_sec += 61;
+    timev.tv_usec = 123456;
+    CppTime::GetUTimeStr(buf, sizeof(buf), &timev);
+    EXPECT_EQ(CppTime::GetTimeStr(timev.tv_sec) + ".123456", buf);
+    EXPECT_EQ(string(buf), CppTime::GetUTimeStr(&timev));
+
+    // 缓冲区不足时截断
+    char shortBuf[11];
+    EXPECT_EQ(10U, CppTime::GetUTimeStr(shortBuf, sizeof(shortBuf), &timev));
+    EXPECT_EQ(CppTime::GetTimeStr(timev.tv_sec, "%Y-%m-%d"), shortBuf);
+}
+
+TEST(CppTime, GetTimeOfDayTest)
+{
+    timeval preciseTime;
+    timeval coarseTime;
+    CppTime::GetTimeOfDay(preciseTime);
+    CppTime::GetTimeOfDay(coarseTime, true);
+
+    // 粗粒度时钟精度为一个时钟节拍
+    EXPECT_LT(llabs(CppTime::TimevDiff(coarseTime, preciseTime)), 100000);
+}
@@ -0,0 +1,140 @@
+#include "CppHistogram.h"
+
+#include <cmath>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+CppHistogram::CppHistogram(uint64_t highestValue, uint32_t significantDigits) :
+    mHighestValue(max<uint64_t>(highestValue, 2)), mSignificantDigits(min(max(significantDigits, 1U), 5U)),
+    mTotalCount(0), mMin(0), mMax(0), mSum(0)
+{
+    // 每段的子桶数至少为2*10^significantDigits，保证段内的相对误差，向上取整到2的幂次
+    uint64_t largestValueWithSingleUnitResolution = 2 * (uint64_t)pow(10, mSignificantDigits);
+    uint32_t subBucketCountMagnitude = (uint32_t)ceil(log2((double)largestValueWithSingleUnitResolution));
+    mSubBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+    mSubBucketHalfCount = 1U << mSubBucketHalfCountMagnitude;
+    uint64_t subBucketCount = 1ULL << subBucketCountMagnitude;
+    mSubBucketMask = subBucketCount - 1;
+
+    // 计算覆盖最大值需要的段数，第一段包含全部子桶，之后每段只用后一半子桶
+    uint32_t bucketCount = 1;
+    uint64_t smallestUntrackableValue = subBucketCount;
+    while (smallestUntrackableValue <= mHighestValue && smallestUntrackableValue <= (UINT64_MAX >> 1))
+    {
+        smallestUntrackableValue <<= 1;
+        ++bucketCount;
+    }
+
+    mCounts.resize((bucketCount + 1) * mSubBucketHalfCount, 0);
+}
+
+uint32_t CppHistogram::GetCountsIndex(uint64_t value) const
+{
+    uint32_t pow2Ceiling = 64 - __builtin_clzll(value | mSubBucketMask);
+    uint32_t bucketIndex = pow2Ceiling - (mSubBucketHalfCountMagnitude + 1);
+    uint32_t subBucketIndex = (uint32_t)(value >> bucketIndex);
+    return ((bucketIndex + 1) << mSubBucketHalfCountMagnitude) + subBucketIndex - mSubBucketHalfCount;
+}
+
+uint64_t CppHistogram::GetValueFromIndex(uint32_t index) const
+{
+    int32_t bucketIndex = (int32_t)(index >> mSubBucketHalfCountMagnitude) - 1;
+    uint64_t subBucketIndex = (index & (mSubBucketHalfCount - 1)) + mSubBucketHalfCount;
+    if (bucketIndex < 0)
+    {
+        subBucketIndex -= mSubBucketHalfCount;
+        bucketIndex = 0;
+    }
+
+    // 返回子桶内的最大等价值
+    return (subBucketIndex << bucketIndex) + (1ULL << bucketIndex) - 1;
+}
+
+void CppHistogram::Record(uint64_t value, uint64_t count)
+{
+    value = min(value, mHighestValue);
+    mCounts[GetCountsIndex(value)] += count;
+
+    if (mTotalCount == 0 || value < mMin)
+    {
+        mMin = value;
+    }
+
+    if (value > mMax)
+    {
+        mMax = value;
+    }
+
+    mTotalCount += count;
+    mSum += value * count;
+}
+
+bool CppHistogram::Merge(const CppHistogram &other)
+{
+    if (other.mHighestValue != mHighestValue || other.mSignificantDigits != mSignificantDigits)
+    {
+        return false;
+    }
+
+    if (other.mTotalCount == 0)
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < mCounts.size(); ++i)
+    {
+        mCounts[i] += other.mCounts[i];
+    }
+
+    if (mTotalCount == 0 || other.mMin < mMin)
+    {
+        mMin = other.mMin;
+    }
+
+    mMax = max(mMax, other.mMax);
+    mTotalCount += other.mTotalCount;
+    mSum += other.mSum;
+
+    return true;
+}
+
+void CppHistogram::Reset()
+{
+    if (mTotalCount == 0)
+    {
+        return;
+    }
+
+    std::fill(mCounts.begin(), mCounts.end(), 0);
+    mTotalCount = 0;
+    mMin = 0;
+    mMax = 0;
+    mSum = 0;
+}
+
+uint64_t CppHistogram::GetValueAtPercentile(double percentile) const
+{
+    if (mTotalCount == 0)
+    {
+        return 0;
+    }
+
+    percentile = min(max(percentile, 0.0), 100.0);
+    uint64_t countAtPercentile = (uint64_t)ceil(percentile / 100 * mTotalCount);
+    countAtPercentile = max<uint64_t>(countAtPercentile, 1);
+
+    uint64_t totalToCurrentIndex = 0;
+    for (uint32_t i = 0; i < mCounts.size(); ++i)
+    {
+        totalToCurrentIndex += mCounts[i];
+        if (totalToCurrentIndex >= countAtPercentile)
+        {
+            // 子桶的最大等价值可能超过实际记录的最大值
+            return min(GetValueFromIndex(i), mMax);
+        }
+    }
+
+    return mMax;
+}
@@ -0,0 +1,107 @@
+#ifndef _CPP_HISTOGRAM_H_
+#define _CPP_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+// HDR直方图，用于统计耗时等数值的分布
+//  按2的幂次分段，每段内线性分成相同数量的子桶，保证任意值的相对误差不超过10^-significantDigits，
+//  内存只与最大值的位数和精度有关，记录为O(1)，适合在压测中记录每个请求的耗时后计算分位数
+//  非线程安全，多线程时每个线程使用自己的直方图，再用Merge合并
+class CppHistogram
+{
+public:
+    /** 构造函数
+     *
+     * @param   uint64_t highestValue           可记录的最大值，超过的值按最大值记录
+     * @param   uint32_t significantDigits      有效数字位数，1-5
+     * @author  moontan
+     */
+    CppHistogram(uint64_t highestValue = 3600ULL * 1000 * 1000, uint32_t significantDigits = 3);
+
+    /** 记录一个值
+     *
+     * @param   uint64_t value
+     * @param   uint64_t count      记录的次数
+     * @retval  void
+     * @author  moontan
+     */
+    void Record(uint64_t value, uint64_t count = 1);
+
+    /** 合并另一个直方图，两个直方图的最大值和精度必须相同
+     *
+     * @param   const CppHistogram & other
+     * @retval  bool        参数不一致时返回false
+     * @author  moontan
+     */
+    bool Merge(const CppHistogram &other);
+
+    /** 清空所有记录
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Reset();
+
+    /** 获取分位数对应的值，返回的是所在子桶的最大等价值
+     *
+     * @param   double percentile       百分位，如99.9
+     * @retval  uint64_t                没有记录时返回0
+     * @author  moontan
+     */
+    uint64_t GetValueAtPercentile(double percentile) const;
+
+    uint64_t GetTotalCount() const
+    {
+        return mTotalCount;
+    }
+
+    uint64_t GetMin() const
+    {
+        return mTotalCount == 0 ? 0 : mMin;
+    }
+
+    uint64_t GetMax() const
+    {
+        return mMax;
+    }
+
+    uint64_t GetSum() const
+    {
+        return mSum;
+    }
+
+    double GetMean() const
+    {
+        return mTotalCount == 0 ? 0 : (double)mSum / mTotalCount;
+    }
+
+    uint64_t GetHighestValue() const
+    {
+        return mHighestValue;
+    }
+
+    uint32_t GetSignificantDigits() const
+    {
+        return mSignificantDigits;
+    }
+
+private:
+    uint32_t GetCountsIndex(uint64_t value) const;
+    uint64_t GetValueFromIndex(uint32_t index) const;
+
+    uint64_t mHighestValue;
+    uint32_t mSignificantDigits;
+    uint32_t mSubBucketHalfCountMagnitude;      // 每段子桶数的一半的2的幂次
+    uint32_t mSubBucketHalfCount;
+    uint64_t mSubBucketMask;
+
+    std::vector<uint64_t> mCounts;
+    uint64_t mTotalCount;
+    uint64_t mMin;
+    uint64_t mMax;
+    uint64_t mSum;
+};
+
+#endif
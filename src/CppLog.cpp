@@ -1,133 +1,2030 @@
 #include "CppLog.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <zlib.h>
 #ifndef __CYGWIN__
 #include <execinfo.h>
 #endif
 #include <cxxabi.h>
+#include <dlfcn.h>
 
+#include <cerrno>
+#include <cstdarg>
 #include <cstdlib>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <unordered_map>
 
-#include "CppFile.h"
 #include "CppArray.h"
 
 using namespace std;
 
-void CppLog::LogMsg(const string &msg)
+// 单生产者单消费者环形缓冲区，生产者为写日志的线程，消费者为异步写线程
+// 每条记录为RecordHead+日志内容，按8字节对齐，记录可以跨越缓冲区末尾
+class CppLogRing
 {
+public:
+    struct RecordHead
+    {
+        uint64_t TimeUs;                        // 写日志的时间，用于合并排序
+        uint32_t Len;                           // 日志内容长度
+        uint32_t Reserved;
+    };
+
+    struct Entry
+    {
+        uint64_t TimeUs;
+        size_t Offset;                          // 在Drain的输出缓冲区中的偏移
+        uint32_t Len;
+    };
+
+    explicit CppLogRing(uint32_t size) : mWriting(false), mClosed(false), mBuf(size), mMask(size - 1), mCachedHead(0), mHead(0), mTail(0)
+    {
+    }
+
+    static uint64_t RecordSize(uint32_t len)
+    {
+        return (sizeof(RecordHead) + len + 7) & ~static_cast<uint64_t>(7);
+    }
+
+    uint64_t Capacity() const
+    {
+        // 关闭时mBuf会被消费者释放，不能读取mBuf.size()
+        return mMask + 1;
+    }
+
+    uint64_t Used() const
+    {
+        return mTail.load(memory_order_relaxed) - mHead.load(memory_order_relaxed);
+    }
+
+    bool Empty() const
+    {
+        return mTail.load(memory_order_acquire) == mHead.load(memory_order_relaxed);
+    }
+
+    /** 生产者写入一条日志，空间不够返回false
+     *
+     * @param   uint64_t timeUs
+     * @param   const char * msg
+     * @param   size_t msgLen
+     * @param   bool newline        是否在末尾追加换行
+     * @retval  bool
+     * @author  moon
+     */
+    bool Push(uint64_t timeUs, const char *msg, size_t msgLen, bool newline)
+    {
+        uint32_t len = msgLen + (newline ? 1 : 0);
+        uint64_t recordSize = RecordSize(len);
+        uint64_t tail = mTail.load(memory_order_relaxed);
+        if (tail + recordSize - mCachedHead > mBuf.size())
+        {
+            mCachedHead = mHead.load(memory_order_acquire);
+            if (tail + recordSize - mCachedHead > mBuf.size())
+            {
+                return false;
+            }
+        }
+
+        RecordHead head = { timeUs, len, 0 };
+        CopyIn(tail, &head, sizeof(head));
+        CopyIn(tail + sizeof(head), msg, msgLen);
+        if (newline)
+        {
+            mBuf[(tail + sizeof(head) + msgLen) & mMask] = '\n';
+        }
+
+        mTail.store(tail + recordSize, memory_order_release);
+        return true;
+    }
+
+    /** 消费者取出所有日志，内容追加到out，位置追加到entries
+     *
+     * @param   string & out
+     * @param   vector<Entry> & entries
+     * @retval  void
+     * @author  moon
+     */
+    void Drain(string &out, vector<Entry> &entries)
+    {
+        uint64_t head = mHead.load(memory_order_relaxed);
+        uint64_t tail = mTail.load(memory_order_acquire);
+        while (head < tail)
+        {
+            RecordHead recordHead;
+            CopyOut(head, &recordHead, sizeof(recordHead));
+
+            Entry entry = { recordHead.TimeUs, out.size(), recordHead.Len };
+            out.resize(out.size() + recordHead.Len);
+            CopyOut(head + sizeof(recordHead), &out[entry.Offset], recordHead.Len);
+            entries.push_back(entry);
+
+            head += RecordSize(recordHead.Len);
+        }
+
+        mHead.store(head, memory_order_release);
+    }
+
+    /** 消费者在停止异步模式时关闭缓冲区：之后生产者不再写入，等待正在进行的写入完成后取出剩余日志并释放内存
+     *
+     * @param   string & out
+     * @param   vector<Entry> & entries
+     * @retval  void
+     * @author  moon
+     */
+    void Close(string &out, vector<Entry> &entries)
+    {
+        mClosed = true;
+        while (mWriting)
+        {
+            this_thread::yield();
+        }
+
+        Drain(out, entries);
+        vector<char>().swap(mBuf);
+    }
+
+    atomic<bool> mWriting;                      // 生产者正在写入，关闭时需要等待
+    atomic<bool> mClosed;                       // 已经关闭，生产者先设置mWriting再检查
+
+private:
+    void CopyIn(uint64_t pos, const void *data, size_t len)
+    {
+        size_t offset = pos & mMask;
+        size_t firstLen = min(len, mBuf.size() - offset);
+        memcpy(&mBuf[offset], data, firstLen);
+        memcpy(&mBuf[0], static_cast<const char *>(data) + firstLen, len - firstLen);
+    }
+
+    void CopyOut(uint64_t pos, void *data, size_t len) const
+    {
+        size_t offset = pos & mMask;
+        size_t firstLen = min(len, mBuf.size() - offset);
+        memcpy(data, &mBuf[offset], firstLen);
+        memcpy(static_cast<char *>(data) + firstLen, &mBuf[0], len - firstLen);
+    }
+
+    vector<char> mBuf;
+    const uint64_t mMask;
+    uint64_t mCachedHead;                       // 生产者缓存的mHead，减少对消费者缓存行的访问
+    char mPad1[64];
+    atomic<uint64_t> mHead;                     // 消费者读取位置
+    char mPad2[64];
+    atomic<uint64_t> mTail;                     // 生产者写入位置
+    char mPad3[64];
+};
+
+atomic<uint64_t> CppLog::sInstanceCount(0);
+atomic<uint32_t> CppLog::sSiteCount(0);
+atomic<uint64_t> CppLog::sLevelGeneration(0);
+atomic<CppLog *> CppLog::sSignalTraceLog(NULL);
+const uint32_t CppLog::DEFAULT_QUEUE_BYTES;
+const uint32_t CppLog::DEFAULT_RING_BYTES;
+
+static const char BINARY_MAGIC[] = "CPPLOGB1";             // 二进制日志会话开始记录的内容
+static const size_t BINARY_RECORD_HEAD_SIZE = 5;            // 记录头：uint32_t记录总长度 + uint8_t记录类型
+
+// 线程的二进制日志编码缓冲区
+static string &ThreadBinaryBuf()
+{
+    static thread_local string buf;
+    return buf;
+}
+
+static const char *LOG_LEVEL_NAMES[] = { "TRACE", "DEBUG", "INFOR", "WARNN", "ERROR" };
+
+// 单调时钟，微秒
+static uint64_t GetMonotonicUs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+bool CppLogLimiter::EveryMs(uint64_t ms)
+{
+    uint64_t nowUs = GetMonotonicUs();
+    uint64_t lastUs = mTimeUs.load(memory_order_relaxed);
+    if ((lastUs != 0 && nowUs < lastUs + ms * 1000) || !mTimeUs.compare_exchange_strong(lastUs, nowUs, memory_order_relaxed))
+    {
+        mSuppressed.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+bool CppLogLimiter::Allow(uint32_t ratePerSec, uint32_t burst)
+{
+    if (ratePerSec == 0)
+    {
+        return true;
+    }
+
+    // 每条日志使理论到达时间后移interval，理论到达时间超前当前时间不超过tolerance时可以记录
+    uint64_t nowUs = GetMonotonicUs();
+    uint64_t intervalUs = max(1000000U / ratePerSec, 1U);
+    uint64_t toleranceUs = intervalUs * (burst > 0 ? burst - 1 : 0);
+    uint64_t tatUs = mTimeUs.load(memory_order_relaxed);
+    while (true)
+    {
+        uint64_t beginUs = max(tatUs, nowUs);
+        if (beginUs - nowUs > toleranceUs)
+        {
+            mSuppressed.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+
+        if (mTimeUs.compare_exchange_weak(tatUs, beginUs + intervalUs, memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+}
+
+const char *CppLog::GetLevelName(LOG_LEVEL logLevel)
+{
+    return static_cast<uint32_t>(logLevel) < ARRAY_SIZE(LOG_LEVEL_NAMES) ? LOG_LEVEL_NAMES[logLevel] : "UNKNW";
+}
+
+uint64_t CppLog::UpdateSiteLevel(CppLogSite &site)
+{
+    // 先取版本再取设置，设置在版本更新之前修改，取到新版本就一定能取到新设置
+    uint64_t levelGeneration = mLevelGeneration.load(memory_order_acquire);
+    LOG_LEVEL logLevel = mLogLevel;
+    uint32_t siteLevel = logLevel;
+    if (mSignalTrace)
+    {
+        siteLevel = TRACE;
+    }
+    else
+    {
+        // 先登记再取快照，修改的线程发布新快照后看到没有读者，就不会再有线程读取旧快照
+        ++mModuleLevelReaders;
+
+        // 模块数量很少，直接比较，不构造std::string
+        const ModuleLevels *pModuleLevels = mModuleLevels.load();
+        for (auto &moduleLevel : *pModuleLevels)
+        {
+            if (strcmp(moduleLevel.first.c_str(), site.mModule) == 0)
+            {
+                siteLevel = moduleLevel.second;
+                break;
+            }
+        }
+
+        --mModuleLevelReaders;
+    }
+
+    uint64_t levelCache = (levelGeneration << 16) | (static_cast<uint64_t>(logLevel) << 8) | siteLevel;
+    site.mLevelCaches[mLevelSlot].store(levelCache, memory_order_relaxed);
+    return levelCache;
+}
+
+void CppLog::PublishModuleLevels(ModuleLevels *pModuleLevels)
+{
+    mModuleLevelSnapshots.push_back(unique_ptr<const ModuleLevels>(pModuleLevels));
+    mModuleLevels.store(pModuleLevels);
+
+    // 有读者时旧快照留到下一次修改，读者只在级别版本变化后更新缓存时短暂读取
+    if (mModuleLevelReaders.load() == 0)
+    {
+        mModuleLevelSnapshots.erase(mModuleLevelSnapshots.begin(), mModuleLevelSnapshots.end() - 1);
+    }
+}
+
+void CppLog::SetLogLevel(LOG_LEVEL logLevel)
+{
+    mLogLevel = logLevel;
+    mLevelGeneration.store(++sLevelGeneration, memory_order_release);
+}
+
+void CppLog::SetModuleLevel(const string &module, LOG_LEVEL logLevel)
+{
+    {
+        lock_guard<mutex> lock(mLevelLock);
+        ModuleLevels *pModuleLevels = new ModuleLevels(*mModuleLevels.load(memory_order_relaxed));
+        (*pModuleLevels)[module] = logLevel;
+        PublishModuleLevels(pModuleLevels);
+    }
+
+    mLevelGeneration.store(++sLevelGeneration, memory_order_release);
+}
+
+void CppLog::ClearModuleLevel(const string &module /*= ""*/)
+{
+    {
+        lock_guard<mutex> lock(mLevelLock);
+        ModuleLevels *pModuleLevels = new ModuleLevels();
+        if (!module.empty())
+        {
+            *pModuleLevels = *mModuleLevels.load(memory_order_relaxed);
+            pModuleLevels->erase(module);
+        }
+
+        PublishModuleLevels(pModuleLevels);
+    }
+
+    mLevelGeneration.store(++sLevelGeneration, memory_order_release);
+}
+
+void CppLog::SignalTraceHandler(int signum)
+{
+    static_cast<void>(signum);
+
+    // 只使用无锁的原子操作，可以在信号处理函数中调用
+    CppLog *pCppLog = sSignalTraceLog.load();
+    if (pCppLog != NULL)
+    {
+        pCppLog->mSignalTrace = !pCppLog->mSignalTrace;
+        pCppLog->mLevelGeneration.store(++sLevelGeneration, memory_order_release);
+    }
+}
+
+void CppLog::EnableSignalTrace(CppLog *pCppLog, int signum /*= SIGUSR1*/)
+{
+    sSignalTraceLog = pCppLog;
+    signal(signum, pCppLog == NULL ? SIG_DFL : &CppLog::SignalTraceHandler);
+}
+
+size_t CppLog::FormatLogPrefix(char *buf, const timeval &now, LOG_LEVEL logLevel, const char *location, size_t maxLocationLen)
+{
+    // 前缀："[时间][级别]位置|"
+    size_t len = 0;
+    buf[len++] = '[';
+    len += CppTime::GetUTimeStr(buf + len, CppTime::UTIME_STR_LEN + 1, &now);
+    buf[len++] = ']';
+    buf[len++] = '[';
+    memcpy(buf + len, GetLevelName(logLevel), 5);
+    len += 5;
+    buf[len++] = ']';
+    size_t locationLen = min(strlen(location), maxLocationLen);
+    memcpy(buf + len, location, locationLen);
+    len += locationLen;
+    buf[len++] = '|';
+    return len;
+}
+
+void CppLog::LogStackTrace(LOG_LEVEL logLevel, const char *location, const CppStackTrace &stackTrace)
+{
+    if (!mLogFile.empty() && mMaxFileCount == 0)
+    {
+        return;
+    }
+
+    timeval now;
+    CppTime::GetTimeOfDay(now, mCoarseClock);
+    PendingStackTrace pendingStackTrace = { CppTime::Timev2Uint(now), logLevel, location, stackTrace, 0, 0 };
+    if (mAsyncRunning)
+    {
+        unique_lock<mutex> lock(mAsyncLock);
+        if (mAsyncRunning)
+        {
+            // 记下当前队列的末尾，写线程把调用栈插在这里，保持与前后日志的顺序
+            if (!mAsyncBlocks.empty())
+            {
+                pendingStackTrace.BlockIndex = mAsyncBlocks.size() - 1;
+                pendingStackTrace.BlockOffset = mAsyncBlocks.back().size();
+            }
+
+            // 按1个字节计入待写入的数据，使Flush能够等到调用栈写入
+            mStackTraces.push_back(pendingStackTrace);
+            ++mAsyncPendingBytes;
+            ++mAsyncCommitBytes;
+            if (logLevel >= WARNN)
+            {
+                mAsyncUrgent = true;
+                mAsyncWriterCond.notify_one();
+            }
+
+            return;
+        }
+    }
+
+    string out;
+    FormatStackTrace(pendingStackTrace, out);
+    if (mBinary && !mLogFile.empty())
+    {
+        WriteLog(out.data(), out.size(), logLevel, false);
+    }
+    else
+    {
+        // 去掉最后的换行
+        WriteLog(out.data(), out.size() - 1, logLevel, true);
+    }
+}
+
+void CppLog::FormatStackTrace(const PendingStackTrace &stackTrace, string &out)
+{
+    size_t begin = out.size();
+    bool binary = mBinary && !mLogFile.empty();
+    if (binary)
+    {
+        AppendValue<uint32_t>(out, 0);
+        out.push_back(BINARY_TEXT);
+    }
+
+    char prefix[CppTime::UTIME_STR_LEN + 1024];
+    timeval logTime = CppTime::Uint2Timev(stackTrace.TimeUs);
+    out.append(prefix, FormatLogPrefix(prefix, logTime, stackTrace.Level, stackTrace.Location, 1000));
+    out += "stack trace:\n";
+    out += stackTrace.StackTrace.ToString();
+    if (binary)
+    {
+        // 文本记录不包括最后的换行
+        out.resize(out.size() - 1);
+        uint32_t recordLen = out.size() - begin;
+        memcpy(&out[begin], &recordLen, sizeof(recordLen));
+    }
+}
+
+void CppLog::LogFormat(LOG_LEVEL logLevel, const char *location, const char *format, ...)
+{
+    // 一般的日志都能放进线程的固定缓冲区，超长的日志使用线程的string，只在变长时申请内存
+    static const size_t LOG_BUF_SIZE = 16 * 1024;
+    static thread_local char buf[LOG_BUF_SIZE];
+    static thread_local string longBuf;
+
+    timeval now;
+    CppTime::GetTimeOfDay(now, mCoarseClock);
+    size_t len = FormatLogPrefix(buf, now, logLevel, location, LOG_BUF_SIZE / 2);
+
+    va_list args;
+    va_start(args, format);
+    int msgLen = vsnprintf(buf + len, LOG_BUF_SIZE - len, format, args);
+    va_end(args);
+    if (msgLen < 0)
+    {
+        msgLen = 0;
+    }
+
+    if (len + msgLen < LOG_BUF_SIZE)
+    {
+        LogMsg(buf, len + msgLen, logLevel);
+        return;
+    }
+
+    longBuf.resize(len + msgLen + 1);
+    memcpy(&longBuf[0], buf, len);
+    va_start(args, format);
+    vsnprintf(&longBuf[len], msgLen + 1, format, args);
+    va_end(args);
+    LogMsg(longBuf.data(), len + msgLen, logLevel);
+}
+
+void CppLog::LogMsg(const string &msg, LOG_LEVEL logLevel /*= TRACE*/)
+{
+    LogMsg(msg.data(), msg.size(), logLevel);
+}
+
+void CppLog::LogMsg(const char *msg, size_t len, LOG_LEVEL logLevel)
+{
+    if (mBinary && !mLogFile.empty())
+    {
+        // 二进制模式下已经格式化的日志作为文本记录写入
+        string &buf = ThreadBinaryBuf();
+        buf.clear();
+        AppendValue<uint32_t>(buf, 0);
+        buf.push_back(BINARY_TEXT);
+        buf.append(msg, len);
+        EndBinaryRecord(buf, logLevel);
+        return;
+    }
+
+    WriteLog(msg, len, logLevel, true);
+}
+
+void CppLog::WriteLog(const char *data, size_t len, LOG_LEVEL logLevel, bool newline)
+{
+    // 如果最大文件数量为0，则不记录
+    if (!mLogFile.empty() && mMaxFileCount == 0)
+    {
+        return;
+    }
+
+    if (mAsyncRunning && mAsyncMode == ASYNC_THREAD_RING)
+    {
+        if (RingAppend(data, len, logLevel, newline))
+        {
+            return;
+        }
+    }
+    else if (mAsyncRunning)
+    {
+        unique_lock<mutex> lock(mAsyncLock);
+        size_t recordLen = len + (newline ? 1 : 0);
+        if (mAsyncBlocks.empty() || mAsyncBlocks.back().size() + recordLen > mAsyncBlockSize)
+        {
+            // 缓存满了，等待写线程写入
+            mAsyncProducerCond.wait(lock, [this] { return mAsyncBlocks.size() < mAsyncMaxBlocks || mAsyncStop; });
+        }
+
+        // 等待期间写线程可能已经退出，退回同步模式
+        if (mAsyncRunning)
+        {
+            if (mAsyncBlocks.empty() || mAsyncBlocks.back().size() + recordLen > mAsyncBlockSize)
+            {
+                if (mAsyncFreeBlocks.empty())
+                {
+                    mAsyncBlocks.push_back(string());
+                    mAsyncBlocks.back().reserve(mAsyncBlockSize);
+                }
+                else
+                {
+                    mAsyncBlocks.push_back(std::move(mAsyncFreeBlocks.back()));
+                    mAsyncFreeBlocks.pop_back();
+                }
+            }
+
+            string &block = mAsyncBlocks.back();
+            block.append(data, len);
+            if (newline)
+            {
+                block.push_back('\n');
+            }
+
+            mAsyncPendingBytes += recordLen;
+            mAsyncCommitBytes += recordLen;
+
+            if (logLevel >= WARNN)
+            {
+                mAsyncUrgent = true;
+                mAsyncWriterCond.notify_one();
+            }
+            else if (mAsyncPendingBytes >= mAsyncBlockSize)
+            {
+                mAsyncWriterCond.notify_one();
+            }
+
+            return;
+        }
+    }
+
     if (mLogFile.empty())
     {
-        cout << msg << endl;
-        return;
+        cout.write(data, len);
+        if (newline)
+        {
+            cout << endl;
+        }
+
+        return;
+    }
+
+    lock_guard<mutex> lock(mFileLock);
+    PrepareLogFile(time(NULL));
+    if (mLogFd >= 0)
+    {
+        iovec iov[2] = { { const_cast<char *>(data), len }, { const_cast<char *>("\n"), 1 } };
+        ssize_t ret = writev(mLogFd, iov, newline ? 2 : 1);
+        if (ret > 0)
+        {
+            mLogFileSize += ret;
+        }
+    }
+}
+
+// 文件扩展名（包括"."）的位置，没有扩展名时为文件名长度
+static string::size_type GetExtIndex(const string &file)
+{
+    string::size_type slashIndex = file.rfind('/');
+    string::size_type dotIndex = file.rfind('.');
+    if (dotIndex == string::npos || (slashIndex != string::npos && dotIndex < slashIndex))
+    {
+        return file.size();
+    }
+
+    return dotIndex;
+}
+
+// 在文件名的扩展名之前插入字符串，如/tmp/log.txt插入1为/tmp/log1.txt
+static string InsertBeforeExt(const string &file, const string &str)
+{
+    string result(file);
+    result.insert(GetExtIndex(file), str);
+    return result;
+}
+
+// 使用gzip压缩srcFile为dstFile，成功后删除srcFile
+static int32_t GzipFile(const string &srcFile, const string &dstFile)
+{
+    int srcFd = open(srcFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (srcFd < 0)
+    {
+        return -1;
+    }
+
+    gzFile dst = gzopen(dstFile.c_str(), "wb");
+    if (dst == NULL)
+    {
+        close(srcFd);
+        return -1;
+    }
+
+    int32_t ret = 0;
+    char buf[64 * 1024];
+    ssize_t readSize;
+    while ((readSize = read(srcFd, buf, sizeof(buf))) != 0)
+    {
+        if (readSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            ret = -1;
+            break;
+        }
+
+        if (gzwrite(dst, buf, readSize) != readSize)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    close(srcFd);
+    if (gzclose(dst) != Z_OK || ret != 0)
+    {
+        unlink(dstFile.c_str());
+        return -1;
+    }
+
+    unlink(srcFile.c_str());
+    return 0;
+}
+
+// 轮转出来的文件移动到dstFile，需要压缩时压缩为dstFile.gz，压缩失败时不压缩
+static void MoveRotatedFile(const string &srcFile, const string &dstFile, bool compress)
+{
+    if (compress && GzipFile(srcFile, dstFile + ".gz") == 0)
+    {
+        return;
+    }
+
+    rename(srcFile.c_str(), dstFile.c_str());
+}
+
+void CppLog::PrepareLogFile(time_t now)
+{
+    // 每秒检查一次文件是否被删除或者移走（如被logrotate处理），是则重新打开
+    if (mLogFd >= 0 && now != mLogCheckTime)
+    {
+        mLogCheckTime = now;
+        struct stat fileStat;
+        if (stat(mLogFile.c_str(), &fileStat) != 0 || fileStat.st_ino != mLogInode)
+        {
+            CloseLogFile();
+        }
+    }
+
+    if (mLogFd < 0)
+    {
+        OpenLogFile(now);
+    }
+
+    // 刚打开的已有文件也可能需要轮转
+    if (mLogFd >= 0 && ((mMaxFileSize > 0 && mLogFileSize >= mMaxFileSize) || (mRotatePeriod != ROTATE_NONE && now >= mLogPeriodEnd)))
+    {
+        RotateLogFile(now);
+    }
+
+    if (mLogFd >= 0 && mBinaryHeadPending.exchange(false))
+    {
+        mLogFileSize += WriteBinaryHead(mLogFd);
+    }
+}
+
+void CppLog::OpenLogFile(time_t now)
+{
+    mLogFd = open(mLogFile.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (mLogFd < 0)
+    {
+        return;
+    }
+
+    struct stat fileStat;
+    if (fstat(mLogFd, &fileStat) != 0)
+    {
+        memset(&fileStat, 0, sizeof(fileStat));
+    }
+
+    mLogFileSize = fileStat.st_size;
+    mLogInode = fileStat.st_ino;
+    mLogCheckTime = now;
+    mBinaryHeadPending = mBinary;
+
+    // 已有内容的文件属于最后修改时间所在的时段
+    time_t periodTime = mLogFileSize > 0 && fileStat.st_mtime < now ? fileStat.st_mtime : now;
+    tm periodTm;
+    localtime_r(&periodTime, &periodTm);
+    periodTm.tm_min = 0;
+    periodTm.tm_sec = 0;
+    periodTm.tm_isdst = -1;
+    if (mRotatePeriod == ROTATE_DAILY)
+    {
+        periodTm.tm_hour = 0;
+    }
+
+    char periodName[32];
+    strftime(periodName, sizeof(periodName), mRotatePeriod == ROTATE_DAILY ? "%Y%m%d" : "%Y%m%d%H", &periodTm);
+    mLogPeriodName = periodName;
+    if (mRotatePeriod == ROTATE_DAILY)
+    {
+        ++periodTm.tm_mday;
+    }
+    else
+    {
+        ++periodTm.tm_hour;
+    }
+
+    mLogPeriodEnd = mktime(&periodTm);
+}
+
+void CppLog::CloseLogFile()
+{
+    if (mLogFd >= 0)
+    {
+        close(mLogFd);
+        mLogFd = -1;
+    }
+}
+
+void CppLog::RotateLogFile(time_t now)
+{
+    CloseLogFile();
+
+    // 只改名一次，后续的循环更名、压缩和清理交给后台线程
+    string rotatingFile = mLogFile + "." + CppString::ToString(getpid()) + "_" + CppString::ToString(++mRotateSeq) + ".rotating";
+    if (rename(mLogFile.c_str(), rotatingFile.c_str()) == 0)
+    {
+        RotateJob job = { rotatingFile, mRotatePeriod == ROTATE_NONE ? string() : mLogPeriodName, mRotateCompress, mMaxFileCount };
+        {
+            unique_lock<mutex> lock(mRotateLock);
+            if (!mRotateThread.joinable())
+            {
+                mRotateStop = false;
+                mRotateThread = thread(&CppLog::RotateThread, this);
+            }
+
+            mRotateJobs.push_back(job);
+        }
+
+        mRotateCond.notify_all();
+    }
+
+    OpenLogFile(now);
+}
+
+void CppLog::RotateThread()
+{
+    vector<RotateJob> jobs;
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(mRotateLock);
+            mRotateCond.wait(lock, [this] { return mRotateStop || !mRotateJobs.empty(); });
+            if (mRotateJobs.empty())
+            {
+                break;
+            }
+
+            jobs.swap(mRotateJobs);
+            mRotateBusy = true;
+        }
+
+        for (auto &job : jobs)
+        {
+            if (job.PeriodName.empty())
+            {
+                RotateLogFiles(job);
+            }
+            else
+            {
+                RotatePeriodFiles(job);
+            }
+        }
+
+        jobs.clear();
+        {
+            unique_lock<mutex> lock(mRotateLock);
+            mRotateBusy = false;
+        }
+
+        mRotateCond.notify_all();
+    }
+}
+
+void CppLog::RotateLogFiles(const RotateJob &job)
+{
+    // 最大文件数为1时保留一个mLogFile0，与原来的行为一致
+    uint32_t maxFileCount = max(job.MaxFileCount, 1U);
+
+    // 删除最老的日志，压缩过和没有压缩过的都要处理
+    string dstFile = InsertBeforeExt(mLogFile, CppString::ToString(maxFileCount - 1));
+    unlink(dstFile.c_str());
+    unlink((dstFile + ".gz").c_str());
+
+    // 循环日志更名
+    for (int32_t i = maxFileCount - 2; i >= 1; --i)
+    {
+        string srcFile = InsertBeforeExt(mLogFile, CppString::ToString(i));
+        rename(srcFile.c_str(), dstFile.c_str());
+        rename((srcFile + ".gz").c_str(), (dstFile + ".gz").c_str());
+        dstFile = srcFile;
+    }
+
+    MoveRotatedFile(job.File, dstFile, job.Compress);
+}
+
+void CppLog::RotatePeriodFiles(const RotateJob &job)
+{
+    // 同一时段内已经轮转过的加上序号
+    string dstFile = InsertBeforeExt(mLogFile, "." + job.PeriodName);
+    for (uint32_t i = 1; access(dstFile.c_str(), F_OK) == 0 || access((dstFile + ".gz").c_str(), F_OK) == 0; ++i)
+    {
+        dstFile = InsertBeforeExt(mLogFile, "." + job.PeriodName + "_" + CppString::ToString(i));
+    }
+
+    MoveRotatedFile(job.File, dstFile, job.Compress);
+
+    // 旧日志的文件名为：前缀 + 时段(数字开头) + 扩展名[.gz]，按文件名排序就是时间顺序
+    string::size_type slashIndex = mLogFile.rfind('/');
+    string dir = slashIndex == string::npos ? string() : mLogFile.substr(0, slashIndex + 1);
+    string fileName = mLogFile.substr(dir.size());
+    string::size_type extIndex = GetExtIndex(fileName);
+    string prefix = fileName.substr(0, extIndex) + ".";
+    string ext = fileName.substr(extIndex);
+
+    vector<string> periodFiles;
+    DIR *pDir = opendir(dir.empty() ? "." : dir.c_str());
+    if (pDir == NULL)
+    {
+        return;
+    }
+
+    for (dirent *pEntry = readdir(pDir); pEntry != NULL; pEntry = readdir(pDir))
+    {
+        string name = pEntry->d_name;
+        if (name.size() <= prefix.size() + ext.size() || name.compare(0, prefix.size(), prefix) != 0
+            || !isdigit(static_cast<unsigned char>(name[prefix.size()])))
+        {
+            continue;
+        }
+
+        string::size_type nameExtIndex = name.size() - ext.size();
+        if (name.size() > prefix.size() + ext.size() + 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+        {
+            nameExtIndex -= 3;
+        }
+
+        if (name.compare(nameExtIndex, ext.size(), ext) == 0 && name.find(".rotating") == string::npos)
+        {
+            periodFiles.push_back(name);
+        }
+    }
+
+    closedir(pDir);
+
+    // 当前文件占一个
+    sort(periodFiles.begin(), periodFiles.end());
+    size_t keepCount = job.MaxFileCount > 0 ? job.MaxFileCount - 1 : 0;
+    for (size_t i = 0; i + keepCount < periodFiles.size(); ++i)
+    {
+        unlink((dir + periodFiles[i]).c_str());
+    }
+}
+
+void CppLog::SetRotate(ROTATE_PERIOD rotatePeriod, bool compress /*= false*/)
+{
+    lock_guard<mutex> lock(mFileLock);
+    mRotatePeriod = rotatePeriod;
+    mRotateCompress = compress;
+
+    // 重新计算当前时段
+    if (mLogFd >= 0)
+    {
+        CloseLogFile();
+        OpenLogFile(time(NULL));
+    }
+}
+
+void CppLog::SetBinary(bool binary)
+{
+    mBinary = binary;
+
+    // 新的会话，之后打开文件写入日志前先写入会话开始记录和所有调用点
+    mBinaryHeadPending = binary;
+}
+
+char CppLog::BinaryArgCursor::Next()
+{
+    const char *p = Format;
+    if (!InSpec)
+    {
+        // 找到下一个转换说明，跳过"%%"
+        while (true)
+        {
+            p = strchr(p, '%');
+            if (p == NULL)
+            {
+                Format += strlen(Format);
+                return 0;
+            }
+
+            if (p[1] != '%')
+            {
+                break;
+            }
+
+            p += 2;
+        }
+
+        ++p;
+        Precision = -1;
+        while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+        {
+            ++p;
+        }
+
+        if (*p == '*')
+        {
+            Format = p + 1;
+            InSpec = true;
+            return '*';
+        }
+    }
+
+    // 宽度之后的部分，从'*'宽度或精度之后继续时也从这里开始
+    while (isdigit(static_cast<unsigned char>(*p)))
+    {
+        ++p;
+    }
+
+    if (*p == '.')
+    {
+        ++p;
+        if (*p == '*')
+        {
+            Format = p + 1;
+            InSpec = true;
+            return '.';
+        }
+
+        Precision = atoi(p);
+        while (isdigit(static_cast<unsigned char>(*p)))
+        {
+            ++p;
+        }
+    }
+
+    while (*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+    {
+        ++p;
+    }
+
+    InSpec = false;
+    Format = *p == '\0' ? p : p + 1;
+    return *p;
+}
+
+void CppLog::EncodeArg(string &buf, BinaryArgCursor &cursor, const char *value)
+{
+    // 只有%s按字符串读取内容，其他转换（如%p）记录指针的值，不能假设指向的内容以'\0'结尾
+    char conversion = cursor.Next();
+    if (conversion != 's' && conversion != 'S' && conversion != 0)
+    {
+        buf.push_back(ARG_POINTER);
+        AppendValue(buf, reinterpret_cast<uint64_t>(value));
+        return;
+    }
+
+    if (value == NULL)
+    {
+        value = "(null)";
+    }
+
+    // 指定了精度时与printf一样最多读取精度个字符
+    uint32_t len = cursor.Precision < 0 ? strlen(value) : strnlen(value, cursor.Precision);
+    buf.push_back(ARG_STRING);
+    AppendValue(buf, len);
+    buf.append(value, len);
+}
+
+// 调用点记录：uint32_t调用点ID + uint32_t位置长度 + 位置 + uint32_t格式字符串长度 + 格式字符串
+static void AppendSiteRecord(string &buf, uint8_t type, const CppLogSite &site)
+{
+    uint32_t locationLen = strlen(site.mLocation);
+    uint32_t formatLen = strlen(site.mFormat);
+    uint32_t recordLen = BINARY_RECORD_HEAD_SIZE + sizeof(uint32_t) * 3 + locationLen + formatLen;
+    uint32_t siteId = site.mId;
+    buf.append(reinterpret_cast<const char *>(&recordLen), sizeof(recordLen));
+    buf.push_back(type);
+    buf.append(reinterpret_cast<const char *>(&siteId), sizeof(siteId));
+    buf.append(reinterpret_cast<const char *>(&locationLen), sizeof(locationLen));
+    buf.append(site.mLocation, locationLen);
+    buf.append(reinterpret_cast<const char *>(&formatLen), sizeof(formatLen));
+    buf.append(site.mFormat, formatLen);
+}
+
+string &CppLog::BeginBinaryRecord(LOG_LEVEL logLevel, CppLogSite &site)
+{
+    uint32_t siteId = site.mId.load(memory_order_acquire);
+    if (unlikely(siteId == 0))
+    {
+        // 多个线程同时分配时以第一个为准
+        uint32_t newId = ++sSiteCount;
+        if (site.mId.compare_exchange_strong(siteId, newId))
+        {
+            siteId = newId;
+        }
+    }
+
+    string &buf = ThreadBinaryBuf();
+    // 每个实例检查调用点自己的槽，超过LEVEL_CACHE_SLOTS个实例共用同一个槽时才会反复进入
+    if (unlikely(site.mInstanceIds[mLevelSlot].load(memory_order_acquire) != mInstanceId))
+    {
+        bool newSite = false;
+        {
+            lock_guard<mutex> lock(mBinaryLock);
+            if (mBinarySiteSet.insert(&site).second)
+            {
+                mBinarySites.push_back(&site);
+                newSite = true;
+            }
+        }
+
+        // 写入时不能持有mBinaryLock，异步写线程写入文件头时需要获取
+        if (newSite)
+        {
+            buf.clear();
+            AppendSiteRecord(buf, BINARY_SITE, site);
+            WriteLog(buf.data(), buf.size(), logLevel, false);
+        }
+
+        site.mInstanceIds[mLevelSlot].store(mInstanceId, memory_order_release);
+    }
+
+    // 日志记录：uint32_t调用点ID + uint8_t级别 + uint64_t时间（微秒） + 参数
+    timeval now;
+    CppTime::GetTimeOfDay(now, mCoarseClock);
+    buf.clear();
+    AppendValue<uint32_t>(buf, 0);
+    buf.push_back(BINARY_LOG);
+    AppendValue(buf, siteId);
+    buf.push_back(static_cast<char>(logLevel));
+    AppendValue(buf, CppTime::Timev2Uint(now));
+    return buf;
+}
+
+void CppLog::EndBinaryRecord(string &buf, LOG_LEVEL logLevel)
+{
+    uint32_t recordLen = buf.size();
+    memcpy(&buf[0], &recordLen, sizeof(recordLen));
+    WriteLog(buf.data(), buf.size(), logLevel, false);
+}
+
+size_t CppLog::WriteBinaryHead(int fd)
+{
+    string head;
+    AppendValue<uint32_t>(head, BINARY_RECORD_HEAD_SIZE + sizeof(BINARY_MAGIC) - 1);
+    head.push_back(BINARY_SESSION);
+    head.append(BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1);
+    {
+        lock_guard<mutex> lock(mBinaryLock);
+        for (auto pSite : mBinarySites)
+        {
+            AppendSiteRecord(head, BINARY_SITE, *pSite);
+        }
+    }
+
+    size_t writeBytes = 0;
+    while (writeBytes < head.size())
+    {
+        ssize_t ret = write(fd, head.data() + writeBytes, head.size() - writeBytes);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        writeBytes += ret;
+    }
+
+    return writeBytes;
+}
+
+namespace
+{
+// 解码后的参数类型
+enum BINARY_ARG_KIND
+{
+    KIND_MISSING,
+    KIND_INT,
+    KIND_DOUBLE,
+    KIND_STRING
+};
+
+struct BinaryArg
+{
+    BINARY_ARG_KIND Kind;
+    int64_t Int;
+    double Double;
+    string Str;
+};
+
+struct BinarySite
+{
+    string Location;
+    string Format;
+};
+}
+
+template <class T>
+static bool ReadValue(const string &data, size_t &pos, size_t end, T &value)
+{
+    if (pos + sizeof(value) > end)
+    {
+        return false;
+    }
+
+    memcpy(&value, &data[pos], sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+static bool ReadString(const string &data, size_t &pos, size_t end, string &value)
+{
+    uint32_t len;
+    if (!ReadValue(data, pos, end, len) || pos + len > end)
+    {
+        return false;
+    }
+
+    value.assign(data, pos, len);
+    pos += len;
+    return true;
+}
+
+/** 读取下一条记录的类型和范围，数据不完整返回false
+ *
+ * @param   const string & data
+ * @param   size_t & pos            输入记录开始位置，输出下一条记录的开始位置
+ * @param   uint8_t & type
+ * @param   size_t & bodyBegin      记录内容的开始位置
+ * @retval  bool
+ * @author  moon
+ */
+static bool NextBinaryRecord(const string &data, size_t &pos, uint8_t &type, size_t &bodyBegin)
+{
+    uint32_t recordLen;
+    size_t readPos = pos;
+    if (!ReadValue(data, readPos, data.size(), recordLen) || !ReadValue(data, readPos, data.size(), type)
+        || recordLen < BINARY_RECORD_HEAD_SIZE || pos + recordLen > data.size())
+    {
+        return false;
+    }
+
+    bodyBegin = readPos;
+    pos += recordLen;
+    return true;
+}
+
+/** 按printf格式字符串把参数格式化，参数按记录时的类型转换成对应的格式
+ *
+ * @param   const string & format
+ * @param   const vector<BinaryArg> & args
+ * @retval  string
+ * @author  moon
+ */
+static string FormatBinaryArgs(const string &format, const vector<BinaryArg> &args)
+{
+    static const BinaryArg MISSING_ARG = { KIND_MISSING, 0, 0, "<missing>" };
+
+    string result;
+    size_t argIndex = 0;
+    auto nextArg = [&args, &argIndex]() -> const BinaryArg & {
+        return argIndex < args.size() ? args[argIndex++] : MISSING_ARG;
+    };
+    auto argInt = [](const BinaryArg &arg) -> int64_t {
+        return arg.Kind == KIND_DOUBLE ? static_cast<int64_t>(arg.Double) : arg.Int;
+    };
+
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        if (format[i] != '%')
+        {
+            result += format[i];
+            continue;
+        }
+
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            result += '%';
+            ++i;
+            continue;
+        }
+
+        // 解析"%[flags][width][.precision][length]conversion"，*替换成参数值，去掉长度修饰符
+        string spec("%");
+        size_t j = i + 1;
+        while (j < format.size() && strchr("-+ #0'", format[j]) != NULL)
+        {
+            spec += format[j++];
+        }
+
+        for (int32_t part = 0; part < 2; ++part)
+        {
+            if (part == 1)
+            {
+                if (j >= format.size() || format[j] != '.')
+                {
+                    break;
+                }
+
+                spec += format[j++];
+            }
+
+            if (j < format.size() && format[j] == '*')
+            {
+                spec += CppString::ToString(argInt(nextArg()));
+                ++j;
+            }
+
+            while (j < format.size() && isdigit(static_cast<unsigned char>(format[j])))
+            {
+                spec += format[j++];
+            }
+        }
+
+        while (j < format.size() && strchr("hlLqjzt", format[j]) != NULL)
+        {
+            ++j;
+        }
+
+        if (j >= format.size())
+        {
+            result.append(format, i, string::npos);
+            break;
+        }
+
+        char conversion = format[j];
+        i = j;
+        if (strchr("diouxXcCeEfFgGaAsSp", conversion) == NULL)
+        {
+            // 不支持的格式（如%n）原样输出
+            result += spec;
+            result += conversion;
+            continue;
+        }
+
+        const BinaryArg &arg = nextArg();
+        if (arg.Kind == KIND_MISSING)
+        {
+            result += arg.Str;
+            continue;
+        }
+
+        switch (conversion)
+        {
+        case 'd':
+        case 'i':
+            result += CppString::GetArgs((spec + "lld").c_str(), static_cast<long long>(argInt(arg)));
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            result += CppString::GetArgs((spec + "ll" + conversion).c_str(), static_cast<unsigned long long>(argInt(arg)));
+            break;
+        case 'c':
+        case 'C':
+            result += CppString::GetArgs((spec + "c").c_str(), static_cast<int>(argInt(arg)));
+            break;
+        case 's':
+        case 'S':
+            result += CppString::GetArgs((spec + "s").c_str(), arg.Kind == KIND_STRING ? arg.Str.c_str() : "<bad arg>");
+            break;
+        case 'p':
+            result += CppString::GetArgs((spec + "p").c_str(), reinterpret_cast<void *>(static_cast<uintptr_t>(argInt(arg))));
+            break;
+        default:
+            result += CppString::GetArgs((spec + conversion).c_str(),
+                                         arg.Kind == KIND_DOUBLE ? arg.Double : static_cast<double>(arg.Int));
+            break;
+        }
     }
 
-    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    return result;
+}
 
-    // 如果最大文件数量为0，则不记录
-    if (mMaxFileCount == 0)
+int32_t CppLog::DecodeBinaryLog(const string &binFile, ostream &os)
+{
+    ifstream ifs(binFile.c_str(), ios::binary);
+    if (!ifs)
     {
-        return;
+        return -1;
     }
 
-    pthread_mutex_lock(&lock);
+    string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
 
-    // 超过大小了，进行日志文件处理
-    if (mMaxFileSize > 0 && CppFile::GetFileSize(mLogFile) >= (int32_t)mMaxFileSize)
+    // 第一遍收集每个会话的调用点，调用点记录可能出现在使用它的日志之后，第一个会话之前的记录属于0号会话
+    vector<map<uint32_t, BinarySite>> sessions(1);
+    size_t pos = 0;
+    uint8_t type;
+    size_t bodyBegin;
+    while (NextBinaryRecord(data, pos, type, bodyBegin))
     {
-        string::size_type dotIndex = mLogFile.rfind('.');
-        if (dotIndex == string::npos)
+        if (type == BINARY_SESSION)
+        {
+            sessions.push_back(map<uint32_t, BinarySite>());
+        }
+        else if (type == BINARY_SITE)
         {
-            dotIndex = mLogFile.size();
+            uint32_t siteId;
+            BinarySite site;
+            if (ReadValue(data, bodyBegin, pos, siteId) && ReadString(data, bodyBegin, pos, site.Location)
+                && ReadString(data, bodyBegin, pos, site.Format))
+            {
+                sessions.back()[siteId] = site;
+            }
         }
+    }
 
-        // 删除最老的日志
-        string dstFile(mLogFile);
-        dstFile.insert(dotIndex, CppString::ToString(mMaxFileCount - 1));
-        unlink(dstFile.c_str());
+    // 第二遍输出日志
+    size_t sessionIndex = 0;
+    vector<BinaryArg> args;
+    char timeBuf[64];
+    pos = 0;
+    while (NextBinaryRecord(data, pos, type, bodyBegin))
+    {
+        if (type == BINARY_SESSION)
+        {
+            ++sessionIndex;
+        }
+        else if (type == BINARY_TEXT)
+        {
+            os.write(&data[bodyBegin], pos - bodyBegin) << '\n';
+        }
+        else if (type == BINARY_LOG)
+        {
+            uint32_t siteId;
+            uint8_t logLevel;
+            uint64_t timeUs;
+            if (!ReadValue(data, bodyBegin, pos, siteId) || !ReadValue(data, bodyBegin, pos, logLevel)
+                || !ReadValue(data, bodyBegin, pos, timeUs))
+            {
+                continue;
+            }
+
+            args.clear();
+            while (bodyBegin < pos)
+            {
+                BinaryArg arg = { KIND_MISSING, 0, 0, string() };
+                uint8_t argType;
+                if (!ReadValue(data, bodyBegin, pos, argType))
+                {
+                    break;
+                }
+
+                bool ok = false;
+                switch (argType)
+                {
+                case ARG_INT64:
+                case ARG_UINT64:
+                case ARG_POINTER:
+                    arg.Kind = KIND_INT;
+                    ok = ReadValue(data, bodyBegin, pos, arg.Int);
+                    break;
+                case ARG_DOUBLE:
+                    arg.Kind = KIND_DOUBLE;
+                    ok = ReadValue(data, bodyBegin, pos, arg.Double);
+                    break;
+                case ARG_STRING:
+                    arg.Kind = KIND_STRING;
+                    ok = ReadString(data, bodyBegin, pos, arg.Str);
+                    break;
+                default:
+                    break;
+                }
+
+                if (!ok)
+                {
+                    break;
+                }
+
+                args.push_back(arg);
+            }
+
+            timeval logTime = CppTime::Uint2Timev(timeUs);
+            CppTime::GetUTimeStr(timeBuf, sizeof(timeBuf), &logTime);
+            os << '[' << timeBuf << "][" << GetLevelName(static_cast<LOG_LEVEL>(logLevel)) << ']';
+
+            const map<uint32_t, BinarySite> &sites = sessions[sessionIndex];
+            auto siteIt = sites.find(siteId);
+            if (siteIt == sites.end())
+            {
+                os << "<unknown site " << siteId << ">|" << args.size() << " args\n";
+                continue;
+            }
+
+            os << siteIt->second.Location << '|' << FormatBinaryArgs(siteIt->second.Format, args) << '\n';
+        }
+    }
+
+    // 文件末尾不完整的记录（如进程异常退出时）
+    return pos == data.size() ? 0 : -1;
+}
+
+CppLog::CppLog(const string &logFile /*= "/tmp/log.txt"*/, LOG_LEVEL logLevel /*= DEBUG*/, uint32_t maxFileSize /*= 0*/, uint32_t maxFileCount /*= 1*/)
+    : mLogFile(logFile), mLogLevel(logLevel), mMaxFileSize(maxFileSize), mMaxFileCount(maxFileCount),
+    mCoarseClock(false), mInstanceId(++sInstanceCount), mLevelSlot((mInstanceId - 1) % CppLogSite::LEVEL_CACHE_SLOTS),
+    mLevelGeneration(++sLevelGeneration), mSignalTrace(false), mModuleLevels(NULL), mModuleLevelReaders(0), mBinary(false), mBinaryHeadPending(false),
+    mLogFd(-1), mLogFileSize(0), mLogInode(0), mLogCheckTime(0), mLogPeriodEnd(0), mRotatePeriod(ROTATE_NONE),
+    mRotateCompress(false), mRotateSeq(0), mRotateStop(false), mRotateBusy(false),
+    mAsyncMode(ASYNC_SHARED_QUEUE), mAsyncRunning(false), mAsyncStop(false),
+    mAsyncUrgent(false), mAsyncWakeup(false), mAsyncBlockSize(0), mAsyncMaxBlocks(0), mAsyncFlushIntervalMs(0),
+    mAsyncPendingBytes(0), mAsyncCommitBytes(0), mAsyncWrittenBytes(0),
+    mRingSize(0), mRingPassCount(0)
+{
+    PublishModuleLevels(new ModuleLevels());
+}
+
+CppLog::~CppLog()
+{
+    CppLog *pCppLog = this;
+    sSignalTraceLog.compare_exchange_strong(pCppLog, NULL);
 
-        // 循环日志更名
-        for (int32_t i = mMaxFileCount - 2; i >= 1; --i)
+    StopAsync();
+    CloseLogFile();
+
+    // 等待后台线程处理完已经轮转的文件
+    if (mRotateThread.joinable())
+    {
         {
-            string srcFile(mLogFile);
-            srcFile.insert(dotIndex, CppString::ToString(i));
+            unique_lock<mutex> lock(mRotateLock);
+            mRotateStop = true;
+        }
+
+        mRotateCond.notify_all();
+        mRotateThread.join();
+    }
+}
+
+int32_t CppLog::StartAsync(uint32_t maxQueueBytes /*= 0*/, uint32_t flushBytes /*= 64 * 1024*/,
+                           uint32_t flushIntervalMs /*= 100*/, ASYNC_MODE asyncMode /*= ASYNC_SHARED_QUEUE*/)
+{
+    if (mAsyncThread.joinable())
+    {
+        return 0;
+    }
 
-            rename(srcFile.c_str(), dstFile.c_str());
-            dstFile = srcFile;
+    if (!mLogFile.empty())
+    {
+        lock_guard<mutex> lock(mFileLock);
+        PrepareLogFile(time(NULL));
+        if (mLogFd < 0)
+        {
+            return -1;
         }
+    }
+
+    if (maxQueueBytes == 0)
+    {
+        maxQueueBytes = asyncMode == ASYNC_THREAD_RING ? DEFAULT_RING_BYTES : DEFAULT_QUEUE_BYTES;
+    }
 
-        rename(mLogFile.c_str(), dstFile.c_str());
+    unique_lock<mutex> lock(mAsyncLock);
+    mAsyncBlockSize = max(flushBytes, 1024U);
+    mAsyncMaxBlocks = max(maxQueueBytes / mAsyncBlockSize, 2U);
+    mAsyncFlushIntervalMs = max(flushIntervalMs, 1U);
+    mAsyncStop = false;
+    mAsyncUrgent = false;
+    mAsyncWakeup = false;
+    mAsyncPendingBytes = 0;
+    mAsyncMode = asyncMode;
+
+    // 环形缓冲区大小取2的幂
+    mRingSize = 4096;
+    while (mRingSize < maxQueueBytes && mRingSize < (1U << 30))
+    {
+        mRingSize <<= 1;
     }
 
-    CppFile::AppendMsg(mLogFile, msg + "\n");
+    mRingPassCount = 0;
+    mAsyncRunning = true;
+    mAsyncThread = thread(mAsyncMode == ASYNC_THREAD_RING ? &CppLog::RingWriteThread : &CppLog::AsyncWriteThread, this);
 
-    pthread_mutex_unlock(&lock);
+    return 0;
 }
 
-CppLog::CppLog(const string &logFile /*= "/tmp/log.txt"*/, LOG_LEVEL logLevel /*= DEBUG*/, uint32_t maxFileSize /*= 0*/, uint32_t maxFileCount /*= 1*/)
-    : mLogFile(logFile), mLogLevel(logLevel), mMaxFileSize(maxFileSize), mMaxFileCount(maxFileCount)
+void CppLog::StopAsync()
 {
+    if (!mAsyncThread.joinable())
+    {
+        return;
+    }
+
+    {
+        unique_lock<mutex> lock(mAsyncLock);
+        mAsyncStop = true;
+    }
+
+    mAsyncWriterCond.notify_one();
+    mAsyncThread.join();
 
+    unique_lock<mutex> lock(mAsyncLock);
+    mAsyncFreeBlocks.clear();
+    mAsyncFreeBlocks.shrink_to_fit();
 }
 
-string CppLog::GetStackTrace()
+void CppLog::Flush()
 {
-#ifndef __CYGWIN__
-    static const uint32_t MAX_STACK_TRACE_SIZE = 50;
-    void *mStackTrace[MAX_STACK_TRACE_SIZE];
-    static uint32_t stackSize = backtrace(mStackTrace, ARRAY_SIZE(mStackTrace));
-    if (stackSize == 0)
     {
-        return "<No stack trace>\n";
+        unique_lock<mutex> lock(mAsyncLock);
+        if (mAsyncRunning && mAsyncMode == ASYNC_THREAD_RING)
+        {
+            // 调用时写线程可能正在写入中，需要再完整执行一轮才能保证取走之前提交的日志
+            // 每一轮都要唤醒写线程，不等待写入间隔
+            uint64_t passCount = mRingPassCount + 2;
+            while (mRingPassCount < passCount)
+            {
+                mAsyncUrgent = true;
+                mAsyncWriterCond.notify_one();
+                mAsyncProducerCond.wait(lock);
+            }
+        }
+        else if (mAsyncRunning && mAsyncWrittenBytes < mAsyncCommitBytes)
+        {
+            uint64_t commitBytes = mAsyncCommitBytes;
+            mAsyncUrgent = true;
+            mAsyncWriterCond.notify_one();
+            mAsyncProducerCond.wait(lock, [this, commitBytes] { return mAsyncWrittenBytes >= commitBytes; });
+        }
+    }
+
+    unique_lock<mutex> lock(mRotateLock);
+    mRotateCond.wait(lock, [this] { return mRotateJobs.empty() && !mRotateBusy; });
+}
+
+size_t CppLog::WriteIov(int fd, vector<iovec> &iovs)
+{
+    size_t totalBytes = 0;
+    iovec *pIov = iovs.data();
+    size_t iovCount = iovs.size();
+    while (iovCount > 0)
+    {
+        ssize_t writeSize = writev(fd, pIov, min(iovCount, static_cast<size_t>(IOV_MAX)));
+        if (writeSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // 写入失败（如磁盘满），丢弃本批日志
+            break;
+        }
+
+        // 处理部分写入
+        totalBytes += writeSize;
+        while (iovCount > 0 && static_cast<size_t>(writeSize) >= pIov->iov_len)
+        {
+            writeSize -= pIov->iov_len;
+            ++pIov;
+            --iovCount;
+        }
+
+        if (iovCount > 0)
+        {
+            pIov->iov_base = static_cast<char *>(pIov->iov_base) + writeSize;
+            pIov->iov_len -= writeSize;
+        }
+    }
+
+    return totalBytes;
+}
+
+void CppLog::AsyncWrite(vector<iovec> &iovs, bool urgent)
+{
+    if (mLogFile.empty())
+    {
+        WriteIov(STDOUT_FILENO, iovs);
+        return;
     }
 
-    char** strings = backtrace_symbols(mStackTrace, stackSize);
+    // 只有写线程和退回同步写入的日志竞争这个锁，不影响生产者
+    lock_guard<mutex> lock(mFileLock);
+    time_t now = time(NULL);
+    PrepareLogFile(now);
+    if (mLogFd < 0)
+    {
+        return;
+    }
 
-    // 仅在DEBUG模式下能获得调用栈，非DEBUG模式可能会为NULL
-    if (strings == NULL)
+    mLogFileSize += WriteIov(mLogFd, iovs);
+    if (urgent)
     {
-        return "<Unknown error: backtrace_symbols returned NULL>\n";
+        fdatasync(mLogFd);
     }
 
-    string result;
-    for (size_t i = 0; i < stackSize; ++i)
+    // 一批可能很大，写完马上轮转，不等下一批
+    if (mMaxFileSize > 0 && mLogFileSize >= mMaxFileSize)
     {
-        string mangledName = strings[i];
-        string::size_type begin = mangledName.find('(');
-        string::size_type end = mangledName.find('+', begin);
-        if (begin == string::npos || end == string::npos)
+        RotateLogFile(now);
+    }
+}
+
+void CppLog::AsyncWriteThread()
+{
+    vector<string> writingBlocks;
+    vector<PendingStackTrace> stackTraces;
+    string stackTraceBuf;
+    vector<size_t> stackTraceEnds;                  // 每个调用栈在stackTraceBuf中的结束位置
+    vector<iovec> iovs;
+    bool stop = false;
+    while (!stop)
+    {
+        bool urgent = false;
+        uint64_t pendingBytes = 0;
         {
-            result += mangledName;
-            result += '\n';
-            continue;
+            unique_lock<mutex> lock(mAsyncLock);
+            mAsyncWriterCond.wait_for(lock, chrono::milliseconds(mAsyncFlushIntervalMs), [this] {
+                return mAsyncStop || mAsyncUrgent || mAsyncPendingBytes >= mAsyncBlockSize;
+            });
+
+            writingBlocks.swap(mAsyncBlocks);
+            stackTraces.swap(mStackTraces);
+            pendingBytes = mAsyncPendingBytes;
+            mAsyncPendingBytes = 0;
+            urgent = mAsyncUrgent;
+            mAsyncUrgent = false;
+
+            // 退出前最后一次取走所有缓存，之后的日志走同步模式
+            stop = mAsyncStop;
+            if (stop)
+            {
+                mAsyncRunning = false;
+            }
+        }
+
+        mAsyncProducerCond.notify_all();
+
+        // 调用栈在写线程中解析，先全部格式化，避免追加时缓冲区搬移使iovec失效
+        stackTraceBuf.clear();
+        stackTraceEnds.clear();
+        for (auto &stackTrace : stackTraces)
+        {
+            FormatStackTrace(stackTrace, stackTraceBuf);
+            stackTraceEnds.push_back(stackTraceBuf.size());
+        }
+
+        if (!writingBlocks.empty() || !stackTraceBuf.empty())
+        {
+            auto appendIov = [&iovs](char *data, size_t len) {
+                if (len > 0)
+                {
+                    iovec iov = { data, len };
+                    iovs.push_back(iov);
+                }
+            };
+
+            // 按记录时的位置把调用栈插入块中
+            iovs.clear();
+            size_t blockIndex = 0;
+            size_t blockOffset = 0;
+            size_t stackTraceBegin = 0;
+            for (size_t i = 0; i < stackTraces.size(); ++i)
+            {
+                const PendingStackTrace &stackTrace = stackTraces[i];
+                for (; blockIndex < stackTrace.BlockIndex; ++blockIndex, blockOffset = 0)
+                {
+                    string &block = writingBlocks[blockIndex];
+                    appendIov(&block[0] + blockOffset, block.size() - blockOffset);
+                }
+
+                if (stackTrace.BlockOffset > blockOffset)
+                {
+                    appendIov(&writingBlocks[blockIndex][0] + blockOffset, stackTrace.BlockOffset - blockOffset);
+                    blockOffset = stackTrace.BlockOffset;
+                }
+
+                appendIov(&stackTraceBuf[0] + stackTraceBegin, stackTraceEnds[i] - stackTraceBegin);
+                stackTraceBegin = stackTraceEnds[i];
+            }
+
+            for (; blockIndex < writingBlocks.size(); ++blockIndex, blockOffset = 0)
+            {
+                string &block = writingBlocks[blockIndex];
+                appendIov(&block[0] + blockOffset, block.size() - blockOffset);
+            }
+
+            AsyncWrite(iovs, urgent);
+        }
+
+        stackTraces.clear();
+        {
+            unique_lock<mutex> lock(mAsyncLock);
+            mAsyncWrittenBytes += pendingBytes;
+
+            // 回收缓存块，过大的块直接释放
+            for (auto &block : writingBlocks)
+            {
+                if (block.capacity() <= 2 * mAsyncBlockSize && mAsyncFreeBlocks.size() < mAsyncMaxBlocks)
+                {
+                    block.clear();
+                    mAsyncFreeBlocks.push_back(std::move(block));
+                }
+            }
         }
 
-        ++begin;
-        int status;
-        char* s = abi::__cxa_demangle(mangledName.substr(begin, end - begin).c_str(), NULL, 0, &status);
-        if (status != 0)
+        writingBlocks.clear();
+        mAsyncProducerCond.notify_all();
+    }
+}
+
+CppLogRing *CppLog::GetThreadRing()
+{
+    // 线程持有的环形缓冲区：<实例ID,缓冲区>，线程退出时释放引用，写线程发现只剩自己引用并且已经写完时注销
+    // 实例停止异步模式或者析构时写线程关闭缓冲区并释放内存，线程下次写日志时移除
+    static thread_local vector<pair<uint64_t, shared_ptr<CppLogRing>>> threadRings;
+    for (size_t i = 0; i < threadRings.size();)
+    {
+        if (threadRings[i].second->mClosed.load(memory_order_relaxed))
         {
-            result += mangledName;
-            result += '\n';
+            threadRings[i] = std::move(threadRings.back());
+            threadRings.pop_back();
             continue;
         }
 
-        // Ignore ExceptionBase::Init so the top frame is the
-        // user's frame where this exception is thrown.
-        //
-        // Can't just ignore frame#0 because the compiler might
-        // inline ExceptionBase::Init.
-        result += mangledName.substr(0, begin);
-        result += s;
-        result += mangledName.substr(end);
-        result += '\n';
+        if (threadRings[i].first == mInstanceId)
+        {
+            return threadRings[i].second.get();
+        }
 
-        free(s);
+        ++i;
+    }
+
+    shared_ptr<CppLogRing> pRing;
+    {
+        // 写线程停止后不再创建，保证所有缓冲区都能被写线程关闭
+        unique_lock<mutex> lock(mAsyncLock);
+        if (!mAsyncRunning)
+        {
+            return NULL;
+        }
+
+        pRing = make_shared<CppLogRing>(mRingSize);
+        mRings.push_back(pRing);
+    }
+
+    threadRings.push_back(make_pair(mInstanceId, pRing));
+    return pRing.get();
+}
+
+bool CppLog::RingAppend(const char *msg, size_t len, LOG_LEVEL logLevel, bool newline)
+{
+    CppLogRing *pRing = GetThreadRing();
+    if (pRing == NULL || CppLogRing::RecordSize(len + 1) > pRing->Capacity())
+    {
+        return false;
+    }
+
+    // 先标记正在写入再检查状态，保证写线程关闭缓冲区时能取走这条日志，关闭后不再写入
+    pRing->mWriting = true;
+    bool result = false;
+    timeval now;
+    CppTime::GetTimeOfDay(now, mCoarseClock);
+    uint64_t timeUs = CppTime::Timev2Uint(now);
+    while (mAsyncRunning && !pRing->mClosed)
+    {
+        if (pRing->Push(timeUs, msg, len, newline))
+        {
+            result = true;
+            break;
+        }
+
+        // 缓冲区满了，唤醒写线程并让出CPU
+        mAsyncWakeup = true;
+        {
+            unique_lock<mutex> lock(mAsyncLock);
+        }
+        mAsyncWriterCond.notify_one();
+        this_thread::yield();
+    }
+
+    pRing->mWriting.store(false, memory_order_release);
+
+    if (result && (logLevel >= WARNN || (pRing->Used() * 2 >= pRing->Capacity() && !mAsyncWakeup)))
+    {
+        if (logLevel >= WARNN)
+        {
+            mAsyncUrgent = true;
+        }
+        else
+        {
+            mAsyncWakeup = true;
+        }
+
+        {
+            unique_lock<mutex> lock(mAsyncLock);
+        }
+        mAsyncWriterCond.notify_one();
     }
 
-    free(strings);
     return result;
+}
+
+void CppLog::RingWriteThread()
+{
+    string staging;
+    vector<CppLogRing::Entry> entries;
+    vector<iovec> iovs;
+    vector<shared_ptr<CppLogRing>> rings;
+    vector<PendingStackTrace> stackTraces;
+    bool stop = false;
+    while (!stop)
+    {
+        bool urgent = false;
+        {
+            unique_lock<mutex> lock(mAsyncLock);
+            mAsyncWriterCond.wait_for(lock, chrono::milliseconds(mAsyncFlushIntervalMs), [this] {
+                return mAsyncStop || mAsyncUrgent || mAsyncWakeup;
+            });
+
+            mAsyncWakeup = false;
+            urgent = mAsyncUrgent.exchange(false);
+            stop = mAsyncStop;
+            if (stop)
+            {
+                mAsyncRunning = false;
+            }
+
+            rings = mRings;
+            stackTraces.swap(mStackTraces);
+        }
+
+        staging.clear();
+        entries.clear();
+        for (auto &pRing : rings)
+        {
+            // 最后一轮关闭所有缓冲区并释放内存，线程持有的引用在下次写日志或者线程退出时释放
+            if (stop)
+            {
+                pRing->Close(staging, entries);
+            }
+            else
+            {
+                pRing->Drain(staging, entries);
+            }
+        }
+
+        // 调用栈在写线程中解析，按记录时间与其他日志合并
+        for (auto &stackTrace : stackTraces)
+        {
+            size_t offset = staging.size();
+            FormatStackTrace(stackTrace, staging);
+            CppLogRing::Entry entry = { stackTrace.TimeUs, offset, static_cast<uint32_t>(staging.size() - offset) };
+            entries.push_back(entry);
+        }
+
+        stackTraces.clear();
+
+        if (!entries.empty())
+        {
+            // 各线程的日志按时间戳合并
+            stable_sort(entries.begin(), entries.end(), [](const CppLogRing::Entry &left, const CppLogRing::Entry &right) {
+                return left.TimeUs < right.TimeUs;
+            });
+
+            iovs.clear();
+            for (auto &entry : entries)
+            {
+                iovec iov = { &staging[entry.Offset], entry.Len };
+                iovs.push_back(iov);
+            }
+
+            AsyncWrite(iovs, urgent);
+        }
+
+        rings.clear();
+        {
+            unique_lock<mutex> lock(mAsyncLock);
+
+            // 注销已经退出的线程的缓冲区，退出时全部注销
+            if (stop)
+            {
+                mRings.clear();
+            }
+            else
+            {
+                mRings.erase(remove_if(mRings.begin(), mRings.end(), [](const shared_ptr<CppLogRing> &pRing) {
+                    return pRing.use_count() == 1 && pRing->Empty();
+                }), mRings.end());
+            }
+
+            // 写线程退出时唤醒所有Flush
+            mRingPassCount = stop ? UINT64_MAX : mRingPassCount + 1;
+        }
+
+        mAsyncProducerCond.notify_all();
+    }
+}
+
+const uint32_t CppStackTrace::MAX_FRAMES;
+
+void CppStackTrace::Capture(uint32_t skip /*= 0*/)
+{
+#ifndef __CYGWIN__
+    void *frames[MAX_FRAMES + 1];
+    int size = backtrace(frames, ARRAY_SIZE(frames));
+
+    // 跳过Capture本身
+    uint32_t begin = min(static_cast<uint32_t>(size), skip + 1);
+    mSize = min(static_cast<uint32_t>(size) - begin, MAX_FRAMES);
+    memcpy(mFrames, frames + begin, mSize * sizeof(void *));
 #else
-    return "<No stack trace>\n";
+    static_cast<void>(skip);
+    mSize = 0;
 #endif
 }
+
+// 解析一个地址的符号，结果缓存，格式与backtrace_symbols相同，函数名已经还原
+static const string &SymbolizeFrame(void *frame)
+{
+    // 不释放，进程退出时其他静态对象的析构中仍可能使用
+    static mutex *pCacheLock = new mutex;
+    static unordered_map<void *, string> *pSymbolCache = new unordered_map<void *, string>;
+
+    lock_guard<mutex> lock(*pCacheLock);
+    auto symbolIt = pSymbolCache->find(frame);
+    if (symbolIt != pSymbolCache->end())
+    {
+        return symbolIt->second;
+    }
+
+    char addressStr[32];
+    snprintf(addressStr, sizeof(addressStr), "[%p]", frame);
+
+    string symbol;
+    Dl_info info;
+    if (dladdr(frame, &info) != 0 && info.dli_fname != NULL)
+    {
+        symbol = info.dli_fname;
+        if (info.dli_sname != NULL)
+        {
+            int status;
+            char *demangledName = abi::__cxa_demangle(info.dli_sname, NULL, 0, &status);
+            char offsetStr[32];
+            snprintf(offsetStr, sizeof(offsetStr), "+%#lx",
+                     static_cast<unsigned long>(static_cast<char *>(frame) - static_cast<char *>(info.dli_saddr)));
+
+            symbol += '(';
+            symbol += status == 0 && demangledName != NULL ? demangledName : info.dli_sname;
+            symbol += offsetStr;
+            symbol += ')';
+            free(demangledName);
+        }
+
+        symbol += ' ';
+    }
+
+    symbol += addressStr;
+    return pSymbolCache->emplace(frame, symbol).first->second;
+}
+
+string CppStackTrace::ToString() const
+{
+    if (mSize == 0)
+    {
+        return "<No stack trace>\n";
+    }
+
+    string result;
+    for (uint32_t i = 0; i < mSize; ++i)
+    {
+        result += SymbolizeFrame(mFrames[i]);
+        result += '\n';
+    }
+
+    return result;
+}
+
+string CppLog::GetStackTrace()
+{
+    CppStackTrace stackTrace;
+    stackTrace.Capture(1);
+    return stackTrace.ToString();
+}
@@ -3,10 +3,20 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <signal.h>
 
 #include <fstream>
 #include <string>
+#include <type_traits>
 #include <ostream>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include "CppTime.h"
 #include "CppString.h"
@@ -23,18 +33,67 @@
 #define unlikely(x)     __builtin_expect((x),0)
 #endif
 
-#define CURR_FILENAME (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
-#define FILE_LOCATION (std::string(CURR_FILENAME) + ":" + CppString::ToString(__LINE__))
+//************************************
+// Describe:  编译期计算路径[begin,end)中最后一个'/'之后的位置，没有'/'返回0，二分递归避免路径过长超过constexpr递归深度
+// Parameter: const char * path
+// Parameter: size_t begin
+// Parameter: size_t end
+// Returns:   constexpr size_t
+// Author:    moon
+//************************************
+constexpr size_t CppLogBaseNameOffset(const char *path, size_t begin, size_t end)
+{
+    return end - begin == 0 ? 0
+           : end - begin == 1 ? (path[begin] == '/' ? begin + 1 : 0)
+           : CppLogBaseNameOffset(path, begin + (end - begin) / 2, end) != 0
+           ? CppLogBaseNameOffset(path, begin + (end - begin) / 2, end)
+           : CppLogBaseNameOffset(path, begin, begin + (end - begin) / 2);
+}
+
+template <size_t N>
+constexpr size_t CppLogBaseNameOffset(const char (&path)[N])
+{
+    return CppLogBaseNameOffset(path, 0, N - 1);
+}
+
+#define CPP_LOG_STR_(x) #x
+#define CPP_LOG_STR(x) CPP_LOG_STR_(x)
 
-// TODO：
-// 如果日志量过大，需要缓存，采用定时写入或者定量写入，不能每次都打开文件写入再关闭
-// 重要的日志，比如ERROR和WARNN级别的，必要的时候需要flush到磁盘
+// 文件名和"文件名:行号"都是编译期确定的字符串常量
+#define CURR_FILENAME (__FILE__ + std::integral_constant<size_t, CppLogBaseNameOffset(__FILE__)>::value)
+#define CPP_LOG_LOCATION (__FILE__ ":" CPP_LOG_STR(__LINE__) + std::integral_constant<size_t, CppLogBaseNameOffset(__FILE__)>::value)
+#define FILE_LOCATION (std::string(CPP_LOG_LOCATION))
+
+// 日志量大时可以调用CppLog::StartAsync开启异步模式，由后台线程定时或者定量批量写入，
+// ERROR和WARNN级别的日志会立即写入并且flush到磁盘
 
 /* 为了标点符号的匹配,所有的THROW最后都不要加入标点符号,所有Log最后都要加入标点符号 */
+// 日志模块名，用于CppLog::SetModuleLevel，默认为文件名，可以在包含本文件前定义，如#define CPP_LOG_MODULE "CppNet"
+#ifndef CPP_LOG_MODULE
+#define CPP_LOG_MODULE CURR_FILENAME
+#endif
+
 #ifdef USE_CPP_LOG_MACRO
-#define Log(cppLog, logLevel, format, ...) if(cppLog != NULL && (cppLog)->mLogLevel <= (logLevel)){(cppLog)->LogMsg(std::string("[") + CppTime::GetUTimeStr() + "]["+CppString::ReplaceStr(#logLevel,"CppLog::")+"]" + FILE_LOCATION + "|" + CppString::GetArgs((format), ##__VA_ARGS__));}
+// 每个调用点生成一个静态的CppLogSite，编译期初始化，format必须是字符串常量，变量请使用"%s"
+// 调用点缓存了生效的日志级别，不记录时只有一次判断，不计算参数
+#define Log(cppLog, logLevel, format, ...) {static CppLogSite cppLogSite(CPP_LOG_LOCATION, "" format, CPP_LOG_MODULE);if(cppLog != NULL && (cppLog)->IsLevelEnabled(cppLogSite, (logLevel))){(cppLog)->LogSite((logLevel), cppLogSite, ##__VA_ARGS__);}}
 #define LOG_THROW(cppLog, logLevel, format, ...) {Log(cppLog, logLevel, format, ##__VA_ARGS__);throw;}
 
+// 记录当前调用栈，只在调用处记录返回地址，异步模式下由写线程解析符号
+#define LOG_STACK_TRACE(cppLog, logLevel) {static CppLogSite cppLogSite(CPP_LOG_LOCATION, "", CPP_LOG_MODULE);if(cppLog != NULL && (cppLog)->IsLevelEnabled(cppLogSite, (logLevel))){CppStackTrace cppStackTrace;cppStackTrace.Capture();(cppLog)->LogStackTrace((logLevel), CPP_LOG_LOCATION, cppStackTrace);}}
+
+// 限制频率的日志，每个调用点一个CppLogLimiter，allow为CppLogLimiter的判断函数
+// 按时间限制的日志被丢弃后，下一次记录前会先记录一条"suppressed N logs."
+#define CPP_LOG_LIMITED(cppLog, logLevel, allow, format, ...) {static CppLogSite cppLogSite(CPP_LOG_LOCATION, "" format, CPP_LOG_MODULE);static CppLogLimiter cppLogLimiter;if(cppLog != NULL && (cppLog)->IsLevelEnabled(cppLogSite, (logLevel)) && cppLogLimiter.allow){(cppLog)->LogLimited((logLevel), cppLogSite, cppLogLimiter, ##__VA_ARGS__);}}
+// 每n次记录一次（第1、n+1、2n+1...次）
+#define LOG_EVERY_N(cppLog, logLevel, n, format, ...) CPP_LOG_LIMITED(cppLog, logLevel, EveryN(n), format, ##__VA_ARGS__)
+// 只记录前n次
+#define LOG_FIRST_N(cppLog, logLevel, n, format, ...) CPP_LOG_LIMITED(cppLog, logLevel, FirstN(n), format, ##__VA_ARGS__)
+// 每ms毫秒最多记录一次
+#define LOG_EVERY_MS(cppLog, logLevel, ms, format, ...) CPP_LOG_LIMITED(cppLog, logLevel, EveryMs(ms), format, ##__VA_ARGS__)
+// 令牌桶限速：平均每秒最多ratePerSec条，最多连续burst条，ratePerSec为0时不限制
+#define LOG_RATE_LIMIT(cppLog, logLevel, ratePerSec, burst, format, ...) CPP_LOG_LIMITED(cppLog, logLevel, Allow(ratePerSec, burst), format, ##__VA_ARGS__)
+
 // 如果定义了CPP_LOG_INSTANCE指定CppLog实例,可以使用下面的简易接口,方法是在使用前定义
 #ifndef CPP_LOG_INSTANCE
 #define CPP_LOG_INSTANCE &cppLog
@@ -51,8 +110,15 @@
 #define WARNN_ILOG(cppLog, format, ...) Log((cppLog), CppLog::WARNN, format, ##__VA_ARGS__)
 #define ERROR_ILOG(cppLog, format, ...) Log((cppLog), CppLog::ERROR, format, ##__VA_ARGS__)
 
-#define CHECK_OP_F(cppLog, expr, ret, op, logLevel, format, ...) if (unlikely(!(expr))){Log(cppLog, logLevel, "Check [" #expr "] Failed,ret[%d]." format, ret, ##__VA_ARGS__);op;}
-#define ERROR_OP_F(cppLog, ret, op, logLevel, format, ...) if (unlikely(ret)){Log(cppLog, logLevel, "ret[%d]." format, ret, ##__VA_ARGS__);op;}
+// CHECK和ERROR系列宏默认按调用点限速，避免后端故障时大量错误日志拖垮进程，可以在包含本文件前定义，CPP_LOG_CHECK_RATE为0时不限速
+#ifndef CPP_LOG_CHECK_RATE
+#define CPP_LOG_CHECK_RATE 100
+#endif
+#ifndef CPP_LOG_CHECK_BURST
+#define CPP_LOG_CHECK_BURST 1000
+#endif
+#define CHECK_OP_F(cppLog, expr, ret, op, logLevel, format, ...) if (unlikely(!(expr))){LOG_RATE_LIMIT(cppLog, logLevel, CPP_LOG_CHECK_RATE, CPP_LOG_CHECK_BURST, "Check [" #expr "] Failed,ret[%d]." format, ret, ##__VA_ARGS__);op;}
+#define ERROR_OP_F(cppLog, ret, op, logLevel, format, ...) if (unlikely(ret)){LOG_RATE_LIMIT(cppLog, logLevel, CPP_LOG_CHECK_RATE, CPP_LOG_CHECK_BURST, "ret[%d]." format, ret, ##__VA_ARGS__);op;}
 
 #define CHECK_RETURN_F(cppLog, expr, ret, logLevel, format, ...) CHECK_OP_F(cppLog, expr, ret, return ret, logLevel, format, ##__VA_ARGS__)
 #define CHECK_RETURN(cppLog, expr, ret, logLevel) CHECK_RETURN_F(cppLog,expr, ret, logLevel, "")
@@ -109,6 +175,107 @@ public:
     }
 };
 
+struct iovec;
+class CppLogRing;
+
+// 日志调用点，由Log宏在每个调用点定义一个静态实例
+// 二进制模式下只记录调用点ID和参数，位置和格式字符串在文件中只记录一次
+class CppLogSite
+{
+public:
+    // 每个CppLog实例固定使用其中一个槽缓存生效级别和二进制模式的注册状态，多个实例共用一个调用点时互不覆盖
+    static const uint32_t LEVEL_CACHE_SLOTS = 4;
+
+    constexpr CppLogSite(const char *location, const char *format, const char *module)
+        : mLocation(location), mFormat(format), mModule(module), mLevelCaches{}, mId(0), mInstanceIds{}
+    {
+    }
+
+    const char *const mLocation;                // "文件名:行号"
+    const char *const mFormat;                  // 格式字符串
+    const char *const mModule;                  // 模块名
+    std::atomic<uint64_t> mLevelCaches[LEVEL_CACHE_SLOTS];  // 生效的日志级别：实例的级别版本(48位) + mLogLevel(8位) + 生效级别(8位)
+    std::atomic<uint32_t> mId;                  // 调用点ID，第一次以二进制模式记录时分配，0表示未分配
+    std::atomic<uint64_t> mInstanceIds[LEVEL_CACHE_SLOTS];  // 每个槽最近一次注册到的CppLog实例ID
+};
+
+// 调用栈，Capture只记录返回地址，开销为微秒级，需要时再调用ToString解析符号
+class CppStackTrace
+{
+public:
+    static const uint32_t MAX_FRAMES = 64;
+
+    CppStackTrace() : mSize(0)
+    {
+    }
+
+    /** 记录当前调用栈的返回地址，不包括Capture本身
+     *
+     * @param   uint32_t skip       跳过最近的几层调用
+     * @retval  void
+     * @author  moon
+     */
+    void Capture(uint32_t skip = 0);
+
+    /** 解析符号并还原C++函数名，每行一层："模块(函数+偏移) [地址]"
+     *  每个地址的解析结果都会缓存，同一个位置反复出错时只有第一次需要解析
+     *
+     * @retval  std::string
+     * @author  moon
+     */
+    std::string ToString() const;
+
+    void *mFrames[MAX_FRAMES];
+    uint32_t mSize;
+};
+
+// 日志调用点的频率限制，由限速的日志宏在每个调用点定义一个静态实例，多线程安全
+class CppLogLimiter
+{
+public:
+    constexpr CppLogLimiter() : mCount(0), mSuppressed(0), mTimeUs(0)
+    {
+    }
+
+    bool FirstN(uint64_t n)
+    {
+        return mCount.fetch_add(1, std::memory_order_relaxed) < n;
+    }
+
+    bool EveryN(uint64_t n)
+    {
+        return mCount.fetch_add(1, std::memory_order_relaxed) % (n > 0 ? n : 1) == 0;
+    }
+
+    /** 距离上次记录超过ms毫秒时返回true
+     *
+     * @param   uint64_t ms
+     * @retval  bool
+     * @author  moon
+     */
+    bool EveryMs(uint64_t ms);
+
+    /** 令牌桶（GCRA算法）判断是否可以记录，只需要一个原子变量
+     *
+     * @param   uint32_t ratePerSec     平均每秒最多记录的条数，0表示不限制
+     * @param   uint32_t burst          最多连续记录的条数
+     * @retval  bool
+     * @author  moon
+     */
+    bool Allow(uint32_t ratePerSec, uint32_t burst);
+
+    // 取出并清零被丢弃的条数
+    uint64_t TakeSuppressed()
+    {
+        return mSuppressed.load(std::memory_order_relaxed) == 0 ? 0 : mSuppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> mCount;               // 调用次数
+    std::atomic<uint64_t> mSuppressed;          // 上次记录之后被丢弃的条数
+    std::atomic<uint64_t> mTimeUs;              // EveryMs为上次记录的时间，Allow为理论到达时间，单调时钟，微秒
+};
+
 class CppLog
 {
 public:
@@ -121,27 +288,629 @@ public:
         ERROR
     };
 
+    // 异步模式的缓存方式
+    enum ASYNC_MODE
+    {
+        ASYNC_SHARED_QUEUE,         // 所有线程共用一个加锁的缓存队列
+        ASYNC_THREAD_RING           // 每个线程一个无锁环形缓冲区，后台线程按时间戳合并写入
+    };
+
+    static const uint32_t DEFAULT_QUEUE_BYTES = 16 * 1024 * 1024;  // ASYNC_SHARED_QUEUE模式默认的缓存大小
+    static const uint32_t DEFAULT_RING_BYTES = 256 * 1024;          // ASYNC_THREAD_RING模式默认的每个线程缓冲区大小
+
+    enum ROTATE_PERIOD
+    {
+        ROTATE_NONE,                // 只按mMaxFileSize轮转
+        ROTATE_HOURLY,              // 每小时轮转
+        ROTATE_DAILY                // 每天轮转
+    };
+
     CppLog(const std::string &logFile = "", LOG_LEVEL logLevel = TRACE, uint32_t maxFileSize = 0, uint32_t maxFileCount = 1);
+    ~CppLog();
+
+    CppLog(const CppLog &) = delete;
+    CppLog &operator=(const CppLog &) = delete;
 
     //************************************
     // Describe:  记录日志
     // Parameter: const std::string & msg
+    // Parameter: LOG_LEVEL logLevel    日志级别，异步模式下WARNN及以上级别会立即写入并flush
     // Returns:   void
     // Author:    moon
     //************************************
-    void LogMsg(const std::string &msg);
+    void LogMsg(const std::string &msg, LOG_LEVEL logLevel = TRACE);
+    // 级别不设默认值，避免LogMsg("msg", CppLog::ERROR)与上面的接口产生歧义
+    void LogMsg(const char *msg, size_t len, LOG_LEVEL logLevel);
+
+    /** 格式化并记录日志，Log宏使用的接口
+     *  "[时间][级别]位置|内容"直接格式化到线程的缓冲区中，不申请内存（超长日志第一次除外）
+     *
+     * @param   LOG_LEVEL logLevel
+     * @param   const char * location   "文件名:行号"
+     * @param   const char * format
+     * @param   ...
+     * @retval  void
+     * @author  moon
+     */
+    void LogFormat(LOG_LEVEL logLevel, const char *location, const char *format, ...);
+
+    //************************************
+    // Describe:  获得日志级别的名称
+    // Parameter: LOG_LEVEL logLevel
+    // Returns:   const char *
+    // Author:    moon
+    //************************************
+    static const char *GetLevelName(LOG_LEVEL logLevel);
+
+    /** 调用点的日志级别是否需要记录，Log宏使用的接口
+     *  调用点缓存了按模块计算出的生效级别，级别设置没有变化时只需要比较一次缓存
+     *  每个实例使用调用点的一个固定缓存槽，多个实例交替使用同一个调用点时缓存仍然有效
+     *
+     * @param   CppLogSite & site
+     * @param   LOG_LEVEL logLevel
+     * @retval  bool
+     * @author  moon
+     */
+    bool IsLevelEnabled(CppLogSite &site, LOG_LEVEL logLevel)
+    {
+        uint64_t levelCache = site.mLevelCaches[mLevelSlot].load(std::memory_order_relaxed);
+        if (unlikely((levelCache >> 8) != ((mLevelGeneration.load(std::memory_order_relaxed) << 8) | mLogLevel)))
+        {
+            levelCache = UpdateSiteLevel(site);
+        }
+
+        return static_cast<uint32_t>(logLevel) >= (levelCache & 0xFF);
+    }
+
+    /** 设置日志级别，与直接修改mLogLevel相同
+     *
+     * @param   LOG_LEVEL logLevel
+     * @retval  void
+     * @author  moon
+     */
+    void SetLogLevel(LOG_LEVEL logLevel);
+
+    /** 设置模块的日志级别，优先于mLogLevel，可以在运行时修改
+     *
+     * @param   const std::string & module      CPP_LOG_MODULE，默认为文件名，如"CppNet.cpp"
+     * @param   LOG_LEVEL logLevel
+     * @retval  void
+     * @author  moon
+     */
+    void SetModuleLevel(const std::string &module, LOG_LEVEL logLevel);
+
+    /** 删除模块的日志级别，恢复使用mLogLevel，module为空时删除所有模块
+     *
+     * @param   const std::string & module
+     * @retval  void
+     * @author  moon
+     */
+    void ClearModuleLevel(const std::string &module = "");
+
+    /** 收到信号signum时在TRACE级别和正常级别之间切换，用于线上临时打开所有日志，同一时间只能有一个实例使用
+     *
+     * @param   CppLog * pCppLog        为NULL时恢复信号的默认处理
+     * @param   int signum
+     * @retval  void
+     * @author  moon
+     */
+    static void EnableSignalTrace(CppLog *pCppLog, int signum = SIGUSR1);
+
+    /** 按调用点记录日志，Log宏使用的接口，二进制模式下记录参数的原始值，否则按格式字符串格式化
+     *
+     * @param   LOG_LEVEL logLevel
+     * @param   CppLogSite & site
+     * @param   Args... args        只支持能传给printf的类型：整数、枚举、浮点数、字符串指针和其他指针
+     * @retval  void
+     * @author  moon
+     */
+    template <class... Args>
+    void LogSite(LOG_LEVEL logLevel, CppLogSite &site, Args... args)
+    {
+        if (mBinary && !mLogFile.empty())
+        {
+            std::string &buf = BeginBinaryRecord(logLevel, site);
+            BinaryArgCursor cursor = { site.mFormat, false, -1 };
+            EncodeArgs(buf, cursor, args...);
+            EndBinaryRecord(buf, logLevel);
+        }
+        else
+        {
+            LogFormat(logLevel, site.mLocation, site.mFormat, args...);
+        }
+    }
+
+    /** 记录限速的日志，限速的日志宏使用的接口，有被丢弃的日志时先记录丢弃的条数
+     *
+     * @param   LOG_LEVEL logLevel
+     * @param   CppLogSite & site
+     * @param   CppLogLimiter & limiter
+     * @param   Args... args
+     * @retval  void
+     * @author  moon
+     */
+    template <class... Args>
+    void LogLimited(LOG_LEVEL logLevel, CppLogSite &site, CppLogLimiter &limiter, Args... args)
+    {
+        uint64_t suppressed = limiter.TakeSuppressed();
+        if (suppressed > 0)
+        {
+            LogFormat(logLevel, site.mLocation, "suppressed %llu logs.", static_cast<unsigned long long>(suppressed));
+        }
+
+        LogSite(logLevel, site, args...);
+    }
+
+    /** 记录调用栈，异步模式下只保存返回地址，由写线程解析符号后按时间顺序写入，不阻塞调用线程
+     *
+     * @param   LOG_LEVEL logLevel
+     * @param   const char * location
+     * @param   const CppStackTrace & stackTrace
+     * @retval  void
+     * @author  moon
+     */
+    void LogStackTrace(LOG_LEVEL logLevel, const char *location, const CppStackTrace &stackTrace);
+
+    /** 设置二进制模式
+     *  二进制模式下通过Log宏记录的日志只写入调用点ID、时间和参数的原始值，不做格式化，CPU和磁盘开销都远小于文本模式，
+     *  需要使用DecodeBinaryLog或者tools/CppLogDecoder还原成文本。每次打开日志文件时会先写入所有调用点的位置和格式字符串。
+     *  mLogFile为空（标准输出）时不生效。建议在记录日志之前设置并且使用单独的日志文件
+     *
+     * @param   bool binary
+     * @retval  void
+     * @author  moon
+     */
+    void SetBinary(bool binary);
+
+    bool IsBinary() const
+    {
+        return mBinary;
+    }
+
+    /** 把二进制日志文件还原成文本格式，与文本模式的日志格式相同
+     *
+     * @param   const std::string & binFile
+     * @param   std::ostream & os
+     * @retval  int32_t                     成功返回0，文件无法打开或者格式错误返回-1（已经解析的部分仍然会输出）
+     * @author  moon
+     */
+    static int32_t DecodeBinaryLog(const std::string &binFile, std::ostream &os);
+
+    /** 开启异步模式
+     *  生产者只把日志追加到内存块中，由后台线程保持文件打开，使用writev批量写入
+     *  缓存字节数达到flushBytes、距离上次写入超过flushIntervalMs或者出现WARNN及以上级别的日志时写入
+     *  ASYNC_THREAD_RING模式下每个线程第一次写日志时创建自己的环形缓冲区，写日志只有一次memcpy，不加锁，
+     *  缓冲区在停止异步模式或者实例析构时由写线程释放
+     *
+     * @param   uint32_t maxQueueBytes      缓存的最大字节数，超过后生产者阻塞等待写入，ASYNC_THREAD_RING模式下为每个线程的缓冲区大小，
+     *                                      为0时使用DEFAULT_QUEUE_BYTES或DEFAULT_RING_BYTES
+     * @param   uint32_t flushBytes         缓存达到该字节数时立即写入，ASYNC_THREAD_RING模式下缓冲区过半时写入
+     * @param   uint32_t flushIntervalMs    最长写入间隔
+     * @param   ASYNC_MODE asyncMode        缓存方式
+     * @retval  int32_t                     成功返回0，打开日志文件失败返回-1
+     * @author  moon
+     */
+    int32_t StartAsync(uint32_t maxQueueBytes = 0, uint32_t flushBytes = 64 * 1024,
+                       uint32_t flushIntervalMs = 100, ASYNC_MODE asyncMode = ASYNC_SHARED_QUEUE);
+
+    /** 停止异步模式，写入所有缓存的日志后返回，之后恢复同步写入
+     *
+     * @retval  void
+     * @author  moon
+     */
+    void StopAsync();
+
+    /** 阻塞等待调用前提交的日志全部写入文件，并等待已经开始的日志轮转（更名、压缩、清理）完成
+     *
+     * @retval  void
+     * @author  moon
+     */
+    void Flush();
+
+    /** 设置按时间轮转和压缩
+     *  按时间轮转时，旧日志更名为"文件名.时段.扩展名"，如log.2017010112.txt，同一时段内因为大小轮转的加上"_序号"，
+     *  最多保留mMaxFileCount - 1个旧日志。不按时间轮转时按大小轮转，更名方式不变：mLogFile -> mLogFile1 -> mLogFile2 ...
+     *  更名、压缩和清理旧日志都在后台线程中进行，写日志的线程只做一次rename并重新打开文件
+     *
+     * @param   ROTATE_PERIOD rotatePeriod
+     * @param   bool compress           使用gzip压缩轮转出来的旧日志，文件名加上".gz"
+     * @retval  void
+     * @author  moon
+     */
+    void SetRotate(ROTATE_PERIOD rotatePeriod, bool compress = false);
+
+    bool IsAsync() const
+    {
+        return mAsyncRunning;
+    }
 
     std::string mLogFile;           // 记录日志的文件
     LOG_LEVEL mLogLevel;            // 日志级别
     uint32_t mMaxFileSize;          // 日志文件最大大小,0表示不限制
     uint32_t mMaxFileCount;         // 日志文件最大数量,0表示不保存日志
+    bool mCoarseClock;              // 使用CLOCK_REALTIME_COARSE获取日志时间，开销更小，精度为毫秒级
 
-    /** 获得调用栈
+    /** 获得调用栈，结果已经解析符号，需要降低开销时使用CppStackTrace
      *
      * @retval  string
      * @author  moontan
      */
     static string GetStackTrace();
+
+private:
+    // 二进制日志记录类型
+    enum BINARY_RECORD_TYPE
+    {
+        BINARY_SESSION = 1,                     // 会话开始，之后的调用点ID重新定义
+        BINARY_SITE = 2,                        // 调用点：ID、位置、格式字符串
+        BINARY_LOG = 3,                         // 日志：调用点ID、级别、时间、参数
+        BINARY_TEXT = 4                         // 已经格式化的文本日志，如直接调用LogMsg记录的日志
+    };
+
+    // 二进制日志参数类型
+    enum BINARY_ARG_TYPE
+    {
+        ARG_INT64 = 1,
+        ARG_UINT64 = 2,
+        ARG_DOUBLE = 3,
+        ARG_STRING = 4,
+        ARG_POINTER = 5
+    };
+
+    template <class T>
+    static void AppendValue(std::string &buf, T value)
+    {
+        buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // 二进制模式下按格式字符串解析每个参数对应的转换说明，决定参数的编码方式
+    struct BinaryArgCursor
+    {
+        const char *Format;                     // 下一次解析的位置
+        bool InSpec;                            // 上一个参数是'*'宽度或精度，还在同一个转换说明中
+        int Precision;                          // 当前转换说明的精度，-1表示未指定
+
+        /** 解析下一个参数对应的转换字符
+         *
+         * @retval  char        转换字符，如's'、'p'，'*'表示宽度参数，'.'表示精度参数，格式中没有更多参数时为0
+         * @author  moon
+         */
+        char Next();
+    };
+
+    static void EncodeArgs(std::string &buf, BinaryArgCursor &cursor)
+    {
+        static_cast<void>(buf);
+        static_cast<void>(cursor);
+    }
+
+    template <class T, class... Args>
+    static void EncodeArgs(std::string &buf, BinaryArgCursor &cursor, T value, Args... args)
+    {
+        EncodeArg(buf, cursor, value);
+        EncodeArgs(buf, cursor, args...);
+    }
+
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value>::type EncodeArg(std::string &buf, BinaryArgCursor &cursor, T value)
+    {
+        // "%.*s"的精度决定字符串参数最多读取的长度
+        if (cursor.Next() == '.')
+        {
+            cursor.Precision = value < 0 ? -1 : static_cast<int>(value);
+        }
+
+        if (std::is_signed<T>::value)
+        {
+            buf.push_back(ARG_INT64);
+            AppendValue(buf, static_cast<int64_t>(value));
+        }
+        else
+        {
+            buf.push_back(ARG_UINT64);
+            AppendValue(buf, static_cast<uint64_t>(value));
+        }
+    }
+
+    template <class T>
+    static typename std::enable_if<std::is_enum<T>::value>::type EncodeArg(std::string &buf, BinaryArgCursor &cursor, T value)
+    {
+        cursor.Next();
+        buf.push_back(ARG_INT64);
+        AppendValue(buf, static_cast<int64_t>(value));
+    }
+
+    static void EncodeArg(std::string &buf, BinaryArgCursor &cursor, double value)
+    {
+        cursor.Next();
+        buf.push_back(ARG_DOUBLE);
+        AppendValue(buf, value);
+    }
+
+    static void EncodeArg(std::string &buf, BinaryArgCursor &cursor, const char *value);
+
+    static void EncodeArg(std::string &buf, BinaryArgCursor &cursor, char *value)
+    {
+        EncodeArg(buf, cursor, static_cast<const char *>(value));
+    }
+
+    template <class T>
+    static void EncodeArg(std::string &buf, BinaryArgCursor &cursor, T *value)
+    {
+        cursor.Next();
+        buf.push_back(ARG_POINTER);
+        AppendValue(buf, reinterpret_cast<uint64_t>(value));
+    }
+
+    /** 开始一条二进制日志：必要时分配调用点ID并注册到本实例，写入记录头，返回线程的编码缓冲区
+     *
+     * @param   LOG_LEVEL logLevel
+     * @param   CppLogSite & site
+     * @retval  std::string &
+     * @author  moon
+     */
+    std::string &BeginBinaryRecord(LOG_LEVEL logLevel, CppLogSite &site);
+
+    /** 填写记录长度并写入日志
+     *
+     * @param   std::string & buf
+     * @param   LOG_LEVEL logLevel
+     * @retval  void
+     * @author  moon
+     */
+    void EndBinaryRecord(std::string &buf, LOG_LEVEL logLevel);
+
+    /** 把会话开始记录和所有已注册的调用点写入fd，每次打开日志文件后、写入日志前调用
+     *
+     * @param   int fd
+     * @retval  size_t      写入的字节数
+     * @author  moon
+     */
+    size_t WriteBinaryHead(int fd);
+
+    /** 写入日志数据，LogMsg、LogFormat和二进制日志的公共部分
+     *
+     * @param   const char * data
+     * @param   size_t len
+     * @param   LOG_LEVEL logLevel
+     * @param   bool newline        是否在末尾追加换行，二进制记录不追加
+     * @retval  void
+     * @author  moon
+     */
+    void WriteLog(const char *data, size_t len, LOG_LEVEL logLevel, bool newline);
+
+    // 等待后台线程处理的轮转文件
+    struct RotateJob
+    {
+        std::string File;                       // 已经从mLogFile更名的临时文件
+        std::string PeriodName;                 // 按时间轮转时文件所属的时段，如"2017010112"，否则为空
+        bool Compress;
+        uint32_t MaxFileCount;
+    };
+
+    // 异步模式下等待写线程解析的调用栈
+    struct PendingStackTrace
+    {
+        uint64_t TimeUs;
+        LOG_LEVEL Level;
+        const char *Location;
+        CppStackTrace StackTrace;
+        size_t BlockIndex;                      // 共享队列模式下记录时所在的块和块内偏移，写线程在此处插入
+        size_t BlockOffset;
+    };
+
+    /** 把"[时间][级别]位置|"格式化到buf中
+     *
+     * @param   char * buf              至少要有位置长度 + 64字节
+     * @param   const timeval & now
+     * @param   LOG_LEVEL logLevel
+     * @param   const char * location
+     * @param   size_t maxLocationLen
+     * @retval  size_t                  写入的长度
+     * @author  moon
+     */
+    static size_t FormatLogPrefix(char *buf, const timeval &now, LOG_LEVEL logLevel, const char *location, size_t maxLocationLen);
+
+    /** 把调用栈按日志格式追加到out中，二进制模式下为文本记录
+     *
+     * @param   const PendingStackTrace & stackTrace
+     * @param   std::string & out
+     * @retval  void
+     * @author  moon
+     */
+    void FormatStackTrace(const PendingStackTrace &stackTrace, std::string &out);
+
+    /** 重新计算调用点的生效级别并缓存
+     *
+     * @param   CppLogSite & site
+     * @retval  uint64_t        新的缓存值
+     * @author  moon
+     */
+    uint64_t UpdateSiteLevel(CppLogSite &site);
+
+    /** 发布新的模块级别快照，构造之后的修改需要持有mLevelLock，之后由调用者更新mLevelGeneration
+     *  发布后没有线程正在读取时释放所有旧快照
+     *
+     * @param   std::map<std::string, LOG_LEVEL> * pModuleLevels    新快照，由实例负责释放
+     * @retval  void
+     * @author  moon
+     */
+    void PublishModuleLevels(std::map<std::string, LOG_LEVEL> *pModuleLevels);
+
+    /** EnableSignalTrace设置的信号处理函数
+     *
+     * @param   int signum
+     * @retval  void
+     * @author  moon
+     */
+    static void SignalTraceHandler(int signum);
+
+    /** 准备写入日志文件：需要时打开、重新打开（文件被删除或者移走）或者轮转，并写入二进制模式的文件头，调用时持有mFileLock
+     *
+     * @param   time_t now
+     * @retval  void
+     * @author  moon
+     */
+    void PrepareLogFile(time_t now);
+
+    /** 打开mLogFile，记录大小和所属时段，调用时持有mFileLock
+     *
+     * @param   time_t now
+     * @retval  void
+     * @author  moon
+     */
+    void OpenLogFile(time_t now);
+
+    void CloseLogFile();
+
+    /** 轮转当前日志文件：更名为临时文件交给后台线程处理，然后重新打开，调用时持有mFileLock
+     *
+     * @param   time_t now
+     * @retval  void
+     * @author  moon
+     */
+    void RotateLogFile(time_t now);
+
+    /** 后台轮转线程，按顺序处理mRotateJobs
+     *
+     * @retval  void
+     * @author  moon
+     */
+    void RotateThread();
+
+    /** 日志文件循环更名，job.File -> mLogFile1，mLogFile1 -> mLogFile2 ...
+     *
+     * @param   const RotateJob & job
+     * @retval  void
+     * @author  moon
+     */
+    void RotateLogFiles(const RotateJob &job);
+
+    /** 按时间轮转的旧日志更名，并删除超过数量的最老的日志
+     *
+     * @param   const RotateJob & job
+     * @retval  void
+     * @author  moon
+     */
+    void RotatePeriodFiles(const RotateJob &job);
+
+    /** 异步写线程，ASYNC_SHARED_QUEUE模式
+     *
+     * @retval  void
+     * @author  moon
+     */
+    void AsyncWriteThread();
+
+    /** 异步写线程，ASYNC_THREAD_RING模式
+     *
+     * @retval  void
+     * @author  moon
+     */
+    void RingWriteThread();
+
+    /** 把日志写入当前线程的环形缓冲区
+     *
+     * @param   const char * msg
+     * @param   size_t len
+     * @param   LOG_LEVEL logLevel
+     * @param   bool newline
+     * @retval  bool                        异步模式已经停止或者日志超过缓冲区大小返回false，需要同步写入
+     * @author  moon
+     */
+    bool RingAppend(const char *msg, size_t len, LOG_LEVEL logLevel, bool newline);
+
+    /** 获得当前线程在本实例中的环形缓冲区，没有则创建并注册，同时移除已经关闭的缓冲区
+     *
+     * @retval  CppLogRing *        异步模式已经停止时返回NULL
+     * @author  moon
+     */
+    CppLogRing *GetThreadRing();
+
+    /** 使用writev把iov全部写入fd，处理部分写入
+     *
+     * @param   int fd
+     * @param   std::vector<iovec> & iovs   会被修改
+     * @retval  size_t                      写入的字节数
+     * @author  moon
+     */
+    static size_t WriteIov(int fd, std::vector<struct iovec> &iovs);
+
+    /** 写线程写入一批日志，需要时轮转，urgent时flush到磁盘
+     *
+     * @param   std::vector<iovec> & iovs
+     * @param   bool urgent
+     * @retval  void
+     * @author  moon
+     */
+    void AsyncWrite(std::vector<struct iovec> &iovs, bool urgent);
+
+    static std::atomic<uint64_t> sInstanceCount;        // 用于分配mInstanceId
+    const uint64_t mInstanceId;                         // 实例唯一ID，用于查找线程的环形缓冲区
+    const uint32_t mLevelSlot;                          // 使用的CppLogSite::mLevelCaches和mInstanceIds下标
+
+    /* 日志级别 */
+    static std::atomic<uint64_t> sLevelGeneration;      // 用于分配mLevelGeneration，保证不同实例不相同
+    static std::atomic<CppLog *> sSignalTraceLog;       // 由信号切换TRACE级别的实例
+    std::atomic<uint64_t> mLevelGeneration;             // 级别设置的版本，修改模块级别或者切换TRACE时更新，使调用点的缓存失效
+    std::atomic<bool> mSignalTrace;                     // 由信号打开了TRACE级别
+    // 模块级别的不可变快照，修改时复制一份后整体替换，调用点更新缓存时无锁读取
+    //  旧快照可能还在被其他线程读取，下次修改时发现没有正在读取的线程再释放
+    typedef std::map<std::string, LOG_LEVEL> ModuleLevels;
+    std::atomic<const ModuleLevels *> mModuleLevels;
+    std::atomic<uint32_t> mModuleLevelReaders;          // 正在读取快照的线程数
+    std::vector<std::unique_ptr<const ModuleLevels>> mModuleLevelSnapshots;  // 最后一个为当前快照，之前的等待释放
+    std::mutex mLevelLock;                              // 串行化模块级别的修改
+
+    /* 二进制模式 */
+    static std::atomic<uint32_t> sSiteCount;            // 用于分配CppLogSite::mId
+    bool mBinary;
+    std::atomic<bool> mBinaryHeadPending;               // 打开日志文件后需要先写入会话开始记录和所有调用点
+    std::vector<const CppLogSite *> mBinarySites;       // 注册到本实例的调用点，按注册顺序写入文件头
+    std::unordered_set<const CppLogSite *> mBinarySiteSet;  // 用于判断调用点是否已经注册
+    std::mutex mBinaryLock;                             // 保护mBinarySites和mBinarySiteSet
+
+    /* 日志文件，同步写入和异步写线程共用 */
+    int mLogFd;                                         // 保持打开的日志文件，-1表示未打开
+    uint64_t mLogFileSize;                              // 当前文件大小，用于判断是否需要轮转
+    uint64_t mLogInode;                                 // 打开的文件的inode，用于发现文件被删除或者移走
+    time_t mLogCheckTime;                               // 上次检查文件是否被移走的时间，每秒最多检查一次
+    time_t mLogPeriodEnd;                               // 当前时段的结束时间，按时间轮转时使用
+    std::string mLogPeriodName;                         // 当前文件所属的时段
+    ROTATE_PERIOD mRotatePeriod;
+    bool mRotateCompress;
+    uint32_t mRotateSeq;                                // 用于生成轮转临时文件名
+    std::mutex mFileLock;                               // 保护以上日志文件数据，写入和轮转时持有
+
+    /* 后台轮转 */
+    std::vector<RotateJob> mRotateJobs;
+    bool mRotateStop;
+    bool mRotateBusy;                                   // 后台线程正在处理
+    std::mutex mRotateLock;                             // 保护以上后台轮转数据
+    std::condition_variable mRotateCond;
+    std::thread mRotateThread;                          // 第一次轮转时启动
+
+    /* 异步模式 */
+    ASYNC_MODE mAsyncMode;
+    std::atomic<bool> mAsyncRunning;                    // 是否处于异步模式
+    bool mAsyncStop;                                    // 通知写线程退出
+    std::atomic<bool> mAsyncUrgent;                     // 有WARNN及以上的日志或者调用了Flush，需要立即写入并flush
+    std::atomic<bool> mAsyncWakeup;                     // 环形缓冲区过半或者已满，唤醒写线程
+    uint32_t mAsyncBlockSize;                           // 每个缓存块的大小，与flushBytes相同
+    uint32_t mAsyncMaxBlocks;                           // 最多缓存的块数
+    uint32_t mAsyncFlushIntervalMs;                     // 最长写入间隔
+    uint64_t mAsyncPendingBytes;                        // 未写入的字节数
+    uint64_t mAsyncCommitBytes;                         // 累计提交的字节数，用于Flush
+    uint64_t mAsyncWrittenBytes;                        // 累计写入的字节数
+    std::vector<std::string> mAsyncBlocks;              // 待写入的块，最后一个为当前正在追加的块
+    std::vector<std::string> mAsyncFreeBlocks;          // 写完回收的块，避免反复申请内存
+    uint32_t mRingSize;                                 // 每个线程环形缓冲区的大小
+    uint64_t mRingPassCount;                            // 写线程完成的轮数，用于Flush
+    std::vector<std::shared_ptr<CppLogRing>> mRings;    // 所有线程的环形缓冲区，由mAsyncLock保护
+    std::vector<PendingStackTrace> mStackTraces;        // 等待写线程解析的调用栈
+    std::mutex mAsyncLock;                              // 保护以上异步模式数据
+    std::condition_variable mAsyncWriterCond;           // 唤醒写线程
+    std::condition_variable mAsyncProducerCond;         // 缓存满或者Flush时等待写线程
+    std::thread mAsyncThread;
 };
 
 #endif
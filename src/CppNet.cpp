@@ -1,14 +1,41 @@
 #include "CppNet.h"
+#include "CppArray.h"
 
 #ifndef __CYGWIN__
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netdb.h>      // hostent
 #include <fcntl.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+// linux/fs.h中的BLOCK_SIZE宏和CppNetBuffer::BLOCK_SIZE冲突
+#ifdef BLOCK_SIZE
+#undef BLOCK_SIZE
+#endif
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+#define CPP_NET_URING
+#endif
 #endif
 #include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPP_NET_X86_SIMD
+#endif
 
 #include <list>
+#include <fstream>
+#include <algorithm>
 #include <thread>
 
 using namespace std;
@@ -16,15 +43,42 @@ using namespace std;
 static const uint32_t MAX_IP_STR_LEN = 16;
 static const uint32_t BUF_SIZE = 256;                       // 读写数据缓冲区大小
 
+static const uint32_t CLIENT_WAIT_MS = 100;                 // 压测客户端每次epoll_wait的最长时间(毫秒)，有事件时立即返回
+static const uint32_t SERVER_WAIT_MS = 10;                  // 服务端accept线程每次epoll_wait的时间(毫秒)
+static const uint32_t SERVER_REACTOR_WAIT_MS = 1000;        // 服务端reactor每次epoll_wait的时间(毫秒)，新连接和停止通过eventfd唤醒
+static const uint32_t SERVER_EPOLL_SIZE = 1024;             // 服务端Epoll池容量
+static const uint32_t SERVER_EVENT_SIZE = 256;              // 服务端每次epoll_wait最多返回的事件数
+static const uint32_t SERVER_READ_SIZE = 16 * 1024;         // 服务端每次read的大小
+static const int SERVER_LISTEN_BACKLOG = 1024;              // 服务端listen队列长度
+static const uint32_t POOL_WAIT_MS = 100;                   // 连接池后台线程每次epoll_wait的时间(毫秒)，用于检查超时和健康探测
+static const uint32_t POOL_EVENT_SIZE = 64;                 // 连接池每次epoll_wait最多返回的事件数
+static const uint32_t POOL_VIRTUAL_NODE_COUNT = 160;        // 一致性哈希每个后端的虚拟节点数
+static const uint64_t POOL_EVENT_FD_ID = 0;                 // 连接池epoll中eventfd的ID，连接ID从1开始
+static const uint32_t DNS_REFRESH_AHEAD_PERCENT = 80;       // 缓存时间过了这个比例后被访问，提前在后台刷新
+static const uint32_t RESP_MAX_INTEGER_LEN = 20;            // RESP长度行的最大字符数
+static const uint32_t RESP_MAX_DEPTH = 64;                  // RESP数组的最大嵌套层数
+static const uint32_t URING_MIN_ENTRIES = 64;               // io_uring队列最小长度
+static const uint32_t URING_MAX_ENTRIES = 4096;             // io_uring提交队列最大长度，超过时填满后先提交一次
+static const uint32_t UDP_GSO_MAX_SEGMENTS = 64;            // 每个GSO消息最多合并的报文数，老内核的上限为64
+static const uint32_t UDP_GSO_MAX_BYTES = 65000;            // 每个GSO消息最大的数据长度，加上IP和UDP头不超过64KB
+static const uint32_t UDP_GRO_BUF_SIZE = 65536;             // 开启GRO时每个消息的接收缓冲区大小
+
 string CppNet::NetIpToStr(uint32_t ip)
 {
-    return inet_ntoa(*((in_addr *)&ip));
+    char buf[INET_ADDRSTRLEN];
+    return string(buf, FormatIpv4(ip, buf));
 }
 
 uint32_t CppNet::StrToNetIp(const string &ipStr)
 {
     uint32_t ip;
 
+    if (ParseIpv4(ipStr.data(), ipStr.size(), ip))
+    {
+        return ip;
+    }
+
+    // 兼容inet_aton支持的127.1、0x7f.0.0.1等写法
     if (inet_aton(ipStr.c_str(), (in_addr *)&ip))
     {
         return ip;
@@ -33,416 +87,4494 @@ uint32_t CppNet::StrToNetIp(const string &ipStr)
     THROW("StrToNetIp error,ip=%s", ipStr.c_str());
 }
 
-// bool CppNet::NetIsOK( vector<IpPort> &ipPort )
-// {
-//     FILE *fp;
-//     for (vector<IpPort>::const_iterator it = ipPort.begin();it!=ipPort.end();++it)
-//     {
-//         if (!(fp=popen((string("ping -c 4 ")+it->IP).c_str(),"r")))
-//         {
-//             continue;
-//         }
-//     }
-// }
-
-#ifndef __CYGWIN__
-CppEpollManager::CppEpollManager(uint32_t size) throw(CppException)
+/** 写入0-255的十进制
+ *
+ * @param   uint32_t value
+ * @param   char * pBuf
+ * @retval  size_t      写入的长度
+ * @author  moontan
+ */
+static inline size_t FormatByte(uint32_t value, char *pBuf)
 {
-    mEpollFd = epoll_create(size);
-    CHECK_THROW_F(mEpollFd >= 0, "epoll_create失败,errno[%d],error[%s].", errno, strerror(errno));
-    mUniqEpollFd = make_shared<UniqueFd>(mEpollFd);
+    if (value >= 100)
+    {
+        pBuf[0] = (char)('0' + value / 100);
+        pBuf[1] = (char)('0' + value / 10 % 10);
+        pBuf[2] = (char)('0' + value % 10);
+        return 3;
+    }
+
+    if (value >= 10)
+    {
+        pBuf[0] = (char)('0' + value / 10);
+        pBuf[1] = (char)('0' + value % 10);
+        return 2;
+    }
+
+    pBuf[0] = (char)('0' + value);
+    return 1;
 }
 
-CppEpollManager::~CppEpollManager()
+// 写入小写十六进制，没有前导0
+static inline size_t FormatHex16(uint32_t value, char *pBuf)
 {
+    static const char HEX_CHARS[] = "0123456789abcdef";
+    size_t len = 0;
+    for (int32_t shift = 12; shift >= 0; shift -= 4)
+    {
+        uint32_t digit = (value >> shift) & 0xF;
+        if (digit != 0 || len != 0 || shift == 0)
+        {
+            pBuf[len++] = HEX_CHARS[digit];
+        }
+    }
 
+    return len;
 }
 
-int32_t CppEpollManager::ProcWrite(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &writeFunc)throw(CppException)
+// 写入十进制端口
+static inline size_t FormatPort(uint32_t port, char *pBuf)
 {
-    int fd = GetFdFromEvent(inevent);
+    char digits[5];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + port % 10);
+        port /= 10;
+    } while (port != 0);
 
-    int32_t ret = writeFunc(inevent);
-    if (ret != 0)
+    for (size_t i = 0; i < count; ++i)
     {
-        return ret;
+        pBuf[i] = digits[count - 1 - i];
     }
 
-    // 检查可读状态
-    inevent.events = EPOLLIN | EPOLLRDHUP;
-    AddOrModFd(fd, inevent);
-
-    // DEBUG_LOG("Proc a request,send[%lu].", gClientData[inevent.data.fd]);
-
-    return 0;
+    return count;
 }
 
-int32_t CppEpollManager::ProcRead(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &readFunc) throw(CppException)
+static inline int32_t HexValue(char c)
 {
-    int fd = GetFdFromEvent(inevent);
-
-    // 读取请求
-    int32_t ret = readFunc(inevent);
-    if (ret != 0)
+    if (c >= '0' && c <= '9')
     {
-        return ret;
+        return c - '0';
     }
 
-    // 检查可写状态
-    inevent.events = EPOLLOUT | EPOLLRDHUP;
-    AddOrModFd(fd, inevent);
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
 
-    // DEBUG_LOG("Read data[%lu].", actualValue);
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
 
-    return 0;
+    return -1;
 }
 
-void CppEpollManager::AddOrModFd(int fd, epoll_event &event) throw(CppException)
+bool CppNet::ParseIpv4(const char *pStr, size_t len, uint32_t &netIp)
 {
-    int32_t ret = 0;
-    SetFdToEvent(fd, event);
-    unique_lock<mutex> lock(mFdLock);
-    if (mFds.find(fd) == mFds.end())
+    uint8_t bytes[4];
+    size_t pos = 0;
+    for (uint32_t i = 0; i < sizeof(bytes); ++i)
     {
-        ret = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event);
-        mFds.insert(fd);
+        if (i > 0)
+        {
+            if (pos >= len || pStr[pos] != '.')
+            {
+                return false;
+            }
+
+            ++pos;
+        }
+
+        size_t begin = pos;
+        uint32_t value = 0;
+        while (pos < len && pos - begin < 3 && pStr[pos] >= '0' && pStr[pos] <= '9')
+        {
+            value = value * 10 + (pStr[pos] - '0');
+            ++pos;
+        }
+
+        // 没有数字、超过255或者有前导0
+        if (pos == begin || value > 255 || (pStr[begin] == '0' && pos - begin > 1))
+        {
+            return false;
+        }
+
+        bytes[i] = (uint8_t)value;
     }
-    else
+
+    if (pos != len)
     {
-        ret = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event);
+        return false;
     }
 
-    ERROR_THROW_F(ret, "epoll_ctl failed,event[%u],fd[%d],errno[%d],error[%s].",
-                  event.events, fd, errno, strerror(errno));
+    memcpy(&netIp, bytes, sizeof(netIp));
+    return true;
 }
 
-void CppEpollManager::DelFd(int fd) throw(CppException)
+bool CppNet::ParseIpv6(const char *pStr, size_t len, uint8_t ip[16])
 {
-    int32_t ret = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
-    ERROR_THROW_F(ret, "epoll_ctl失败,fd[%d],errno[%d],error[%s].", fd, errno, strerror(errno));
-    unique_lock<mutex> lock(mFdLock);
-    mFds.erase(fd);
-    // DEBUG_LOG("Delete fd[%d] from epoll success.", fd);
-}
+    const size_t IPV6_SIZE = 16;
+    uint8_t bytes[IPV6_SIZE];
+    size_t count = 0;           // 已经解析的字节数
+    int32_t gapPos = -1;        // ::在bytes中的位置
+    size_t pos = 0;
 
-void CppEpollManager::Wait(function<int32_t(epoll_event &inevent)> &readFunc,
-                           function<int32_t(epoll_event &inevent)> &writeFunc,
-                           function<void(int fd)> &deleteFdFunc,
-                           uint32_t timeOutMs) throw(CppException)
-{
+    if (len >= 2 && pStr[0] == ':' && pStr[1] == ':')
     {
-        unique_lock<mutex> lock(mFdLock);
+        gapPos = 0;
+        pos = 2;
+    }
 
-        // mEvents扩容，缩容使用其他函数手工实现
-        if (mEvents.size() < mFds.size())
+    while (pos < len)
+    {
+        if (count == IPV6_SIZE)
         {
-            mEvents.resize(mFds.size());
+            return false;
         }
-    }
 
-    int32_t fdsCount = epoll_wait(mEpollFd, &mEvents[0], mEvents.size(), timeOutMs);
-    int32_t ret = 0;
+        size_t begin = pos;
+        uint32_t value = 0;
+        int32_t digit;
+        while (pos < len && pos - begin < 4 && (digit = HexValue(pStr[pos])) >= 0)
+        {
+            value = (value << 4) | (uint32_t)digit;
+            ++pos;
+        }
 
-    for (int32_t i = 0; i < fdsCount; ++i)
-    {
-        epoll_event &event = mEvents[i];
-        if (event.events & EPOLLIN)
+        if (pos == begin)
         {
-            if (event.events & EPOLLRDHUP)
+            return false;
+        }
+
+        // 最后32位是点分十进制的IPv4
+        if (pos < len && pStr[pos] == '.')
+        {
+            uint32_t netIp;
+            if (count + sizeof(netIp) > IPV6_SIZE || !ParseIpv4(pStr + begin, len - begin, netIp))
             {
-                // 同时有EPOLLIN和EPOLLRDHUP事件表示对端断开，删除fd
-                DelFd(GetFdFromEvent(event));
-                if (deleteFdFunc)
-                {
-                    deleteFdFunc(event.data.fd);
-                }
+                return false;
             }
-            else
-            {
-                // 读取并且检查数据
-                ret = ProcRead(event, readFunc);
 
-                // 失败删除fd
-                if (ret != 0)
-                {
-                    DelFd(GetFdFromEvent(event));
-                    if (deleteFdFunc)
-                    {
-                        deleteFdFunc(event.data.fd);
-                    }
-                }
-            }
+            memcpy(bytes + count, &netIp, sizeof(netIp));
+            count += sizeof(netIp);
+            break;
         }
-        else if (event.events & EPOLLOUT)
+
+        bytes[count++] = (uint8_t)(value >> 8);
+        bytes[count++] = (uint8_t)value;
+        if (pos == len)
         {
-            // 写入数据
-            ret = ProcWrite(event, writeFunc);
+            break;
+        }
 
-            // 失败删除fd
-            if (ret != 0)
+        if (pStr[pos] != ':' || ++pos == len)
+        {
+            return false;
+        }
+
+        if (pStr[pos] == ':')
+        {
+            if (gapPos >= 0)
             {
-                DelFd(GetFdFromEvent(event));
-                if (deleteFdFunc)
-                {
-                    deleteFdFunc(event.data.fd);
-                }
+                return false;
             }
+
+            gapPos = (int32_t)count;
+            ++pos;
         }
-        else
+    }
+
+    if (gapPos >= 0)
+    {
+        // ::至少代表一组0
+        if (count == IPV6_SIZE)
         {
-            continue;
+            return false;
         }
+
+        size_t tailSize = count - gapPos;
+        memmove(bytes + IPV6_SIZE - tailSize, bytes + gapPos, tailSize);
+        memset(bytes + gapPos, 0, IPV6_SIZE - count);
+    }
+    else if (count != IPV6_SIZE)
+    {
+        return false;
     }
-}
 
-int32_t CppEpollManager::Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs)
-{
-    int32_t pollSize = epoll_wait(mEpollFd, events, eventSize, timeOutMs);
-    return pollSize;
+    memcpy(ip, bytes, IPV6_SIZE);
+    return true;
 }
 
-void CppEpollManager::ReleaseEventsMemory()
+size_t CppNet::FormatIpv4(uint32_t netIp, char *pBuf)
 {
-    mEvents.shrink_to_fit();
-}
+    const uint8_t *pBytes = reinterpret_cast<const uint8_t *>(&netIp);
+    size_t len = FormatByte(pBytes[0], pBuf);
+    for (uint32_t i = 1; i < sizeof(netIp); ++i)
+    {
+        pBuf[len++] = '.';
+        len += FormatByte(pBytes[i], pBuf + len);
+    }
 
-int CppEpollManager::GetFdFromEvent(epoll_event &event)
-{
-    return event.data.fd;
+    pBuf[len] = '\0';
+    return len;
 }
 
-void CppEpollManager::SetFdToEvent(int fd, epoll_event &event)
+size_t CppNet::FormatIpv6(const uint8_t ip[16], char *pBuf)
 {
-    event.data.fd = fd;
-}
+    const int32_t WORD_COUNT = 8;
+    uint32_t words[WORD_COUNT];
+    for (int32_t i = 0; i < WORD_COUNT; ++i)
+    {
+        words[i] = ((uint32_t)ip[i * 2] << 8) | ip[i * 2 + 1];
+    }
 
-MultiThreadClientBase::MultiThreadClientBase(const std::string &serverAddr, uint16_t serverPort,
-                                             uint32_t runSecond, uint32_t clientThreadCount,
-                                             uint32_t clientCountPerThread,
-                                             uint32_t epollSize, CppLog *mpCppLog) :
-    gSuccessCount(0), gFailCount(0), gTotalTimeUs(0), gMinTimeUs(0), gMaxTimeUs(0),
-    gCurrTotalTimeUs(0), gCurrMinTimeUs(0), gCurrMaxTimeUs(0), gClientStop(false),
-    mServerAddr(serverAddr), mServerPort(serverPort), mRunSecond(runSecond),
-    mClientThreadCount(clientThreadCount), mClientCountPerThread(clientCountPerThread),
-    mEpollSize(epollSize), mpCppLog(mpCppLog)
-{
+    // 找到最长的连续0，长度相同时取第一个，只有一组0时不缩写
+    int32_t bestBase = -1;
+    int32_t bestLen = 0;
+    int32_t curBase = -1;
+    for (int32_t i = 0; i < WORD_COUNT; ++i)
+    {
+        if (words[i] != 0)
+        {
+            curBase = -1;
+            continue;
+        }
 
-}
+        if (curBase < 0)
+        {
+            curBase = i;
+        }
 
-int32_t MultiThreadClientBase::ProcWrite(uint32_t threadId, epoll_event &inevent)
-{
-    const string data = GetSendData(threadId, inevent.data.fd);
-    int32_t ret = write(inevent.data.fd, data.data(), data.size());
-    CHECK_RETURN_F(mpCppLog, ret > 0, ret, CppLog::ERROR,
-                   "write失败,event[%u],fd[%d],errno[%d],error[%s].",
-                   inevent.events, inevent.data.fd, errno, strerror(errno));
-    // DEBUG_LOG("Proc a request,send[%lu].", gClientData[inevent.data.fd]);
+        if (i - curBase + 1 > bestLen)
+        {
+            bestBase = curBase;
+            bestLen = i - curBase + 1;
+        }
+    }
+
+    if (bestLen < 2)
+    {
+        bestBase = -1;
+    }
 
-    // 记录开始时间
-    gettimeofday(&GetClientData(threadId, inevent.data.fd)->sendTime, NULL);
+    size_t len = 0;
+    for (int32_t i = 0; i < WORD_COUNT; ++i)
+    {
+        if (bestBase >= 0 && i >= bestBase && i < bestBase + bestLen)
+        {
+            if (i == bestBase)
+            {
+                pBuf[len++] = ':';
+            }
 
-    return 0;
-}
+            continue;
+        }
 
-int32_t MultiThreadClientBase::ProcRead(uint32_t threadId, epoll_event &inevent)
-{
-    // 记录结束时间
-    timeval receiveTime;
-    gettimeofday(&receiveTime, NULL);
+        if (i != 0)
+        {
+            pBuf[len++] = ':';
+        }
 
-    // 计算耗时
-    int64_t usedTimeUs = CppTime::TimevDiff(receiveTime, GetClientData(threadId, inevent.data.fd)->sendTime);
-    CHECK_RETURN_F(mpCppLog, usedTimeUs > 0, -1, CppLog::ERROR, "时间不正确[%ld].", usedTimeUs);
+        // IPv4兼容地址(::a.b.c.d)和IPv4映射地址(::ffff:a.b.c.d)的最后32位按点分十进制输出
+        if (i == 6 && bestBase == 0 && (bestLen == 6 || (bestLen == 5 && words[5] == 0xFFFF)))
+        {
+            uint32_t netIp;
+            memcpy(&netIp, ip + 12, sizeof(netIp));
+            return len + FormatIpv4(netIp, pBuf + len);
+        }
 
-    // 总耗时统计
-    gTotalTimeUs += usedTimeUs;
-    if (gMaxTimeUs < static_cast<uint64_t>(usedTimeUs))
-    {
-        gMaxTimeUs = usedTimeUs;
+        len += FormatHex16(words[i], pBuf + len);
     }
 
-    if (gMinTimeUs == 0 || gMinTimeUs > static_cast<uint64_t>(usedTimeUs))
+    if (bestBase >= 0 && bestBase + bestLen == WORD_COUNT)
     {
-        gMinTimeUs = usedTimeUs;
+        pBuf[len++] = ':';
     }
 
-    // 周期耗时统计
-    gCurrTotalTimeUs += usedTimeUs;
+    pBuf[len] = '\0';
+    return len;
+}
+
+IpPortKey::IpPortKey(uint32_t netIp, uint16_t port) : mPort(port)
+{
+    uint8_t *pBytes = reinterpret_cast<uint8_t *>(mAddr);
+    memset(pBytes, 0, 10);
+    pBytes[10] = 0xFF;
+    pBytes[11] = 0xFF;
+    memcpy(pBytes + 12, &netIp, sizeof(netIp));
+}
 
-    if (gCurrMaxTimeUs < static_cast<uint64_t>(usedTimeUs))
+bool IpPortKey::Parse(const char *pIp, uint16_t port)
+{
+    size_t len = strlen(pIp);
+    uint32_t netIp;
+    if (CppNet::ParseIpv4(pIp, len, netIp))
     {
-        gCurrMaxTimeUs = usedTimeUs;
+        *this = IpPortKey(netIp, port);
+        return true;
     }
 
-    if (gCurrMinTimeUs == 0 || gCurrMinTimeUs > static_cast<uint64_t>(usedTimeUs))
+    uint8_t ip[16];
+    if (CppNet::ParseIpv6(pIp, len, ip))
     {
-        gCurrMinTimeUs = usedTimeUs;
+        memcpy(mAddr, ip, sizeof(mAddr));
+        mPort = port;
+        return true;
     }
 
-    // 读取请求
-    string bufStr;
-    char buf[BUF_SIZE];
+    return false;
+}
 
-    int readSize;
-    while ((readSize = read(inevent.data.fd, buf, sizeof(buf))) > 0)
+bool IpPortKey::FromSockAddr(const sockaddr *pAddr)
+{
+    if (pAddr->sa_family == AF_INET)
     {
-        CHECK_RETURN_F(mpCppLog, readSize > 0, readSize, CppLog::ERROR,
-                       "read error,readSize[%d],event[%u],fd[%d,]errno[%d],error[%s].", readSize, inevent.events, inevent.data.fd, errno, strerror(errno));
+        const sockaddr_in *pAddr4 = reinterpret_cast<const sockaddr_in *>(pAddr);
+        *this = IpPortKey(pAddr4->sin_addr.s_addr, ntohs(pAddr4->sin_port));
+        return true;
+    }
 
-        bufStr.append(buf, readSize);
+    if (pAddr->sa_family == AF_INET6)
+    {
+        const sockaddr_in6 *pAddr6 = reinterpret_cast<const sockaddr_in6 *>(pAddr);
+        memcpy(mAddr, &pAddr6->sin6_addr, sizeof(mAddr));
+        mPort = ntohs(pAddr6->sin6_port);
+        return true;
     }
 
-    // DEBUG_LOG("Read data[%lu].", actualValue);
+    return false;
+}
 
-    CheckResponse(threadId, inevent.data.fd, bufStr) ? ++gSuccessCount : ++gFailCount;
+socklen_t IpPortKey::ToSockAddr(sockaddr_storage &addr) const
+{
+    memset(&addr, 0, sizeof(addr));
+    if (IsIpv4())
+    {
+        sockaddr_in *pAddr4 = reinterpret_cast<sockaddr_in *>(&addr);
+        pAddr4->sin_family = AF_INET;
+        pAddr4->sin_addr.s_addr = GetIpv4();
+        pAddr4->sin_port = htons(mPort);
+        return sizeof(sockaddr_in);
+    }
 
-    return 0;
+    sockaddr_in6 *pAddr6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    pAddr6->sin6_family = AF_INET6;
+    memcpy(&pAddr6->sin6_addr, mAddr, sizeof(mAddr));
+    pAddr6->sin6_port = htons(mPort);
+    return sizeof(sockaddr_in6);
 }
 
-void MultiThreadClientBase::ProcDeleteFd(uint32_t threadId, int fd)
+size_t IpPortKey::FormatIp(char *pBuf) const
 {
-    mClientDatas[threadId].erase(fd);
+    return IsIpv4() ? CppNet::FormatIpv4(GetIpv4(), pBuf) : CppNet::FormatIpv6(GetIpv6(), pBuf);
 }
 
-void MultiThreadClientBase::ThreadFunc(uint32_t threadId)
+size_t IpPortKey::Format(char *pBuf) const
 {
-    // 创建Epoll池
-    CppEpollManager mEpollManager(mEpollSize);
-
-    epoll_event ev;
-    ev.events = EPOLLOUT | EPOLLRDHUP;      // 连接之后监听可写事件
-
-    // 创建客户端并将其加入epoll池
-    for (uint32_t i = 0; i < mClientCountPerThread; ++i)
+    size_t len = 0;
+    if (IsIpv4())
     {
-        ev.data.fd = ConnectServer();
-        CHECK_CONTINUE(mpCppLog, ev.data.fd >= 0, ev.data.fd, CppLog::ERROR);
-        mEpollManager.AddOrModFd(ev.data.fd, ev);
-        mClientDatas[threadId][ev.data.fd] = MakeNewClientData();
-        mClientDatas[threadId][ev.data.fd]->uniqueFd.Reset(ev.data.fd);
+        len = CppNet::FormatIpv4(GetIpv4(), pBuf);
     }
-
-    int waitTime = 0;
-    function<int32_t(epoll_event &inevent)> readFunc = bind(&MultiThreadClientBase::ProcRead, this, threadId, placeholders::_1);
-    function<int32_t(epoll_event &inevent)> writeFunc = bind(&MultiThreadClientBase::ProcWrite, this, threadId, placeholders::_1);
-    function<void(int fd)> deleteFdFunc = bind(&MultiThreadClientBase::ProcDeleteFd, this, threadId, placeholders::_1);
-
-    while (!gClientStop)
+    else
     {
-        // 事件循环
-        mEpollManager.Wait(readFunc, writeFunc, deleteFdFunc, waitTime);
+        pBuf[len++] = '[';
+        len += CppNet::FormatIpv6(GetIpv6(), pBuf + len);
+        pBuf[len++] = ']';
     }
 
-    DEBUG_ILOG(mpCppLog, "exit thread[%u].", threadId);
+    pBuf[len++] = ':';
+    len += FormatPort(mPort, pBuf + len);
+    pBuf[len] = '\0';
+    return len;
 }
 
-int32_t MultiThreadClientBase::ConnectServer()
+static inline uint16_t ByteSwap(uint16_t data)
 {
-    char buf[1024];
-    int ret;
-
-    // 解析域名，如果是IP则不用解析，如果出错，显示错误信息
-    hostent nlp_host, *p_host;
-    gethostbyname_r(mServerAddr.c_str(), &nlp_host, buf, sizeof(buf), &p_host, &ret);
-    CHECK_RETURN_F(mpCppLog, ret == 0, -1, CppLog::ERROR, "gethostbyname失败,errno[%d],error[%s].", errno, strerror(errno));
-
-    // 设置pin变量，包括协议、地址、端口等，此段可直接复制到自己的程序中
-    sockaddr_in pin;
-    bzero(&pin, sizeof(pin));
-    pin.sin_family = AF_INET;                   // AF_INET表示使用IPv4
-    pin.sin_addr.s_addr = ((struct in_addr *)(nlp_host.h_addr))->s_addr;       // TODO:这一句是干嘛用的？好像没什么用，去掉不影响。
-    pin.sin_port = htons(mServerPort);
+    return __builtin_bswap16(data);
+}
 
-    // 建立socket
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    CHECK_RETURN_F(mpCppLog, fd >= 0, fd, CppLog::ERROR, "socket失败,ret[%d],errno[%d],error[%s].", fd, errno, strerror(errno));
+static inline uint32_t ByteSwap(uint32_t data)
+{
+    return __builtin_bswap32(data);
+}
 
-    // 中途出错，释放FD
-    UniqueFd uniqFd(fd);
+static inline uint64_t ByteSwap(uint64_t data)
+{
+    return __builtin_bswap64(data);
+}
 
-    // 建立连接
-    ret = connect(fd, (struct sockaddr*)&pin, sizeof(pin));
-    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "connect失败,errno[%d],error[%s].", errno, strerror(errno));
+template <typename T>
+static void ByteSwapArrayScalar(const T *pSrc, T *pDest, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        pDest[i] = ByteSwap(pSrc[i]);
+    }
+}
+
+#ifdef CPP_NET_X86_SIMD
+// 每个元素内部字节倒序的pshufb掩码，AVX2的vpshufb在两个128位通道内分别使用同样的掩码
+template <typename T>
+static void GetByteSwapMask(char mask[16])
+{
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t base = i - i % sizeof(T);
+        mask[i] = (char)(base + sizeof(T) - 1 - i % sizeof(T));
+    }
+}
+
+// 编译选项中没有-mssse3/-mavx2，只在这两个函数上开启，调用前检查CPU是否支持
+template <typename T>
+__attribute__((target("ssse3")))
+static void ByteSwapArraySsse3(const T *pSrc, T *pDest, size_t count)
+{
+    const size_t STEP = 16 / sizeof(T);
+    char maskBytes[16];
+    GetByteSwapMask<T>(maskBytes);
+    __m128i mask = _mm_loadu_si128((const __m128i *)maskBytes);
+
+    size_t i = 0;
+    for (; i + STEP <= count; i += STEP)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *)(pSrc + i));
+        _mm_storeu_si128((__m128i *)(pDest + i), _mm_shuffle_epi8(data, mask));
+    }
+
+    ByteSwapArrayScalar(pSrc + i, pDest + i, count - i);
+}
+
+template <typename T>
+__attribute__((target("avx2")))
+static void ByteSwapArrayAvx2(const T *pSrc, T *pDest, size_t count)
+{
+    const size_t STEP = 32 / sizeof(T);
+    char maskBytes[16];
+    GetByteSwapMask<T>(maskBytes);
+    __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)maskBytes));
+
+    // 每次处理两个256位，减少循环判断
+    size_t i = 0;
+    for (; i + 2 * STEP <= count; i += 2 * STEP)
+    {
+        __m256i data0 = _mm256_loadu_si256((const __m256i *)(pSrc + i));
+        __m256i data1 = _mm256_loadu_si256((const __m256i *)(pSrc + i + STEP));
+        _mm256_storeu_si256((__m256i *)(pDest + i), _mm256_shuffle_epi8(data0, mask));
+        _mm256_storeu_si256((__m256i *)(pDest + i + STEP), _mm256_shuffle_epi8(data1, mask));
+    }
+
+    for (; i + STEP <= count; i += STEP)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i *)(pSrc + i));
+        _mm256_storeu_si256((__m256i *)(pDest + i), _mm256_shuffle_epi8(data, mask));
+    }
+
+    ByteSwapArrayScalar(pSrc + i, pDest + i, count - i);
+}
+#endif
+
+CppNet::SIMD_LEVEL CppNet::GetSimdLevel()
+{
+#ifdef CPP_NET_X86_SIMD
+    static const SIMD_LEVEL level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+                                    (__builtin_cpu_supports("ssse3") ? SIMD_SSSE3 : SIMD_NONE);
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+template <typename T>
+static void HtonArrayImpl(const T *pSrc, T *pDest, size_t count, CppNet::SIMD_LEVEL maxLevel)
+{
+    if (CppNet::IsBigendian())
+    {
+        if (pSrc != pDest)
+        {
+            memcpy(pDest, pSrc, count * sizeof(T));
+        }
+
+        return;
+    }
+
+#ifdef CPP_NET_X86_SIMD
+    // 不足一个向量时直接逐个转换
+    CppNet::SIMD_LEVEL level = min(maxLevel, CppNet::GetSimdLevel());
+    if (level == CppNet::SIMD_AVX2 && count * sizeof(T) >= 32)
+    {
+        ByteSwapArrayAvx2(pSrc, pDest, count);
+        return;
+    }
+
+    if (level >= CppNet::SIMD_SSSE3 && count * sizeof(T) >= 16)
+    {
+        ByteSwapArraySsse3(pSrc, pDest, count);
+        return;
+    }
+#endif
+
+    ByteSwapArrayScalar(pSrc, pDest, count);
+}
+
+void CppNet::HtonArray(const uint64_t *pSrc, uint64_t *pDest, size_t count, SIMD_LEVEL maxLevel)
+{
+    HtonArrayImpl(pSrc, pDest, count, maxLevel);
+}
+
+void CppNet::HtonArray(const uint32_t *pSrc, uint32_t *pDest, size_t count, SIMD_LEVEL maxLevel)
+{
+    HtonArrayImpl(pSrc, pDest, count, maxLevel);
+}
+
+void CppNet::HtonArray(const uint16_t *pSrc, uint16_t *pDest, size_t count, SIMD_LEVEL maxLevel)
+{
+    HtonArrayImpl(pSrc, pDest, count, maxLevel);
+}
+
+// bool CppNet::NetIsOK( vector<IpPort> &ipPort )
+// {
+//     FILE *fp;
+//     for (vector<IpPort>::const_iterator it = ipPort.begin();it!=ipPort.end();++it)
+//     {
+//         if (!(fp=popen((string("ping -c 4 ")+it->IP).c_str(),"r")))
+//         {
+//             continue;
+//         }
+//     }
+// }
+
+// 每个线程的空闲块，线程退出时释放
+struct CppNetBlockPool
+{
+    CppNetBlockPool() : pHead(NULL), Count(0)
+    {
+    }
+
+    ~CppNetBlockPool();
+
+    CppNetBuffer::Block *pHead;
+    uint32_t Count;
+};
+
+static const uint32_t MAX_POOL_BLOCK_COUNT = 256;           // 每个线程最多缓存的空闲块数量
+static const uint32_t READ_EXTRA_BLOCK_COUNT = 2;           // 每次readv额外使用的新块数量
+
+static thread_local CppNetBlockPool tBlockPool;
+static __thread bool tBlockPoolDestroyed = false;          // 线程退出时块池已经析构，之后释放的块直接delete
+
+CppNetBlockPool::~CppNetBlockPool()
+{
+    while (pHead != NULL)
+    {
+        CppNetBuffer::Block *pNext = pHead->pNext;
+        delete pHead;
+        pHead = pNext;
+    }
+
+    Count = 0;
+    tBlockPoolDestroyed = true;
+}
+
+CppNetBuffer::Block *CppNetBuffer::AllocBlock()
+{
+    Block *pBlock;
+    if (!tBlockPoolDestroyed && tBlockPool.pHead != NULL)
+    {
+        pBlock = tBlockPool.pHead;
+        tBlockPool.pHead = pBlock->pNext;
+        --tBlockPool.Count;
+    }
+    else
+    {
+        pBlock = new Block;
+    }
+
+    pBlock->pNext = NULL;
+    pBlock->Begin = 0;
+    pBlock->End = 0;
+    return pBlock;
+}
+
+void CppNetBuffer::FreeBlock(Block *pBlock)
+{
+    if (tBlockPoolDestroyed || tBlockPool.Count >= MAX_POOL_BLOCK_COUNT)
+    {
+        delete pBlock;
+        return;
+    }
+
+    pBlock->pNext = tBlockPool.pHead;
+    tBlockPool.pHead = pBlock;
+    ++tBlockPool.Count;
+}
+
+void CppNetBuffer::PushBlock(Block *pBlock)
+{
+    if (mpTail == NULL)
+    {
+        mpHead = pBlock;
+    }
+    else
+    {
+        mpTail->pNext = pBlock;
+    }
+
+    mpTail = pBlock;
+}
+
+void CppNetBuffer::Append(const char *data, size_t size)
+{
+    mSize += size;
+    while (size > 0)
+    {
+        if (mpTail == NULL || mpTail->End == BLOCK_SIZE)
+        {
+            PushBlock(AllocBlock());
+        }
+
+        size_t copySize = min(size, static_cast<size_t>(BLOCK_SIZE - mpTail->End));
+        memcpy(mpTail->Data + mpTail->End, data, copySize);
+        mpTail->End += copySize;
+        data += copySize;
+        size -= copySize;
+    }
+}
+
+const char *CppNetBuffer::Peek(size_t size)
+{
+    if (size > mSize)
+    {
+        return NULL;
+    }
+
+    if (size == 0 || mpHead->End - mpHead->Begin >= size)
+    {
+        return mpHead == NULL ? "" : mpHead->Data + mpHead->Begin;
+    }
+
+    mPeekBuf.resize(size);
+    Copy(&mPeekBuf[0], size);
+    return mPeekBuf.data();
+}
+
+size_t CppNetBuffer::Copy(char *dest, size_t size, size_t offset) const
+{
+    size_t copied = 0;
+    for (Block *pBlock = mpHead; pBlock != NULL && copied < size; pBlock = pBlock->pNext)
+    {
+        size_t blockSize = pBlock->End - pBlock->Begin;
+        if (offset >= blockSize)
+        {
+            offset -= blockSize;
+            continue;
+        }
+
+        size_t copySize = min(size - copied, blockSize - offset);
+        memcpy(dest + copied, pBlock->Data + pBlock->Begin + offset, copySize);
+        copied += copySize;
+        offset = 0;
+    }
+
+    return copied;
+}
+
+size_t CppNetBuffer::Find(const string &pattern, size_t offset) const
+{
+    size_t size = pattern.size();
+    if (size == 0 || offset + size > mSize)
+    {
+        return size == 0 && offset <= mSize ? offset : string::npos;
+    }
+
+    // 用memchr找第一个字符，再逐个块比较剩下的字符
+    size_t blockOffset = 0;
+    for (Block *pBlock = mpHead; pBlock != NULL; pBlock = pBlock->pNext)
+    {
+        size_t blockSize = pBlock->End - pBlock->Begin;
+        const char *pData = pBlock->Data + pBlock->Begin;
+        size_t pos = offset > blockOffset ? offset - blockOffset : 0;
+        while (pos < blockSize)
+        {
+            const char *pFound = static_cast<const char *>(memchr(pData + pos, pattern[0], blockSize - pos));
+            if (pFound == NULL)
+            {
+                break;
+            }
+
+            pos = pFound - pData;
+            if (blockOffset + pos + size > mSize)
+            {
+                return string::npos;
+            }
+
+            // 比较剩下的字符，可能跨块
+            const Block *pCurr = pBlock;
+            size_t currPos = pos + 1;
+            size_t matched = 1;
+            while (matched < size)
+            {
+                if (pCurr->Begin + currPos >= pCurr->End)
+                {
+                    pCurr = pCurr->pNext;
+                    currPos = 0;
+                    continue;
+                }
+
+                if (pCurr->Data[pCurr->Begin + currPos] != pattern[matched])
+                {
+                    break;
+                }
+
+                ++currPos;
+                ++matched;
+            }
+
+            if (matched == size)
+            {
+                return blockOffset + pos;
+            }
+
+            ++pos;
+        }
+
+        blockOffset += blockSize;
+    }
+
+    return string::npos;
+}
+
+void CppNetBuffer::Consume(size_t size)
+{
+    size = min(size, mSize);
+    mSize -= size;
+    while (size > 0)
+    {
+        size_t blockSize = mpHead->End - mpHead->Begin;
+        if (size < blockSize)
+        {
+            mpHead->Begin += size;
+            break;
+        }
+
+        size -= blockSize;
+        Block *pNext = mpHead->pNext;
+        FreeBlock(mpHead);
+        mpHead = pNext;
+    }
+
+    // 空了之后最后一个块也还回去，避免空连接占用块
+    if (mSize == 0)
+    {
+        while (mpHead != NULL)
+        {
+            Block *pNext = mpHead->pNext;
+            FreeBlock(mpHead);
+            mpHead = pNext;
+        }
+
+        mpTail = NULL;
+    }
+}
+
+string CppNetBuffer::ToString() const
+{
+    string data(mSize, '\0');
+    Copy(&data[0], mSize);
+    return data;
+}
+
+ssize_t CppNetBuffer::ReadFd(int fd)
+{
+    iovec iovs[READ_EXTRA_BLOCK_COUNT + 1];
+    Block *extraBlocks[READ_EXTRA_BLOCK_COUNT];
+    uint32_t iovCount = 0;
+    if (mpTail != NULL && mpTail->End < BLOCK_SIZE)
+    {
+        iovs[iovCount].iov_base = mpTail->Data + mpTail->End;
+        iovs[iovCount].iov_len = BLOCK_SIZE - mpTail->End;
+        ++iovCount;
+    }
+
+    for (uint32_t i = 0; i < READ_EXTRA_BLOCK_COUNT; ++i)
+    {
+        extraBlocks[i] = AllocBlock();
+        iovs[iovCount].iov_base = extraBlocks[i]->Data;
+        iovs[iovCount].iov_len = BLOCK_SIZE;
+        ++iovCount;
+    }
+
+    ssize_t readSize = readv(fd, iovs, iovCount);
+    size_t left = readSize > 0 ? readSize : 0;
+    mSize += left;
+
+    // 先填满最后一个块，剩下的在新块中，没用到的新块还回去
+    if (iovCount > READ_EXTRA_BLOCK_COUNT)
+    {
+        size_t tailSize = min(left, iovs[0].iov_len);
+        mpTail->End += tailSize;
+        left -= tailSize;
+    }
+
+    for (uint32_t i = 0; i < READ_EXTRA_BLOCK_COUNT; ++i)
+    {
+        if (left == 0)
+        {
+            FreeBlock(extraBlocks[i]);
+            continue;
+        }
+
+        extraBlocks[i]->End = min(left, static_cast<size_t>(BLOCK_SIZE));
+        left -= extraBlocks[i]->End;
+        PushBlock(extraBlocks[i]);
+    }
+
+    return readSize;
+}
+
+ssize_t CppNetBuffer::WriteFd(int fd)
+{
+    if (mSize == 0)
+    {
+        return 0;
+    }
+
+    iovec iovs[MAX_IOV_COUNT];
+    uint32_t iovCount = 0;
+    for (Block *pBlock = mpHead; pBlock != NULL && iovCount < MAX_IOV_COUNT; pBlock = pBlock->pNext)
+    {
+        iovs[iovCount].iov_base = pBlock->Data + pBlock->Begin;
+        iovs[iovCount].iov_len = pBlock->End - pBlock->Begin;
+        ++iovCount;
+    }
+
+    ssize_t writeSize = writev(fd, iovs, iovCount);
+    if (writeSize > 0)
+    {
+        Consume(writeSize);
+    }
+
+    return writeSize;
+}
+
+// 连续内存的只读视图，提供和CppNetBuffer相同的Size/Copy/Find，解码器用同一份代码处理两种缓冲区
+class CppFrameView
+{
+public:
+    CppFrameView(const char *data, size_t size) : mpData(data), mSize(size)
+    {
+    }
+
+    size_t Size() const
+    {
+        return mSize;
+    }
+
+    size_t Copy(char *dest, size_t size, size_t offset = 0) const
+    {
+        if (offset >= mSize)
+        {
+            return 0;
+        }
+
+        size = min(size, mSize - offset);
+        memcpy(dest, mpData + offset, size);
+        return size;
+    }
+
+    size_t Find(const string &pattern, size_t offset = 0) const
+    {
+        if (offset > mSize)
+        {
+            return string::npos;
+        }
+
+        const void *pFound = memmem(mpData + offset, mSize - offset, pattern.data(), pattern.size());
+        return pFound == NULL ? string::npos : static_cast<const char *>(pFound) - mpData;
+    }
+
+private:
+    const char *mpData;
+    size_t mSize;
+};
+
+CppLengthCodec::CppLengthCodec(uint32_t lengthBytes, uint32_t headerSize, uint32_t lengthOffset,
+                               bool lengthIncludesHeader, uint32_t maxFrameSize) throw(CppException) :
+    mLengthBytes(lengthBytes), mHeaderSize(headerSize == 0 ? lengthOffset + lengthBytes : headerSize),
+    mLengthOffset(lengthOffset), mLengthIncludesHeader(lengthIncludesHeader),
+    mMaxFrameSize(min(maxFrameSize, static_cast<uint32_t>(INT32_MAX)))
+{
+    CHECK_THROW_F(lengthBytes == 1 || lengthBytes == 2 || lengthBytes == 4 || lengthBytes == 8,
+                  "长度字段字节数[%u]不正确.", lengthBytes);
+    CHECK_THROW_F(mLengthOffset + mLengthBytes <= mHeaderSize, "长度字段[%u,%u]超出帧头[%u].",
+                  mLengthOffset, mLengthBytes, mHeaderSize);
+}
+
+template <typename Buffer>
+int32_t CppLengthCodec::Decode(const Buffer &buf) const
+{
+    if (buf.Size() < mHeaderSize)
+    {
+        return 0;
+    }
+
+    // 只拷贝长度字段，按网络字节序转换
+    char lengthBuf[sizeof(uint64_t)];
+    buf.Copy(lengthBuf, mLengthBytes, mLengthOffset);
+    uint64_t length = 0;
+    if (mLengthBytes == 1)
+    {
+        length = static_cast<uint8_t>(lengthBuf[0]);
+    }
+    else if (mLengthBytes == 2)
+    {
+        uint16_t value;
+        memcpy(&value, lengthBuf, sizeof(value));
+        length = ntohs(value);
+    }
+    else if (mLengthBytes == 4)
+    {
+        uint32_t value;
+        memcpy(&value, lengthBuf, sizeof(value));
+        length = ntohl(value);
+    }
+    else
+    {
+        uint64_t value;
+        memcpy(&value, lengthBuf, sizeof(value));
+        length = CppNet::Ntohll(value);
+    }
+
+    if (length > mMaxFrameSize)
+    {
+        return -1;
+    }
+
+    uint64_t frameSize = mLengthIncludesHeader ? length : length + mHeaderSize;
+    if (frameSize < mHeaderSize || frameSize > mMaxFrameSize)
+    {
+        return -1;
+    }
+
+    return buf.Size() >= frameSize ? static_cast<int32_t>(frameSize) : 0;
+}
+
+int32_t CppLengthCodec::GetFrameSize(const CppNetBuffer &buf)
+{
+    return Decode(buf);
+}
+
+int32_t CppLengthCodec::GetFrameSize(const char *data, size_t size)
+{
+    return Decode(CppFrameView(data, size));
+}
+
+void CppLengthCodec::Encode(const char *data, size_t size, string &out) const throw(CppException)
+{
+    uint64_t length = mLengthIncludesHeader ? size + mHeaderSize : size;
+    CHECK_THROW_F(size + mHeaderSize <= mMaxFrameSize && (mLengthBytes == 8 || length < (1ULL << (mLengthBytes * 8))),
+                  "数据长度[%zu]超出范围.", size);
+
+    char lengthBuf[sizeof(uint64_t)];
+    if (mLengthBytes == 1)
+    {
+        lengthBuf[0] = static_cast<char>(length);
+    }
+    else if (mLengthBytes == 2)
+    {
+        uint16_t value = htons(static_cast<uint16_t>(length));
+        memcpy(lengthBuf, &value, sizeof(value));
+    }
+    else if (mLengthBytes == 4)
+    {
+        uint32_t value = htonl(static_cast<uint32_t>(length));
+        memcpy(lengthBuf, &value, sizeof(value));
+    }
+    else
+    {
+        uint64_t value = CppNet::Htonll(length);
+        memcpy(lengthBuf, &value, sizeof(value));
+    }
+
+    size_t headerPos = out.size();
+    out.append(mHeaderSize, '\0');
+    memcpy(&out[headerPos + mLengthOffset], lengthBuf, mLengthBytes);
+    out.append(data, size);
+}
+
+CppDelimiterCodec::CppDelimiterCodec(const string &delimiter, uint32_t maxFrameSize) :
+    mDelimiter(delimiter.empty() ? "\r\n" : delimiter), mMaxFrameSize(min(maxFrameSize, static_cast<uint32_t>(INT32_MAX))),
+    mScanPos(0)
+{
+}
+
+template <typename Buffer>
+int32_t CppDelimiterCodec::Decode(const Buffer &buf)
+{
+    size_t pos = buf.Find(mDelimiter, mScanPos);
+    if (pos == string::npos)
+    {
+        if (buf.Size() > mMaxFrameSize)
+        {
+            return -1;
+        }
+
+        // 末尾可能是分隔符的前一部分，下一次从可能的开始位置查找
+        mScanPos = buf.Size() >= mDelimiter.size() ? buf.Size() - mDelimiter.size() + 1 : 0;
+        return 0;
+    }
+
+    mScanPos = 0;
+    size_t frameSize = pos + mDelimiter.size();
+    return frameSize > mMaxFrameSize ? -1 : static_cast<int32_t>(frameSize);
+}
+
+int32_t CppDelimiterCodec::GetFrameSize(const CppNetBuffer &buf)
+{
+    return Decode(buf);
+}
+
+int32_t CppDelimiterCodec::GetFrameSize(const char *data, size_t size)
+{
+    return Decode(CppFrameView(data, size));
+}
+
+/** 解析RESP行中[begin,end)的整数，如$和*后面的长度
+ *
+ * @param   const Buffer & buf
+ * @param   size_t begin
+ * @param   size_t end
+ * @param   int64_t & value
+ * @retval  bool                    格式不正确返回false
+ * @author  moontan
+ */
+template <typename Buffer>
+static bool ParseRespInteger(const Buffer &buf, size_t begin, size_t end, int64_t &value)
+{
+    char digits[RESP_MAX_INTEGER_LEN];
+    size_t size = end - begin;
+    if (size == 0 || size > sizeof(digits))
+    {
+        return false;
+    }
+
+    buf.Copy(digits, size, begin);
+    bool negative = digits[0] == '-';
+    if (negative && size == 1)
+    {
+        return false;
+    }
+
+    value = 0;
+    for (size_t i = negative ? 1 : 0; i < size; ++i)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return false;
+        }
+
+        // 网络数据不可信，乘10之前检查是否溢出
+        int64_t digit = digits[i] - '0';
+        if (value > (INT64_MAX - digit) / 10)
+        {
+            return false;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    value = negative ? -value : value;
+    return true;
+}
+
+CppRespCodec::CppRespCodec(uint32_t maxFrameSize) :
+    mMaxFrameSize(min(maxFrameSize, static_cast<uint32_t>(INT32_MAX))), mPos(0)
+{
+}
+
+template <typename Buffer>
+int32_t CppRespCodec::Decode(const Buffer &buf)
+{
+    while (true)
+    {
+        // 每个元素以类型和一行开头，行不完整时下一次从这个元素重新解析
+        size_t lineEnd = buf.Find("\r\n", mPos);
+        if (lineEnd == string::npos)
+        {
+            return buf.Size() > mMaxFrameSize ? -1 : 0;
+        }
+
+        char type = 0;
+        buf.Copy(&type, 1, mPos);
+        size_t next = lineEnd + 2;
+        if (type == '$' || type == '*')
+        {
+            int64_t count = 0;
+            if (!ParseRespInteger(buf, mPos + 1, lineEnd, count) || count < -1 || count > mMaxFrameSize)
+            {
+                return -1;
+            }
+
+            if (type == '$' && count >= 0)
+            {
+                // 批量字符串按长度跳过，不查找内容中的\r\n
+                next += count + 2;
+                if (next > mMaxFrameSize)
+                {
+                    return -1;
+                }
+
+                if (buf.Size() < next)
+                {
+                    return 0;
+                }
+
+                char crlf[2];
+                buf.Copy(crlf, sizeof(crlf), next - 2);
+                if (crlf[0] != '\r' || crlf[1] != '\n')
+                {
+                    return -1;
+                }
+            }
+            else if (type == '*' && count > 0)
+            {
+                if (mRemains.size() >= RESP_MAX_DEPTH)
+                {
+                    return -1;
+                }
+
+                mRemains.push_back(count);
+                mPos = next;
+                continue;
+            }
+        }
+        else if (type != '+' && type != '-' && type != ':')
+        {
+            return -1;
+        }
+
+        // 一个元素完整，外层数组的元素都完整时外层数组也完整
+        while (!mRemains.empty() && --mRemains.back() == 0)
+        {
+            mRemains.pop_back();
+        }
+
+        mPos = next;
+        if (mPos > mMaxFrameSize)
+        {
+            return -1;
+        }
+
+        if (mRemains.empty())
+        {
+            size_t frameSize = mPos;
+            Reset();
+            return static_cast<int32_t>(frameSize);
+        }
+    }
+}
+
+int32_t CppRespCodec::GetFrameSize(const CppNetBuffer &buf)
+{
+    return Decode(buf);
+}
+
+int32_t CppRespCodec::GetFrameSize(const char *data, size_t size)
+{
+    return Decode(CppFrameView(data, size));
+}
+
+void CppRespCodec::EncodeCommand(const vector<string> &args, string &out)
+{
+    out.append("*").append(to_string(args.size())).append("\r\n");
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        out.append("$").append(to_string(args[i].size())).append("\r\n");
+        out.append(args[i]).append("\r\n");
+    }
+}
+
+#ifndef __CYGWIN__
+// 单调时钟的毫秒数，不受系统时间调整影响
+static uint64_t GetMonotonicMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+CppTimerWheel::CppTimerWheel(uint64_t nowMs) : mCurrentMs(nowMs), mNextId(1)
+{
+    for (uint32_t level = 0; level < LEVEL_COUNT; ++level)
+    {
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot)
+        {
+            mSlots[level][slot].pPrev = &mSlots[level][slot];
+            mSlots[level][slot].pNext = &mSlots[level][slot];
+        }
+
+        mBitmaps[level] = 0;
+    }
+}
+
+CppTimerWheel::~CppTimerWheel()
+{
+    for (auto &item : mTimers)
+    {
+        delete item.second;
+    }
+}
+
+uint64_t CppTimerWheel::AddTimer(uint32_t delayMs, function<void()> callback, uint32_t intervalMs)
+{
+    Node *pNode = new Node;
+    pNode->Id = mNextId++;
+    pNode->ExpireMs = mCurrentMs + delayMs;
+    pNode->IntervalMs = intervalMs;
+    pNode->Callback = std::move(callback);
+    Place(pNode);
+    mTimers[pNode->Id] = pNode;
+
+    return pNode->Id;
+}
+
+bool CppTimerWheel::CancelTimer(uint64_t timerId)
+{
+    auto it = mTimers.find(timerId);
+    if (it == mTimers.end())
+    {
+        return false;
+    }
+
+    Remove(it->second);
+    delete it->second;
+    mTimers.erase(it);
+
+    return true;
+}
+
+void CppTimerWheel::Place(Node *pNode, bool cascading)
+{
+    // 新加入的已经到期的定时器放到下一毫秒，下放时到期时间可能等于当前时间，放到当前槽中马上执行
+    uint64_t expireMs = max(pNode->ExpireMs, cascading ? mCurrentMs : mCurrentMs + 1);
+    uint32_t level = 0;
+    uint32_t slot = 0;
+    for (; level < LEVEL_COUNT; ++level)
+    {
+        uint32_t shift = level * SLOT_BITS;
+        if ((expireMs >> shift) - (mCurrentMs >> shift) < SLOT_COUNT)
+        {
+            slot = (expireMs >> shift) & (SLOT_COUNT - 1);
+            break;
+        }
+    }
+
+    // 超出范围的放到最高层最远的槽，下放时重新放置
+    if (level == LEVEL_COUNT)
+    {
+        level = LEVEL_COUNT - 1;
+        slot = ((mCurrentMs >> (level * SLOT_BITS)) + SLOT_COUNT - 1) & (SLOT_COUNT - 1);
+    }
+
+    Node &head = mSlots[level][slot];
+    pNode->Level = level;
+    pNode->Slot = slot;
+    pNode->pPrev = head.pPrev;
+    pNode->pNext = &head;
+    head.pPrev->pNext = pNode;
+    head.pPrev = pNode;
+    mBitmaps[level] |= 1ULL << slot;
+}
+
+void CppTimerWheel::Remove(Node *pNode)
+{
+    pNode->pPrev->pNext = pNode->pNext;
+    pNode->pNext->pPrev = pNode->pPrev;
+    if (pNode->Level < LEVEL_COUNT)
+    {
+        Node &head = mSlots[pNode->Level][pNode->Slot];
+        if (head.pNext == &head)
+        {
+            mBitmaps[pNode->Level] &= ~(1ULL << pNode->Slot);
+        }
+    }
+}
+
+void CppTimerWheel::TakeSlot(uint32_t level, uint32_t slot, Node &head)
+{
+    Node &slotHead = mSlots[level][slot];
+    if (slotHead.pNext == &slotHead)
+    {
+        head.pPrev = &head;
+        head.pNext = &head;
+        return;
+    }
+
+    head.pNext = slotHead.pNext;
+    head.pPrev = slotHead.pPrev;
+    head.pNext->pPrev = &head;
+    head.pPrev->pNext = &head;
+    slotHead.pPrev = &slotHead;
+    slotHead.pNext = &slotHead;
+    mBitmaps[level] &= ~(1ULL << slot);
+
+    for (Node *pNode = head.pNext; pNode != &head; pNode = pNode->pNext)
+    {
+        pNode->Level = LEVEL_COUNT;
+    }
+}
+
+uint64_t CppTimerWheel::GetNextEventMs() const
+{
+    uint64_t nextMs = UINT64_MAX;
+    for (uint32_t level = 0; level < LEVEL_COUNT; ++level)
+    {
+        if (mBitmaps[level] == 0)
+        {
+            continue;
+        }
+
+        // 从当前槽的下一个槽开始找第一个非空的槽，循环右移后最低位对应下一个槽
+        uint32_t shift = level * SLOT_BITS;
+        uint64_t position = mCurrentMs >> shift;
+        uint32_t rotate = (position + 1) & (SLOT_COUNT - 1);
+        uint64_t bitmap = rotate == 0 ? mBitmaps[level] : (mBitmaps[level] >> rotate) | (mBitmaps[level] << (SLOT_COUNT - rotate));
+        uint64_t distance = __builtin_ctzll(bitmap) + 1;
+        nextMs = min(nextMs, (position + distance) << shift);
+    }
+
+    return nextMs;
+}
+
+int64_t CppTimerWheel::GetNextTimeoutMs(uint64_t nowMs) const
+{
+    uint64_t nextMs = GetNextEventMs();
+    if (nextMs == UINT64_MAX)
+    {
+        return -1;
+    }
+
+    return nextMs > nowMs ? nextMs - nowMs : 0;
+}
+
+void CppTimerWheel::Cascade(uint32_t level, uint32_t slot)
+{
+    Node head;
+    TakeSlot(level, slot, head);
+    while (head.pNext != &head)
+    {
+        Node *pNode = head.pNext;
+        Remove(pNode);
+        Place(pNode, true);
+    }
+}
+
+uint32_t CppTimerWheel::Advance(uint64_t nowMs)
+{
+    uint32_t count = 0;
+    while (mCurrentMs < nowMs)
+    {
+        // 直接跳到下一个需要处理的时间，中间的空槽不需要处理
+        uint64_t nextMs = GetNextEventMs();
+        if (nextMs > nowMs)
+        {
+            mCurrentMs = nowMs;
+            break;
+        }
+
+        mCurrentMs = nextMs;
+
+        // 到了高层槽的起始时间，从高到低依次下放
+        for (uint32_t level = LEVEL_COUNT - 1; level > 0; --level)
+        {
+            uint32_t shift = level * SLOT_BITS;
+            if ((mCurrentMs & ((1ULL << shift) - 1)) == 0)
+            {
+                Cascade(level, (mCurrentMs >> shift) & (SLOT_COUNT - 1));
+            }
+        }
+
+        Node head;
+        TakeSlot(0, mCurrentMs & (SLOT_COUNT - 1), head);
+        while (head.pNext != &head)
+        {
+            Node *pNode = head.pNext;
+            Remove(pNode);
+
+            // 周期定时器在回调前重新放置，回调中可以取消自己，所以回调需要复制一份
+            function<void()> callback;
+            if (pNode->IntervalMs > 0)
+            {
+                pNode->ExpireMs += pNode->IntervalMs;
+                Place(pNode);
+                callback = pNode->Callback;
+            }
+            else
+            {
+                callback = std::move(pNode->Callback);
+                mTimers.erase(pNode->Id);
+                delete pNode;
+            }
+
+            callback();
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+CppEpollManager::CppEpollManager(uint32_t size, bool edgeTriggered) throw(CppException) :
+    mEdgeTriggered(edgeTriggered), mFdCount(0), mPostedTasks(NULL), mNowMs(GetMonotonicMs()), mTimerWheel(mNowMs)
+{
+    mEpollFd = epoll_create(size);
+    CHECK_THROW_F(mEpollFd >= 0, "epoll_create失败,errno[%d],error[%s].", errno, strerror(errno));
+    mUniqEpollFd = make_shared<UniqueFd>(mEpollFd);
+
+    // eventfd始终水平触发，直接写入data.fd，不经过SetFdToEvent
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    CHECK_THROW_F(mEventFd >= 0, "eventfd失败,errno[%d],error[%s].", errno, strerror(errno));
+    mUniqEventFd.Reset(mEventFd);
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    event.data.fd = mEventFd;
+    int32_t ret = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mEventFd, &event);
+    ERROR_THROW_F(ret, "epoll_ctl eventfd失败,errno[%d],error[%s].", errno, strerror(errno));
+}
+
+CppEpollManager::~CppEpollManager()
+{
+    // 没有执行的任务直接丢弃
+    PostedTask *pTask = mPostedTasks.exchange(NULL);
+    while (pTask != NULL)
+    {
+        PostedTask *pNext = pTask->pNext;
+        delete pTask;
+        pTask = pNext;
+    }
+}
+
+int32_t CppEpollManager::ProcWrite(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &writeFunc)throw(CppException)
+{
+    int fd = GetFdFromEvent(inevent);
+
+    int32_t ret = writeFunc(inevent);
+    if (ret != 0 || mEdgeTriggered)
+    {
+        return ret;
+    }
+
+    // 检查可读状态
+    inevent.events = EPOLLIN | EPOLLRDHUP;
+    AddOrModFd(fd, inevent);
+
+    // DEBUG_LOG("Proc a request,send[%lu].", gClientData[inevent.data.fd]);
+
+    return 0;
+}
+
+int32_t CppEpollManager::ProcRead(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &readFunc,
+                                  function<int32_t(epoll_event &inevent)> &writeFunc) throw(CppException)
+{
+    int fd = GetFdFromEvent(inevent);
+
+    // 读取请求
+    int32_t ret = readFunc(inevent);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    // 边缘触发时socket一般一直可写，不会再有可写事件，直接写
+    if (mEdgeTriggered)
+    {
+        return writeFunc(inevent);
+    }
+
+    // 检查可写状态
+    inevent.events = EPOLLOUT | EPOLLRDHUP;
+    AddOrModFd(fd, inevent);
+
+    // DEBUG_LOG("Read data[%lu].", actualValue);
+
+    return 0;
+}
+
+void CppEpollManager::AddOrModFd(int fd, epoll_event &event) throw(CppException)
+{
+    CHECK_THROW_F(fd >= 0, "fd[%d]不正确.", fd);
+
+    int32_t ret = 0;
+    SetFdToEvent(fd, event);
+    if (mFdStates.size() <= static_cast<size_t>(fd))
+    {
+        mFdStates.resize(max(static_cast<size_t>(fd) + 1, mFdStates.size() * 2), 0);
+    }
+
+    if (mFdStates[fd] == 0)
+    {
+        if (mEdgeTriggered)
+        {
+            event.events |= EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        }
+
+        ret = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event);
+        if (ret == 0)
+        {
+            mFdStates[fd] = 1;
+            ++mFdCount;
+        }
+    }
+    else if (mEdgeTriggered)
+    {
+        // 边缘触发时读写事件已经注册，不需要修改
+        return;
+    }
+    else
+    {
+        ret = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    ERROR_THROW_F(ret, "epoll_ctl failed,event[%u],fd[%d],errno[%d],error[%s].",
+                  event.events, fd, errno, strerror(errno));
+}
+
+void CppEpollManager::ModFdEvents(int fd, uint32_t events) throw(CppException)
+{
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = 0;
+    event.data.fd = fd;
+    int32_t ret = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event);
+    ERROR_THROW_F(ret, "epoll_ctl failed,event[%u],fd[%d],errno[%d],error[%s].", events, fd, errno, strerror(errno));
+}
+
+void CppEpollManager::DelFd(int fd) throw(CppException)
+{
+    int32_t ret = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+    ERROR_THROW_F(ret, "epoll_ctl失败,fd[%d],errno[%d],error[%s].", fd, errno, strerror(errno));
+    if (static_cast<size_t>(fd) < mFdStates.size() && mFdStates[fd] != 0)
+    {
+        mFdStates[fd] = 0;
+        --mFdCount;
+    }
+
+    // DEBUG_LOG("Delete fd[%d] from epoll success.", fd);
+}
+
+void CppEpollManager::PostAddFd(int fd, const epoll_event &event)
+{
+    epoll_event addEvent = event;
+    PostTask([this, fd, addEvent]() mutable
+    {
+        AddOrModFd(fd, addEvent);
+    });
+}
+
+void CppEpollManager::PostTask(function<void()> task)
+{
+    PostedTask *pTask = new PostedTask;
+    pTask->Task = std::move(task);
+    PostedTask *pOldHead = mPostedTasks.load(memory_order_relaxed);
+    do
+    {
+        pTask->pNext = pOldHead;
+    } while (!mPostedTasks.compare_exchange_weak(pOldHead, pTask, memory_order_release, memory_order_relaxed));
+
+    // 加入后pTask可能已经被Wait所在线程取走释放，只能使用pOldHead
+    // 队列原来为空时才需要唤醒，不为空说明已经唤醒过，Wait所在线程还没取走
+    if (pOldHead == NULL)
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(mEventFd, &one, sizeof(one));
+        static_cast<void>(ret);
+    }
+}
+
+void CppEpollManager::RunPostedTasks() throw(CppException)
+{
+    // 先清空eventfd再取队列，避免取走队列后投递的任务的通知被清掉
+    uint64_t count;
+    ssize_t readSize = read(mEventFd, &count, sizeof(count));
+    static_cast<void>(readSize);
+
+    PostedTask *pTask = mPostedTasks.exchange(NULL, memory_order_acquire);
+    if (pTask == NULL)
+    {
+        return;
+    }
+
+    // 链表头是最后投递的，反转后按投递顺序执行
+    PostedTask *pHead = NULL;
+    while (pTask != NULL)
+    {
+        PostedTask *pNext = pTask->pNext;
+        pTask->pNext = pHead;
+        pHead = pTask;
+        pTask = pNext;
+    }
+
+    // 所有任务都执行完再抛出第一个异常
+    bool hasError = false;
+    CppException error;
+    while (pHead != NULL)
+    {
+        unique_ptr<PostedTask> pCurr(pHead);
+        pHead = pHead->pNext;
+        try
+        {
+            pCurr->Task();
+        }
+        catch (CppException &e)
+        {
+            if (!hasError)
+            {
+                hasError = true;
+                error = e;
+            }
+        }
+    }
+
+    if (hasError)
+    {
+        throw error;
+    }
+}
+
+int32_t CppEpollManager::ProcPostedEvents(epoll_event events[], int32_t fdsCount) throw(CppException)
+{
+    for (int32_t i = 0; i < fdsCount; ++i)
+    {
+        if (events[i].data.u64 == static_cast<uint64_t>(mEventFd))
+        {
+            // 用最后一个事件填补eventfd的位置
+            events[i] = events[--fdsCount];
+            RunPostedTasks();
+            break;
+        }
+    }
+
+    return fdsCount;
+}
+
+void CppEpollManager::Wait(function<int32_t(epoll_event &inevent)> &readFunc,
+                           function<int32_t(epoll_event &inevent)> &writeFunc,
+                           function<void(int fd)> &deleteFdFunc,
+                           uint32_t timeOutMs) throw(CppException)
+{
+    // mEvents扩容，缩容使用其他函数手工实现，多一个给eventfd
+    if (mEvents.size() < mFdCount + 1)
+    {
+        mEvents.resize(mFdCount + 1);
+    }
+
+    int32_t fdsCount = Wait(&mEvents[0], mEvents.size(), timeOutMs);
+    int32_t ret = 0;
+
+    for (int32_t i = 0; i < fdsCount; ++i)
+    {
+        epoll_event &event = mEvents[i];
+        if (event.events & EPOLLIN)
+        {
+            if (event.events & EPOLLRDHUP)
+            {
+                // 同时有EPOLLIN和EPOLLRDHUP事件表示对端断开，删除fd
+                DelFd(GetFdFromEvent(event));
+                if (deleteFdFunc)
+                {
+                    deleteFdFunc(event.data.fd);
+                }
+            }
+            else
+            {
+                // 读取并且检查数据
+                ret = ProcRead(event, readFunc, writeFunc);
+
+                // 失败删除fd，没有处理完的等待下一次同样的事件
+                if (ret != 0 && ret != PROC_AGAIN)
+                {
+                    DelFd(GetFdFromEvent(event));
+                    if (deleteFdFunc)
+                    {
+                        deleteFdFunc(event.data.fd);
+                    }
+                }
+            }
+        }
+        else if (event.events & EPOLLOUT)
+        {
+            // 写入数据
+            ret = ProcWrite(event, writeFunc);
+
+            // 失败删除fd，没有处理完的等待下一次同样的事件
+            if (ret != 0 && ret != PROC_AGAIN)
+            {
+                DelFd(GetFdFromEvent(event));
+                if (deleteFdFunc)
+                {
+                    deleteFdFunc(event.data.fd);
+                }
+            }
+        }
+        else
+        {
+            continue;
+        }
+    }
+}
+
+int32_t CppEpollManager::Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs) throw(CppException)
+{
+    // 上一次返回的事件已经处理完，这时执行定时器不会关闭还没处理的fd
+    // 执行了定时器则不再等待，让调用者尽快处理定时器回调产生的结果
+    // 没有定时器时推进只更新时间，之后添加的定时器从当前时间开始计算
+    mNowMs = GetMonotonicMs();
+    int64_t timerTimeoutMs = mTimerWheel.Advance(mNowMs) > 0 ? 0 : mTimerWheel.GetNextTimeoutMs(mNowMs);
+
+    int timeout = (timerTimeoutMs >= 0 && timerTimeoutMs < timeOutMs) ? timerTimeoutMs : timeOutMs;
+    int32_t pollSize = epoll_wait(mEpollFd, events, eventSize, timeout);
+    mNowMs = GetMonotonicMs();
+    if (pollSize < 0)
+    {
+        return pollSize;
+    }
+
+    // 超时返回时没有待处理的事件，直接执行到期的定时器
+    if (pollSize == 0)
+    {
+        mTimerWheel.Advance(mNowMs);
+        return 0;
+    }
+
+    return ProcPostedEvents(events, pollSize);
+}
+
+void CppEpollManager::ReleaseEventsMemory()
+{
+    mEvents.shrink_to_fit();
+}
+
+int CppEpollManager::GetFdFromEvent(epoll_event &event)
+{
+    return event.data.fd;
+}
+
+void CppEpollManager::SetFdToEvent(int fd, epoll_event &event)
+{
+    event.data.fd = fd;
+}
+
+#ifdef CPP_NET_URING
+// user_data的最高2位表示完成事件的类型，POLL_ADD的低32位为fd，中间30位为fd的Generation
+static const uint32_t URING_TAG_SHIFT = 62;
+static const uint64_t URING_TAG_POLL = 0;
+static const uint64_t URING_TAG_EVENT_FD = 1;
+static const uint64_t URING_TAG_IO = 2;
+static const uint64_t URING_TAG_IGNORE = 3;
+static const uint32_t URING_GENERATION_MASK = (1U << 30) - 1;
+static const uint32_t URING_POLL_EVENTS = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP;
+
+static uint64_t MakePollUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation & URING_GENERATION_MASK) << 32) | static_cast<uint32_t>(fd);
+}
+
+static int IoUringSetup(uint32_t entries, io_uring_params *pParams)
+{
+    return syscall(__NR_io_uring_setup, entries, pParams);
+}
+
+static int IoUringEnter(int ringFd, uint32_t submitCount, uint32_t waitCount, uint32_t flags, void *pArg, size_t argSize)
+{
+    return syscall(__NR_io_uring_enter, ringFd, submitCount, waitCount, flags, pArg, argSize);
+}
+
+static int IoUringRegister(int ringFd, uint32_t opcode, void *pArg, uint32_t argCount)
+{
+    return syscall(__NR_io_uring_register, ringFd, opcode, pArg, argCount);
+}
+
+// 需要一次映射两个队列、完成队列溢出时不丢弃、io_uring_enter支持超时参数，5.11及以上的内核都支持
+static const uint32_t URING_REQUIRED_FEATURES = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+#endif
+
+CppUringManager::CppUringManager(uint32_t size, bool useUring) throw(CppException) :
+    CppEpollManager(size, false), mRingFd(-1), mpRing(NULL), mRingSize(0), mpSqes(NULL), mSqesSize(0),
+    mpSqHead(NULL), mpSqTail(NULL), mSqMask(0), mSqEntries(0), mpCqHead(NULL), mpCqTail(NULL), mCqMask(0),
+    mpCqes(NULL), mSqeTail(0), mEventFdArmed(false), mpBuffers(NULL), mBufferCount(0), mBufferSize(0), mNextIoId(0)
+{
+    if (useUring)
+    {
+        SetupRing(size);
+    }
+}
+
+CppUringManager::~CppUringManager()
+{
+    // 关闭ring时内核会取消所有未完成的请求，再释放缓冲区
+    mUniqRingFd.Reset();
+#ifdef CPP_NET_URING
+    if (mpSqes != NULL)
+    {
+        munmap(mpSqes, mSqesSize);
+    }
+
+    if (mpRing != NULL)
+    {
+        munmap(mpRing, mRingSize);
+    }
+#endif
+
+    free(mpBuffers);
+}
+
+bool CppUringManager::IsSupported()
+{
+#ifdef CPP_NET_URING
+    static const bool supported = []()
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int ringFd = IoUringSetup(1, &params);
+        if (ringFd < 0)
+        {
+            return false;
+        }
+
+        close(ringFd);
+        return (params.features & URING_REQUIRED_FEATURES) == URING_REQUIRED_FEATURES;
+    }();
+
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool CppUringManager::SetupRing(uint32_t entries)
+{
+#ifdef CPP_NET_URING
+    // 每个fd最多有一个POLL_ADD，多一个给eventfd，完成队列放大一倍给读写和POLL_REMOVE
+    entries = min(max(entries + 1, URING_MIN_ENTRIES), URING_MAX_ENTRIES);
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 2;
+    int ringFd = IoUringSetup(entries, &params);
+    if (ringFd < 0)
+    {
+        return false;
+    }
+
+    UniqueFd uniqRingFd(ringFd);
+    if ((params.features & URING_REQUIRED_FEATURES) != URING_REQUIRED_FEATURES)
+    {
+        return false;
+    }
+
+    size_t ringSize = max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                          params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    void *pRing = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (pRing == MAP_FAILED)
+    {
+        return false;
+    }
+
+    size_t sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *pSqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (pSqes == MAP_FAILED)
+    {
+        munmap(pRing, ringSize);
+        return false;
+    }
+
+    char *pRingStart = static_cast<char *>(pRing);
+    mpSqHead = reinterpret_cast<uint32_t *>(pRingStart + params.sq_off.head);
+    mpSqTail = reinterpret_cast<uint32_t *>(pRingStart + params.sq_off.tail);
+    mSqMask = *reinterpret_cast<uint32_t *>(pRingStart + params.sq_off.ring_mask);
+    mSqEntries = params.sq_entries;
+    mpCqHead = reinterpret_cast<uint32_t *>(pRingStart + params.cq_off.head);
+    mpCqTail = reinterpret_cast<uint32_t *>(pRingStart + params.cq_off.tail);
+    mCqMask = *reinterpret_cast<uint32_t *>(pRingStart + params.cq_off.ring_mask);
+    mpCqes = pRingStart + params.cq_off.cqes;
+
+    // sqe按顺序使用，提交队列的下标数组固定为自身的位置
+    uint32_t *pSqArray = reinterpret_cast<uint32_t *>(pRingStart + params.sq_off.array);
+    for (uint32_t i = 0; i < params.sq_entries; ++i)
+    {
+        pSqArray[i] = i;
+    }
+
+    mSqeTail = *mpSqTail;
+    mpRing = pRing;
+    mRingSize = ringSize;
+    mpSqes = pSqes;
+    mSqesSize = sqesSize;
+    mRingFd = ringFd;
+    mUniqRingFd = std::move(uniqRingFd);
+
+    return true;
+#else
+    static_cast<void>(entries);
+    return false;
+#endif
+}
+
+void *CppUringManager::GetSqe() throw(CppException)
+{
+#ifdef CPP_NET_URING
+    // 提交队列满了先提交一次
+    if (mSqeTail - __atomic_load_n(mpSqHead, __ATOMIC_ACQUIRE) >= mSqEntries)
+    {
+        int32_t ret = Enter(0, 0);
+        CHECK_THROW_F(mSqeTail - __atomic_load_n(mpSqHead, __ATOMIC_ACQUIRE) < mSqEntries,
+                      "io_uring提交队列满,ret[%d],errno[%d],error[%s].", ret, errno, strerror(errno));
+    }
+
+    io_uring_sqe *pSqe = static_cast<io_uring_sqe *>(mpSqes) + (mSqeTail & mSqMask);
+    memset(pSqe, 0, sizeof(*pSqe));
+    ++mSqeTail;
+
+    return pSqe;
+#else
+    THROW("不支持io_uring.");
+#endif
+}
+
+int32_t CppUringManager::Enter(uint32_t waitCount, int64_t timeOutMs)
+{
+#ifdef CPP_NET_URING
+    __atomic_store_n(mpSqTail, mSqeTail, __ATOMIC_RELEASE);
+    uint32_t submitCount = mSqeTail - __atomic_load_n(mpSqHead, __ATOMIC_ACQUIRE);
+    if (submitCount == 0 && waitCount == 0)
+    {
+        return 0;
+    }
+
+    if (waitCount == 0)
+    {
+        return IoUringEnter(mRingFd, submitCount, 0, 0, NULL, 0);
+    }
+
+    // 超时时间通过扩展参数传入，不需要额外提交超时请求
+    __kernel_timespec ts;
+    ts.tv_sec = timeOutMs / 1000;
+    ts.tv_nsec = timeOutMs % 1000 * 1000000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uintptr_t>(&ts);
+    return IoUringEnter(mRingFd, submitCount, waitCount, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+#else
+    static_cast<void>(waitCount);
+    static_cast<void>(timeOutMs);
+    return -1;
+#endif
+}
+
+void CppUringManager::ArmEventFd() throw(CppException)
+{
+#ifdef CPP_NET_URING
+    io_uring_sqe *pSqe = static_cast<io_uring_sqe *>(GetSqe());
+    pSqe->opcode = IORING_OP_POLL_ADD;
+    pSqe->fd = mEventFd;
+    pSqe->poll32_events = EPOLLIN;
+    pSqe->user_data = URING_TAG_EVENT_FD << URING_TAG_SHIFT;
+    mEventFdArmed = true;
+#endif
+}
+
+void CppUringManager::ArmPoll(int fd) throw(CppException)
+{
+#ifdef CPP_NET_URING
+    UringFd &state = mUringFds[fd];
+    if (!state.Registered || state.Armed)
+    {
+        return;
+    }
+
+    io_uring_sqe *pSqe = static_cast<io_uring_sqe *>(GetSqe());
+    pSqe->opcode = IORING_OP_POLL_ADD;
+    pSqe->fd = fd;
+    pSqe->poll32_events = state.Event.events & URING_POLL_EVENTS;
+    pSqe->user_data = MakePollUserData(fd, state.Generation);
+    state.Armed = true;
+#else
+    static_cast<void>(fd);
+#endif
+}
+
+void CppUringManager::DisarmPoll(UringFd &state, int fd) throw(CppException)
+{
+#ifdef CPP_NET_URING
+    if (state.Armed)
+    {
+        io_uring_sqe *pSqe = static_cast<io_uring_sqe *>(GetSqe());
+        pSqe->opcode = IORING_OP_POLL_REMOVE;
+        pSqe->fd = -1;
+        pSqe->addr = MakePollUserData(fd, state.Generation);
+        pSqe->user_data = URING_TAG_IGNORE << URING_TAG_SHIFT;
+        state.Armed = false;
+    }
+
+    // 之前提交的POLL_ADD的完成事件可能还在完成队列中，换一个Generation后丢弃
+    ++state.Generation;
+#else
+    static_cast<void>(state);
+    static_cast<void>(fd);
+#endif
+}
+
+void CppUringManager::AddOrModFd(int fd, epoll_event &event) throw(CppException)
+{
+    if (mRingFd < 0)
+    {
+        CppEpollManager::AddOrModFd(fd, event);
+        return;
+    }
+
+    CHECK_THROW_F(fd >= 0, "fd[%d]不正确.", fd);
+
+    SetFdToEvent(fd, event);
+    if (mUringFds.size() <= static_cast<size_t>(fd))
+    {
+        mUringFds.resize(max(static_cast<size_t>(fd) + 1, mUringFds.size() * 2), UringFd());
+    }
+
+    UringFd &state = mUringFds[fd];
+    if (!state.Registered)
+    {
+        state.Registered = true;
+        ++mFdCount;
+        mRearmFds.push_back(fd);
+    }
+    else if (state.Event.events != event.events)
+    {
+        // 事件改变时取消还没完成的POLL_ADD，在下一次Wait中按新的事件提交
+        DisarmPoll(state, fd);
+        mRearmFds.push_back(fd);
+    }
+
+    state.Event = event;
+}
+
+void CppUringManager::ModFdEvents(int fd, uint32_t events) throw(CppException)
+{
+    if (mRingFd < 0)
+    {
+        CppEpollManager::ModFdEvents(fd, events);
+        return;
+    }
+
+    CHECK_THROW_F(fd >= 0 && static_cast<size_t>(fd) < mUringFds.size() && mUringFds[fd].Registered,
+                  "fd[%d]没有加入.", fd);
+
+    UringFd &state = mUringFds[fd];
+    if (state.Event.events != events)
+    {
+        DisarmPoll(state, fd);
+        mRearmFds.push_back(fd);
+    }
+
+    state.Event.events = events;
+    state.Event.data.u64 = 0;
+    state.Event.data.fd = fd;
+}
+
+void CppUringManager::DelFd(int fd) throw(CppException)
+{
+    if (mRingFd < 0)
+    {
+        CppEpollManager::DelFd(fd);
+        return;
+    }
+
+    CHECK_THROW_F(fd >= 0 && static_cast<size_t>(fd) < mUringFds.size() && mUringFds[fd].Registered,
+                  "fd[%d]没有加入.", fd);
+
+    UringFd &state = mUringFds[fd];
+    DisarmPoll(state, fd);
+    state.Registered = false;
+    --mFdCount;
+}
+
+int32_t CppUringManager::Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs) throw(CppException)
+{
+    if (mRingFd < 0)
+    {
+        // 退回epoll，有已经完成的读写时不等待
+        int32_t fdsCount = CppEpollManager::Wait(events, eventSize, mDoneIos.empty() ? timeOutMs : 0);
+        RunIoCallbacks();
+        return fdsCount;
+    }
+
+#ifdef CPP_NET_URING
+    // 和CppEpollManager::Wait相同，先执行到期的定时器，等待时间不超过下一个定时器
+    mNowMs = GetMonotonicMs();
+    int64_t timerTimeoutMs = -1;
+    if (mTimerWheel.Advance(mNowMs) > 0 || !mDoneIos.empty())
+    {
+        timerTimeoutMs = 0;
+    }
+    else
+    {
+        timerTimeoutMs = mTimerWheel.GetNextTimeoutMs(mNowMs);
+    }
+
+    int64_t timeout = (timerTimeoutMs >= 0 && timerTimeoutMs < timeOutMs) ? timerTimeoutMs : timeOutMs;
+
+    // 上一次触发或者修改过的fd重新提交POLL_ADD，和等待一起提交
+    if (!mEventFdArmed)
+    {
+        ArmEventFd();
+    }
+
+    for (size_t i = 0; i < mRearmFds.size(); ++i)
+    {
+        ArmPoll(mRearmFds[i]);
+    }
+
+    mRearmFds.clear();
+
+    int32_t ret = Enter(timeout > 0 ? 1 : 0, timeout);
+    if (ret < 0 && errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+    {
+        return ret;
+    }
+
+    mNowMs = GetMonotonicMs();
+
+    // 直接读取完成队列，events满了剩下的留到下一次Wait
+    io_uring_cqe *pCqes = static_cast<io_uring_cqe *>(mpCqes);
+    uint32_t head = *mpCqHead;
+    uint32_t tail = __atomic_load_n(mpCqTail, __ATOMIC_ACQUIRE);
+    int32_t fdsCount = 0;
+    bool hasPostedTasks = false;
+    while (head != tail && static_cast<uint32_t>(fdsCount) < eventSize)
+    {
+        io_uring_cqe &cqe = pCqes[head & mCqMask];
+        ++head;
+
+        uint64_t tag = cqe.user_data >> URING_TAG_SHIFT;
+        if (tag == URING_TAG_POLL)
+        {
+            int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFF);
+            uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32) & URING_GENERATION_MASK;
+            if (static_cast<size_t>(fd) >= mUringFds.size())
+            {
+                continue;
+            }
+
+            UringFd &state = mUringFds[fd];
+            if (!state.Registered || !state.Armed || (state.Generation & URING_GENERATION_MASK) != generation)
+            {
+                continue;
+            }
+
+            state.Armed = false;
+            mRearmFds.push_back(fd);
+            if (cqe.res > 0)
+            {
+                events[fdsCount] = state.Event;
+                events[fdsCount].events = static_cast<uint32_t>(cqe.res);
+                ++fdsCount;
+            }
+        }
+        else if (tag == URING_TAG_EVENT_FD)
+        {
+            mEventFdArmed = false;
+            hasPostedTasks = true;
+        }
+        else if (tag == URING_TAG_IO)
+        {
+            auto it = mIoCallbacks.find(cqe.user_data & ((1ULL << URING_TAG_SHIFT) - 1));
+            if (it != mIoCallbacks.end())
+            {
+                IoDone done;
+                done.Callback = std::move(it->second);
+                done.Result = cqe.res;
+                mDoneIos.push_back(std::move(done));
+                mIoCallbacks.erase(it);
+            }
+        }
+    }
+
+    __atomic_store_n(mpCqHead, head, __ATOMIC_RELEASE);
+
+    if (hasPostedTasks)
+    {
+        RunPostedTasks();
+    }
+
+    // 没有待处理的事件，直接执行到期的定时器
+    if (fdsCount == 0)
+    {
+        mTimerWheel.Advance(mNowMs);
+    }
+
+    RunIoCallbacks();
+
+    return fdsCount;
+#else
+    return -1;
+#endif
+}
+
+void CppUringManager::RegisterBuffers(uint32_t count, uint32_t size) throw(CppException)
+{
+    CHECK_THROW_F(mpBuffers == NULL, "固定缓冲区已经注册.");
+    CHECK_THROW_F(count > 0 && count <= IOV_MAX && size > 0, "缓冲区数量[%u]或大小[%u]不正确.", count, size);
+
+    void *pBuffers = NULL;
+    int ret = posix_memalign(&pBuffers, sysconf(_SC_PAGESIZE), static_cast<size_t>(count) * size);
+    ERROR_THROW_F(ret, "分配固定缓冲区失败,数量[%u],大小[%u].", count, size);
+
+#ifdef CPP_NET_URING
+    if (mRingFd >= 0)
+    {
+        vector<iovec> iovecs(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            iovecs[i].iov_base = static_cast<char *>(pBuffers) + static_cast<size_t>(i) * size;
+            iovecs[i].iov_len = size;
+        }
+
+        ret = IoUringRegister(mRingFd, IORING_REGISTER_BUFFERS, &iovecs[0], count);
+        if (ret < 0)
+        {
+            int error = errno;
+            free(pBuffers);
+            THROW("注册固定缓冲区失败,errno[%d],error[%s].", error, strerror(error));
+        }
+    }
+#endif
+
+    mpBuffers = static_cast<char *>(pBuffers);
+    mBufferCount = count;
+    mBufferSize = size;
+}
+
+void CppUringManager::ReadFixed(int fd, uint32_t index, uint32_t size, function<void(int32_t)> callback) throw(CppException)
+{
+    SubmitFixed(true, fd, index, size, callback);
+}
+
+void CppUringManager::WriteFixed(int fd, uint32_t index, uint32_t size, function<void(int32_t)> callback) throw(CppException)
+{
+    SubmitFixed(false, fd, index, size, callback);
+}
+
+void CppUringManager::SubmitFixed(bool isRead, int fd, uint32_t index, uint32_t size,
+                                  function<void(int32_t)> &callback) throw(CppException)
+{
+    CHECK_THROW_F(index < mBufferCount && size <= mBufferSize, "缓冲区[%u]或长度[%u]不正确.", index, size);
+
+    char *pBuffer = GetBuffer(index);
+    if (mRingFd < 0)
+    {
+        ssize_t ret = isRead ? read(fd, pBuffer, size) : write(fd, pBuffer, size);
+        IoDone done;
+        done.Callback = std::move(callback);
+        done.Result = ret < 0 ? -errno : static_cast<int32_t>(ret);
+        mDoneIos.push_back(std::move(done));
+        return;
+    }
+
+#ifdef CPP_NET_URING
+    // 偏移为-1表示使用fd当前的位置，和read/write相同
+    io_uring_sqe *pSqe = static_cast<io_uring_sqe *>(GetSqe());
+    pSqe->opcode = isRead ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+    pSqe->fd = fd;
+    pSqe->off = static_cast<uint64_t>(-1);
+    pSqe->addr = reinterpret_cast<uintptr_t>(pBuffer);
+    pSqe->len = size;
+    pSqe->buf_index = static_cast<uint16_t>(index);
+    uint64_t ioId = mNextIoId++ & ((1ULL << URING_TAG_SHIFT) - 1);
+    pSqe->user_data = (URING_TAG_IO << URING_TAG_SHIFT) | ioId;
+    mIoCallbacks[ioId] = std::move(callback);
+#endif
+}
+
+void CppUringManager::RunIoCallbacks() throw(CppException)
+{
+    if (mDoneIos.empty())
+    {
+        return;
+    }
+
+    // 回调中可能提交新的读写，先取出已经完成的
+    vector<IoDone> doneIos;
+    doneIos.swap(mDoneIos);
+
+    // 所有回调都执行完再抛出第一个异常
+    bool hasError = false;
+    CppException error;
+    for (size_t i = 0; i < doneIos.size(); ++i)
+    {
+        try
+        {
+            doneIos[i].Callback(doneIos[i].Result);
+        }
+        catch (CppException &e)
+        {
+            if (!hasError)
+            {
+                hasError = true;
+                error = e;
+            }
+        }
+    }
+
+    if (hasError)
+    {
+        throw error;
+    }
+}
+
+MultiThreadClientBase::MultiThreadClientBase(const std::string &serverAddr, uint16_t serverPort,
+                                             uint32_t runSecond, uint32_t clientThreadCount,
+                                             uint32_t clientCountPerThread,
+                                             uint32_t epollSize, CppLog *mpCppLog, bool edgeTriggered) :
+    gSuccessCount(0), gFailCount(0), gTotalTimeUs(0), gMinTimeUs(0), gMaxTimeUs(0),
+    gCurrTotalTimeUs(0), gCurrMinTimeUs(0), gCurrMaxTimeUs(0), gClientStop(false),
+    mServerAddr(serverAddr), mServerPort(serverPort), mRunSecond(runSecond),
+    mClientThreadCount(clientThreadCount), mClientCountPerThread(clientCountPerThread),
+    mEpollSize(epollSize), mpCppLog(mpCppLog), mEdgeTriggered(edgeTriggered), mPipelineDepth(1),
+    mTargetQps(0), mPoisson(false), mStatsFormat(STATS_CSV)
+{
+
+}
+
+int32_t MultiThreadClientBase::ProcWrite(uint32_t threadId, epoll_event &inevent)
+{
+    PressCallClientDataBase &clientData = *mClientDatas[threadId][inevent.data.fd];
+    CppNetBuffer &sendBuf = clientData.sendBuf;
+
+    while (true)
+    {
+        // 上一批请求已经写完才生成新的请求，补满管道，并记录每个请求的开始时间
+        // 开环模式下只发送已经到了计划发送时间的请求，开始时间为计划发送时间
+        while (sendBuf.Empty() && clientData.inflightCount < mPipelineDepth)
+        {
+            if (mTargetQps > 0)
+            {
+                if (clientData.pendingTimes.empty())
+                {
+                    break;
+                }
+
+                clientData.sendTime = clientData.pendingTimes.front();
+                clientData.pendingTimes.pop_front();
+            }
+            else
+            {
+                gettimeofday(&clientData.sendTime, NULL);
+            }
+
+            GetSendData(threadId, inevent.data.fd, sendBuf);
+            clientData.sendTimes[(clientData.sendTimeHead + clientData.inflightCount) % mPipelineDepth] = clientData.sendTime;
+            ++clientData.inflightCount;
+        }
+
+        if (sendBuf.Empty())
+        {
+            break;
+        }
+
+        ssize_t ret = sendBuf.WriteFd(inevent.data.fd);
+        if (ret > 0 || (ret < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        // 没写完，等可写事件继续写
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return CppEpollManager::PROC_AGAIN;
+        }
+
+        ERROR_ILOG(mpCppLog, "write失败,event[%u],fd[%d],errno[%d],error[%s].",
+                   inevent.events, inevent.data.fd, errno, strerror(errno));
+        return -1;
+    }
+
+    // DEBUG_LOG("Proc a request,send[%lu].", gClientData[inevent.data.fd]);
+
+    return 0;
+}
+
+int32_t MultiThreadClientBase::ProcRead(uint32_t threadId, epoll_event &inevent)
+{
+    PressCallClientDataBase &clientData = *mClientDatas[threadId][inevent.data.fd];
+
+    // 读取回包，直接读到连接的接收缓冲区中
+    CppNetBuffer &recvBuf = clientData.recvBuf;
+    ssize_t readSize;
+    do
+    {
+        readSize = recvBuf.ReadFd(inevent.data.fd);
+    } while (readSize > 0 || (readSize < 0 && errno == EINTR));
+
+    bool peerClosed = readSize == 0;
+    CHECK_RETURN_F(mpCppLog, peerClosed || errno == EAGAIN || errno == EWOULDBLOCK, -1, CppLog::ERROR,
+                   "read error,readSize[%zd],event[%u],fd[%d,]errno[%d],error[%s].", readSize, inevent.events, inevent.data.fd, errno, strerror(errno));
+
+    // 记录结束时间
+    timeval receiveTime;
+    gettimeofday(&receiveTime, NULL);
+
+    // 按顺序切分出每个回包，与最早发送的请求对应，统计记录到本线程的直方图
+    ThreadStats &stats = *mThreadStats[threadId];
+    std::lock_guard<std::mutex> statsLock(stats.Lock);
+    uint32_t responseCount = 0;
+    while (!recvBuf.Empty() && clientData.inflightCount > 0)
+    {
+        int32_t responseSize = GetResponseSize(threadId, inevent.data.fd, recvBuf);
+        CHECK_RETURN_F(mpCppLog, responseSize >= 0, -1, CppLog::ERROR, "回包错误,fd[%d],ret[%d].", inevent.data.fd, responseSize);
+        if (responseSize == 0)
+        {
+            break;
+        }
+
+        // 计算耗时
+        int64_t usedTimeUs = CppTime::TimevDiff(receiveTime, clientData.sendTimes[clientData.sendTimeHead]);
+        CHECK_RETURN_F(mpCppLog, usedTimeUs > 0, -1, CppLog::ERROR, "时间不正确[%ld].", usedTimeUs);
+        stats.Histogram.Record(usedTimeUs);
+
+        CheckResponse(threadId, inevent.data.fd, recvBuf, responseSize) ? ++stats.SuccessCount : ++stats.FailCount;
+        recvBuf.Consume(responseSize);
+        clientData.sendTimeHead = (clientData.sendTimeHead + 1) % mPipelineDepth;
+        --clientData.inflightCount;
+        ++responseCount;
+    }
+
+    // DEBUG_LOG("Read data[%lu].", actualValue);
+
+    // 对端已经关闭，删除fd
+    if (peerClosed)
+    {
+        return -1;
+    }
+
+    // 没有完整的回包，继续等待可读
+    return responseCount == 0 ? CppEpollManager::PROC_AGAIN : 0;
+}
+
+void MultiThreadClientBase::ProcDeleteFd(uint32_t threadId, int fd)
+{
+    mClientDatas[threadId].erase(fd);
+    if (mTargetQps > 0)
+    {
+        vector<int> &fds = mOpenLoopStates[threadId].Fds;
+        fds.erase(std::remove(fds.begin(), fds.end(), fd), fds.end());
+    }
+}
+
+void MultiThreadClientBase::ProcTimer(uint32_t threadId)
+{
+    OpenLoopState &state = mOpenLoopStates[threadId];
+    timeval now;
+    gettimeofday(&now, NULL);
+    double nowUs = now.tv_sec * 1000000.0 + now.tv_usec;
+
+    // 到了计划发送时间的请求轮流分配给各个连接，即使连接还在等回包也要排队，排队时间计入耗时
+    exponential_distribution<double> poissonInterval(1.0 / state.IntervalUs);
+    state.TouchedFds.clear();
+    while (state.NextSendUs <= nowUs && !state.Fds.empty())
+    {
+        int fd = state.Fds[state.NextFd++ % state.Fds.size()];
+        timeval sendTime;
+        sendTime.tv_sec = static_cast<time_t>(state.NextSendUs / 1000000);
+        sendTime.tv_usec = static_cast<suseconds_t>(state.NextSendUs - sendTime.tv_sec * 1000000.0);
+        mClientDatas[threadId][fd]->pendingTimes.push_back(sendTime);
+        if (state.TouchedFds.size() < state.Fds.size())
+        {
+            state.TouchedFds.push_back(fd);
+        }
+
+        state.NextSendUs += mPoisson ? poissonInterval(state.Rng) : state.IntervalUs;
+    }
+
+    for (int fd : state.TouchedFds)
+    {
+        epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.fd = fd;
+        int32_t ret = ProcWrite(threadId, ev);
+        if (ret != 0 && ret != CppEpollManager::PROC_AGAIN)
+        {
+            state.pEpollManager->DelFd(fd);
+            ProcDeleteFd(threadId, fd);
+        }
+    }
+
+    // 定时到下一个请求的计划发送时间，不足1毫秒的在下一毫秒发送
+    uint32_t delayMs = state.NextSendUs > nowUs ? static_cast<uint32_t>((state.NextSendUs - nowUs) / 1000) : 0;
+    state.pEpollManager->AddTimer(delayMs, [this, threadId]() { ProcTimer(threadId); });
+}
+
+void MultiThreadClientBase::ThreadFunc(uint32_t threadId)
+{
+    // 创建Epoll池，开环模式下读写互不等待，使用边缘触发
+    CppEpollManager mEpollManager(mEpollSize, mEdgeTriggered || mTargetQps > 0);
+
+    epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLRDHUP;      // 连接之后监听可写事件
+
+    // 创建客户端并将其加入epoll池
+    for (uint32_t i = 0; i < mClientCountPerThread; ++i)
+    {
+        ev.data.fd = ConnectServer();
+        CHECK_CONTINUE(mpCppLog, ev.data.fd >= 0, ev.data.fd, CppLog::ERROR);
+        mEpollManager.AddOrModFd(ev.data.fd, ev);
+        mClientDatas[threadId][ev.data.fd] = MakeNewClientData();
+        mClientDatas[threadId][ev.data.fd]->uniqueFd.Reset(ev.data.fd);
+        mClientDatas[threadId][ev.data.fd]->sendTimes.resize(mPipelineDepth);
+        if (mpFrameCodec)
+        {
+            mClientDatas[threadId][ev.data.fd]->frameCodec = mpFrameCodec->Clone();
+        }
+    }
+
+    if (mTargetQps > 0)
+    {
+        // 每个线程平分QPS，从现在开始按计划发送
+        OpenLoopState &state = mOpenLoopStates[threadId];
+        state.pEpollManager = &mEpollManager;
+        for (auto &clientData : mClientDatas[threadId])
+        {
+            state.Fds.push_back(clientData.first);
+        }
+
+        state.IntervalUs = 1000000.0 * mClientThreadCount / mTargetQps;
+        state.Rng.seed(CppTime::GetUTime() + threadId);
+        timeval now;
+        gettimeofday(&now, NULL);
+        state.NextSendUs = now.tv_sec * 1000000.0 + now.tv_usec;
+        mEpollManager.AddTimer(0, [this, threadId]() { ProcTimer(threadId); });
+    }
+
+    ClientHandler handler = {this, threadId};
+
+    while (!gClientStop)
+    {
+        // 事件循环，没有事件时最多等到下一个定时器或者CLIENT_WAIT_MS后检查是否停止
+        mEpollManager.Wait(handler, CLIENT_WAIT_MS);
+    }
+
+    DEBUG_ILOG(mpCppLog, "exit thread[%u].", threadId);
+}
+
+int32_t MultiThreadClientBase::ConnectServer()
+{
+    // 解析域名，如果是IP则不用解析，结果在进程内缓存，大量连接同时建立时只解析一次
+    vector<sockaddr_storage> addrs;
+    int ret = CppDnsCache::Default().Resolve(mServerAddr, mServerPort, addrs);
+    CHECK_RETURN_F(mpCppLog, ret == 0, -1, CppLog::ERROR, "解析[%s]失败,ret[%d],error[%s].", mServerAddr.c_str(), ret, gai_strerror(ret));
+
+    // 依次尝试每个地址，直到连接成功
+    UniqueFd uniqFd;
+    for (auto &addr : addrs)
+    {
+        // 建立socket
+        uniqFd.Reset(socket(addr.ss_family, SOCK_STREAM, 0));
+        CHECK_RETURN_F(mpCppLog, uniqFd.Get() >= 0, -1, CppLog::ERROR, "socket失败,errno[%d],error[%s].", errno, strerror(errno));
+
+        // 建立连接
+        socklen_t addrLen = addr.ss_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+        ret = connect(uniqFd.Get(), (struct sockaddr *)&addr, addrLen);
+        if (ret == 0)
+        {
+            break;
+        }
+
+        DEBUG_ILOG(mpCppLog, "connect失败,errno[%d],error[%s].", errno, strerror(errno));
+        uniqFd.Reset();
+    }
+
+    CHECK_RETURN_F(mpCppLog, uniqFd.Get() >= 0, -1, CppLog::ERROR, "连接[%s:%u]失败.", mServerAddr.c_str(), mServerPort);
+    int fd = uniqFd.Get();
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "fcntl O_NONBLOCK失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    flags = 1;
+    ret = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flags, sizeof(flags));
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt TCP_NODELAY失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    // 初始化连接
+    InitConnection(fd);
+
+    return uniqFd.Release();
+}
+
+void MultiThreadClientBase::CollectStats(uint64_t &currSuccess, uint64_t &currFail)
+{
+    gCurrHistogram.Reset();
+    currSuccess = 0;
+    currFail = 0;
+
+    // 只在取走统计时加锁，客户端线程大部分时间不会竞争
+    for (auto &pStats : mThreadStats)
+    {
+        std::lock_guard<std::mutex> statsLock(pStats->Lock);
+        gCurrHistogram.Merge(pStats->Histogram);
+        currSuccess += pStats->SuccessCount;
+        currFail += pStats->FailCount;
+        pStats->Histogram.Reset();
+        pStats->SuccessCount = 0;
+        pStats->FailCount = 0;
+    }
+
+    gTotalHistogram.Merge(gCurrHistogram);
+    gSuccessCount += currSuccess;
+    gFailCount += currFail;
+
+    gCurrTotalTimeUs = gCurrHistogram.GetSum();
+    gCurrMinTimeUs = gCurrHistogram.GetMin();
+    gCurrMaxTimeUs = gCurrHistogram.GetMax();
+    gTotalTimeUs = gTotalHistogram.GetSum();
+    gMinTimeUs = gTotalHistogram.GetMin();
+    gMaxTimeUs = gTotalHistogram.GetMax();
+}
+
+void MultiThreadClientBase::ReportStats(const CppHistogram &histogram, uint64_t successCount, uint64_t failCount,
+                                        int64_t second, std::ostream *pExport)
+{
+    uint64_t p50 = histogram.GetValueAtPercentile(50);
+    uint64_t p90 = histogram.GetValueAtPercentile(90);
+    uint64_t p99 = histogram.GetValueAtPercentile(99);
+    uint64_t p999 = histogram.GetValueAtPercentile(99.9);
+    uint64_t p9999 = histogram.GetValueAtPercentile(99.99);
+    uint64_t meanTimeUs = (uint64_t)histogram.GetMean();
+
+    const char *prefix = second < 0 ? "总" : "周期";
+    DEBUG_ILOG(mpCppLog, "%s成功[%llu],%s失败[%llu],%s成功率[%.2lf%%],最大耗时[%llu],最小耗时[%llu],平均耗时[%llu],"
+               "P50[%llu],P90[%llu],P99[%llu],P99.9[%llu],P99.99[%llu].",
+               prefix, successCount, prefix, failCount, prefix,
+               (successCount + failCount) == 0 ? 0 : successCount * 100.0 / (successCount + failCount),
+               histogram.GetMax(), histogram.GetMin(), meanTimeUs, p50, p90, p99, p999, p9999);
+
+    if (pExport == NULL)
+    {
+        return;
+    }
+
+    char line[512];
+    string secondStr = second >= 0 ? CppString::ToString(second) : (mStatsFormat == STATS_JSON ? "\"total\"" : "total");
+    if (mStatsFormat == STATS_JSON)
+    {
+        snprintf(line, sizeof(line), "{\"second\":%s,\"success\":%llu,\"fail\":%llu,\"min_us\":%llu,\"mean_us\":%llu,"
+                 "\"p50_us\":%llu,\"p90_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"p9999_us\":%llu,\"max_us\":%llu}",
+                 secondStr.c_str(), (unsigned long long)successCount, (unsigned long long)failCount,
+                 (unsigned long long)histogram.GetMin(), (unsigned long long)meanTimeUs,
+                 (unsigned long long)p50, (unsigned long long)p90, (unsigned long long)p99,
+                 (unsigned long long)p999, (unsigned long long)p9999, (unsigned long long)histogram.GetMax());
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu",
+                 secondStr.c_str(), (unsigned long long)successCount, (unsigned long long)failCount,
+                 (unsigned long long)histogram.GetMin(), (unsigned long long)meanTimeUs,
+                 (unsigned long long)p50, (unsigned long long)p90, (unsigned long long)p99,
+                 (unsigned long long)p999, (unsigned long long)p9999, (unsigned long long)histogram.GetMax());
+    }
+
+    // 每行都刷新，压测中途退出时已输出的周期也可用
+    *pExport << line << std::endl;
+}
+
+int32_t MultiThreadClientBase::Run()
+{
+    list<thread> threads;
+    mClientDatas.resize(mClientThreadCount);
+    mOpenLoopStates.resize(mClientThreadCount);
+    mThreadStats.clear();
+    for (uint32_t i = 0; i < mClientThreadCount; ++i)
+    {
+        mThreadStats.push_back(std::unique_ptr<ThreadStats>(new ThreadStats));
+    }
+
+    // 统计导出文件打开失败不影响压测
+    std::ofstream exportFile;
+    std::ostream *pExport = NULL;
+    if (!mStatsExportPath.empty())
+    {
+        exportFile.open(mStatsExportPath.c_str(), ios::out | ios::trunc);
+        if (exportFile)
+        {
+            pExport = &exportFile;
+            if (mStatsFormat == STATS_CSV)
+            {
+                exportFile << "second,success,fail,min_us,mean_us,p50_us,p90_us,p99_us,p999_us,p9999_us,max_us" << std::endl;
+            }
+        }
+        else
+        {
+            ERROR_ILOG(mpCppLog, "打开统计导出文件[%s]失败,errno[%d],error[%s].", mStatsExportPath.c_str(), errno, strerror(errno));
+        }
+    }
+
+    for (uint32_t i = 0; i < mClientThreadCount; ++i)
+    {
+        threads.push_back(thread(&MultiThreadClientBase::ThreadFunc, this, i));
+    }
+
+    uint64_t currSuccess = 0;
+    uint64_t currFail = 0;
+    uint32_t second = 0;
+
+    DEBUG_ILOG(mpCppLog, "开始压测[%s:%u],线程数[%u],每线程客户端数[%u],总客户端数[%u],管道深度[%u],目标QPS[%llu%s],压测[%u]秒.",
+               mServerAddr.c_str(), mServerPort, mClientThreadCount, mClientCountPerThread,
+               mClientThreadCount * mClientCountPerThread, mPipelineDepth, mTargetQps,
+               mTargetQps == 0 ? "(闭环)" : (mPoisson ? "(泊松)" : "(固定间隔)"), mRunSecond);
+    while (true)
+    {
+        sleep(1);
+        ++second;
+
+        CollectStats(currSuccess, currFail);
+        ReportStats(gCurrHistogram, currSuccess, currFail, second, pExport);
+        ReportStats(gTotalHistogram, gSuccessCount, gFailCount, -1, NULL);
+
+        if (second >= mRunSecond)
+        {
+            gClientStop = true;
+            break;
+        }
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    // 线程退出前最后一个周期还可能有回包，计入总统计
+    CollectStats(currSuccess, currFail);
+    ReportStats(gTotalHistogram, gSuccessCount, gFailCount, -1, pExport);
+
+    DEBUG_ILOG(mpCppLog, "结束压测,线程数[%u],每线程客户端数[%u],总客户端数[%u],成功[%llu],失败[%llu],成功率[%.2lf%%],每秒请求[%llu],"
+               "最大耗时[%llu],最小耗时[%llu],平均耗时[%llu],P50[%llu],P90[%llu],P99[%llu],P99.9[%llu],P99.99[%llu].",
+               mClientThreadCount, mClientCountPerThread, mClientThreadCount * mClientCountPerThread,
+               gSuccessCount, gFailCount,
+               (gSuccessCount + gFailCount) == 0 ? 0 : gSuccessCount * 100.0 / (gSuccessCount + gFailCount),
+               (gSuccessCount + gFailCount) / mRunSecond,
+               gMaxTimeUs, gMinTimeUs, (uint64_t)gTotalHistogram.GetMean(),
+               gTotalHistogram.GetValueAtPercentile(50), gTotalHistogram.GetValueAtPercentile(90),
+               gTotalHistogram.GetValueAtPercentile(99), gTotalHistogram.GetValueAtPercentile(99.9),
+               gTotalHistogram.GetValueAtPercentile(99.99));
+
+    return 0;
+}
+
+void CppTcpConnection::Consume(size_t size)
+{
+    mReadPos += min(size, ReadSize());
+    if (mReadPos == mReadBuf.size())
+    {
+        mReadBuf.clear();
+        mReadPos = 0;
+    }
+    else if (mReadPos >= mReadBuf.size() / 2)
+    {
+        // 已处理的数据超过一半时才移动，避免每个包都移动剩余数据
+        mReadBuf.erase(0, mReadPos);
+        mReadPos = 0;
+    }
+}
+
+CppTcpServer::CppTcpServer(const std::string &ip, uint16_t port, uint32_t reactorCount, bool reusePort,
+                           bool bindCpu, CppLog *pCppLog) :
+    mIp(ip), mPort(port), mReactorCount(reactorCount == 0 ? 1 : reactorCount), mReusePort(reusePort),
+    mBindCpu(bindCpu), mpCppLog(pCppLog), mIdleTimeoutMs(0), mNextReactor(0), mStop(false), mStarted(false)
+{
+}
+
+CppTcpServer::~CppTcpServer()
+{
+    Stop();
+}
+
+int CppTcpServer::CreateListenFd(uint16_t port)
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    CHECK_RETURN_F(mpCppLog, listenFd >= 0, listenFd, CppLog::ERROR, "socket失败,errno[%d],error[%s].", errno, strerror(errno));
+    UniqueFd uniqListenFd(listenFd);
+
+    // 设置REUSEADDR标识，服务器重启可以快速使用这个端口，避免在TIME_WAIT状态无法重新监听这个端口
+    int flags = 1;
+    int32_t ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt SO_REUSEADDR失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    if (mReusePort)
+    {
+        ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags));
+        ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt SO_REUSEPORT失败,errno[%d],error[%s].", errno, strerror(errno));
+    }
+
+    sockaddr_in servAddr;
+    memset(&servAddr, 0, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(port);
+    servAddr.sin_addr.s_addr = mIp.empty() ? htonl(INADDR_ANY) : inet_addr(mIp.c_str());
+
+    ret = bind(listenFd, (struct sockaddr *)&servAddr, sizeof(servAddr));
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "bind失败,ip[%s],port[%u],errno[%d],error[%s].",
+                   mIp.c_str(), port, errno, strerror(errno));
+
+    ret = listen(listenFd, SERVER_LISTEN_BACKLOG);
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "listen失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    return uniqListenFd.Release();
+}
+
+int32_t CppTcpServer::Start()
+{
+    CHECK_RETURN_F(mpCppLog, !mStarted, -1, CppLog::ERROR, "服务已经启动.");
+
+    // 忽略SIGPIPE信号，防止客户端关闭后，服务端往Socket中写入数据导致服务端收到此信号导致服务挂掉
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, 0);
+
+    mStop = false;
+    mReactors.clear();
+    try
+    {
+        for (uint32_t i = 0; i < mReactorCount; ++i)
+        {
+            mReactors.push_back(unique_ptr<Reactor>(new Reactor(i, SERVER_EPOLL_SIZE)));
+        }
+
+        // 创建监听fd，端口为0时第一个监听fd由系统分配端口，其余的监听同一个端口
+        uint32_t listenCount = mReusePort ? mReactorCount : 1;
+        for (uint32_t i = 0; i < listenCount; ++i)
+        {
+            int listenFd = CreateListenFd(mPort);
+            CHECK_THROW_F(listenFd >= 0, "创建监听fd失败,port[%u].", mPort);
+
+            if (mPort == 0)
+            {
+                sockaddr_in addr;
+                socklen_t addrLen = sizeof(addr);
+                getsockname(listenFd, (struct sockaddr *)&addr, &addrLen);
+                mPort = ntohs(addr.sin_port);
+            }
+
+            if (mReusePort)
+            {
+                mReactors[i]->ListenFd.Reset(listenFd);
+                epoll_event ev;
+                ev.events = EPOLLIN;
+                mReactors[i]->EpollManager.AddOrModFd(listenFd, ev);
+            }
+            else
+            {
+                mListenFd.Reset(listenFd);
+            }
+        }
+    }
+    catch (CppException &e)
+    {
+        ERROR_ILOG(mpCppLog, "服务启动失败[%s].", e.ToString().c_str());
+        mReactors.clear();
+        mListenFd.Reset();
+        return -1;
+    }
+
+    for (auto &pReactor : mReactors)
+    {
+        pReactor->Thread = thread(&CppTcpServer::ReactorThread, this, std::ref(*pReactor));
+    }
+
+    if (!mReusePort)
+    {
+        mAcceptThread = thread(&CppTcpServer::AcceptThread, this);
+    }
+
+    mStarted = true;
+    DEBUG_ILOG(mpCppLog, "服务启动成功,监听[%s:%u],reactor数[%u],SO_REUSEPORT[%d],绑定CPU[%d].",
+               mIp.c_str(), mPort, mReactorCount, mReusePort, mBindCpu);
+
+    return 0;
+}
+
+void CppTcpServer::Stop()
+{
+    if (!mStarted)
+    {
+        return;
+    }
+
+    // 先停止accept线程，再通知reactor停止，保证accept线程投递的新连接都被reactor处理
+    mStop = true;
+    if (mAcceptThread.joinable())
+    {
+        mAcceptThread.join();
+    }
+
+    for (auto &pReactor : mReactors)
+    {
+        Reactor *pCurr = pReactor.get();
+        pCurr->EpollManager.PostTask([pCurr]()
+        {
+            pCurr->Stopped = true;
+        });
+    }
+
+    for (auto &pReactor : mReactors)
+    {
+        if (pReactor->Thread.joinable())
+        {
+            pReactor->Thread.join();
+        }
+    }
+
+    mReactors.clear();
+    mListenFd.Reset();
+    mStarted = false;
+}
+
+void CppTcpServer::AcceptThread()
+{
+    CppEpollManager epollManager(1);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    epollManager.AddOrModFd(mListenFd, ev);
+
+    epoll_event events[1];
+    while (!mStop)
+    {
+        if (epollManager.Wait(events, ARRAY_SIZE(events), SERVER_WAIT_MS) > 0)
+        {
+            AcceptConnections(mListenFd, NULL);
+        }
+    }
+}
+
+void CppTcpServer::AcceptConnections(int listenFd, Reactor *pReactor)
+{
+    sockaddr_in cliAddr;
+    socklen_t addrLen;
+    while (true)
+    {
+        addrLen = sizeof(cliAddr);
+        int clientFd = accept4(listenFd, (struct sockaddr *)&cliAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                ERROR_ILOG(mpCppLog, "accept失败,errno[%d],error[%s].", errno, strerror(errno));
+            }
+
+            return;
+        }
+
+        int flags = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, (char *)&flags, sizeof(flags));
+
+        IpPort peer(CppNet::NetIpToStr(cliAddr.sin_addr.s_addr), ntohs(cliAddr.sin_port));
+        if (pReactor != NULL)
+        {
+            AddConnection(*pReactor, clientFd, peer);
+            continue;
+        }
+
+        // 轮流分发给各个reactor，由reactor线程自己创建连接
+        Reactor &reactor = *mReactors[mNextReactor++ % mReactorCount];
+        reactor.EpollManager.PostTask([this, &reactor, clientFd, peer]()
+        {
+            AddConnection(reactor, clientFd, peer);
+        });
+    }
+}
+
+void CppTcpServer::AddConnection(Reactor &reactor, int fd, const IpPort &peer)
+{
+    shared_ptr<CppTcpConnection> pConn = MakeNewConnection();
+    pConn->mUniqueFd.Reset(fd);
+    pConn->mPeer = peer;
+    pConn->mReactorId = reactor.Id;
+    if (mpFrameCodec)
+    {
+        pConn->mpFrameCodec = mpFrameCodec->Clone();
+    }
+
+    try
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        reactor.EpollManager.AddOrModFd(fd, ev);
+    }
+    catch (CppException &e)
+    {
+        ERROR_ILOG(mpCppLog, "添加连接失败,fd[%d],peer[%s],error[%s].", fd, peer.ToString().c_str(), e.ToString().c_str());
+        return;
+    }
+
+    reactor.Connections[fd] = pConn;
+    if (mIdleTimeoutMs > 0)
+    {
+        pConn->mLastActiveMs = reactor.EpollManager.GetNowMs();
+        pConn->mIdleTimerId = reactor.EpollManager.AddTimer(mIdleTimeoutMs, [this, &reactor, fd]() { CheckIdle(reactor, fd); });
+    }
+
+    OnConnect(*pConn);
+}
+
+void CppTcpServer::CheckIdle(Reactor &reactor, int fd)
+{
+    auto it = reactor.Connections.find(fd);
+    if (it == reactor.Connections.end())
+    {
+        return;
+    }
+
+    CppTcpConnection &conn = *it->second;
+    uint64_t idleMs = reactor.EpollManager.GetNowMs() - conn.mLastActiveMs;
+    if (idleMs >= mIdleTimeoutMs)
+    {
+        DEBUG_ILOG(mpCppLog, "连接空闲[%llu]毫秒,关闭,fd[%d],peer[%s].", idleMs, fd, conn.GetPeer().ToString().c_str());
+        conn.mIdleTimerId = 0;
+        CloseConnection(reactor, fd);
+        return;
+    }
+
+    conn.mIdleTimerId = reactor.EpollManager.AddTimer(mIdleTimeoutMs - idleMs, [this, &reactor, fd]() { CheckIdle(reactor, fd); });
+}
+
+void CppTcpServer::CloseConnection(Reactor &reactor, int fd)
+{
+    auto it = reactor.Connections.find(fd);
+    if (it == reactor.Connections.end())
+    {
+        return;
+    }
+
+    // 先从epoll中删除再关闭fd
+    try
+    {
+        reactor.EpollManager.DelFd(fd);
+    }
+    catch (CppException &e)
+    {
+        ERROR_ILOG(mpCppLog, "%s", e.ToString().c_str());
+    }
+
+    // fd会被复用，空闲检查的定时器必须取消
+    if (it->second->mIdleTimerId != 0)
+    {
+        reactor.EpollManager.CancelTimer(it->second->mIdleTimerId);
+    }
+
+    OnClose(*it->second);
+    reactor.Connections.erase(it);
+}
+
+int32_t CppTcpServer::ProcRead(Reactor &reactor, CppTcpConnection &conn)
+{
+    int fd = conn.GetFd();
+    bool peerClosed = false;
+    conn.mLastActiveMs = reactor.EpollManager.GetNowMs();
+
+    // 先读到栈上的缓冲区，只把读到的数据追加到连接的读缓冲区，避免每次resize都把16KB清0，读满一次则继续读
+    char buf[SERVER_READ_SIZE];
+    while (true)
+    {
+        ssize_t readSize = read(fd, buf, sizeof(buf));
+        if (readSize > 0)
+        {
+            conn.mReadBuf.append(buf, readSize);
+            if (static_cast<size_t>(readSize) < SERVER_READ_SIZE)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (readSize == 0)
+        {
+            peerClosed = true;
+            break;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+
+        DEBUG_ILOG(mpCppLog, "read失败,fd[%d],peer[%s],errno[%d],error[%s].",
+                   fd, conn.mPeer.ToString().c_str(), errno, strerror(errno));
+        return -1;
+    }
+
+    if (conn.ReadSize() > 0)
+    {
+        int32_t ret = OnMessage(conn);
+        if (ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    int32_t ret = ProcWrite(reactor, conn);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    // 对端已经关闭，回包尽量发出后关闭
+    return peerClosed ? -1 : 0;
+}
+
+int32_t CppTcpServer::ProcWrite(Reactor &reactor, CppTcpConnection &conn)
+{
+    int fd = conn.GetFd();
+    while (conn.HasPendingWrite())
+    {
+        ssize_t writeSize = send(fd, conn.mWriteBuf.data() + conn.mWritePos, conn.mWriteBuf.size() - conn.mWritePos,
+                                 MSG_NOSIGNAL);
+        if (writeSize > 0)
+        {
+            conn.mWritePos += writeSize;
+            continue;
+        }
+
+        if (writeSize < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (writeSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        DEBUG_ILOG(mpCppLog, "send失败,fd[%d],peer[%s],errno[%d],error[%s].",
+                   fd, conn.mPeer.ToString().c_str(), errno, strerror(errno));
+        return -1;
+    }
+
+    epoll_event ev;
+    if (conn.HasPendingWrite())
+    {
+        // 写不完，等可写事件再写
+        if (!conn.mWatchWrite)
+        {
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+            reactor.EpollManager.AddOrModFd(fd, ev);
+            conn.mWatchWrite = true;
+        }
+
+        return 0;
+    }
+
+    conn.mWriteBuf.clear();
+    conn.mWritePos = 0;
+    if (conn.mWatchWrite)
+    {
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        reactor.EpollManager.AddOrModFd(fd, ev);
+        conn.mWatchWrite = false;
+    }
+
+    return conn.mClosing ? 1 : 0;
+}
+
+void CppTcpServer::ReactorThread(Reactor &reactor)
+{
+    if (mBindCpu)
+    {
+        uint32_t cpuCount = thread::hardware_concurrency();
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(reactor.Id % (cpuCount == 0 ? 1 : cpuCount), &cpuSet);
+        int32_t ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (ret != 0)
+        {
+            ERROR_ILOG(mpCppLog, "reactor[%u]绑定CPU失败,ret[%d].", reactor.Id, ret);
+        }
+    }
+
+    epoll_event events[SERVER_EVENT_SIZE];
+    while (!reactor.Stopped)
+    {
+        // accept线程分发过来的新连接通过投递任务在Wait中加入
+        int32_t fdsCount = 0;
+        try
+        {
+            fdsCount = reactor.EpollManager.Wait(events, ARRAY_SIZE(events), SERVER_REACTOR_WAIT_MS);
+        }
+        catch (CppException &e)
+        {
+            ERROR_ILOG(mpCppLog, "%s", e.ToString().c_str());
+            continue;
+        }
+
+        for (int32_t i = 0; i < fdsCount; ++i)
+        {
+            epoll_event &event = events[i];
+            int fd = reactor.EpollManager.GetFdFromEvent(event);
+            if (fd == reactor.ListenFd.Get())
+            {
+                AcceptConnections(fd, &reactor);
+                continue;
+            }
+
+            auto it = reactor.Connections.find(fd);
+            if (it == reactor.Connections.end())
+            {
+                continue;
+            }
+
+            CppTcpConnection &conn = *it->second;
+            int32_t ret = 0;
+            try
+            {
+                if (event.events & (EPOLLERR | EPOLLHUP))
+                {
+                    ret = -1;
+                }
+                else
+                {
+                    if (event.events & EPOLLOUT)
+                    {
+                        ret = ProcWrite(reactor, conn);
+                    }
+
+                    if (ret == 0 && (event.events & (EPOLLIN | EPOLLRDHUP)))
+                    {
+                        ret = ProcRead(reactor, conn);
+                    }
+                }
+            }
+            catch (CppException &e)
+            {
+                ERROR_ILOG(mpCppLog, "%s", e.ToString().c_str());
+                ret = -1;
+            }
+
+            if (ret != 0)
+            {
+                CloseConnection(reactor, fd);
+            }
+        }
+    }
+
+    // 关闭所有连接
+    while (!reactor.Connections.empty())
+    {
+        CloseConnection(reactor, reactor.Connections.begin()->first);
+    }
+
+    DEBUG_ILOG(mpCppLog, "exit reactor[%u].", reactor.Id);
+}
+
+// 64位整数的混合函数(MurmurHash3 fmix64)，让相近的key在哈希环上分散
+static uint64_t MixHash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// FNV-1a，结果与进程无关，同一后端在不同进程中的哈希环位置相同
+static uint64_t HashString(const string &str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : str)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return MixHash(hash);
+}
+
+CppConnectionPool::CppConnectionPool(BALANCE_MODE mode, CppLog *pCppLog) :
+    mMode(mode), mpCppLog(pCppLog), mConnectTimeoutMs(1000), mMinIdle(1), mMaxIdle(8), mMaxIdleTimeMs(60000),
+    mHealthCheckIntervalMs(1000), mFailThreshold(3), mNextEndpoint(0), mNextConnId(POOL_EVENT_FD_ID + 1),
+    mStop(false), mStarted(false)
+{
+
+}
+
+CppConnectionPool::~CppConnectionPool()
+{
+    Stop();
+}
+
+int32_t CppConnectionPool::AddEndpoint(const IpPort &endpoint)
+{
+    shared_ptr<Endpoint> pEndpoint = make_shared<Endpoint>();
+    pEndpoint->Addr = endpoint;
+    memset(&pEndpoint->SockAddr, 0, sizeof(pEndpoint->SockAddr));
+    pEndpoint->SockAddr.sin_family = AF_INET;
+    pEndpoint->SockAddr.sin_port = htons(endpoint.Port);
+    int ret = inet_pton(AF_INET, endpoint.IP.c_str(), &pEndpoint->SockAddr.sin_addr);
+    CHECK_RETURN_F(mpCppLog, ret == 1, -1, CppLog::ERROR, "后端IP不合法[%s].", endpoint.ToString().c_str());
+
+    {
+        lock_guard<mutex> lock(mMutex);
+        CHECK_RETURN_F(mpCppLog, mEndpoints.find(endpoint) == mEndpoints.end(), -1, CppLog::ERROR,
+                       "后端已存在[%s].", endpoint.ToString().c_str());
+
+        mEndpoints[endpoint] = pEndpoint;
+        mEndpointList.push_back(pEndpoint);
+        RebuildRing();
+    }
+
+    // 唤醒后台线程建立连接
+    if (mEventFd.Get() >= 0)
+    {
+        eventfd_write(mEventFd.Get(), 1);
+    }
+
+    return 0;
+}
+
+int32_t CppConnectionPool::RemoveEndpoint(const IpPort &endpoint)
+{
+    lock_guard<mutex> lock(mMutex);
+    auto it = mEndpoints.find(endpoint);
+    CHECK_RETURN_F(mpCppLog, it != mEndpoints.end(), -1, CppLog::ERROR, "后端不存在[%s].", endpoint.ToString().c_str());
+
+    shared_ptr<Endpoint> pEndpoint = it->second;
+    pEndpoint->Removed = true;
+    CloseIdleConns(*pEndpoint);
+
+    // 正在connect的连接在完成或超时时关闭
+    mEndpoints.erase(it);
+    mEndpointList.erase(find(mEndpointList.begin(), mEndpointList.end(), pEndpoint));
+    RebuildRing();
+
+    // 正在等待这个后端的调用方重新选择
+    mIdleCond.notify_all();
+
+    return 0;
+}
+
+void CppConnectionPool::RebuildRing()
+{
+    mRing.clear();
+    for (auto &pEndpoint : mEndpointList)
+    {
+        string key = pEndpoint->Addr.ToString();
+        for (uint32_t i = 0; i < POOL_VIRTUAL_NODE_COUNT; ++i)
+        {
+            mRing.push_back(make_pair(HashString(key + "#" + CppString::ToString(i)), pEndpoint));
+        }
+    }
+
+    sort(mRing.begin(), mRing.end(),
+         [](const pair<uint64_t, shared_ptr<Endpoint>> &left, const pair<uint64_t, shared_ptr<Endpoint>> &right)
+         {
+             return left.first < right.first;
+         });
+}
+
+int32_t CppConnectionPool::Start()
+{
+    CHECK_RETURN_F(mpCppLog, !mStarted, -1, CppLog::ERROR, "连接池已经启动.");
+
+    // 忽略SIGPIPE信号，防止后端关闭后写入导致进程退出
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, 0);
+
+    mEpollFd.Reset(epoll_create1(EPOLL_CLOEXEC));
+    CHECK_RETURN_F(mpCppLog, mEpollFd.Get() >= 0, -1, CppLog::ERROR, "epoll_create1失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    mEventFd.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    CHECK_RETURN_F(mpCppLog, mEventFd.Get() >= 0, -1, CppLog::ERROR, "eventfd失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = POOL_EVENT_FD_ID;
+    int ret = epoll_ctl(mEpollFd.Get(), EPOLL_CTL_ADD, mEventFd.Get(), &ev);
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "epoll_ctl eventfd失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    mStop = false;
+    mThread = thread(&CppConnectionPool::ThreadFunc, this);
+    mStarted = true;
+
+    DEBUG_ILOG(mpCppLog, "连接池启动,模式[%s],后端数[%zu],空闲连接[%u-%u],connect超时[%u],探测间隔[%u],失败阈值[%u].",
+               mMode == LEAST_LOADED ? "最少连接" : "一致性哈希", mEndpointList.size(), mMinIdle, mMaxIdle,
+               mConnectTimeoutMs, mHealthCheckIntervalMs, mFailThreshold);
+
+    return 0;
+}
+
+void CppConnectionPool::Stop()
+{
+    if (!mStarted)
+    {
+        return;
+    }
+
+    mStop = true;
+    eventfd_write(mEventFd.Get(), 1);
+    mThread.join();
+
+    // 只保留在用的连接，Release时关闭
+    unique_lock<mutex> lock(mMutex);
+    for (auto it = mConns.begin(); it != mConns.end();)
+    {
+        if (it->second.State == CONN_BUSY)
+        {
+            ++it;
+            continue;
+        }
+
+        Endpoint &endpoint = *it->second.pEndpoint;
+        if (it->second.State == CONN_CONNECTING)
+        {
+            --endpoint.ConnectingCount;
+        }
+        else
+        {
+            endpoint.IdleIds.clear();
+        }
+
+        it = mConns.erase(it);
+    }
+
+    mStarted = false;
+    lock.unlock();
+    mIdleCond.notify_all();
+
+    DEBUG_ILOG(mpCppLog, "连接池停止.");
+}
+
+shared_ptr<CppConnectionPool::Endpoint> CppConnectionPool::SelectEndpoint(uint64_t hashKey)
+{
+    if (mMode == CONSISTENT_HASH)
+    {
+        if (mRing.empty())
+        {
+            return shared_ptr<Endpoint>();
+        }
+
+        // 顺时针找到第一个健康的后端，不健康的后端的key由下一个后端承接
+        uint64_t hash = MixHash(hashKey);
+        auto it = lower_bound(mRing.begin(), mRing.end(), hash,
+                              [](const pair<uint64_t, shared_ptr<Endpoint>> &node, uint64_t value)
+                              {
+                                  return node.first < value;
+                              });
+        size_t start = it - mRing.begin();
+        for (size_t i = 0; i < mRing.size(); ++i)
+        {
+            const shared_ptr<Endpoint> &pEndpoint = mRing[(start + i) % mRing.size()].second;
+            if (pEndpoint->Healthy)
+            {
+                return pEndpoint;
+            }
+        }
+
+        return shared_ptr<Endpoint>();
+    }
+
+    // 在用连接最少的后端，有空闲连接的优先
+    shared_ptr<Endpoint> pBest;
+    size_t count = mEndpointList.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const shared_ptr<Endpoint> &pEndpoint = mEndpointList[(mNextEndpoint + i) % count];
+        if (!pEndpoint->Healthy)
+        {
+            continue;
+        }
+
+        if (!pBest || (pBest->IdleIds.empty() && !pEndpoint->IdleIds.empty()) ||
+            (pBest->IdleIds.empty() == pEndpoint->IdleIds.empty() && pEndpoint->ActiveCount < pBest->ActiveCount))
+        {
+            pBest = pEndpoint;
+        }
+    }
+
+    ++mNextEndpoint;
+    return pBest;
+}
+
+int CppConnectionPool::Acquire(IpPort &endpoint, uint64_t hashKey, uint32_t waitMs)
+{
+    unique_lock<mutex> lock(mMutex);
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(waitMs);
+    while (mStarted)
+    {
+        shared_ptr<Endpoint> pEndpoint = SelectEndpoint(hashKey);
+        if (pEndpoint && !pEndpoint->IdleIds.empty())
+        {
+            uint64_t id = pEndpoint->IdleIds.back();
+            pEndpoint->IdleIds.pop_back();
+
+            Conn &conn = mConns[id];
+            epoll_ctl(mEpollFd.Get(), EPOLL_CTL_DEL, conn.Fd.Get(), NULL);
+            conn.State = CONN_BUSY;
+            ++pEndpoint->ActiveCount;
+            mBusyFds[conn.Fd.Get()] = id;
+            endpoint = pEndpoint->Addr;
+
+            // 空闲连接少于下限时让后台线程补充
+            if (pEndpoint->IdleIds.size() < mMinIdle)
+            {
+                eventfd_write(mEventFd.Get(), 1);
+            }
+
+            return conn.Fd.Get();
+        }
+
+        if (!pEndpoint || waitMs == 0 || chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+
+        // 登记等待，后台线程按等待数补充连接
+        ++pEndpoint->WaitingCount;
+        eventfd_write(mEventFd.Get(), 1);
+        mIdleCond.wait_until(lock, deadline);
+        --pEndpoint->WaitingCount;
+    }
+
+    return -1;
+}
+
+int32_t CppConnectionPool::Release(int fd, bool reuse)
+{
+    lock_guard<mutex> lock(mMutex);
+    auto it = mBusyFds.find(fd);
+    CHECK_RETURN_F(mpCppLog, it != mBusyFds.end(), -1, CppLog::ERROR, "fd[%d]不是从连接池获取的.", fd);
+
+    uint64_t id = it->second;
+    mBusyFds.erase(it);
+    Conn &conn = mConns[id];
+    Endpoint &endpoint = *conn.pEndpoint;
+    --endpoint.ActiveCount;
+
+    if (reuse && mStarted && !endpoint.Removed && endpoint.Healthy && endpoint.IdleIds.size() < mMaxIdle)
+    {
+        AddIdle(id, conn, GetMonotonicMs());
+    }
+    else
+    {
+        mConns.erase(id);
+    }
+
+    return 0;
+}
+
+uint32_t CppConnectionPool::GetIdleCount(const IpPort &endpoint)
+{
+    lock_guard<mutex> lock(mMutex);
+    auto it = mEndpoints.find(endpoint);
+    return it == mEndpoints.end() ? 0 : it->second->IdleIds.size();
+}
+
+bool CppConnectionPool::IsHealthy(const IpPort &endpoint)
+{
+    lock_guard<mutex> lock(mMutex);
+    auto it = mEndpoints.find(endpoint);
+    return it != mEndpoints.end() && it->second->Healthy;
+}
+
+void CppConnectionPool::AddIdle(uint64_t id, Conn &conn, uint64_t nowMs)
+{
+    // 空闲连接只关心对端关闭，收到任何数据也说明连接状态不对，都直接关闭
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = id;
+    int op = conn.State == CONN_CONNECTING ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(mEpollFd.Get(), op, conn.Fd.Get(), &ev) != 0)
+    {
+        ERROR_ILOG(mpCppLog, "epoll_ctl空闲连接失败,fd[%d],errno[%d],error[%s].", conn.Fd.Get(), errno, strerror(errno));
+        mConns.erase(id);
+        return;
+    }
+
+    conn.State = CONN_IDLE;
+    conn.TimeMs = nowMs;
+    conn.pEndpoint->IdleIds.push_back(id);
+    mIdleCond.notify_one();
+}
+
+void CppConnectionPool::CloseConn(uint64_t id)
+{
+    auto it = mConns.find(id);
+    if (it == mConns.end())
+    {
+        return;
+    }
+
+    Endpoint &endpoint = *it->second.pEndpoint;
+    if (it->second.State == CONN_IDLE)
+    {
+        endpoint.IdleIds.erase(find(endpoint.IdleIds.begin(), endpoint.IdleIds.end(), id));
+    }
+    else if (it->second.State == CONN_CONNECTING)
+    {
+        --endpoint.ConnectingCount;
+    }
+
+    // close时fd自动从epoll中移除
+    mConns.erase(it);
+}
+
+void CppConnectionPool::CloseIdleConns(Endpoint &endpoint)
+{
+    while (!endpoint.IdleIds.empty())
+    {
+        CloseConn(endpoint.IdleIds.back());
+    }
+}
+
+void CppConnectionPool::StartConnect(const shared_ptr<Endpoint> &pEndpoint, uint64_t nowMs)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    CHECK_RETURN_VOID_F(mpCppLog, fd >= 0, fd, CppLog::ERROR, "socket失败,errno[%d],error[%s].", errno, strerror(errno));
+
+    uint64_t id = mNextConnId++;
+    Conn &conn = mConns[id];
+    conn.Fd.Reset(fd);
+    conn.pEndpoint = pEndpoint;
+    conn.State = CONN_CONNECTING;
+    conn.TimeMs = nowMs + mConnectTimeoutMs;
+    ++pEndpoint->ConnectingCount;
+
+    int flags = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &flags, sizeof(flags));
+
+    // 本机连接可能立即成功，同样等可写事件再处理
+    int ret = connect(fd, (struct sockaddr *)&pEndpoint->SockAddr, sizeof(pEndpoint->SockAddr));
+    if (ret != 0 && errno != EINPROGRESS)
+    {
+        DEBUG_ILOG(mpCppLog, "connect失败,后端[%s],errno[%d],error[%s].", pEndpoint->Addr.ToString().c_str(), errno, strerror(errno));
+        OnConnectFailed(id, conn);
+        return;
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.u64 = id;
+    if (epoll_ctl(mEpollFd.Get(), EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        ERROR_ILOG(mpCppLog, "epoll_ctl失败,fd[%d],errno[%d],error[%s].", fd, errno, strerror(errno));
+        CloseConn(id);
+    }
+}
+
+void CppConnectionPool::OnConnected(uint64_t id, Conn &conn, uint64_t nowMs)
+{
+    Endpoint &endpoint = *conn.pEndpoint;
+    --endpoint.ConnectingCount;
+    endpoint.FailCount = 0;
+    if (!endpoint.Healthy)
+    {
+        endpoint.Healthy = true;
+        DEBUG_ILOG(mpCppLog, "后端恢复健康[%s].", endpoint.Addr.ToString().c_str());
+        mIdleCond.notify_all();
+    }
+
+    if (endpoint.Removed || endpoint.IdleIds.size() >= mMaxIdle)
+    {
+        mConns.erase(id);
+        return;
+    }
+
+    // AddIdle中从监听可写改为监听可读
+    AddIdle(id, conn, nowMs);
+}
+
+void CppConnectionPool::OnConnectFailed(uint64_t id, Conn &conn)
+{
+    Endpoint &endpoint = *conn.pEndpoint;
+    --endpoint.ConnectingCount;
+    mConns.erase(id);
+
+    if (++endpoint.FailCount >= mFailThreshold && endpoint.Healthy)
+    {
+        endpoint.Healthy = false;
+        CloseIdleConns(endpoint);
+        ERROR_ILOG(mpCppLog, "后端连续connect失败[%u]次,标记为不健康[%s].", endpoint.FailCount, endpoint.Addr.ToString().c_str());
+
+        // 等待这个后端的调用方重新选择
+        mIdleCond.notify_all();
+    }
+}
+
+void CppConnectionPool::Maintain(uint64_t nowMs)
+{
+    // connect超时
+    vector<uint64_t> timeoutIds;
+    for (auto &item : mConns)
+    {
+        if (item.second.State == CONN_CONNECTING && nowMs >= item.second.TimeMs)
+        {
+            timeoutIds.push_back(item.first);
+        }
+    }
+
+    for (uint64_t id : timeoutIds)
+    {
+        Conn &conn = mConns[id];
+        DEBUG_ILOG(mpCppLog, "connect超时,后端[%s].", conn.pEndpoint->Addr.ToString().c_str());
+        OnConnectFailed(id, conn);
+    }
+
+    for (auto &pEndpoint : mEndpointList)
+    {
+        Endpoint &endpoint = *pEndpoint;
+
+        // 超过下限的空闲连接，空闲太久的关闭，最早归还的在前面
+        while (endpoint.IdleIds.size() > mMinIdle && nowMs >= mConns[endpoint.IdleIds.front()].TimeMs + mMaxIdleTimeMs)
+        {
+            CloseConn(endpoint.IdleIds.front());
+        }
+
+        // 健康探测，探测用的连接成功后作为空闲连接
+        bool probe = nowMs >= endpoint.NextProbeMs;
+        if (probe)
+        {
+            endpoint.NextProbeMs = nowMs + mHealthCheckIntervalMs;
+        }
+
+        // 不健康的后端只做探测，不补充连接
+        uint32_t target = 0;
+        if (endpoint.Healthy)
+        {
+            target = min(max(mMinIdle, endpoint.WaitingCount), mMaxIdle);
+        }
+
+        uint32_t current = endpoint.IdleIds.size() + endpoint.ConnectingCount;
+        uint32_t connectCount = current < target ? target - current : 0;
+        if (probe && connectCount == 0 && endpoint.ConnectingCount == 0)
+        {
+            connectCount = 1;
+        }
+
+        for (uint32_t i = 0; i < connectCount && !endpoint.Removed; ++i)
+        {
+            StartConnect(pEndpoint, nowMs);
+        }
+    }
+}
+
+void CppConnectionPool::ThreadFunc()
+{
+    epoll_event events[POOL_EVENT_SIZE];
+    while (!mStop)
+    {
+        int eventCount = epoll_wait(mEpollFd.Get(), events, POOL_EVENT_SIZE, POOL_WAIT_MS);
+        if (eventCount < 0 && errno != EINTR)
+        {
+            ERROR_ILOG(mpCppLog, "epoll_wait失败,errno[%d],error[%s].", errno, strerror(errno));
+            break;
+        }
+
+        lock_guard<mutex> lock(mMutex);
+        uint64_t nowMs = GetMonotonicMs();
+        for (int i = 0; i < eventCount; ++i)
+        {
+            uint64_t id = events[i].data.u64;
+            if (id == POOL_EVENT_FD_ID)
+            {
+                eventfd_t value;
+                eventfd_read(mEventFd.Get(), &value);
+                continue;
+            }
+
+            // 事件返回前连接可能已经被Acquire取走或关闭
+            auto it = mConns.find(id);
+            if (it == mConns.end())
+            {
+                continue;
+            }
+
+            Conn &conn = it->second;
+            if (conn.State == CONN_CONNECTING)
+            {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(conn.Fd.Get(), SOL_SOCKET, SO_ERROR, &error, &len);
+                if (error == 0 && (events[i].events & (EPOLLERR | EPOLLHUP)) == 0)
+                {
+                    OnConnected(id, conn, nowMs);
+                }
+                else
+                {
+                    DEBUG_ILOG(mpCppLog, "connect失败,后端[%s],error[%d][%s].", conn.pEndpoint->Addr.ToString().c_str(), error, strerror(error));
+                    OnConnectFailed(id, conn);
+                }
+            }
+            else if (conn.State == CONN_IDLE)
+            {
+                // 空闲连接被对端关闭
+                CloseConn(id);
+            }
+        }
+
+        Maintain(nowMs);
+    }
+
+    DEBUG_ILOG(mpCppLog, "exit connection pool thread.");
+}
+
+CppDnsCache::CppDnsCache(uint32_t ttlMs, uint32_t negativeTtlMs, CppLog *pCppLog) :
+    mTtlMs(ttlMs), mNegativeTtlMs(negativeTtlMs), mpCppLog(pCppLog), mPendingCount(0)
+{
+
+}
+
+CppDnsCache::~CppDnsCache()
+{
+    // 回调中会访问缓存，必须等所有请求返回
+    unique_lock<mutex> lock(mMutex);
+    mCond.wait(lock, [this]() { return mPendingCount == 0; });
+}
+
+CppDnsCache &CppDnsCache::Default()
+{
+    static CppDnsCache dnsCache;
+    return dnsCache;
+}
+
+// IP字符串直接转换，不需要解析
+static bool ParseNumericHost(const string &host, uint16_t port, sockaddr_storage &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in *pAddr4 = reinterpret_cast<sockaddr_in *>(&addr);
+    if (inet_pton(AF_INET, host.c_str(), &pAddr4->sin_addr) == 1)
+    {
+        pAddr4->sin_family = AF_INET;
+        pAddr4->sin_port = htons(port);
+        return true;
+    }
+
+    sockaddr_in6 *pAddr6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    if (inet_pton(AF_INET6, host.c_str(), &pAddr6->sin6_addr) == 1)
+    {
+        pAddr6->sin6_family = AF_INET6;
+        pAddr6->sin6_port = htons(port);
+        return true;
+    }
+
+    return false;
+}
+
+int32_t CppDnsCache::Resolve(const string &host, uint16_t port, vector<sockaddr_storage> &addrs, uint32_t timeoutMs)
+{
+    addrs.clear();
+    sockaddr_storage numericAddr;
+    if (ParseNumericHost(host, port, numericAddr))
+    {
+        addrs.push_back(numericAddr);
+        return 0;
+    }
 
-    int flags = fcntl(fd, F_GETFL, 0);
-    ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "fcntl O_NONBLOCK失败,errno[%d],error[%s].", errno, strerror(errno));
+    unique_lock<mutex> lock(mMutex);
+    uint64_t nowMs = GetMonotonicMs();
+    Entry &entry = mEntries[host];
+    bool cached = entry.ResolveMs != 0 && nowMs < entry.ExpireMs;
+    if (cached && entry.Error == 0 && !entry.Resolving &&
+        nowMs >= entry.ResolveMs + (uint64_t)mTtlMs * DNS_REFRESH_AHEAD_PERCENT / 100)
+    {
+        // 提前刷新，这次仍然返回缓存的结果
+        StartResolve(host, entry);
+    }
 
-    flags = 1;
-    ret = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flags, sizeof(flags));
-    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt TCP_NODELAY失败,errno[%d],error[%s].", errno, strerror(errno));
+    if (!cached)
+    {
+        if (!entry.Resolving)
+        {
+            int32_t ret = StartResolve(host, entry);
+            if (ret != 0)
+            {
+                return ret;
+            }
+        }
 
-    // 初始化连接
-    InitConnection(fd);
+        if (timeoutMs == 0)
+        {
+            return EAI_AGAIN;
+        }
 
-    return uniqFd.Release();
+        // 等待解析完成，Clear可能会删除节点，每次都重新查找
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        bool done = mCond.wait_until(lock, deadline, [&]()
+        {
+            auto it = mEntries.find(host);
+            return it == mEntries.end() || !it->second.Resolving;
+        });
+
+        auto it = mEntries.find(host);
+        if (!done || it == mEntries.end() || it->second.ResolveMs == 0)
+        {
+            return EAI_AGAIN;
+        }
+    }
+
+    const Entry &result = mEntries[host];
+    if (result.Error != 0)
+    {
+        return result.Error;
+    }
+
+    addrs = result.Addrs;
+    for (auto &addr : addrs)
+    {
+        if (addr.ss_family == AF_INET)
+        {
+            reinterpret_cast<sockaddr_in *>(&addr)->sin_port = htons(port);
+        }
+        else
+        {
+            reinterpret_cast<sockaddr_in6 *>(&addr)->sin6_port = htons(port);
+        }
+    }
+
+    return 0;
 }
 
-int32_t MultiThreadClientBase::Run()
+int32_t CppDnsCache::ResolveIp(const string &host, string &ip, uint32_t timeoutMs)
 {
-    list<thread> threads;
-    mClientDatas.resize(mClientThreadCount);
-    for (uint32_t i = 0; i < mClientThreadCount; ++i)
+    vector<sockaddr_storage> addrs;
+    int32_t ret = Resolve(host, 0, addrs, timeoutMs);
+    if (ret != 0)
     {
-        threads.push_back(thread(&MultiThreadClientBase::ThreadFunc, this, i));
+        return ret;
     }
 
-    uint64_t lastSuccess = 0;
-    uint64_t lastFail = 0;
+    char buf[INET6_ADDRSTRLEN];
+    const sockaddr_storage &addr = addrs[0];
+    if (addr.ss_family == AF_INET)
+    {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(&addr)->sin_addr, buf, sizeof(buf));
+    }
+    else
+    {
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 *>(&addr)->sin6_addr, buf, sizeof(buf));
+    }
 
-    // 为了不被其他线程影响，这里需要将全局数据拷贝下来
-    uint64_t currTotalSuccess = 0;
-    uint64_t currTotalFail = 0;
+    ip = buf;
+    return 0;
+}
 
-    uint32_t second = 0;
+int32_t CppDnsCache::ResolveHostList(const string &hosts, string &resolvedHosts, uint32_t timeoutMs)
+{
+    vector<string> hostList;
+    CppString::SplitStr(hosts, ",", hostList);
 
-    DEBUG_ILOG(mpCppLog, "开始压测[%s:%u],线程数[%u],每线程客户端数[%u],总客户端数[%u],压测[%u]秒.",
-               mServerAddr.c_str(), mServerPort, mClientThreadCount, mClientCountPerThread,
-               mClientThreadCount * mClientCountPerThread, mRunSecond);
-    while (true)
+    resolvedHosts.clear();
+    for (auto &hostPort : hostList)
     {
-        sleep(1);
-        currTotalSuccess = gSuccessCount;
-        currTotalFail = gFailCount;
-
-        DEBUG_ILOG(mpCppLog, "周期成功[%llu],周期失败[%llu],周期成功率[%.2lf%%],最大耗时[%llu],最小耗时[%llu],平均耗时[%llu].",
-                   currTotalSuccess - lastSuccess, currTotalFail - lastFail,
-                   (currTotalSuccess - lastSuccess + currTotalFail - lastFail) == 0 ? 0 : (currTotalSuccess - lastSuccess) * 100.0 / (currTotalSuccess - lastSuccess + currTotalFail - lastFail),
-                   gCurrMaxTimeUs, gCurrMinTimeUs,
-                   (currTotalSuccess - lastSuccess + currTotalFail - lastFail) == 0 ? 0 : gCurrTotalTimeUs / (currTotalSuccess - lastSuccess + currTotalFail - lastFail));
-        DEBUG_ILOG(mpCppLog, "总成功[%llu],总失败[%llu],总成功率[%.2lf%%],总最大耗时[%llu],总最小耗时[%llu],总平均耗时[%llu].",
-                   currTotalSuccess, currTotalFail,
-                   (currTotalSuccess + currTotalFail) == 0 ? 0 : currTotalSuccess * 100.0 / (currTotalSuccess + currTotalFail),
-                   gMaxTimeUs, gMinTimeUs,
-                   (currTotalSuccess + currTotalFail) == 0 ? 0 : gTotalTimeUs / (currTotalSuccess + currTotalFail));
-
-        lastSuccess = currTotalSuccess;
-        lastFail = currTotalFail;
-        gCurrTotalTimeUs = 0;
-        gCurrMinTimeUs = 0;
-        gCurrMaxTimeUs = 0;
-
-        if (++second >= mRunSecond)
+        // IPv6的地址带中括号：[::1]:2181
+        size_t colonPos = hostPort.rfind(':');
+        CHECK_RETURN_F(mpCppLog, colonPos != string::npos, EAI_NONAME, CppLog::ERROR, "地址格式错误[%s].", hostPort.c_str());
+        string host = hostPort.substr(0, colonPos);
+        if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']')
         {
-            gClientStop = true;
-            break;
+            host = host.substr(1, host.size() - 2);
         }
+
+        string ip;
+        int32_t ret = ResolveIp(host, ip, timeoutMs);
+        CHECK_RETURN_F(mpCppLog, ret == 0, ret, CppLog::ERROR, "解析[%s]失败,ret[%d],error[%s].", host.c_str(), ret, gai_strerror(ret));
+
+        resolvedHosts += resolvedHosts.empty() ? "" : ",";
+        resolvedHosts += (ip.find(':') == string::npos ? ip : "[" + ip + "]") + hostPort.substr(colonPos);
     }
 
-    DEBUG_ILOG(mpCppLog, "结束压测,线程数[%u],每线程客户端数[%u],总客户端数[%u],成功[%llu],失败[%llu],成功率[%.2lf%%],每秒请求[%llu],最大耗时[%llu],最小耗时[%llu],平均耗时[%llu].",
-               mClientThreadCount, mClientCountPerThread, mClientThreadCount * mClientCountPerThread,
-               currTotalSuccess, currTotalFail,
-               (currTotalSuccess + currTotalFail) == 0 ? 0 : currTotalSuccess * 100.0 / (currTotalSuccess + currTotalFail),
-               (currTotalSuccess + currTotalFail) / mRunSecond,
-               gMaxTimeUs, gMinTimeUs,
-               (currTotalSuccess + currTotalFail) == 0 ? 0 : gTotalTimeUs / (currTotalSuccess + currTotalFail));
+    return 0;
+}
 
-    for (auto &t : threads)
+void CppDnsCache::Clear()
+{
+    lock_guard<mutex> lock(mMutex);
+    mEntries.clear();
+}
+
+size_t CppDnsCache::Size()
+{
+    lock_guard<mutex> lock(mMutex);
+    return mEntries.size();
+}
+
+int32_t CppDnsCache::StartResolve(const string &host, Entry &entry)
+{
+    Request *pRequest = new Request;
+    pRequest->pCache = this;
+    pRequest->Host = host;
+    memset(&pRequest->Hints, 0, sizeof(pRequest->Hints));
+    pRequest->Hints.ai_family = AF_UNSPEC;
+    pRequest->Hints.ai_socktype = SOCK_STREAM;
+    pRequest->Hints.ai_flags = AI_ADDRCONFIG;
+    memset(&pRequest->Cb, 0, sizeof(pRequest->Cb));
+    pRequest->Cb.ar_name = pRequest->Host.c_str();
+    pRequest->Cb.ar_request = &pRequest->Hints;
+
+    // 解析完成后在glibc创建的线程中回调
+    memset(&pRequest->Event, 0, sizeof(pRequest->Event));
+    pRequest->Event.sigev_notify = SIGEV_THREAD;
+    pRequest->Event.sigev_notify_function = &CppDnsCache::OnResolved;
+    pRequest->Event.sigev_value.sival_ptr = pRequest;
+
+    gaicb *pList[] = {&pRequest->Cb};
+    int32_t ret = getaddrinfo_a(GAI_NOWAIT, pList, 1, &pRequest->Event);
+    if (ret != 0)
     {
-        t.join();
+        ERROR_ILOG(mpCppLog, "getaddrinfo_a失败,host[%s],ret[%d],error[%s].", host.c_str(), ret, gai_strerror(ret));
+        delete pRequest;
+        return ret;
+    }
+
+    entry.Resolving = true;
+    ++mPendingCount;
+    return 0;
+}
+
+void CppDnsCache::OnResolved(sigval value)
+{
+    unique_ptr<Request> pRequest(static_cast<Request *>(value.sival_ptr));
+    CppDnsCache &cache = *pRequest->pCache;
+
+    int32_t error = gai_error(&pRequest->Cb);
+    vector<sockaddr_storage> addrs;
+    if (error == 0)
+    {
+        for (addrinfo *pInfo = pRequest->Cb.ar_result; pInfo != NULL; pInfo = pInfo->ai_next)
+        {
+            sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            memcpy(&addr, pInfo->ai_addr, min<size_t>(pInfo->ai_addrlen, sizeof(addr)));
+            addrs.push_back(addr);
+        }
+
+        freeaddrinfo(pRequest->Cb.ar_result);
+        error = addrs.empty() ? EAI_NODATA : 0;
+    }
+
+    lock_guard<mutex> lock(cache.mMutex);
+    uint64_t nowMs = GetMonotonicMs();
+    Entry &entry = cache.mEntries[pRequest->Host];
+    entry.Resolving = false;
+    if (error != 0 && entry.Error == 0 && entry.ResolveMs != 0 && nowMs < entry.ExpireMs)
+    {
+        // 提前刷新失败，旧结果用到过期为止
+        WARNN_ILOG(cache.mpCppLog, "刷新[%s]失败,继续使用旧结果,ret[%d],error[%s].", pRequest->Host.c_str(), error, gai_strerror(error));
+    }
+    else
+    {
+        entry.Addrs.swap(addrs);
+        entry.Error = error;
+        entry.ResolveMs = nowMs;
+        entry.ExpireMs = nowMs + (error == 0 ? cache.mTtlMs : cache.mNegativeTtlMs);
+    }
+
+    // 在锁内通知，析构函数拿到锁之后这里不会再访问缓存
+    --cache.mPendingCount;
+    cache.mCond.notify_all();
+}
+
+/** IpPortKey转换成socket使用的地址，AF_INET6的socket发往IPv4时使用IPv4映射地址
+ *
+ * @param   const IpPortKey & key
+ * @param   int family
+ * @param   sockaddr_storage & addr
+ * @retval  socklen_t
+ * @author  moontan
+ */
+static socklen_t ToUdpSockAddr(const IpPortKey &key, int family, sockaddr_storage &addr)
+{
+    if (family == AF_INET || !key.IsIpv4())
+    {
+        return key.ToSockAddr(addr);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in6 *pAddr6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    pAddr6->sin6_family = AF_INET6;
+    memcpy(&pAddr6->sin6_addr, key.GetIpv6(), sizeof(pAddr6->sin6_addr));
+    pAddr6->sin6_port = htons(key.GetPort());
+    return sizeof(sockaddr_in6);
+}
+
+CppUdpSocket::CppUdpSocket(uint32_t batchSize, uint32_t maxDatagramSize, CppLog *pCppLog) :
+    mBatchSize(min(max(batchSize, 1U), (uint32_t)UIO_MAXIOV)), mMaxDatagramSize(max(maxDatagramSize, 1U)),
+    mpCppLog(pCppLog), mFamily(AF_UNSPEC), mGso(false), mGro(false), mSyscallCount(0), mRecvBufSize(0)
+{
+}
+
+int32_t CppUdpSocket::Open(const IpPortKey &bindAddr, bool reusePort)
+{
+    Close();
+
+    sockaddr_storage addr;
+    socklen_t addrLen = bindAddr.ToSockAddr(addr);
+    int fd = socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    CHECK_RETURN_F(mpCppLog, fd >= 0, fd, CppLog::ERROR, "socket失败,errno[%d],error[%s].", errno, strerror(errno));
+    UniqueFd uniqFd(fd);
+
+    int flags = 1;
+    int32_t ret = 0;
+    if (reusePort)
+    {
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags));
+        ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt SO_REUSEPORT失败,errno[%d],error[%s].", errno, strerror(errno));
+    }
+
+    // IPv6的socket同时收发IPv4
+    if (addr.ss_family == AF_INET6)
+    {
+        flags = 0;
+        ret = setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &flags, sizeof(flags));
+        ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt IPV6_V6ONLY失败,errno[%d],error[%s].", errno, strerror(errno));
+    }
+
+    ret = bind(fd, reinterpret_cast<sockaddr *>(&addr), addrLen);
+    ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "bind失败,addr[%s],errno[%d],error[%s].",
+                   bindAddr.ToString().c_str(), errno, strerror(errno));
+
+    mUniqueFd = std::move(uniqFd);
+    mFamily = addr.ss_family;
+    return 0;
+}
+
+void CppUdpSocket::Close()
+{
+    mUniqueFd.Reset();
+    mFamily = AF_UNSPEC;
+    mGso = false;
+    mGro = false;
+    mPendings.clear();
+    mSendBuf.clear();
+}
+
+IpPortKey CppUdpSocket::GetLocalAddr() const
+{
+    IpPortKey key;
+    sockaddr_storage addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(GetFd(), reinterpret_cast<sockaddr *>(&addr), &addrLen) == 0)
+    {
+        key.FromSockAddr(reinterpret_cast<sockaddr *>(&addr));
+    }
+
+    return key;
+}
+
+int32_t CppUdpSocket::SetBufferSize(uint32_t recvSize, uint32_t sendSize)
+{
+    int32_t ret = 0;
+    if (recvSize > 0)
+    {
+        ret = setsockopt(GetFd(), SOL_SOCKET, SO_RCVBUF, &recvSize, sizeof(recvSize));
+        ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt SO_RCVBUF失败,errno[%d],error[%s].", errno, strerror(errno));
+    }
+
+    if (sendSize > 0)
+    {
+        ret = setsockopt(GetFd(), SOL_SOCKET, SO_SNDBUF, &sendSize, sizeof(sendSize));
+        ERROR_RETURN_F(mpCppLog, ret, CppLog::ERROR, "setsockopt SO_SNDBUF失败,errno[%d],error[%s].", errno, strerror(errno));
+    }
+
+    return 0;
+}
+
+bool CppUdpSocket::EnableGso()
+{
+#ifdef UDP_SEGMENT
+    // 设置socket级别的分段大小为0只用于检查内核是否支持，每个消息的分段大小通过控制信息指定
+    int segmentSize = 0;
+    mGso = setsockopt(GetFd(), SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize)) == 0;
+#endif
+    return mGso;
+}
+
+bool CppUdpSocket::EnableGro()
+{
+#ifdef UDP_GRO
+    int flags = 1;
+    mGro = setsockopt(GetFd(), SOL_UDP, UDP_GRO, &flags, sizeof(flags)) == 0;
+#endif
+    return mGro;
+}
+
+int32_t CppUdpSocket::Send(const IpPortKey &peer, const char *data, size_t size)
+{
+    if (GetFd() < 0)
+    {
+        return -EBADF;
+    }
+
+    if (mFamily == AF_INET && !peer.IsIpv4())
+    {
+        return -EAFNOSUPPORT;
+    }
+
+    if (mPendings.size() >= mBatchSize)
+    {
+        Flush();
+        if (mPendings.size() >= mBatchSize)
+        {
+            return -EAGAIN;
+        }
+    }
+
+    Pending pending;
+    pending.Peer = peer;
+    pending.Offset = mSendBuf.size();
+    pending.Size = static_cast<uint32_t>(size);
+    mSendBuf.append(data, size);
+    mPendings.push_back(pending);
+
+    if (mPendings.size() >= mBatchSize)
+    {
+        Flush();
     }
 
     return 0;
 }
 
+uint32_t CppUdpSocket::BuildSendMessages()
+{
+    const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+    size_t count = mPendings.size();
+    mSendMsgs.resize(count);
+    mSendMsgCounts.resize(count);
+    mSendIovs.resize(count);
+    mSendAddrs.resize(count);
+    if (mGso)
+    {
+        mSendControls.resize(count * CONTROL_SIZE);
+    }
+
+    uint32_t msgCount = 0;
+    for (size_t i = 0; i < count;)
+    {
+        const Pending &first = mPendings[i];
+        mmsghdr &msg = mSendMsgs[msgCount];
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_hdr.msg_name = &mSendAddrs[msgCount];
+        msg.msg_hdr.msg_namelen = ToUdpSockAddr(first.Peer, mFamily, mSendAddrs[msgCount]);
+        mSendIovs[i].iov_base = &mSendBuf[first.Offset];
+        mSendIovs[i].iov_len = first.Size;
+
+        // 合并发往同一地址的后续报文，只有最后一个可以比第一个短
+        uint32_t segments = 1;
+        size_t totalSize = first.Size;
+        while (mGso && first.Size > 0 && i + segments < count && segments < UDP_GSO_MAX_SEGMENTS)
+        {
+            const Pending &next = mPendings[i + segments];
+            if (next.Peer != first.Peer || next.Size == 0 || next.Size > first.Size || totalSize + next.Size > UDP_GSO_MAX_BYTES)
+            {
+                break;
+            }
+
+            mSendIovs[i + segments].iov_base = &mSendBuf[next.Offset];
+            mSendIovs[i + segments].iov_len = next.Size;
+            totalSize += next.Size;
+            ++segments;
+            if (next.Size < first.Size)
+            {
+                break;
+            }
+        }
+
+        msg.msg_hdr.msg_iov = &mSendIovs[i];
+        msg.msg_hdr.msg_iovlen = segments;
+#ifdef UDP_SEGMENT
+        if (segments > 1)
+        {
+            msg.msg_hdr.msg_control = &mSendControls[msgCount * CONTROL_SIZE];
+            msg.msg_hdr.msg_controllen = CONTROL_SIZE;
+            cmsghdr *pCmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+            pCmsg->cmsg_level = SOL_UDP;
+            pCmsg->cmsg_type = UDP_SEGMENT;
+            pCmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = static_cast<uint16_t>(first.Size);
+            memcpy(CMSG_DATA(pCmsg), &segmentSize, sizeof(segmentSize));
+        }
+#endif
+
+        mSendMsgCounts[msgCount] = segments;
+        ++msgCount;
+        i += segments;
+    }
+
+    return msgCount;
+}
+
+void CppUdpSocket::PopPendings(size_t count)
+{
+    mPendings.erase(mPendings.begin(), mPendings.begin() + count);
+    if (mPendings.empty())
+    {
+        mSendBuf.clear();
+        return;
+    }
+
+    // 剩余的数据移到开头
+    size_t offset = mPendings[0].Offset;
+    mSendBuf.erase(0, offset);
+    for (auto &pending : mPendings)
+    {
+        pending.Offset -= offset;
+    }
+}
+
+int32_t CppUdpSocket::Flush()
+{
+    int32_t doneCount = 0;
+    while (!mPendings.empty())
+    {
+        uint32_t msgCount = BuildSendMessages();
+        int ret = sendmmsg(GetFd(), &mSendMsgs[0], msgCount, 0);
+        ++mSyscallCount;
+        if (ret > 0)
+        {
+            size_t count = 0;
+            for (int i = 0; i < ret; ++i)
+            {
+                count += mSendMsgCounts[i];
+            }
+
+            PopPendings(count);
+            doneCount += static_cast<int32_t>(count);
+            continue;
+        }
+
+        int error = errno;
+        if (error == EINTR)
+        {
+            continue;
+        }
+
+        if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS)
+        {
+            break;
+        }
+
+        // 网卡或者路由不支持GSO时关闭GSO，不丢弃报文
+        if (mSendMsgCounts[0] > 1 && (error == EINVAL || error == EIO))
+        {
+            WARNN_ILOG(mpCppLog, "GSO发送失败,关闭GSO,errno[%d],error[%s].", error, strerror(error));
+            mGso = false;
+            continue;
+        }
+
+        LOG_EVERY_MS(mpCppLog, CppLog::WARNN, 1000, "发送到[%s]失败,丢弃[%u]个报文,errno[%d],error[%s].",
+                     mPendings[0].Peer.ToString().c_str(), mSendMsgCounts[0], error, strerror(error));
+        doneCount += static_cast<int32_t>(mSendMsgCounts[0]);
+        PopPendings(mSendMsgCounts[0]);
+    }
+
+    return doneCount;
+}
+
+int32_t CppUdpSocket::Recv(vector<Datagram> &datagrams)
+{
+    datagrams.clear();
+
+    const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+    uint32_t bufSize = mGro ? max(mMaxDatagramSize, UDP_GRO_BUF_SIZE) : mMaxDatagramSize;
+    if (mRecvBufSize != bufSize || mRecvMsgs.size() != mBatchSize)
+    {
+        mRecvBufSize = bufSize;
+        mRecvMsgs.resize(mBatchSize);
+        mRecvIovs.resize(mBatchSize);
+        mRecvAddrs.resize(mBatchSize);
+        mRecvControls.resize(mBatchSize * CONTROL_SIZE);
+        mRecvBuf.resize((size_t)mBatchSize * bufSize);
+    }
+
+    // 内核会修改地址和控制信息的长度，每次都重新设置
+    for (uint32_t i = 0; i < mBatchSize; ++i)
+    {
+        mRecvIovs[i].iov_base = &mRecvBuf[(size_t)i * bufSize];
+        mRecvIovs[i].iov_len = bufSize;
+        msghdr &hdr = mRecvMsgs[i].msg_hdr;
+        hdr.msg_name = &mRecvAddrs[i];
+        hdr.msg_namelen = sizeof(mRecvAddrs[i]);
+        hdr.msg_iov = &mRecvIovs[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = mGro ? &mRecvControls[i * CONTROL_SIZE] : NULL;
+        hdr.msg_controllen = mGro ? CONTROL_SIZE : 0;
+        hdr.msg_flags = 0;
+    }
+
+    int ret;
+    do
+    {
+        ret = recvmmsg(GetFd(), &mRecvMsgs[0], mBatchSize, 0, NULL);
+        ++mSyscallCount;
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+    {
+        int error = errno;
+        return (error == EAGAIN || error == EWOULDBLOCK) ? 0 : -error;
+    }
+
+    Datagram datagram;
+    for (int i = 0; i < ret; ++i)
+    {
+        msghdr &hdr = mRecvMsgs[i].msg_hdr;
+        uint32_t size = mRecvMsgs[i].msg_len;
+        uint32_t segmentSize = size;
+#ifdef UDP_GRO
+        for (cmsghdr *pCmsg = CMSG_FIRSTHDR(&hdr); pCmsg != NULL; pCmsg = CMSG_NXTHDR(&hdr, pCmsg))
+        {
+            if (pCmsg->cmsg_level == SOL_UDP && pCmsg->cmsg_type == UDP_GRO)
+            {
+                int groSize;
+                memcpy(&groSize, CMSG_DATA(pCmsg), sizeof(groSize));
+                segmentSize = static_cast<uint32_t>(groSize);
+            }
+        }
+#endif
+
+        if ((hdr.msg_flags & MSG_TRUNC) || segmentSize > mMaxDatagramSize)
+        {
+            LOG_EVERY_MS(mpCppLog, CppLog::WARNN, 1000, "报文长度[%u]超过[%u],丢弃.", segmentSize, mMaxDatagramSize);
+            continue;
+        }
+
+        datagram.Peer.FromSockAddr(reinterpret_cast<sockaddr *>(&mRecvAddrs[i]));
+        const char *pData = static_cast<const char *>(mRecvIovs[i].iov_base);
+        if (size == 0)
+        {
+            datagram.pData = pData;
+            datagram.Size = 0;
+            datagrams.push_back(datagram);
+            continue;
+        }
+
+        // GRO合并的消息按分段大小拆开，最后一个可能更短
+        for (uint32_t offset = 0; offset < size; offset += segmentSize)
+        {
+            datagram.pData = pData + offset;
+            datagram.Size = min(segmentSize, size - offset);
+            datagrams.push_back(datagram);
+        }
+    }
+
+    return static_cast<int32_t>(datagrams.size());
+}
+
 #endif
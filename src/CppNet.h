@@ -3,7 +3,10 @@
 
 #include <stdint.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <string.h>
+#include <sys/uio.h>
 
 #include <string>
 #include <vector>
@@ -12,12 +15,20 @@
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <deque>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <condition_variable>
+#include <algorithm>
 
 #ifndef USE_CPP_LOG_MACRO
 #define USE_CPP_LOG_MACRO
 #endif
 #include "CppLog.h"
 #include "CppString.h"
+#include "CppHistogram.h"
 
 /* IP:端口对 */
 class IpPort
@@ -32,7 +43,7 @@ public:
 
     std::string ToString() const
     {
-        return IP + ":" + CppString::ToString(Port);
+        return IP + ":" + std::to_string(Port);
     }
 
     bool operator==(const IpPort &right) const
@@ -78,16 +89,14 @@ public:
     //************************************
     static uint32_t StrToNetIp(const std::string &ipStr);
 
-    /** 判断主机序是否是大端
+    /** 判断主机序是否是大端，编译期确定
      *
      * @retval  bool
      * @author  moontan
      */
-    static bool IsBigendian()
+    static constexpr bool IsBigendian()
     {
-        uint32_t a = 1;
-        // 大端在内存中内存排列为00 00 00 01
-        return (reinterpret_cast<char *>(&a))[3] == 1;
+        return __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
     }
 
     /** 64位数据主机序转网络序
@@ -96,18 +105,10 @@ public:
      * @retval  uint64_t
      * @author  moontan
      */
-    static inline uint64_t Htonll(uint64_t dataHost)
+    static constexpr uint64_t Htonll(uint64_t dataHost)
     {
-        // 网络序是大端，如果主机序也为大端，则直接返回即可
-        if (IsBigendian())
-        {
-            return dataHost;
-        }
-
-        // 否则全部反过来
-        uint32_t high = (dataHost >> 32) & 0xFFFFFFFF;
-        uint32_t low = dataHost & 0xFFFFFFFF;
-        return (static_cast<uint64_t>(htonl(low)) << 32) + htonl(high);
+        // 网络序是大端，如果主机序也为大端，则直接返回即可，否则编译成一条bswap指令
+        return IsBigendian() ? dataHost : __builtin_bswap64(dataHost);
     }
 
     /** 64位数据网络序转主机序
@@ -116,14 +117,253 @@ public:
      * @retval  uint64_t
      * @author  moontan
      */
-    static inline uint64_t Ntohll(uint64_t dataNet)
+    static constexpr uint64_t Ntohll(uint64_t dataNet)
     {
         return Htonll(dataNet);
     }
 
+    // 批量字节序转换使用的指令集
+    enum SIMD_LEVEL
+    {
+        SIMD_NONE = 0,      // 逐个元素bswap
+        SIMD_SSSE3 = 1,     // 每次16字节pshufb
+        SIMD_AVX2 = 2,      // 每次32字节vpshufb
+    };
+
+    /** 获取当前CPU支持的最高SIMD_LEVEL，首次调用时检测
+     *
+     * @retval  CppNet::SIMD_LEVEL
+     * @author  moontan
+     */
+    static SIMD_LEVEL GetSimdLevel();
+
+    /** 批量主机序转网络序，用于序列化大量ID等数组，小端机器上按CPU支持的最高指令集做字节翻转
+     *  不要求地址对齐，pDest可以等于pSrc原地转换，其他情况下两者不能重叠
+     *
+     * @param   const uint64_t * pSrc
+     * @param   uint64_t * pDest
+     * @param   size_t count            元素个数
+     * @param   SIMD_LEVEL maxLevel     最多使用的指令集，用于对比测试，实际使用的不超过GetSimdLevel()
+     * @retval  void
+     * @author  moontan
+     */
+    static void HtonArray(const uint64_t *pSrc, uint64_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2);
+    static void HtonArray(const uint32_t *pSrc, uint32_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2);
+    static void HtonArray(const uint16_t *pSrc, uint16_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2);
+
+    /** 批量网络序转主机序，参数同HtonArray
+     *
+     * @param   const uint64_t * pSrc
+     * @param   uint64_t * pDest
+     * @param   size_t count
+     * @param   SIMD_LEVEL maxLevel
+     * @retval  void
+     * @author  moontan
+     */
+    static void NtohArray(const uint64_t *pSrc, uint64_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2)
+    {
+        HtonArray(pSrc, pDest, count, maxLevel);
+    }
+
+    static void NtohArray(const uint32_t *pSrc, uint32_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2)
+    {
+        HtonArray(pSrc, pDest, count, maxLevel);
+    }
+
+    static void NtohArray(const uint16_t *pSrc, uint16_t *pDest, size_t count, SIMD_LEVEL maxLevel = SIMD_AVX2)
+    {
+        HtonArray(pSrc, pDest, count, maxLevel);
+    }
+
+    /** 解析IPv4点分十进制字符串，不分配内存，线程安全
+     *  只接受a.b.c.d格式，每段0-255并且没有前导0，和inet_pton一致
+     *
+     * @param   const char * pStr
+     * @param   size_t len          字符串长度，不要求以0结尾
+     * @param   uint32_t & netIp    网络序的IP
+     * @retval  bool                格式错误时返回false
+     * @author  moontan
+     */
+    static bool ParseIpv4(const char *pStr, size_t len, uint32_t &netIp);
+
+    /** 解析IPv6字符串，支持::缩写和结尾的IPv4形式，不支持%接口名，不分配内存，线程安全
+     *
+     * @param   const char * pStr
+     * @param   size_t len
+     * @param   uint8_t ip[16]      网络序的IP
+     * @retval  bool                格式错误时返回false
+     * @author  moontan
+     */
+    static bool ParseIpv6(const char *pStr, size_t len, uint8_t ip[16]);
+
+    /** 网络序的IPv4格式化成点分十进制，不分配内存，线程安全
+     *
+     * @param   uint32_t netIp
+     * @param   char * pBuf         长度至少为INET_ADDRSTRLEN，以0结尾
+     * @retval  size_t              字符串长度，不包括结尾的0
+     * @author  moontan
+     */
+    static size_t FormatIpv4(uint32_t netIp, char *pBuf);
+
+    /** 网络序的IPv6格式化成字符串，最长的连续0用::缩写，输出和inet_ntop一致
+     *
+     * @param   const uint8_t ip[16]
+     * @param   char * pBuf         长度至少为INET6_ADDRSTRLEN，以0结尾
+     * @retval  size_t              字符串长度，不包括结尾的0
+     * @author  moontan
+     */
+    static size_t FormatIpv6(const uint8_t ip[16], char *pBuf);
+
     //static bool NetIsOK(vector<IpPort> &ipPort);
 };
 
+// 二进制的IP:端口，用于哈希表和map的键，比较和哈希只需要几次整数运算
+//  IPv4按IPv4映射的IPv6地址(::ffff:a.b.c.d)存放，两种地址使用同一种键
+class IpPortKey
+{
+public:
+    // [IPv6]:端口的最大长度，包括结尾的0
+    static const size_t MAX_STR_LEN = INET6_ADDRSTRLEN + 8;
+
+    IpPortKey() : mPort(0)
+    {
+        mAddr[0] = 0;
+        mAddr[1] = 0;
+    }
+
+    /** 使用IPv4构造
+     *
+     * @param   uint32_t netIp      网络序的IP
+     * @param   uint16_t port       主机序的端口
+     * @author  moontan
+     */
+    IpPortKey(uint32_t netIp, uint16_t port);
+
+    /** 解析IP字符串，IPv4和IPv6都可以，失败时不修改原来的值
+     *
+     * @param   const char * pIp    以0结尾的IP字符串，不能是域名
+     * @param   uint16_t port       主机序的端口
+     * @retval  bool
+     * @author  moontan
+     */
+    bool Parse(const char *pIp, uint16_t port);
+
+    /** 从accept/recvfrom得到的地址构造，只支持AF_INET和AF_INET6
+     *
+     * @param   const sockaddr * pAddr
+     * @retval  bool
+     * @author  moontan
+     */
+    bool FromSockAddr(const sockaddr *pAddr);
+
+    /** 转换成connect/sendto使用的地址，IPv4映射地址转成AF_INET
+     *
+     * @param   sockaddr_storage & addr
+     * @retval  socklen_t           地址长度
+     * @author  moontan
+     */
+    socklen_t ToSockAddr(sockaddr_storage &addr) const;
+
+    /** 格式化成IP:端口，IPv6为[IP]:端口，不分配内存
+     *
+     * @param   char * pBuf         长度至少为MAX_STR_LEN，以0结尾
+     * @retval  size_t              字符串长度，不包括结尾的0
+     * @author  moontan
+     */
+    size_t Format(char *pBuf) const;
+
+    /** 格式化IP，不带端口
+     *
+     * @param   char * pBuf         长度至少为INET6_ADDRSTRLEN
+     * @retval  size_t
+     * @author  moontan
+     */
+    size_t FormatIp(char *pBuf) const;
+
+    std::string ToString() const
+    {
+        char buf[MAX_STR_LEN];
+        return std::string(buf, Format(buf));
+    }
+
+    bool IsIpv4() const
+    {
+        uint32_t prefix;
+        memcpy(&prefix, GetIpv6() + 8, sizeof(prefix));
+        return mAddr[0] == 0 && prefix == htonl(0xFFFF);
+    }
+
+    // IsIpv4()为true时有效，网络序
+    uint32_t GetIpv4() const
+    {
+        uint32_t netIp;
+        memcpy(&netIp, GetIpv6() + 12, sizeof(netIp));
+        return netIp;
+    }
+
+    // 网络序的16字节IP
+    const uint8_t *GetIpv6() const
+    {
+        return reinterpret_cast<const uint8_t *>(mAddr);
+    }
+
+    uint16_t GetPort() const
+    {
+        return mPort;
+    }
+
+    size_t Hash() const
+    {
+        // 每个字段乘不同的奇数后混合高位，IP和端口的低位变化都能扩散到整个结果
+        uint64_t h = mAddr[0] * 0x9E3779B97F4A7C15ULL ^ mAddr[1] * 0xC2B2AE3D27D4EB4FULL ^ mPort;
+        h ^= h >> 29;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        return (size_t)(h ^ (h >> 32));
+    }
+
+    bool operator==(const IpPortKey &right) const
+    {
+        return mAddr[0] == right.mAddr[0] && mAddr[1] == right.mAddr[1] && mPort == right.mPort;
+    }
+
+    bool operator!=(const IpPortKey &right) const
+    {
+        return !(*this == right);
+    }
+
+    // 按网络序的IP再按端口排序，和字符串的顺序不同
+    bool operator<(const IpPortKey &right) const
+    {
+        if (mAddr[0] != right.mAddr[0])
+        {
+            return CppNet::Ntohll(mAddr[0]) < CppNet::Ntohll(right.mAddr[0]);
+        }
+
+        if (mAddr[1] != right.mAddr[1])
+        {
+            return CppNet::Ntohll(mAddr[1]) < CppNet::Ntohll(right.mAddr[1]);
+        }
+
+        return mPort < right.mPort;
+    }
+
+private:
+    uint64_t mAddr[2];      // 网络序的16字节IP，按8字节读写，减少比较次数
+    uint16_t mPort;         // 主机序
+};
+
+namespace std
+{
+template <>
+struct hash<IpPortKey>
+{
+    size_t operator()(const IpPortKey &key) const
+    {
+        return key.Hash();
+    }
+};
+}
+
 // socket管理，自动释放
 // 来自http://stackoverflow.com/questions/29614775/smart-pointer-to-manage-socket-file-descriptor
 class UniqueFd
@@ -195,177 +435,1950 @@ private:
     int mFd = -1;
 };
 
-#ifndef __CYGWIN__
-class epoll_event;
-
-// 压测工具
-// 每个连接对应的数据基类，需要时可以继承此类加上其他用户数据
-class PressCallClientDataBase
+// 网络读写缓冲区，由固定大小的块串起来，块从线程内的块池中分配，释放时还给块池
+// 读写使用readv/writev直接读写到块中，不经过中间缓冲区，适合作为每个连接的常驻缓冲区
+class CppNetBuffer
 {
 public:
-    PressCallClientDataBase() :uniqueFd()
+    static const uint32_t BLOCK_SIZE = 4080;    // 每个块的数据大小，加上块头为4096
+    static const uint32_t MAX_IOV_COUNT = 16;   // 每次writev最多使用的块数
+
+    struct Block
+    {
+        Block *pNext;
+        uint32_t Begin;                         // [Begin,End)为有效数据
+        uint32_t End;
+        char Data[BLOCK_SIZE];
+    };
+
+    CppNetBuffer() : mpHead(NULL), mpTail(NULL), mSize(0)
     {
     }
 
-    UniqueFd uniqueFd;
-    timeval sendTime;       // 发送时间
-};
+    ~CppNetBuffer()
+    {
+        Clear();
+    }
 
-class MultiThreadClientBase
-{
-public:
+    CppNetBuffer(const CppNetBuffer &) = delete;
+    CppNetBuffer &operator=(const CppNetBuffer &) = delete;
 
-    MultiThreadClientBase(const std::string &serverAddr, uint16_t serverPort, uint32_t runSecond = 10,
-                          uint32_t clientThreadCount = 1, uint32_t clientCountPerThread = 1,
-                          uint32_t epollSize = 100, CppLog *pCppLog = NULL);
+    size_t Size() const
+    {
+        return mSize;
+    }
 
-    /** 启动客户端线程
-    *
-    * @retval  int32_t
-    * @author  moon
-    */
-    int32_t Run();
+    bool Empty() const
+    {
+        return mSize == 0;
+    }
 
-    /* 统计信息 */
-    uint64_t gSuccessCount;                                     // 总成功数量
-    uint64_t gFailCount;                                        // 总失败数量
-    uint64_t gTotalTimeUs;                                      // 总耗时
-    uint64_t gMinTimeUs;                                        // 最小耗时
-    uint64_t gMaxTimeUs;                                        // 最大耗时
-    uint64_t gCurrTotalTimeUs;                                  // 周期总耗时
-    uint64_t gCurrMinTimeUs;                                    // 周期最小耗时
-    uint64_t gCurrMaxTimeUs;                                    // 周期最大耗时
+    /** 在末尾追加数据
+     *
+     * @param   const char * data
+     * @param   size_t size
+     * @retval  void
+     * @author  moontan
+     */
+    void Append(const char *data, size_t size);
 
-    bool gClientStop;
+    void Append(const std::string &data)
+    {
+        Append(data.data(), data.size());
+    }
 
-    string mServerAddr;                                         // 服务端地址
-    uint16_t mServerPort;                                       // 服务端端口
-    uint32_t mRunSecond;                                        // 压测时间
-    uint32_t mClientThreadCount;                                // 客户端线程数
-    uint32_t mClientCountPerThread;                             // 每个客户端线程包含的客户端数量
-    uint32_t mEpollSize;                                        // 每个线程的Epoll池容量
-    CppLog *mpCppLog;
+    /** 获得开头size字节的连续数据，数据在同一个块中时直接返回块中的指针，否则拷贝到内部缓冲区中
+     *  返回的指针在下一次修改缓冲区之前有效
+     *
+     * @param   size_t size
+     * @retval  const char *            数据不足size字节时返回NULL
+     * @author  moontan
+     */
+    const char *Peek(size_t size);
 
-protected:
+    /** 从offset开始拷贝最多size字节数据，不移除数据
+     *
+     * @param   char * dest
+     * @param   size_t size
+     * @param   size_t offset
+     * @retval  size_t                  实际拷贝的字节数
+     * @author  moontan
+     */
+    size_t Copy(char *dest, size_t size, size_t offset = 0) const;
 
-    /** 初始化连接
+    /** 从offset开始查找数据，可以跨块
      *
-     * @param 	int fd
-     * @retval 	void
-     * @author 	moontan
+     * @param   const std::string & pattern
+     * @param   size_t offset
+     * @retval  size_t                  找到返回位置，找不到返回std::string::npos
+     * @author  moontan
      */
-    virtual void InitConnection(int fd)
+    size_t Find(const std::string &pattern, size_t offset = 0) const;
+
+    /** 移除开头size字节，空出来的块还给块池
+     *
+     * @param   size_t size
+     * @retval  void
+     * @author  moontan
+     */
+    void Consume(size_t size);
+
+    void Clear()
     {
-        static_cast<void>(fd);
+        Consume(mSize);
     }
 
-    /** 获得要发送的数据
-    *
-    * @param 	int fd
-    * @retval 	const string
-    * @author 	moontan
-    */
-    virtual const string GetSendData(uint32_t threadId, int fd) = 0;
-
-    /** 创建一个客户端数据，不需要填充数值
-    *
-    * @retval 	std::shared_ptr<PressCallClientDataBase>
-    * @author 	moontan
-    */
-    virtual shared_ptr<PressCallClientDataBase> MakeNewClientData() = 0;
+    std::string ToString() const;
 
-    /** 检查结果并做统计工作
+    /** 调用一次readv，读到最后一个块的剩余空间和块池中的新块中
      *
-     * @param 	uint32_t threadId
-     * @param 	int fd
-     * @param 	const string & bufStr
-     * @retval 	bool                        成功返回true，失败返回false
-     * @author 	moontan
+     * @param   int fd
+     * @retval  ssize_t                 返回读取的字节数，0表示对端关闭，<0表示失败
+     * @author  moontan
      */
-    virtual bool CheckResponse(uint32_t threadId, int fd, const string &bufStr) = 0;
-
-    int32_t ProcWrite(uint32_t threadId, epoll_event &inevent);
-
-    int32_t ProcRead(uint32_t threadId, epoll_event &inevent);
+    ssize_t ReadFd(int fd);
 
-    void ProcDeleteFd(uint32_t threadId, int fd);
+    /** 调用一次writev，写出开头最多MAX_IOV_COUNT个块，写出的数据被移除
+     *
+     * @param   int fd
+     * @retval  ssize_t                 返回写出的字节数，<0表示失败
+     * @author  moontan
+     */
+    ssize_t WriteFd(int fd);
 
-    /** 连接服务器，获得fd
-    *
-    * @retval  int32_t         成功则>=0，否则失败
-    * @author  moontan
-    */
-    int32_t ConnectServer();
+private:
+    static Block *AllocBlock();
 
-    /** 客户端线程函数，每个线程管理一个epoll池，每个epoll池管理多个客户端
-    *
-    * @param   uint32_t threadId
-    * @retval  void
-    * @author  moon
-    */
-    void ThreadFunc(uint32_t threadId);
+    static void FreeBlock(Block *pBlock);
 
-    shared_ptr<PressCallClientDataBase> GetClientData(uint32_t threadId, int fd)
-    {
-        return mClientDatas[threadId][fd];
-    }
+    void PushBlock(Block *pBlock);
 
-    vector<std::unordered_map<int, shared_ptr<PressCallClientDataBase>>> mClientDatas; // 线程ID->map<fd,用户数据>
+    Block *mpHead;
+    Block *mpTail;
+    size_t mSize;
+    std::string mPeekBuf;                       // Peek跨块时使用
 };
 
-class CppEpollManager
+// 帧解码器，从接收缓冲区开头切分出第一个完整的帧，只读取帧头，不拷贝数据，数据分多次到达时也能正确切分
+//  可以用于CppNetBuffer（压测客户端）和连续内存（CppTcpConnection::ReadData），调用者处理完帧后Consume帧的大小
+//  有状态的解码器记录上一次扫描到的位置，数据不完整时下一次从这里继续，所以每个连接使用自己的解码器（Clone），
+//  并且两次调用之间缓冲区只能追加数据；返回完整的帧后状态自动清空，调用者必须先Consume这个帧再解码下一个
+class CppFrameCodec
 {
 public:
-    CppEpollManager(uint32_t size) throw(CppException);
-    ~CppEpollManager();
-
-    void AddOrModFd(int fd, epoll_event &event) throw(CppException);
+    static const uint32_t DEFAULT_MAX_FRAME_SIZE = 64 * 1024 * 1024;   // 默认最大帧大小
 
-    void DelFd(int fd) throw(CppException);
+    virtual ~CppFrameCodec()
+    {
+    }
 
-    void Wait(function<int32_t(epoll_event &inevent)> &readFunc,
-              function<int32_t(epoll_event &inevent)> &writeFunc,
-              function<void(int fd)> &deleteFdFunc,
-              uint32_t timeOutMs) throw(CppException);
+    /** 获得缓冲区开头第一个完整帧的大小
+     *
+     * @param   const CppNetBuffer & buf
+     * @retval  int32_t                 帧大小（包括帧头和分隔符），0表示不完整，<0表示数据错误，需要关闭连接
+     * @author  moontan
+     */
+    virtual int32_t GetFrameSize(const CppNetBuffer &buf) = 0;
 
-    /** 调用epoll_wait
+    /** 获得连续内存开头第一个完整帧的大小
      *
-     * @param   epoll_event events[]
-     * @param   uint32_t eventSize
-     * @param   uint32_t timeOutMs
-     * @retval  int32_t                 返回触发的fd数量
+     * @param   const char * data
+     * @param   size_t size
+     * @retval  int32_t                 同上
      * @author  moontan
      */
-    int32_t Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs);
+    virtual int32_t GetFrameSize(const char *data, size_t size) = 0;
 
-    virtual int GetFdFromEvent(epoll_event &event);
+    /** 清空解码状态，连接重用时调用
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void Reset()
+    {
+    }
 
-    virtual void SetFdToEvent(int fd, epoll_event &event);
+    /** 复制一个初始状态的解码器，每个连接使用一个
+     *
+     * @retval  std::unique_ptr<CppFrameCodec>
+     * @author  moontan
+     */
+    virtual std::unique_ptr<CppFrameCodec> Clone() const = 0;
+};
 
-    int32_t GetEpollFd()
+// 长度字段帧，支持长度前缀（u16/u32等）和带长度字段的固定帧头，长度字段为网络字节序
+//  帧头为headerSize字节，长度字段在帧头的lengthOffset处，占lengthBytes字节，
+//  帧大小为帧头+长度，lengthIncludesHeader为true时长度已经包含帧头；无状态，只读取长度字段
+class CppLengthCodec : public CppFrameCodec
+{
+public:
+    /** 构造函数，参数不正确时抛出异常
+     *
+     * @param   uint32_t lengthBytes            长度字段字节数，1/2/4/8
+     * @param   uint32_t headerSize             帧头大小，0表示帧头只有长度字段，即lengthOffset+lengthBytes
+     * @param   uint32_t lengthOffset           长度字段在帧头中的位置
+     * @param   bool lengthIncludesHeader       长度是否包含帧头
+     * @param   uint32_t maxFrameSize           最大帧大小，超过时返回错误
+     * @author  moontan
+     */
+    CppLengthCodec(uint32_t lengthBytes = 4, uint32_t headerSize = 0, uint32_t lengthOffset = 0,
+                   bool lengthIncludesHeader = false, uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE) throw(CppException);
+
+    virtual int32_t GetFrameSize(const CppNetBuffer &buf);
+    virtual int32_t GetFrameSize(const char *data, size_t size);
+
+    virtual std::unique_ptr<CppFrameCodec> Clone() const
     {
-        return mEpollFd;
+        return std::unique_ptr<CppFrameCodec>(new CppLengthCodec(*this));
     }
 
-    /** 为mEvents缩容
-     *  mEvents仅会自动扩容，如果需要缩容，需要手工调用此函数
+    /** 编码一个帧追加到out，帧头除长度字段外都为0
      *
+     * @param   const char * data       帧的数据部分
+     * @param   size_t size
+     * @param   std::string & out
      * @retval  void
      * @author  moontan
      */
-    void ReleaseEventsMemory();
+    void Encode(const char *data, size_t size, std::string &out) const throw(CppException);
+
+    uint32_t GetHeaderSize() const
+    {
+        return mHeaderSize;
+    }
+
+private:
+    template <typename Buffer>
+    int32_t Decode(const Buffer &buf) const;
+
+    uint32_t mLengthBytes;
+    uint32_t mHeaderSize;
+    uint32_t mLengthOffset;
+    bool mLengthIncludesHeader;
+    uint32_t mMaxFrameSize;
+};
+
+// 分隔符帧，如按\r\n切分的文本协议，帧大小包括分隔符
+//  数据不完整时记录已经扫描的位置，下一次只查找新到达的数据
+class CppDelimiterCodec : public CppFrameCodec
+{
+public:
+    CppDelimiterCodec(const std::string &delimiter = "\r\n", uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE);
+
+    virtual int32_t GetFrameSize(const CppNetBuffer &buf);
+    virtual int32_t GetFrameSize(const char *data, size_t size);
+
+    virtual void Reset()
+    {
+        mScanPos = 0;
+    }
+
+    virtual std::unique_ptr<CppFrameCodec> Clone() const
+    {
+        return std::unique_ptr<CppFrameCodec>(new CppDelimiterCodec(mDelimiter, mMaxFrameSize));
+    }
+
+    /** 编码一个帧追加到out，数据中不能包含分隔符
+     *
+     * @param   const char * data
+     * @param   size_t size
+     * @param   std::string & out
+     * @retval  void
+     * @author  moontan
+     */
+    void Encode(const char *data, size_t size, std::string &out) const
+    {
+        out.append(data, size);
+        out.append(mDelimiter);
+    }
+
+private:
+    template <typename Buffer>
+    int32_t Decode(const Buffer &buf);
+
+    std::string mDelimiter;
+    uint32_t mMaxFrameSize;
+    size_t mScanPos;                // 下一次开始查找的位置
+};
+
+// Redis RESP2协议帧，一个帧为一个完整的回复或命令，支持+-:$*类型和嵌套数组
+//  数据不完整时记录已经完整的元素的结束位置和每层数组还剩的元素数，下一次从这里继续解析
+class CppRespCodec : public CppFrameCodec
+{
+public:
+    CppRespCodec(uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE);
+
+    virtual int32_t GetFrameSize(const CppNetBuffer &buf);
+    virtual int32_t GetFrameSize(const char *data, size_t size);
+
+    virtual void Reset()
+    {
+        mPos = 0;
+        mRemains.clear();
+    }
+
+    virtual std::unique_ptr<CppFrameCodec> Clone() const
+    {
+        return std::unique_ptr<CppFrameCodec>(new CppRespCodec(mMaxFrameSize));
+    }
+
+    /** 把命令编码成RESP数组追加到out，如{"SET","a","1"}
+     *
+     * @param   const std::vector<std::string> & args
+     * @param   std::string & out
+     * @retval  void
+     * @author  moontan
+     */
+    static void EncodeCommand(const std::vector<std::string> &args, std::string &out);
+
+private:
+    template <typename Buffer>
+    int32_t Decode(const Buffer &buf);
+
+    uint32_t mMaxFrameSize;
+    size_t mPos;                        // 下一个元素的开始位置
+    std::vector<int64_t> mRemains;      // 每层未完成的数组还剩的元素数
+};
+
+#ifndef __CYGWIN__
+#include <sys/epoll.h>
+#include <netdb.h>
+#include <signal.h>
+
+class CppEpollManager;
+
+// 压测工具
+// 每个连接对应的数据基类，需要时可以继承此类加上其他用户数据
+class PressCallClientDataBase
+{
+public:
+    PressCallClientDataBase() :uniqueFd()
+    {
+    }
+
+    virtual ~PressCallClientDataBase()
+    {
+    }
+
+    UniqueFd uniqueFd;
+    timeval sendTime;       // 最后一个请求的发送时间
+    CppNetBuffer sendBuf;   // 发送缓冲区，一个请求没有写完时等可写事件继续写
+    CppNetBuffer recvBuf;   // 接收缓冲区
+
+    std::deque<timeval> pendingTimes;   // 开环模式下已经到了计划发送时间，但是因为管道已满还没有发送的请求的计划发送时间
+    std::vector<timeval> sendTimes;     // 已发送未回包请求的发送时间（开环模式下为计划发送时间），环形队列，大小为管道深度
+    uint32_t sendTimeHead = 0;          // 最早发送的请求在sendTimes中的位置
+    uint32_t inflightCount = 0;         // 已发送未回包的请求数量
+    std::unique_ptr<CppFrameCodec> frameCodec;  // 回包解码器，设置了SetFrameCodec时每个连接一个
+};
+
+class MultiThreadClientBase
+{
+public:
+
+    MultiThreadClientBase(const std::string &serverAddr, uint16_t serverPort, uint32_t runSecond = 10,
+                          uint32_t clientThreadCount = 1, uint32_t clientCountPerThread = 1,
+                          uint32_t epollSize = 100, CppLog *pCppLog = NULL, bool edgeTriggered = false);
+
+    /** 启动客户端线程
+    *
+    * @retval  int32_t
+    * @author  moon
+    */
+    int32_t Run();
+
+    /** 设置管道深度，即每个连接最多同时有多少个请求没有回包，默认为1，需要在Run之前调用
+     *  大于1时需要调用SetFrameCodec或者实现GetResponseSize，从接收缓冲区中切分出每个回包
+     *
+     * @param   uint32_t depth
+     * @retval  void
+     * @author  moontan
+     */
+    void SetPipelineDepth(uint32_t depth)
+    {
+        mPipelineDepth = depth == 0 ? 1 : depth;
+    }
+
+    /** 设置开环模式，按目标QPS定时发送请求，不等待上一个回包，需要在Run之前调用
+     *  耗时从计划发送时间开始计算，包括请求在客户端排队的时间，避免服务端变慢时客户端发送变慢而掩盖排队耗时
+     *  开环模式强制使用边缘触发，每个线程用Epoll池的定时器按1毫秒的精度定时，请求轮流分配到线程内的各个连接
+     *
+     * @param   uint64_t targetQps          所有线程总的目标QPS，0表示闭环模式（默认）
+     * @param   bool poisson                true则请求间隔服从指数分布（泊松到达），false则间隔固定
+     * @retval  void
+     * @author  moontan
+     */
+    void SetOpenLoop(uint64_t targetQps, bool poisson = false)
+    {
+        mTargetQps = targetQps;
+        mPoisson = poisson;
+    }
+
+    enum STATS_FORMAT
+    {
+        STATS_CSV,                  // 第一行为表头，之后每个周期一行
+        STATS_JSON                  // 每个周期一行JSON对象
+    };
+
+    /** 设置统计数据导出文件，每秒输出一个周期的统计，压测结束时输出一行总统计，需要在Run之前调用
+     *
+     * @param   const string & filePath     导出文件路径，为空则不导出（默认）
+     * @param   STATS_FORMAT format
+     * @retval  void
+     * @author  moontan
+     */
+    void SetStatsExport(const string &filePath, STATS_FORMAT format = STATS_CSV)
+    {
+        mStatsExportPath = filePath;
+        mStatsFormat = format;
+    }
+
+    /** 设置回包解码器，每个连接使用一个复制的解码器切分回包，需要在Run之前调用
+     *
+     * @param   const CppFrameCodec & codec
+     * @retval  void
+     * @author  moontan
+     */
+    void SetFrameCodec(const CppFrameCodec &codec)
+    {
+        mpFrameCodec = codec.Clone();
+    }
+
+    /* 统计信息，各线程的统计由Run每秒汇总后更新，只能在Run返回后或Run所在线程中读取 */
+    uint64_t gSuccessCount;                                     // 总成功数量
+    uint64_t gFailCount;                                        // 总失败数量
+    uint64_t gTotalTimeUs;                                      // 总耗时
+    uint64_t gMinTimeUs;                                        // 最小耗时
+    uint64_t gMaxTimeUs;                                        // 最大耗时
+    uint64_t gCurrTotalTimeUs;                                  // 周期总耗时
+    uint64_t gCurrMinTimeUs;                                    // 周期最小耗时
+    uint64_t gCurrMaxTimeUs;                                    // 周期最大耗时
+    CppHistogram gTotalHistogram;                               // 总耗时分布
+    CppHistogram gCurrHistogram;                                // 周期耗时分布
+
+    std::atomic<bool> gClientStop;
+
+    string mServerAddr;                                         // 服务端地址
+    uint16_t mServerPort;                                       // 服务端端口
+    uint32_t mRunSecond;                                        // 压测时间
+    uint32_t mClientThreadCount;                                // 客户端线程数
+    uint32_t mClientCountPerThread;                             // 每个客户端线程包含的客户端数量
+    uint32_t mEpollSize;                                        // 每个线程的Epoll池容量
+    CppLog *mpCppLog;
+    bool mEdgeTriggered;                                        // Epoll池是否使用边缘触发
+    uint32_t mPipelineDepth;                                    // 管道深度，每个连接最多同时未回包的请求数
+    uint64_t mTargetQps;                                        // 开环模式的目标QPS，0表示闭环模式
+    bool mPoisson;                                              // 开环模式下请求是否泊松到达
+    string mStatsExportPath;                                    // 统计数据导出文件
+    STATS_FORMAT mStatsFormat;                                  // 统计数据导出格式
+    std::unique_ptr<CppFrameCodec> mpFrameCodec;                // 回包解码器，NULL表示不使用
 
 protected:
-    virtual int32_t ProcWrite(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &writeFunc) throw(CppException);
 
-    virtual int32_t ProcRead(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &readFunc) throw(CppException);
+    /** 初始化连接
+     *
+     * @param 	int fd
+     * @retval 	void
+     * @author 	moontan
+     */
+    virtual void InitConnection(int fd)
+    {
+        static_cast<void>(fd);
+    }
 
-    int mEpollFd;
+    /** 获得要发送的一个请求，只在没有使用缓冲区版本的GetSendData时需要实现
+    *
+    * @param 	int fd
+    * @retval 	const string
+    * @author 	moontan
+    */
+    virtual const string GetSendData(uint32_t threadId, int fd)
+    {
+        static_cast<void>(threadId);
+        static_cast<void>(fd);
+        return "";
+    }
 
-    std::set<int> mFds;                         // 保存mEpollFd中管理的所有的fd
-    std::mutex mFdLock;                         // 用于mFds的线程保护，任何对mFds的操作都要加这个锁，因为其他线程有可能往本线程的实例中添加Fd
-    std::shared_ptr<UniqueFd> mUniqEpollFd;
-    std::vector<epoll_event> mEvents;           // 用于wait的event
+    /** 把要发送的一个请求追加到发送缓冲区中，默认调用string版本的GetSendData
+     *
+     * @param   uint32_t threadId
+     * @param   int fd
+     * @param   CppNetBuffer & sendBuf
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void GetSendData(uint32_t threadId, int fd, CppNetBuffer &sendBuf)
+    {
+        sendBuf.Append(GetSendData(threadId, fd));
+    }
+
+    /** 创建一个客户端数据，不需要填充数值
+    *
+    * @retval 	std::shared_ptr<PressCallClientDataBase>
+    * @author 	moontan
+    */
+    virtual shared_ptr<PressCallClientDataBase> MakeNewClientData() = 0;
+
+    /** 检查结果并做统计工作，只在没有使用缓冲区版本的CheckResponse时需要实现
+     *
+     * @param 	uint32_t threadId
+     * @param 	int fd
+     * @param 	const string & bufStr
+     * @retval 	bool                        成功返回true，失败返回false
+     * @author 	moontan
+     */
+    virtual bool CheckResponse(uint32_t threadId, int fd, const string &bufStr)
+    {
+        static_cast<void>(threadId);
+        static_cast<void>(fd);
+        static_cast<void>(bufStr);
+        return false;
+    }
+
+    /** 获得接收缓冲区开头第一个完整回包的大小，设置了SetFrameCodec时用连接的解码器切分，否则把收到的所有数据当作一个回包
+     *
+     * @param   uint32_t threadId
+     * @param   int fd
+     * @param   CppNetBuffer & recvBuf
+     * @retval  int32_t                     回包大小，0表示回包不完整，<0表示数据错误，关闭连接
+     * @author  moontan
+     */
+    virtual int32_t GetResponseSize(uint32_t threadId, int fd, CppNetBuffer &recvBuf)
+    {
+        PressCallClientDataBase &clientData = *mClientDatas[threadId][fd];
+        return clientData.frameCodec ? clientData.frameCodec->GetFrameSize(recvBuf) : recvBuf.Size();
+    }
+
+    /** 检查接收缓冲区开头size字节的回包，返回后由调用者Consume，默认转成string调用string版本的CheckResponse
+     *
+     * @param   uint32_t threadId
+     * @param   int fd
+     * @param   CppNetBuffer & recvBuf
+     * @param   size_t size                 回包大小，即GetResponseSize的返回值
+     * @retval  bool                        成功返回true，失败返回false
+     * @author  moontan
+     */
+    virtual bool CheckResponse(uint32_t threadId, int fd, CppNetBuffer &recvBuf, size_t size)
+    {
+        return CheckResponse(threadId, fd, string(recvBuf.Peek(size), size));
+    }
+
+    int32_t ProcWrite(uint32_t threadId, epoll_event &inevent);
+
+    int32_t ProcRead(uint32_t threadId, epoll_event &inevent);
+
+    void ProcDeleteFd(uint32_t threadId, int fd);
+
+    /** 开环模式的定时器回调，把到了计划发送时间的请求分配给各个连接并发送，再定时到下一个请求的计划发送时间
+     *
+     * @param   uint32_t threadId
+     * @retval  void
+     * @author  moontan
+     */
+    void ProcTimer(uint32_t threadId);
+
+    /** 连接服务器，获得fd
+    *
+    * @retval  int32_t         成功则>=0，否则失败
+    * @author  moontan
+    */
+    int32_t ConnectServer();
+
+    /** 客户端线程函数，每个线程管理一个epoll池，每个epoll池管理多个客户端
+    *
+    * @param   uint32_t threadId
+    * @retval  void
+    * @author  moon
+    */
+    void ThreadFunc(uint32_t threadId);
+
+    shared_ptr<PressCallClientDataBase> GetClientData(uint32_t threadId, int fd)
+    {
+        return mClientDatas[threadId][fd];
+    }
+
+    /** 汇总各线程在上一个周期的统计，并清空线程的统计
+     *
+     * @param   uint64_t & currSuccess      返回周期成功数量
+     * @param   uint64_t & currFail         返回周期失败数量
+     * @retval  void
+     * @author  moontan
+     */
+    void CollectStats(uint64_t &currSuccess, uint64_t &currFail);
+
+    /** 输出一个周期或总的统计到日志和导出文件
+     *
+     * @param   const CppHistogram & histogram
+     * @param   uint64_t successCount
+     * @param   uint64_t failCount
+     * @param   int64_t second          周期序号，从1开始，-1表示总统计
+     * @param   std::ostream * pExport  导出文件，NULL表示不导出
+     * @retval  void
+     * @author  moontan
+     */
+    void ReportStats(const CppHistogram &histogram, uint64_t successCount, uint64_t failCount,
+                     int64_t second, std::ostream *pExport);
+
+    // 客户端线程的Epoll事件处理器
+    struct ClientHandler
+    {
+        MultiThreadClientBase *pClient;
+        uint32_t ThreadId;
+
+        int32_t OnRead(epoll_event &event)
+        {
+            return pClient->ProcRead(ThreadId, event);
+        }
+
+        int32_t OnWrite(epoll_event &event)
+        {
+            return pClient->ProcWrite(ThreadId, event);
+        }
+
+        void OnDelete(int fd)
+        {
+            pClient->ProcDeleteFd(ThreadId, fd);
+        }
+    };
+
+    vector<std::unordered_map<int, shared_ptr<PressCallClientDataBase>>> mClientDatas; // 线程ID->map<fd,用户数据>
+
+    // 每个客户端线程的开环模式数据
+    struct OpenLoopState
+    {
+        CppEpollManager *pEpollManager;
+        std::vector<int> Fds;                   // 线程内的所有连接，请求轮流分配
+        uint32_t NextFd = 0;
+        double NextSendUs = 0;                  // 下一个请求的计划发送时间（微秒）
+        double IntervalUs = 0;                  // 平均请求间隔（微秒）
+        std::mt19937_64 Rng;
+        std::vector<int> TouchedFds;            // 本次定时器中分配到了请求的连接
+    };
+
+    vector<OpenLoopState> mOpenLoopStates;      // 线程ID->开环模式数据
+
+    // 每个客户端线程的统计，线程处理回包时加锁记录，Run每秒加锁取走
+    struct ThreadStats
+    {
+        std::mutex Lock;
+        CppHistogram Histogram;
+        uint64_t SuccessCount = 0;
+        uint64_t FailCount = 0;
+    };
+
+    vector<std::unique_ptr<ThreadStats>> mThreadStats;  // 线程ID->统计
+};
+
+// 分层时间轮，精度为1毫秒
+//  5层，每层64个槽，第0层每个槽1毫秒，上一层每个槽是下一层一圈的时间，共覆盖2^30毫秒（约12天），更远的定时器到期前会重新放置
+//  添加、取消为O(1)，每层用64位的位图记录非空的槽，可以直接算出下一个需要处理的时间，空闲时不需要逐个槽推进
+//  非线程安全，由CppEpollManager在Wait所在线程中使用
+class CppTimerWheel
+{
+public:
+    static const uint32_t LEVEL_COUNT = 5;
+    static const uint32_t SLOT_BITS = 6;
+    static const uint32_t SLOT_COUNT = 1 << SLOT_BITS;
+
+    /** 构造函数
+     *
+     * @param   uint64_t nowMs          当前时间，之后传入的时间必须使用同一个时钟
+     * @author  moontan
+     */
+    explicit CppTimerWheel(uint64_t nowMs);
+
+    ~CppTimerWheel();
+
+    /** 添加定时器，回调中可以添加和取消定时器
+     *
+     * @param   uint32_t delayMs                    从当前时间开始多久后触发
+     * @param   std::function<void()> callback
+     * @param   uint32_t intervalMs                 大于0则之后每隔这么久触发一次，直到取消
+     * @retval  uint64_t                            定时器ID，不会为0
+     * @author  moontan
+     */
+    uint64_t AddTimer(uint32_t delayMs, std::function<void()> callback, uint32_t intervalMs = 0);
+
+    /** 取消定时器
+     *
+     * @param   uint64_t timerId
+     * @retval  bool                已经触发过的单次定时器或者不存在时返回false
+     * @author  moontan
+     */
+    bool CancelTimer(uint64_t timerId);
+
+    /** 推进到指定时间，执行所有到期的定时器
+     *
+     * @param   uint64_t nowMs
+     * @retval  uint32_t            返回执行的定时器数量
+     * @author  moontan
+     */
+    uint32_t Advance(uint64_t nowMs);
+
+    /** 获取距离下一个需要处理的时间的毫秒数，高层的槽需要在到期前下放，返回的时间可能早于定时器的到期时间
+     *
+     * @param   uint64_t nowMs
+     * @retval  int64_t             没有定时器返回-1
+     * @author  moontan
+     */
+    int64_t GetNextTimeoutMs(uint64_t nowMs) const;
+
+    size_t Size() const
+    {
+        return mTimers.size();
+    }
+
+    uint64_t GetCurrentMs() const
+    {
+        return mCurrentMs;
+    }
+
+private:
+    // 定时器节点，槽内为带头节点的双向循环链表
+    struct Node
+    {
+        uint64_t Id;
+        uint64_t ExpireMs;
+        uint32_t IntervalMs;
+        std::function<void()> Callback;
+        uint32_t Level;                             // 所在的层，LEVEL_COUNT表示不在时间轮中
+        uint32_t Slot;
+        Node *pPrev;
+        Node *pNext;
+    };
+
+    // 按到期时间和当前时间的距离放到对应层的槽中
+    void Place(Node *pNode, bool cascading = false);
+
+    // 从所在的链表中移除，槽变空时清除位图
+    void Remove(Node *pNode);
+
+    // 把槽内的所有节点移到head中
+    void TakeSlot(uint32_t level, uint32_t slot, Node &head);
+
+    // 取出槽内所有节点重新放置
+    void Cascade(uint32_t level, uint32_t slot);
+
+    /** 获取下一个需要处理的时间，即第0层最近的非空槽或者高层最近的非空槽下放的时间
+     *
+     * @retval  uint64_t            没有定时器返回UINT64_MAX
+     * @author  moontan
+     */
+    uint64_t GetNextEventMs() const;
+
+    uint64_t mCurrentMs;                            // 已经处理到的时间
+    uint64_t mNextId;
+    Node mSlots[LEVEL_COUNT][SLOT_COUNT];           // 头节点
+    uint64_t mBitmaps[LEVEL_COUNT];                 // 每层非空的槽
+    std::unordered_map<uint64_t, Node *> mTimers;   // 定时器ID->节点
+};
+
+// Epoll池管理
+//  fd注册信息保存在以fd为下标的数组中，只能在调用Wait的线程中操作，其他线程使用PostAddFd/PostTask，
+//  通过无锁队列+eventfd通知到Wait所在线程执行
+//  边缘触发模式下，fd只在加入时注册一次读写事件，Wait中的读写切换不再调用epoll_ctl
+class CppEpollManager
+{
+public:
+    // 读写回调返回此值表示还没有处理完，继续等待同一个事件，不切换读写，其他非0值仍然表示删除fd
+    static const int32_t PROC_AGAIN = INT32_MIN;
+
+    CppEpollManager(uint32_t size, bool edgeTriggered = false) throw(CppException);
+    virtual ~CppEpollManager();
+
+    /** 添加或者修改fd，只能在调用Wait的线程中调用，边缘触发模式下会加上EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET
+     *
+     * @param   int fd
+     * @param   epoll_event & event
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void AddOrModFd(int fd, epoll_event &event) throw(CppException);
+
+    virtual void DelFd(int fd) throw(CppException);
+
+    /** 其他线程添加fd，在下一次Wait中加入
+     *
+     * @param   int fd
+     * @param   const epoll_event & event
+     * @retval  void
+     * @author  moontan
+     */
+    void PostAddFd(int fd, const epoll_event &event);
+
+    /** 其他线程投递任务，在下一次Wait中按投递顺序执行，任务抛出的异常由Wait抛出
+     *
+     * @param   std::function<void()> task
+     * @retval  void
+     * @author  moontan
+     */
+    void PostTask(std::function<void()> task);
+
+    /** 执行已经投递的任务，Wait中会自动调用
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void RunPostedTasks() throw(CppException);
+
+    void Wait(function<int32_t(epoll_event &inevent)> &readFunc,
+              function<int32_t(epoll_event &inevent)> &writeFunc,
+              function<void(int fd)> &deleteFdFunc,
+              uint32_t timeOutMs) throw(CppException);
+
+    /** 调用epoll_wait，返回的events中不包含内部的eventfd
+     *
+     * @param   epoll_event events[]
+     * @param   uint32_t eventSize
+     * @param   uint32_t timeOutMs
+     * @retval  int32_t                 返回触发的fd数量
+     * @author  moontan
+     */
+    virtual int32_t Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs) throw(CppException);
+
+    /** 等待并处理事件，与std::function版本的Wait逻辑相同，处理器的函数直接调用，可以被内联
+     *  fd从event.data.fd中获取，不调用GetFdFromEvent，不能与重载了SetFdToEvent的子类一起使用
+     *  Handler需要实现：
+     *      int32_t OnRead(epoll_event &event);     返回PROC_AGAIN则继续等待可读，其他非0值则删除fd
+     *      int32_t OnWrite(epoll_event &event);    返回PROC_AGAIN则继续等待可写，其他非0值则删除fd
+     *      void OnDelete(int fd);                  fd从Epoll池中删除后调用
+     *
+     * @param   Handler & handler
+     * @param   uint32_t timeOutMs
+     * @retval  void
+     * @author  moontan
+     */
+    template <typename Handler>
+    void Wait(Handler &handler, uint32_t timeOutMs) throw(CppException);
+
+    /** 添加定时器，只能在调用Wait的线程中调用，其他线程通过PostTask添加
+     *  到期的定时器在Wait超时返回前或下一次Wait开始时执行，不会和未处理的事件交错，epoll_wait最多等到下一个定时器到期
+     *
+     * @param   uint32_t delayMs                    从上一次Wait返回的时间开始多久后触发
+     * @param   std::function<void()> callback      回调中可以添加和取消定时器，抛出的异常由Wait抛出
+     * @param   uint32_t intervalMs                 大于0则之后每隔这么久触发一次，直到取消
+     * @retval  uint64_t                            定时器ID
+     * @author  moontan
+     */
+    uint64_t AddTimer(uint32_t delayMs, std::function<void()> callback, uint32_t intervalMs = 0)
+    {
+        // 有事件返回时时间轮还没有推进到mNowMs，补上相差的时间
+        return mTimerWheel.AddTimer(delayMs + (mNowMs - mTimerWheel.GetCurrentMs()), std::move(callback), intervalMs);
+    }
+
+    /** 取消定时器，只能在调用Wait的线程中调用
+     *
+     * @param   uint64_t timerId
+     * @retval  bool                已经触发过的单次定时器或者不存在时返回false
+     * @author  moontan
+     */
+    bool CancelTimer(uint64_t timerId)
+    {
+        return mTimerWheel.CancelTimer(timerId);
+    }
+
+    /** 获取上一次Wait返回时的单调时钟毫秒数，处理事件时用于记录时间，避免每次都获取时间
+     *
+     * @retval  uint64_t
+     * @author  moontan
+     */
+    uint64_t GetNowMs() const
+    {
+        return mNowMs;
+    }
+
+    virtual int GetFdFromEvent(epoll_event &event);
+
+    virtual void SetFdToEvent(int fd, epoll_event &event);
+
+    int32_t GetEpollFd()
+    {
+        return mEpollFd;
+    }
+
+    bool IsEdgeTriggered() const
+    {
+        return mEdgeTriggered;
+    }
+
+    /** 为mEvents缩容
+     *  mEvents仅会自动扩容，如果需要缩容，需要手工调用此函数
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void ReleaseEventsMemory();
+
+protected:
+    virtual int32_t ProcWrite(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &writeFunc) throw(CppException);
+
+    virtual int32_t ProcRead(epoll_event &inevent, function<int32_t(epoll_event &inevent)> &readFunc,
+                             function<int32_t(epoll_event &inevent)> &writeFunc) throw(CppException);
+
+    /** 修改已经加入的fd监听的事件，不经过SetFdToEvent
+     *
+     * @param   int fd
+     * @param   uint32_t events
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void ModFdEvents(int fd, uint32_t events) throw(CppException);
+
+    /** 从events中去掉eventfd的事件，有的话执行投递的任务
+     *
+     * @param   epoll_event events[]
+     * @param   int32_t fdsCount
+     * @retval  int32_t                 返回剩余的事件数量
+     * @author  moontan
+     */
+    int32_t ProcPostedEvents(epoll_event events[], int32_t fdsCount) throw(CppException);
+
+    // 投递任务的无锁队列节点
+    struct PostedTask
+    {
+        std::function<void()> Task;
+        PostedTask *pNext;
+    };
+
+    int mEpollFd;
+    int mEventFd;                               // 用于唤醒Wait，数据保存在event.data.fd中
+    bool mEdgeTriggered;                        // 是否边缘触发
+
+    std::vector<uint8_t> mFdStates;             // 以fd为下标，非0表示fd已经加入mEpollFd
+    uint32_t mFdCount;                          // mEpollFd中管理的fd数量
+    std::atomic<PostedTask *> mPostedTasks;     // 其他线程投递的任务，后投递的在链表头
+    std::shared_ptr<UniqueFd> mUniqEpollFd;
+    UniqueFd mUniqEventFd;
+    std::vector<epoll_event> mEvents;           // 用于wait的event
+    uint64_t mNowMs;                            // 上一次Wait返回的时间
+    CppTimerWheel mTimerWheel;
+};
+
+template <typename Handler>
+void CppEpollManager::Wait(Handler &handler, uint32_t timeOutMs) throw(CppException)
+{
+    // mEvents扩容，缩容使用其他函数手工实现，多一个给eventfd
+    if (mEvents.size() < mFdCount + 1)
+    {
+        mEvents.resize(mFdCount + 1);
+    }
+
+    int32_t fdsCount = Wait(&mEvents[0], mEvents.size(), timeOutMs);
+    for (int32_t i = 0; i < fdsCount; ++i)
+    {
+        epoll_event &event = mEvents[i];
+        int fd = event.data.fd;
+        int32_t ret = 0;
+        if (event.events & EPOLLIN)
+        {
+            // 同时有EPOLLIN和EPOLLRDHUP事件表示对端断开，删除fd
+            if (event.events & EPOLLRDHUP)
+            {
+                ret = -1;
+            }
+            else
+            {
+                ret = handler.OnRead(event);
+                if (ret == 0)
+                {
+                    // 边缘触发直接写，否则检查可写状态
+                    if (mEdgeTriggered)
+                    {
+                        ret = handler.OnWrite(event);
+                    }
+                    else
+                    {
+                        ModFdEvents(fd, EPOLLOUT | EPOLLRDHUP);
+                    }
+                }
+            }
+        }
+        else if (event.events & EPOLLOUT)
+        {
+            ret = handler.OnWrite(event);
+            if (ret == 0 && !mEdgeTriggered)
+            {
+                // 检查可读状态
+                ModFdEvents(fd, EPOLLIN | EPOLLRDHUP);
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        // 失败删除fd，没有处理完的等待下一次同样的事件
+        if (ret != 0 && ret != PROC_AGAIN)
+        {
+            DelFd(fd);
+            handler.OnDelete(fd);
+        }
+    }
+}
+
+// 基于io_uring的Epoll池，接口和水平触发的CppEpollManager相同，Wait的三种重载、定时器和投递任务都可以直接使用
+//  每个fd提交一次性的IORING_OP_POLL_ADD等待事件，触发后在下一次Wait中重新提交，修改和删除fd只修改本地状态，
+//  所有提交和等待在一次io_uring_enter中完成，完成事件直接从共享内存的完成队列中读取
+//  可以注册固定缓冲区，用ReadFixed/WriteFixed提交读写，和事件等待一起批量提交，省掉单独的read/write系统调用和内存映射
+//  内核不支持io_uring（5.11以下、被seccomp禁用或编译时没有头文件）时自动退回到epoll，行为相同
+//  只支持水平触发
+class CppUringManager : public CppEpollManager
+{
+public:
+    /** 构造函数，io_uring初始化失败时退回到epoll
+     *
+     * @param   uint32_t size       预计管理的fd数量，用于确定队列大小
+     * @param   bool useUring       为false时直接使用epoll
+     * @author  moontan
+     */
+    CppUringManager(uint32_t size, bool useUring = true) throw(CppException);
+    ~CppUringManager();
+
+    /** 检查当前内核是否支持需要的io_uring功能
+     *
+     * @retval  bool
+     * @author  moontan
+     */
+    static bool IsSupported();
+
+    bool IsUringEnabled() const
+    {
+        return mRingFd >= 0;
+    }
+
+    virtual void AddOrModFd(int fd, epoll_event &event) throw(CppException);
+    virtual void DelFd(int fd) throw(CppException);
+
+    /** 提交已经修改的fd，等待事件，返回的events中不包含内部的eventfd，完成的固定缓冲区读写的回调在返回前执行
+     *
+     * @param   epoll_event events[]
+     * @param   uint32_t eventSize
+     * @param   uint32_t timeOutMs
+     * @retval  int32_t                 返回触发的fd数量
+     * @author  moontan
+     */
+    virtual int32_t Wait(epoll_event events[], uint32_t eventSize, uint32_t timeOutMs) throw(CppException);
+    using CppEpollManager::Wait;
+
+    /** 注册固定缓冲区，只能注册一次，内核会固定这些内存，读写时不需要再映射
+     *
+     * @param   uint32_t count      缓冲区数量
+     * @param   uint32_t size       每个缓冲区的大小
+     * @retval  void
+     * @author  moontan
+     */
+    void RegisterBuffers(uint32_t count, uint32_t size) throw(CppException);
+
+    char *GetBuffer(uint32_t index)
+    {
+        return mpBuffers + static_cast<size_t>(index) * mBufferSize;
+    }
+
+    uint32_t GetBufferCount() const
+    {
+        return mBufferCount;
+    }
+
+    uint32_t GetBufferSize() const
+    {
+        return mBufferSize;
+    }
+
+    /** 用固定缓冲区读取，和下一次Wait一起提交，完成后在Wait中执行回调
+     *  一般在可读事件中调用，非阻塞fd没有数据时较老的内核返回-EAGAIN，较新的内核等到有数据后完成；
+     *  退回epoll时直接read，回调同样在下一次Wait中执行
+     *
+     * @param   int fd
+     * @param   uint32_t index                              缓冲区下标
+     * @param   uint32_t size                               最多读取的长度，不超过缓冲区大小
+     * @param   std::function<void(int32_t)> callback       参数为读取的长度，失败时为-errno，抛出的异常由Wait抛出
+     * @retval  void
+     * @author  moontan
+     */
+    void ReadFixed(int fd, uint32_t index, uint32_t size, std::function<void(int32_t)> callback) throw(CppException);
+
+    /** 用固定缓冲区写入，和ReadFixed相同
+     *
+     * @param   int fd
+     * @param   uint32_t index
+     * @param   uint32_t size                               写入的长度
+     * @param   std::function<void(int32_t)> callback       参数为写入的长度，失败时为-errno
+     * @retval  void
+     * @author  moontan
+     */
+    void WriteFixed(int fd, uint32_t index, uint32_t size, std::function<void(int32_t)> callback) throw(CppException);
+
+protected:
+    virtual void ModFdEvents(int fd, uint32_t events) throw(CppException);
+
+private:
+    // io_uring中每个fd的状态，Generation用于丢弃删除或修改前提交的POLL_ADD的完成事件
+    struct UringFd
+    {
+        epoll_event Event;
+        uint32_t Generation;
+        bool Registered;
+        bool Armed;             // 是否有还没完成的POLL_ADD
+    };
+
+    // 已经完成的固定缓冲区读写
+    struct IoDone
+    {
+        std::function<void(int32_t)> Callback;
+        int32_t Result;
+    };
+
+    bool SetupRing(uint32_t entries);
+    void *GetSqe() throw(CppException);
+    void ArmEventFd() throw(CppException);
+    int32_t Enter(uint32_t waitCount, int64_t timeOutMs);
+    void ArmPoll(int fd) throw(CppException);
+    void DisarmPoll(UringFd &state, int fd) throw(CppException);
+    void SubmitFixed(bool isRead, int fd, uint32_t index, uint32_t size,
+                     std::function<void(int32_t)> &callback) throw(CppException);
+    void RunIoCallbacks() throw(CppException);
+
+    int mRingFd;
+    UniqueFd mUniqRingFd;
+    void *mpRing;                           // 提交队列和完成队列共用一次映射
+    size_t mRingSize;
+    void *mpSqes;
+    size_t mSqesSize;
+    uint32_t *mpSqHead;
+    uint32_t *mpSqTail;
+    uint32_t mSqMask;
+    uint32_t mSqEntries;
+    uint32_t *mpCqHead;
+    uint32_t *mpCqTail;
+    uint32_t mCqMask;
+    void *mpCqes;
+    uint32_t mSqeTail;                      // 已经填写的sqe位置，提交时写入共享的sq tail
+
+    std::vector<UringFd> mUringFds;         // 以fd为下标
+    std::vector<int> mRearmFds;             // 需要重新提交POLL_ADD的fd
+    bool mEventFdArmed;
+
+    char *mpBuffers;
+    uint32_t mBufferCount;
+    uint32_t mBufferSize;
+    uint64_t mNextIoId;
+    std::unordered_map<uint64_t, std::function<void(int32_t)>> mIoCallbacks;   // 已经提交还没有完成的读写
+    std::vector<IoDone> mDoneIos;
+};
+
+// 服务端连接，每个连接有自己的读写缓冲区，需要时可以继承此类加上其他用户数据
+// 所有接口只能在连接所属的reactor线程中调用
+class CppTcpConnection
+{
+public:
+    CppTcpConnection() : mReactorId(0), mReadPos(0), mWritePos(0), mWatchWrite(false), mClosing(false),
+        mLastActiveMs(0), mIdleTimerId(0)
+    {
+    }
+
+    virtual ~CppTcpConnection()
+    {
+    }
+
+    int GetFd() const
+    {
+        return mUniqueFd.Get();
+    }
+
+    const IpPort &GetPeer() const
+    {
+        return mPeer;
+    }
+
+    uint32_t GetReactorId() const
+    {
+        return mReactorId;
+    }
+
+    /** 读缓冲区中未处理的数据
+     *
+     * @retval  const char *
+     * @author  moontan
+     */
+    const char *ReadData() const
+    {
+        return mReadBuf.data() + mReadPos;
+    }
+
+    size_t ReadSize() const
+    {
+        return mReadBuf.size() - mReadPos;
+    }
+
+    /** 从读缓冲区中丢弃已经处理过的数据
+     *
+     * @param   size_t size
+     * @retval  void
+     * @author  moontan
+     */
+    void Consume(size_t size);
+
+    /** 获得读缓冲区开头第一个完整帧的大小，服务端设置了SetFrameCodec时用连接的解码器切分，否则返回所有未处理数据的大小
+     *  处理完帧后调用Consume，再获取下一个帧
+     *
+     * @retval  int32_t                 0表示不完整，<0表示数据错误，需要关闭连接
+     * @author  moontan
+     */
+    int32_t NextFrame()
+    {
+        if (!mpFrameCodec)
+        {
+            return static_cast<int32_t>(ReadSize());
+        }
+
+        return mpFrameCodec->GetFrameSize(ReadData(), ReadSize());
+    }
+
+    /** 发送数据，数据先放到写缓冲区，OnMessage返回后由reactor统一写出，写不完的等可写事件再写
+     *
+     * @param   const char * data
+     * @param   size_t size
+     * @retval  void
+     * @author  moontan
+     */
+    void Send(const char *data, size_t size)
+    {
+        mWriteBuf.append(data, size);
+    }
+
+    void Send(const std::string &data)
+    {
+        mWriteBuf.append(data);
+    }
+
+    /** 写缓冲区中的数据发送完成后关闭连接
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Close()
+    {
+        mClosing = true;
+    }
+
+private:
+    friend class CppTcpServer;
+
+    bool HasPendingWrite() const
+    {
+        return mWritePos < mWriteBuf.size();
+    }
+
+    UniqueFd mUniqueFd;
+    IpPort mPeer;
+    uint32_t mReactorId;
+    std::string mReadBuf;                       // 读缓冲区，[mReadPos,size)为未处理数据
+    size_t mReadPos;
+    std::string mWriteBuf;                      // 写缓冲区，[mWritePos,size)为未发送数据
+    size_t mWritePos;
+    bool mWatchWrite;                           // 是否在监听可写事件
+    bool mClosing;                              // 发送完成后关闭
+    std::unique_ptr<CppFrameCodec> mpFrameCodec;    // 帧解码器，服务端设置了SetFrameCodec时每个连接一个
+    uint64_t mLastActiveMs;                     // 最后一次收到数据的时间
+    uint64_t mIdleTimerId;                      // 空闲检查的定时器，0表示没有
+};
+
+// 多Reactor TCP服务端
+//  监听方式有两种：
+//  1、1个accept线程，accept到的连接轮流分发给各个reactor线程
+//  2、SO_REUSEPORT，每个reactor线程有自己的监听fd，由内核做负载均衡
+//  每个reactor线程管理一个CppEpollManager，可以绑定CPU
+//  使用时继承此类，实现OnMessage，需要时实现OnConnect、OnClose、MakeNewConnection
+class CppTcpServer
+{
+public:
+    /** 构造函数
+     *
+     * @param   const std::string & ip          监听IP，空表示所有IP
+     * @param   uint16_t port                   监听端口，0表示由系统分配，Start后用GetPort获取
+     * @param   uint32_t reactorCount           reactor线程数
+     * @param   bool reusePort                  true使用SO_REUSEPORT每个reactor监听，false使用accept线程
+     * @param   bool bindCpu                    reactor线程是否绑定CPU
+     * @param   CppLog * pCppLog
+     * @author  moontan
+     */
+    CppTcpServer(const std::string &ip, uint16_t port, uint32_t reactorCount = 1, bool reusePort = false,
+                 bool bindCpu = false, CppLog *pCppLog = NULL);
+
+    virtual ~CppTcpServer();
+
+    /** 创建监听端口并启动线程，不阻塞
+     *
+     * @retval  int32_t                 成功返回0
+     * @author  moontan
+     */
+    int32_t Start();
+
+    /** 停止所有线程并关闭所有连接
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Stop();
+
+    uint16_t GetPort() const
+    {
+        return mPort;
+    }
+
+    uint32_t GetReactorCount() const
+    {
+        return mReactorCount;
+    }
+
+    /** 设置空闲超时，连接超过这么久没有收到数据则关闭，需要在Start之前调用
+     *  每个连接一个reactor的定时器，收到数据时只记录时间，定时器到期时按剩余时间重新定时
+     *
+     * @param   uint32_t timeoutMs      0表示不检查（默认）
+     * @retval  void
+     * @author  moontan
+     */
+    void SetIdleTimeout(uint32_t timeoutMs)
+    {
+        mIdleTimeoutMs = timeoutMs;
+    }
+
+    /** 设置帧解码器，每个连接使用一个复制的解码器，OnMessage中用CppTcpConnection::NextFrame切分，需要在Start之前调用
+     *
+     * @param   const CppFrameCodec & codec
+     * @retval  void
+     * @author  moontan
+     */
+    void SetFrameCodec(const CppFrameCodec &codec)
+    {
+        mpFrameCodec = codec.Clone();
+    }
+
+protected:
+    /** 新连接建立，在reactor线程中调用
+     *
+     * @param   CppTcpConnection & conn
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void OnConnect(CppTcpConnection &conn)
+    {
+        static_cast<void>(conn);
+    }
+
+    /** 连接收到数据，在reactor线程中调用
+     *  conn.ReadData()/ReadSize()为未处理的数据，处理完一个完整的包后调用Consume，回包调用Send
+     *  设置了SetFrameCodec时用conn.NextFrame()获取每个完整帧的大小
+     *
+     * @param   CppTcpConnection & conn
+     * @retval  int32_t                 非0则关闭连接
+     * @author  moontan
+     */
+    virtual int32_t OnMessage(CppTcpConnection &conn) = 0;
+
+    /** 连接关闭，在reactor线程中调用，返回后fd被关闭
+     *
+     * @param   CppTcpConnection & conn
+     * @retval  void
+     * @author  moontan
+     */
+    virtual void OnClose(CppTcpConnection &conn)
+    {
+        static_cast<void>(conn);
+    }
+
+    /** 创建一个连接对象，不需要填充数值
+     *
+     * @retval  std::shared_ptr<CppTcpConnection>
+     * @author  moontan
+     */
+    virtual std::shared_ptr<CppTcpConnection> MakeNewConnection()
+    {
+        return std::make_shared<CppTcpConnection>();
+    }
+
+    std::string mIp;                            // 监听IP
+    uint16_t mPort;                             // 监听端口
+    uint32_t mReactorCount;                     // reactor线程数
+    bool mReusePort;                            // 是否使用SO_REUSEPORT
+    bool mBindCpu;                              // 是否绑定CPU
+    CppLog *mpCppLog;
+    uint32_t mIdleTimeoutMs;                    // 空闲超时，0表示不检查
+    std::unique_ptr<CppFrameCodec> mpFrameCodec;    // 帧解码器，NULL表示不使用
+
+private:
+    // 每个reactor线程的数据
+    struct Reactor
+    {
+        Reactor(uint32_t id, uint32_t epollSize) : Id(id), EpollManager(epollSize), Stopped(false)
+        {
+        }
+
+        uint32_t Id;
+        CppEpollManager EpollManager;
+        UniqueFd ListenFd;                      // SO_REUSEPORT模式下的监听fd
+        std::unordered_map<int, std::shared_ptr<CppTcpConnection>> Connections;
+        bool Stopped;                           // 由Stop投递的任务设置，之前投递的新连接都已经处理完
+        std::thread Thread;
+    };
+
+    /** 创建监听fd
+     *
+     * @param   uint16_t port
+     * @retval  int                     成功返回fd，失败返回<0
+     * @author  moontan
+     */
+    int CreateListenFd(uint16_t port);
+
+    void AcceptThread();
+
+    void ReactorThread(Reactor &reactor);
+
+    /** 从监听fd中accept所有新连接
+     *
+     * @param   int listenFd
+     * @param   Reactor * pReactor      非NULL则加入这个reactor，NULL则轮流分发
+     * @retval  void
+     * @author  moontan
+     */
+    void AcceptConnections(int listenFd, Reactor *pReactor);
+
+    void AddConnection(Reactor &reactor, int fd, const IpPort &peer);
+
+    /** 读取数据并回调OnMessage
+     *
+     * @retval  int32_t                 需要关闭连接返回非0
+     * @author  moontan
+     */
+    int32_t ProcRead(Reactor &reactor, CppTcpConnection &conn);
+
+    /** 把写缓冲区中的数据尽量写出，写不完则监听可写事件
+     *
+     * @retval  int32_t                 需要关闭连接返回非0
+     * @author  moontan
+     */
+    int32_t ProcWrite(Reactor &reactor, CppTcpConnection &conn);
+
+    void CloseConnection(Reactor &reactor, int fd);
+
+    /** 空闲检查的定时器回调，超时则关闭连接，否则按剩余时间重新定时
+     *
+     * @param   Reactor & reactor
+     * @param   int fd
+     * @retval  void
+     * @author  moontan
+     */
+    void CheckIdle(Reactor &reactor, int fd);
+
+    std::vector<std::unique_ptr<Reactor>> mReactors;
+    UniqueFd mListenFd;                         // accept线程模式下的监听fd
+    std::thread mAcceptThread;
+    uint32_t mNextReactor;                      // 轮流分发的下一个reactor
+    std::atomic<bool> mStop;
+    bool mStarted;
+};
+
+
+// 客户端连接池
+//  按IpPort管理多个后端，每个后端保持一定数量的空闲连接，后台线程负责：
+//  1、非阻塞connect，超时失败
+//  2、空闲连接开启SO_KEEPALIVE并监听可读事件，对端关闭或超过空闲时间时关闭
+//  3、定时对每个后端发起连接探测，连续失败达到阈值标记为不健康，不再被选中，探测成功后恢复
+//  4、空闲连接少于下限或有调用方在等待时补充连接
+//  Acquire按最少在用连接数或一致性哈希选择健康的后端，只取已建立的空闲连接，不在调用线程中握手
+//  后端地址需要是IP，Acquire和Release可以在任意线程调用
+class CppConnectionPool
+{
+public:
+    enum BALANCE_MODE
+    {
+        LEAST_LOADED,               // 选择在用连接数最少的后端
+        CONSISTENT_HASH             // 按hashKey在哈希环上选择，后端增减时只影响少量key
+    };
+
+    /** 构造函数
+     *
+     * @param   BALANCE_MODE mode
+     * @param   CppLog * pCppLog
+     * @author  moontan
+     */
+    CppConnectionPool(BALANCE_MODE mode = LEAST_LOADED, CppLog *pCppLog = NULL);
+
+    ~CppConnectionPool();
+
+    /** 设置connect超时时间，需要在Start之前调用
+     *
+     * @param   uint32_t timeoutMs
+     * @retval  void
+     * @author  moontan
+     */
+    void SetConnectTimeout(uint32_t timeoutMs)
+    {
+        mConnectTimeoutMs = timeoutMs;
+    }
+
+    /** 设置每个后端的空闲连接数，需要在Start之前调用
+     *
+     * @param   uint32_t minIdle            空闲连接少于这个数时补充
+     * @param   uint32_t maxIdle            空闲连接超过这个数时Release直接关闭
+     * @param   uint32_t maxIdleTimeMs      超过minIdle的空闲连接空闲这么久后关闭
+     * @retval  void
+     * @author  moontan
+     */
+    void SetIdle(uint32_t minIdle, uint32_t maxIdle, uint32_t maxIdleTimeMs)
+    {
+        mMinIdle = minIdle;
+        mMaxIdle = std::max(minIdle, maxIdle);
+        mMaxIdleTimeMs = maxIdleTimeMs;
+    }
+
+    /** 设置健康检查，需要在Start之前调用
+     *
+     * @param   uint32_t intervalMs         每个后端探测的间隔
+     * @param   uint32_t failThreshold      连续connect失败多少次标记为不健康
+     * @retval  void
+     * @author  moontan
+     */
+    void SetHealthCheck(uint32_t intervalMs, uint32_t failThreshold)
+    {
+        mHealthCheckIntervalMs = intervalMs;
+        mFailThreshold = std::max(failThreshold, 1U);
+    }
+
+    /** 添加后端，可以在Start之后调用
+     *
+     * @param   const IpPort & endpoint
+     * @retval  int32_t             IP不合法或已存在返回非0
+     * @author  moontan
+     */
+    int32_t AddEndpoint(const IpPort &endpoint);
+
+    /** 删除后端，关闭空闲连接，在用的连接Release时关闭
+     *
+     * @param   const IpPort & endpoint
+     * @retval  int32_t             不存在返回非0
+     * @author  moontan
+     */
+    int32_t RemoveEndpoint(const IpPort &endpoint);
+
+    /** 启动后台线程，不阻塞
+     *
+     * @retval  int32_t             成功返回0
+     * @author  moontan
+     */
+    int32_t Start();
+
+    /** 停止后台线程并关闭所有空闲连接，在用的连接Release时关闭
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Stop();
+
+    /** 获取一个已建立的连接，用完后必须调用Release，不能自己close
+     *
+     * @param   IpPort & endpoint       返回连接的后端
+     * @param   uint64_t hashKey        一致性哈希模式下用于选择后端
+     * @param   uint32_t waitMs         没有空闲连接时最多等待的时间，0表示不等待
+     * @retval  int                     成功返回fd，没有健康的后端或等待超时返回-1
+     * @author  moontan
+     */
+    int Acquire(IpPort &endpoint, uint64_t hashKey = 0, uint32_t waitMs = 0);
+
+    /** 归还连接
+     *
+     * @param   int fd
+     * @param   bool reuse              连接状态正常（没有未读完的回包等）时为true，false则关闭
+     * @retval  int32_t                 fd不是从连接池获取的返回非0
+     * @author  moontan
+     */
+    int32_t Release(int fd, bool reuse = true);
+
+    /** 获取后端的空闲连接数
+     *
+     * @param   const IpPort & endpoint
+     * @retval  uint32_t
+     * @author  moontan
+     */
+    uint32_t GetIdleCount(const IpPort &endpoint);
+
+    /** 后端是否健康，不存在返回false
+     *
+     * @param   const IpPort & endpoint
+     * @retval  bool
+     * @author  moontan
+     */
+    bool IsHealthy(const IpPort &endpoint);
+
+private:
+    struct Endpoint
+    {
+        IpPort Addr;
+        sockaddr_in SockAddr;
+        bool Healthy = true;
+        bool Removed = false;
+        uint32_t FailCount = 0;                 // 连续connect失败次数
+        uint32_t ActiveCount = 0;               // 在用连接数
+        uint32_t ConnectingCount = 0;           // 正在connect的连接数
+        uint32_t WaitingCount = 0;              // 在Acquire中等待的调用方数
+        uint64_t NextProbeMs = 0;               // 下次健康探测的时间
+        std::deque<uint64_t> IdleIds;           // 空闲连接，后归还的在后面，从后面取，从前面过期
+    };
+
+    enum CONN_STATE
+    {
+        CONN_CONNECTING,
+        CONN_IDLE,
+        CONN_BUSY
+    };
+
+    struct Conn
+    {
+        UniqueFd Fd;
+        std::shared_ptr<Endpoint> pEndpoint;
+        CONN_STATE State;
+        uint64_t TimeMs;                        // connect超时时间或者开始空闲的时间
+    };
+
+    void ThreadFunc();
+
+    /** 选择健康的后端，优先选择有空闲连接的
+     *
+     * @param   uint64_t hashKey
+     * @retval  std::shared_ptr<Endpoint>       没有健康的后端返回空
+     * @author  moontan
+     */
+    std::shared_ptr<Endpoint> SelectEndpoint(uint64_t hashKey);
+
+    void RebuildRing();
+
+    // 以下函数需要持有mMutex
+    void StartConnect(const std::shared_ptr<Endpoint> &pEndpoint, uint64_t nowMs);
+    void OnConnected(uint64_t id, Conn &conn, uint64_t nowMs);
+    void OnConnectFailed(uint64_t id, Conn &conn);
+    void AddIdle(uint64_t id, Conn &conn, uint64_t nowMs);
+    void CloseConn(uint64_t id);
+    void CloseIdleConns(Endpoint &endpoint);
+    void Maintain(uint64_t nowMs);
+
+    BALANCE_MODE mMode;
+    CppLog *mpCppLog;
+    uint32_t mConnectTimeoutMs;
+    uint32_t mMinIdle;
+    uint32_t mMaxIdle;
+    uint32_t mMaxIdleTimeMs;
+    uint32_t mHealthCheckIntervalMs;
+    uint32_t mFailThreshold;
+
+    std::mutex mMutex;
+    std::condition_variable mIdleCond;          // 有新的空闲连接或后端状态变化
+    std::map<IpPort, std::shared_ptr<Endpoint>> mEndpoints;
+    std::vector<std::shared_ptr<Endpoint>> mEndpointList;   // 最少连接模式下轮流作为起点，避免总选第一个
+    uint32_t mNextEndpoint;
+    std::vector<std::pair<uint64_t, std::shared_ptr<Endpoint>>> mRing;   // 一致性哈希环，按哈希值排序
+    std::unordered_map<uint64_t, Conn> mConns;  // 连接ID->连接，ID用作epoll的data，避免fd复用时误处理旧事件
+    std::unordered_map<int, uint64_t> mBusyFds; // 在用的fd->连接ID
+    uint64_t mNextConnId;
+
+    UniqueFd mEpollFd;                          // epoll_ctl是线程安全的，Acquire时直接在调用线程中移除
+    UniqueFd mEventFd;                          // 唤醒后台线程
+    std::thread mThread;
+    std::atomic<bool> mStop;
+    bool mStarted;
+};
+
+
+// 域名解析缓存
+//  解析结果按TTL缓存，解析失败的结果也缓存一段时间（负缓存），连接风暴时不会反复请求DNS服务器
+//  未命中时用getaddrinfo_a异步解析，同一个域名同时只有一个解析请求，调用方可以等待结果或立即返回
+//  缓存快过期时被访问会在后台提前刷新，刷新期间和刷新失败时继续返回旧结果直到过期
+//  支持IPv4和IPv6，IP字符串不经过缓存直接返回，所有接口线程安全
+class CppDnsCache
+{
+public:
+    /** 构造函数
+     *
+     * @param   uint32_t ttlMs              解析成功的缓存时间
+     * @param   uint32_t negativeTtlMs      解析失败的缓存时间
+     * @param   CppLog * pCppLog
+     * @author  moontan
+     */
+    CppDnsCache(uint32_t ttlMs = 60000, uint32_t negativeTtlMs = 5000, CppLog *pCppLog = NULL);
+
+    /** 析构时等待所有未完成的解析请求返回
+     *
+     * @author  moontan
+     */
+    ~CppDnsCache();
+
+    /** 进程共享的缓存，CppNet内部使用
+     *
+     * @retval  CppDnsCache &
+     * @author  moontan
+     */
+    static CppDnsCache &Default();
+
+    /** 解析域名
+     *
+     * @param   const std::string & host                域名或IP
+     * @param   uint16_t port                           填到返回的地址中的端口
+     * @param   std::vector<sockaddr_storage> & addrs   返回所有地址
+     * @param   uint32_t timeoutMs                      未命中时最多等待的时间，0表示不等待，适合在reactor线程中调用
+     * @retval  int32_t                                 成功返回0，失败返回getaddrinfo的错误码，可以用gai_strerror获取说明，
+     *                                                  等待超时返回EAI_AGAIN
+     * @author  moontan
+     */
+    int32_t Resolve(const std::string &host, uint16_t port, std::vector<sockaddr_storage> &addrs, uint32_t timeoutMs = 5000);
+
+    /** 解析域名，返回第一个IP的字符串，用于IpPort等只需要一个地址的地方
+     *
+     * @param   const std::string & host
+     * @param   std::string & ip
+     * @param   uint32_t timeoutMs
+     * @retval  int32_t                                 同Resolve
+     * @author  moontan
+     */
+    int32_t ResolveIp(const std::string &host, std::string &ip, uint32_t timeoutMs = 5000);
+
+    /** 解析host:port,host:port格式的地址列表（ZooKeeper等使用的格式），域名替换为IP，IPv6格式为[ip]:port
+     *
+     * @param   const std::string & hosts
+     * @param   std::string & resolvedHosts
+     * @param   uint32_t timeoutMs
+     * @retval  int32_t                                 任一地址解析失败都返回错误码
+     * @author  moontan
+     */
+    int32_t ResolveHostList(const std::string &hosts, std::string &resolvedHosts, uint32_t timeoutMs = 5000);
+
+    /** 清空缓存，正在解析的请求完成后仍会写入
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Clear();
+
+    size_t Size();
+
+private:
+    struct Entry
+    {
+        std::vector<sockaddr_storage> Addrs;    // 端口为0
+        int32_t Error = EAI_AGAIN;
+        uint64_t ResolveMs = 0;                 // 得到结果的时间，0表示还没有结果
+        uint64_t ExpireMs = 0;
+        bool Resolving = false;
+    };
+
+    // 一个getaddrinfo_a请求，在回调中释放
+    struct Request
+    {
+        CppDnsCache *pCache;
+        std::string Host;
+        addrinfo Hints;
+        gaicb Cb;
+        sigevent Event;
+    };
+
+    /** 发起异步解析，需要持有mMutex
+     *
+     * @retval  int32_t                 成功返回0
+     * @author  moontan
+     */
+    int32_t StartResolve(const std::string &host, Entry &entry);
+
+    static void OnResolved(sigval value);
+
+    uint32_t mTtlMs;
+    uint32_t mNegativeTtlMs;
+    CppLog *mpCppLog;
+    std::mutex mMutex;
+    std::condition_variable mCond;              // 有解析请求完成
+    std::unordered_map<std::string, Entry> mEntries;
+    uint32_t mPendingCount;                     // 未完成的解析请求数
+};
+
+// 非阻塞UDP socket，用sendmmsg/recvmmsg批量收发，一次系统调用处理多个报文
+//  发送：Send把报文放到发送队列，队列满或者调用Flush时一次sendmmsg发出，socket不可写时留在队列中，等可写后再Flush
+//  接收：Recv用一次recvmmsg收取最多batchSize个报文，返回的数据指向内部缓冲区，下一次Recv之前有效
+//  GSO：开启后发往同一地址的连续报文（除最后一个外长度相同）合并成一个消息，由内核或网卡分段，发送失败时自动关闭
+//  GRO：开启后内核把同一个流的多个报文合并后上交，Recv按分段大小拆开，调用方看到的仍然是单个报文
+//  加入CppEpollManager时使用水平触发，处理器的OnRead中调用Recv直到返回0，发送队列为空时返回PROC_AGAIN继续等待可读，
+//  否则返回0切换到可写；OnWrite中调用Flush，还有未发出的报文时返回PROC_AGAIN，否则返回0切换回可读
+//  非线程安全，只能在一个线程中使用
+class CppUdpSocket
+{
+public:
+    // 接收到的报文
+    struct Datagram
+    {
+        IpPortKey Peer;
+        const char *pData;
+        uint32_t Size;
+    };
+
+    /** 构造函数
+     *
+     * @param   uint32_t batchSize          每次sendmmsg/recvmmsg的最大报文数
+     * @param   uint32_t maxDatagramSize    接收报文的最大长度，超过的报文被丢弃，开启GRO时每个接收缓冲区为64KB
+     * @param   CppLog * pCppLog
+     * @author  moontan
+     */
+    CppUdpSocket(uint32_t batchSize = 64, uint32_t maxDatagramSize = 2048, CppLog *pCppLog = NULL);
+
+    /** 创建socket并绑定地址，IPv4地址创建AF_INET的socket，否则创建同时接收IPv4的AF_INET6的socket
+     *
+     * @param   const IpPortKey & bindAddr      端口为0时由系统分配，用GetLocalAddr获取
+     * @param   bool reusePort                  是否设置SO_REUSEPORT，多个线程各自绑定同一个端口
+     * @retval  int32_t                         成功返回0
+     * @author  moontan
+     */
+    int32_t Open(const IpPortKey &bindAddr, bool reusePort = false);
+
+    /** 关闭socket，清空发送队列
+     *
+     * @retval  void
+     * @author  moontan
+     */
+    void Close();
+
+    int GetFd() const
+    {
+        return mUniqueFd.Get();
+    }
+
+    /** 获取绑定的本地地址
+     *
+     * @retval  IpPortKey               失败时返回全0的地址
+     * @author  moontan
+     */
+    IpPortKey GetLocalAddr() const;
+
+    /** 设置内核的收发缓冲区大小，高包量时避免缓冲区满丢包
+     *
+     * @param   uint32_t recvSize       0表示不修改
+     * @param   uint32_t sendSize       0表示不修改
+     * @retval  int32_t                 成功返回0
+     * @author  moontan
+     */
+    int32_t SetBufferSize(uint32_t recvSize, uint32_t sendSize);
+
+    /** 开启UDP GSO(UDP_SEGMENT)，需要4.18以上内核
+     *
+     * @retval  bool                    内核不支持时返回false
+     * @author  moontan
+     */
+    bool EnableGso();
+
+    /** 开启UDP GRO，需要5.0以上内核
+     *
+     * @retval  bool                    内核不支持时返回false
+     * @author  moontan
+     */
+    bool EnableGro();
+
+    bool IsGsoEnabled() const
+    {
+        return mGso;
+    }
+
+    bool IsGroEnabled() const
+    {
+        return mGro;
+    }
+
+    /** 把报文放到发送队列，队列中有batchSize个报文时自动Flush
+     *
+     * @param   const IpPortKey & peer
+     * @param   const char * data
+     * @param   size_t size
+     * @retval  int32_t                 成功返回0，发送队列满并且socket不可写时返回-EAGAIN，报文不放入队列
+     * @author  moontan
+     */
+    int32_t Send(const IpPortKey &peer, const char *data, size_t size);
+
+    /** 用sendmmsg发送队列中的报文，直到全部发出或者socket不可写
+     *  单个报文发送失败（如ICMP返回的ECONNREFUSED、报文过大）时丢弃这个报文并记录日志，继续发送后面的报文
+     *
+     * @retval  int32_t                 返回发出和丢弃的报文数，socket不可写时剩余的报文留在队列中
+     * @author  moontan
+     */
+    int32_t Flush();
+
+    /** 发送队列中未发出的报文数
+     *
+     * @retval  size_t
+     * @author  moontan
+     */
+    size_t GetPendingCount() const
+    {
+        return mPendings.size();
+    }
+
+    /** 用一次recvmmsg接收报文，开启GRO时一个消息可能拆成多个报文
+     *
+     * @param   std::vector<Datagram> & datagrams   接收到的报文，数据在下一次Recv之前有效
+     * @retval  int32_t                             返回报文数量，没有数据返回0，失败返回-errno
+     * @author  moontan
+     */
+    int32_t Recv(std::vector<Datagram> &datagrams);
+
+    /** 累计调用sendmmsg/recvmmsg的次数，用于观察批量的效果
+     *
+     * @retval  uint64_t
+     * @author  moontan
+     */
+    uint64_t GetSyscallCount() const
+    {
+        return mSyscallCount;
+    }
+
+private:
+    // 发送队列中的报文，数据在mSendBuf中
+    struct Pending
+    {
+        IpPortKey Peer;
+        size_t Offset;
+        uint32_t Size;
+    };
+
+    /** 把发送队列从第一个报文开始组装成sendmmsg的消息，开启GSO时合并同一地址的连续报文
+     *
+     * @retval  uint32_t                消息数量
+     * @author  moontan
+     */
+    uint32_t BuildSendMessages();
+
+    /** 从发送队列开头删除报文
+     *
+     * @param   size_t count
+     * @retval  void
+     * @author  moontan
+     */
+    void PopPendings(size_t count);
+
+    uint32_t mBatchSize;
+    uint32_t mMaxDatagramSize;
+    CppLog *mpCppLog;
+    UniqueFd mUniqueFd;
+    int mFamily;                                // socket的地址族
+    bool mGso;
+    bool mGro;
+    uint64_t mSyscallCount;
+
+    std::vector<Pending> mPendings;             // 发送队列
+    std::string mSendBuf;                       // 发送队列中报文的数据
+    std::vector<mmsghdr> mSendMsgs;
+    std::vector<uint32_t> mSendMsgCounts;       // 每个消息包含的报文数
+    std::vector<iovec> mSendIovs;
+    std::vector<sockaddr_storage> mSendAddrs;
+    std::vector<char> mSendControls;            // 每个消息的UDP_SEGMENT控制信息
+
+    std::vector<mmsghdr> mRecvMsgs;
+    std::vector<iovec> mRecvIovs;
+    std::vector<sockaddr_storage> mRecvAddrs;
+    std::vector<char> mRecvControls;            // 每个消息的UDP_GRO控制信息
+    std::vector<char> mRecvBuf;
+    uint32_t mRecvBufSize;                      // 每个消息的接收缓冲区大小
 };
 
 #endif
@@ -21,6 +21,8 @@ const uint32_t CppTime::SECOND_PER_HOUR = CppTime::SECOND_PER_MINUTE * CppTime::
 const uint32_t CppTime::SECOND_PER_DAY = CppTime::SECOND_PER_MINUTE * CppTime::MINUTE_PER_DAY;
 const uint32_t CppTime::SECOND_PER_WEEK = CppTime::SECOND_PER_MINUTE * CppTime::MINUTE_PER_WEEK;
 
+const size_t CppTime::UTIME_STR_LEN;
+
 #if defined(_MSC_VER) 
 int gettimeofday(timeval *timev, __timezone__ *timez)
 {
@@ -113,9 +115,80 @@ string CppTime::GetUTimeStr(timeval *pTimeval /*= NULL*/, const string &timeForm
         gettimeofday(pTimeval, NULL);
     }
 
+    // 默认格式使用缓存
+    if (timeFormat == "%Y-%m-%d %H:%M:%S")
+    {
+        char buf[UTIME_STR_LEN + 1];
+        size_t len = GetUTimeStr(buf, sizeof(buf), pTimeval);
+        return string(buf, len);
+    }
+
     return CppString::GetArgs("%s.%06u", GetTimeStr(pTimeval->tv_sec, timeFormat).c_str(), pTimeval->tv_usec);
 }
 
+void CppTime::GetTimeOfDay(timeval &timev, bool coarse /*= false*/)
+{
+#ifdef CLOCK_REALTIME_COARSE
+    timespec timeSpec;
+    if (coarse && clock_gettime(CLOCK_REALTIME_COARSE, &timeSpec) == 0)
+    {
+        timev.tv_sec = timeSpec.tv_sec;
+        timev.tv_usec = timeSpec.tv_nsec / 1000;
+        return;
+    }
+#else
+    static_cast<void>(coarse);
+#endif
+
+    gettimeofday(&timev, NULL);
+}
+
+size_t CppTime::GetUTimeStr(char *buf, size_t bufSize, const timeval *pTimeval /*= NULL*/)
+{
+    static const size_t SECOND_STR_LEN = 19;        // "2013-12-15 20:26:40"的长度
+    static thread_local time_t cachedSecond = -1;
+    static thread_local char cachedStr[SECOND_STR_LEN + 1];
+
+    if (bufSize == 0)
+    {
+        return 0;
+    }
+
+    timeval timeVal;
+    if (pTimeval == NULL)
+    {
+        pTimeval = &timeVal;
+        gettimeofday(&timeVal, NULL);
+    }
+
+    // 秒数变化时才重新格式化
+    if (pTimeval->tv_sec != cachedSecond)
+    {
+        tm timeStruct;
+        time_t timet = pTimeval->tv_sec;
+        localtime_r(&timet, &timeStruct);
+        strftime(cachedStr, sizeof(cachedStr), "%Y-%m-%d %H:%M:%S", &timeStruct);
+        cachedSecond = pTimeval->tv_sec;
+    }
+
+    char timeBuf[UTIME_STR_LEN + 1];
+    memcpy(timeBuf, cachedStr, SECOND_STR_LEN);
+    timeBuf[SECOND_STR_LEN] = '.';
+
+    // 填充微秒
+    uint32_t usec = static_cast<uint32_t>(pTimeval->tv_usec);
+    for (size_t i = UTIME_STR_LEN - 1; i > SECOND_STR_LEN; --i)
+    {
+        timeBuf[i] = '0' + usec % 10;
+        usec /= 10;
+    }
+
+    size_t len = UTIME_STR_LEN < bufSize ? UTIME_STR_LEN : bufSize - 1;
+    memcpy(buf, timeBuf, len);
+    buf[len] = '\0';
+    return len;
+}
+
 uint32_t CppTime::GetCurrDay(time_t timet)
 {
     tm timeStruct;
@@ -192,8 +265,10 @@ string CppShowTimer::Record(const string &msg)
     gettimeofday(&currTime, NULL);
     TimeRecorder.push_back(pair<timeval, string>(currTime, msg));
 
+    char timeStr[CppTime::UTIME_STR_LEN + 1];
+    CppTime::GetUTimeStr(timeStr, sizeof(timeStr), &currTime);
     string resultMsg = CppString::GetArgs("[%s]%s: From start %llu us,from last %llu us",
-                                          CppTime::GetUTimeStr(&currTime).c_str(), msg.c_str(),
+                                          timeStr, msg.c_str(),
                                           CppTime::TimevDiff(currTime, StartTime),
                                           CppTime::TimevDiff(currTime, lastTime));
     lastTime = currTime;
@@ -208,7 +283,9 @@ string CppShowTimer::Start(const string &msg)
     TimeRecorder.clear();
     TimeRecorder.push_back(pair<timeval, string>(lastTime, msg));
 
-    return CppString::GetArgs("[%s]%s", CppTime::GetUTimeStr(&StartTime).c_str(), msg.c_str());
+    char timeStr[CppTime::UTIME_STR_LEN + 1];
+    CppTime::GetUTimeStr(timeStr, sizeof(timeStr), &StartTime);
+    return CppString::GetArgs("[%s]%s", timeStr, msg.c_str());
 }
 
 CppShowTimer::CppShowTimer()
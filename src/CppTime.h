@@ -41,6 +41,8 @@ public:
     static const uint32_t SECOND_PER_DAY;
     static const uint32_t SECOND_PER_WEEK;
 
+    static const size_t UTIME_STR_LEN = 26;         // "2013-12-15 20:26:40.422773"的长度
+
     //************************************
     // Describe:  获得时间的字符串形式,包含本地时区信息
     // Parameter: time_t timet              time_t类型时间,默认当前时间
@@ -138,6 +140,17 @@ public:
         return timev.tv_sec * 1000000 + timev.tv_usec;
     }
 
+    /** 获得当前时间
+     *  coarse为true时使用clock_gettime(CLOCK_REALTIME_COARSE)，不需要读取时钟硬件，开销远小于gettimeofday，
+     *  但是精度只有一个时钟节拍（通常为1~4ms），适合日志等不需要精确时间的场景
+     *
+     * @param   timeval & timev
+     * @param   bool coarse
+     * @retval  void
+     * @author  moon
+     */
+    static void GetTimeOfDay(timeval &timev, bool coarse = false);
+
     //************************************
     // Describe:  获得当前时间的uint64_t值
     // Returns:   uint64_t
@@ -197,6 +210,17 @@ public:
     // Author:    moon
     //************************************
     static string GetUTimeStr(timeval *pTimeval = NULL, const string &timeFormat = "%Y-%m-%d %H:%M:%S");
+
+    /** 获得"%Y-%m-%d %H:%M:%S.[微秒]"格式的时间字符串，写入调用方的缓冲区，不申请内存
+     *  每个线程缓存当前秒的格式化结果，秒数变化时才调用localtime_r和strftime，否则只填充微秒部分
+     *
+     * @param   char * buf                  至少UTIME_STR_LEN + 1字节，否则截断
+     * @param   size_t bufSize
+     * @param   const timeval * pTimeval    为NULL时使用当前时间
+     * @retval  size_t                      写入的长度，不包含结尾的'\0'
+     * @author  moon
+     */
+    static size_t GetUTimeStr(char *buf, size_t bufSize, const timeval *pTimeval = NULL);
 };
 
 class CppShowTimer
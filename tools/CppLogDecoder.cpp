@@ -0,0 +1,28 @@
+// 把CppLog二进制模式记录的日志还原成文本，输出到标准输出
+// 用法：CppLogDecoder log.bin [log1.bin ...]
+#include <iostream>
+
+#include "CppLog.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " binLogFile [binLogFile ...]" << endl;
+        return 1;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (CppLog::DecodeBinaryLog(argv[i], cout) != 0)
+        {
+            cerr << "Decode [" << argv[i] << "] failed or file is truncated." << endl;
+            ret = 1;
+        }
+    }
+
+    return ret;
+}